@@ -0,0 +1,75 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "hash.h"
+
+#include <boost/thread.hpp>
+
+namespace {
+
+// A block's worth of inputs, each costing a few hashes like a cheap signature check
+const unsigned int BLOCK_CHECKS = 4000;
+const unsigned int CHECKS_PER_TX = 2;
+
+struct HashCheck
+{
+    uint256 hash;
+
+    bool operator()()
+    {
+        for (int i = 0; i < 32; i++)
+            hash = Hash(hash.begin(), hash.end());
+        return true;
+    }
+
+    void swap(HashCheck& check)
+    {
+        std::swap(hash, check.hash);
+    }
+};
+
+// Connects blocks through a queue served by nThreads threads including the master, as -par=nThreads does
+void Scaling(benchmark::State& state, int nThreads)
+{
+    CCheckQueue<HashCheck> queue(128);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<HashCheck>::Thread, boost::ref(queue)));
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashCheck> control(&queue);
+        for (unsigned int i = 0; i < BLOCK_CHECKS; i += CHECKS_PER_TX) {
+            std::vector<HashCheck> vChecks(CHECKS_PER_TX);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+}
+
+static void CheckQueueScaling1(benchmark::State& state) { Scaling(state, 1); }
+static void CheckQueueScaling2(benchmark::State& state) { Scaling(state, 2); }
+static void CheckQueueScaling4(benchmark::State& state) { Scaling(state, 4); }
+static void CheckQueueScaling8(benchmark::State& state) { Scaling(state, 8); }
+static void CheckQueueScaling16(benchmark::State& state) { Scaling(state, 16); }
+static void CheckQueueScaling32(benchmark::State& state) { Scaling(state, 32); }
+
+// Runs as many threads as the machine has cores
+static void CheckQueueScalingAllCores(benchmark::State& state)
+{
+    Scaling(state, std::max(1, (int)boost::thread::hardware_concurrency()));
+}
+
+BENCHMARK(CheckQueueScaling1);
+BENCHMARK(CheckQueueScaling2);
+BENCHMARK(CheckQueueScaling4);
+BENCHMARK(CheckQueueScaling8);
+BENCHMARK(CheckQueueScaling16);
+BENCHMARK(CheckQueueScaling32);
+BENCHMARK(CheckQueueScalingAllCores);
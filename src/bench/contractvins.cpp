@@ -0,0 +1,72 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include <libethereum/State.h>
+
+using dev::eth::ContractVins;
+using dev::eth::VinsInfo;
+
+namespace {
+
+// A contract that has collected many small payments.
+const unsigned int CONTRACT_OUTPUTS = 10000;
+
+VinsInfo ManyVins()
+{
+    VinsInfo vins;
+    for (unsigned int i = 0; i < CONTRACT_OUTPUTS; i++)
+        vins.push_back(std::make_pair(COutPoint(h256Touint(dev::sha3(dev::rlp(i))), 0), CAmount(1000)));
+    return vins;
+}
+
+}
+
+// A payment out of the contract that spends two outputs and gets one back as change, on the
+// vector the outputs used to be kept in and with the copy TxGeneration used to select from.
+static void ContractVinsPayVector(benchmark::State& state)
+{
+    VinsInfo vins = ManyVins();
+    while (state.KeepRunning()) {
+        VinsInfo copy(vins);
+        CAmount sum = 0;
+        VinsInfo selected;
+        for (size_t i = 1; i < copy.size() && sum < 1500; i++) {
+            sum += copy[i].second;
+            selected.push_back(copy[i]);
+        }
+        for (size_t i = 0; i < selected.size(); i++)
+            vins.erase(vins.begin() + 1);
+        vins.push_back(std::make_pair(selected.front().first, sum - 1500));
+    }
+}
+
+static void ContractVinsPay(benchmark::State& state)
+{
+    ContractVins vins;
+    vins.append(ManyVins());
+    while (state.KeepRunning()) {
+        CAmount sum = 0;
+        VinsInfo selected = vins.select(1500, sum);
+        vins.spend(selected.size());
+        vins.push_back(std::make_pair(selected.front().first, sum - 1500));
+    }
+}
+
+// Writing the outputs into the UTXO trie and reading them back.
+static void ContractVinsEncode(benchmark::State& state)
+{
+    ContractVins vins;
+    vins.append(ManyVins());
+    while (state.KeepRunning()) {
+        dev::RLPStream s(1);
+        vins.streamRLP(s);
+        ContractVins decoded(dev::RLP(s.out())[0]);
+    }
+}
+
+BENCHMARK(ContractVinsPayVector);
+BENCHMARK(ContractVinsPay);
+BENCHMARK(ContractVinsEncode);
@@ -0,0 +1,205 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include <map>
+
+#include <libdevcore/SHA3.h>
+#include <libevm/ExtVMFace.h>
+#include <libevm/VMFactory.h>
+
+using dev::bytes;
+using dev::u256;
+using dev::eth::Instruction;
+
+namespace {
+
+// Minimal host for running bytecode: in-memory storage and nothing else.
+class BenchExtVM : public dev::eth::ExtVMFace
+{
+public:
+    BenchExtVM(dev::eth::EnvInfo const& env, bytes const& code, bytes const& data) :
+        dev::eth::ExtVMFace(env, dev::Address(0x1001), dev::Address(0x1002), dev::Address(0x1002), 0, 1, dev::bytesConstRef(), dev::bytesConstRef(), dev::sha3(code), 0),
+        bytecode(code),
+        calldata(data)
+    {
+        this->code = dev::bytesConstRef(&bytecode);
+        this->data = dev::bytesConstRef(&calldata);
+    }
+
+    u256 store(u256 key) override
+    {
+        auto it = storage.find(key);
+        return it == storage.end() ? 0 : it->second;
+    }
+    void setStore(u256 key, u256 value) override { storage[key] = value; }
+
+    bytes bytecode;
+    bytes calldata;
+    std::map<u256, u256> storage;
+};
+
+void Op(bytes& code, Instruction inst)
+{
+    code.push_back((uint8_t)inst);
+}
+
+void Push(bytes& code, u256 value)
+{
+    bytes data = dev::toCompactBigEndian(value, 1);
+    code.push_back((uint8_t)Instruction::PUSH1 + data.size() - 1);
+    code.insert(code.end(), data.begin(), data.end());
+}
+
+// Wraps body in a loop run n times; body must leave the stack as it found it. Loops are kept
+// short enough to stay within the interpreter's step limit.
+bytes Loop(unsigned n, bytes const& body)
+{
+    bytes code;
+    Push(code, n);
+    size_t top = code.size();
+    Op(code, Instruction::JUMPDEST);
+    code.insert(code.end(), body.begin(), body.end());
+    Push(code, 1);
+    Op(code, Instruction::SWAP1);
+    Op(code, Instruction::SUB);
+    Op(code, Instruction::DUP1);
+    Push(code, top);
+    Op(code, Instruction::JUMPI);
+    Op(code, Instruction::STOP);
+    return code;
+}
+
+// The balance of token holder a is stored at sha3(a . 0), as a Solidity mapping in slot 0 would be.
+void BalanceKey(bytes& code)
+{
+    Push(code, 0);
+    Op(code, Instruction::MSTORE);
+    Push(code, 64);
+    Push(code, 0);
+    Op(code, Instruction::SHA3);
+}
+
+// transfer(to, amount) with the arguments as two calldata words: moves the balance and logs Transfer.
+bytes TokenTransfer()
+{
+    bytes code;
+    Op(code, Instruction::CALLER);
+    BalanceKey(code);                       // kFrom
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::SLOAD);           // kFrom balFrom
+    Push(code, 32);
+    Op(code, Instruction::CALLDATALOAD);    // kFrom balFrom amount
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::DUP3);
+    Op(code, Instruction::LT);
+    Op(code, Instruction::PUSH1);
+    size_t fail = code.size();
+    code.push_back(0);
+    Op(code, Instruction::JUMPI);
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::SWAP2);
+    Op(code, Instruction::SUB);
+    Op(code, Instruction::DUP3);
+    Op(code, Instruction::SSTORE);          // kFrom amount
+    Push(code, 0);
+    Op(code, Instruction::CALLDATALOAD);
+    BalanceKey(code);                       // kFrom amount kTo
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::SLOAD);
+    Op(code, Instruction::DUP3);
+    Op(code, Instruction::ADD);
+    Op(code, Instruction::SWAP1);
+    Op(code, Instruction::SSTORE);          // kFrom amount
+    Push(code, 0);
+    Op(code, Instruction::MSTORE);          // kFrom
+    Push(code, 0);
+    Op(code, Instruction::CALLDATALOAD);
+    Op(code, Instruction::CALLER);
+    Push(code, u256(dev::sha3(std::string("Transfer(address,address,uint256)"))));
+    Push(code, 32);
+    Push(code, 0);
+    Op(code, Instruction::LOG3);
+    Op(code, Instruction::POP);
+    Push(code, 1);
+    Push(code, 0);
+    Op(code, Instruction::MSTORE);
+    Push(code, 32);
+    Push(code, 0);
+    Op(code, Instruction::RETURN);
+    code[fail] = (uint8_t)code.size();
+    Op(code, Instruction::JUMPDEST);
+    Op(code, Instruction::STOP);
+    return code;
+}
+
+void RunCode(benchmark::State& state, dev::eth::VMKind kind, bytes const& code, bytes const& data = bytes())
+{
+    dev::eth::EnvInfo env;
+    BenchExtVM ext(env, code, data);
+    bytes holder = dev::h256(dev::h160(0x1002), dev::h256::AlignRight).asBytes();
+    holder.resize(64);
+    ext.storage[u256(dev::sha3(holder))] = u256(1) << 200;
+    while (state.KeepRunning()) {
+        u256 gas = 10000000;
+        dev::eth::VMFactory::create(kind)->exec(gas, ext, dev::eth::OnOpFunc());
+        ext.sub.logs.clear();
+    }
+}
+
+bytes LoopCode()
+{
+    return Loop(10000, bytes());
+}
+
+bytes Sha3Code()
+{
+    bytes body;
+    Push(body, 64);
+    Push(body, 0);
+    Op(body, Instruction::SHA3);
+    Push(body, 0);
+    Op(body, Instruction::MSTORE);
+    return Loop(1000, body);
+}
+
+bytes MstoreCode()
+{
+    bytes body;
+    Op(body, Instruction::DUP1);
+    Op(body, Instruction::DUP1);
+    Push(body, 0x3ff);
+    Op(body, Instruction::AND);
+    Op(body, Instruction::MSTORE);
+    return Loop(5000, body);
+}
+
+bytes TransferData()
+{
+    bytes data = dev::h256(dev::h160(0x2001), dev::h256::AlignRight).asBytes();
+    bytes amount = dev::h256(1).asBytes();
+    data.insert(data.end(), amount.begin(), amount.end());
+    return data;
+}
+
+}
+
+static void EVMLoopInterpreter(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Interpreter, LoopCode()); }
+static void EVMLoopThreaded(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Threaded, LoopCode()); }
+static void EVMSha3Interpreter(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Interpreter, Sha3Code()); }
+static void EVMSha3Threaded(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Threaded, Sha3Code()); }
+static void EVMMstoreInterpreter(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Interpreter, MstoreCode()); }
+static void EVMMstoreThreaded(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Threaded, MstoreCode()); }
+static void EVMTokenTransferInterpreter(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Interpreter, TokenTransfer(), TransferData()); }
+static void EVMTokenTransferThreaded(benchmark::State& state) { RunCode(state, dev::eth::VMKind::Threaded, TokenTransfer(), TransferData()); }
+
+BENCHMARK(EVMLoopInterpreter);
+BENCHMARK(EVMLoopThreaded);
+BENCHMARK(EVMSha3Interpreter);
+BENCHMARK(EVMSha3Threaded);
+BENCHMARK(EVMMstoreInterpreter);
+BENCHMARK(EVMMstoreThreaded);
+BENCHMARK(EVMTokenTransferInterpreter);
+BENCHMARK(EVMTokenTransferThreaded);
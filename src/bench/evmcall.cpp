@@ -0,0 +1,89 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+
+#include <libethereum/Executive.h>
+#include <libevmcore/Instruction.h>
+
+using dev::bytes;
+using dev::u256;
+using dev::eth::Instruction;
+
+namespace {
+
+const unsigned int CALL_DEPTH = 64;
+
+// Accounts the transaction touched before reaching the chain, as a block's worth of payments would.
+const unsigned int CACHED_ACCOUNTS = 1000;
+
+void Op(bytes& code, Instruction inst)
+{
+    code.push_back((uint8_t)inst);
+}
+
+void Push(bytes& code, u256 value)
+{
+    bytes data = dev::toCompactBigEndian(value, 1);
+    code.push_back((uint8_t)Instruction::PUSH1 + data.size() - 1);
+    code.insert(code.end(), data.begin(), data.end());
+}
+
+// Writes slot 0 and, unless next is null, calls next with all but 1000 of the remaining gas.
+bytes Link(dev::Address const& next)
+{
+    bytes code;
+    Push(code, 1);
+    Push(code, 0);
+    Op(code, Instruction::SSTORE);
+    if (next) {
+        for (int i = 0; i < 5; i++)
+            Push(code, 0);
+        Push(code, u256(dev::u160(next)));
+        Push(code, 1000);
+        Op(code, Instruction::GAS);
+        Op(code, Instruction::SUB);
+        Op(code, Instruction::CALL);
+        Op(code, Instruction::POP);
+    }
+    Op(code, Instruction::STOP);
+    return code;
+}
+
+}
+
+// A transaction entering a chain of CALL_DEPTH contracts, each calling the next.
+static void EVMCallChain(benchmark::State& state)
+{
+    dev::eth::Ethash::init();
+    std::unique_ptr<dev::eth::SealEngineFace> se(dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::HomesteadTest)).createSealEngine());
+    dev::eth::EnvInfo env;
+    dev::eth::State s(0, dev::OverlayDB(), dev::eth::BaseState::Empty);
+
+    dev::Address sender(0x1001);
+    s.addBalance(sender, 1000);
+    for (unsigned int i = 0; i < CACHED_ACCOUNTS; i++)
+        s.addBalance(dev::Address(0x2000 + i), 1);
+    dev::Address next;
+    for (unsigned int i = 0; i < CALL_DEPTH; i++)
+        next = s.newContract(0, Link(next));
+    s.commit();
+
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < CACHED_ACCOUNTS; i++)
+            s.balance(dev::Address(0x2000 + i));
+        {
+            dev::eth::Executive e(s, env, se.get());
+            if (!e.call(next, sender, 0, 1, dev::bytesConstRef(), 10000000))
+                e.go();
+            assert(!e.excepted());
+        }
+        s.txData.clear();
+        s.delAddresses.clear();
+        s.rollback(s.savepoint());
+    }
+}
+
+BENCHMARK(EVMCallChain);
@@ -0,0 +1,70 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include <vector>
+
+#include <libdevcore/MemoryDB.h>
+#include <libdevcore/SHA3.h>
+#include <libdevcore/TrieDB.h>
+
+using dev::bytes;
+using dev::bytesConstRef;
+using dev::h256;
+
+// A state trie key: one storage slot or account address padded to a word
+static void Keccak256_32b(benchmark::State& state)
+{
+    h256 hash(0x1234);
+    while (state.KeepRunning())
+        hash = dev::sha3(hash.ref());
+}
+
+static void Keccak256_1M(benchmark::State& state)
+{
+    bytes in(1000000);
+    h256 hash;
+    while (state.KeepRunning())
+        dev::sha3(bytesConstRef(&in), hash.ref());
+}
+
+// The four-way kernel is only used where the CPU has AVX2
+static void Keccak256Batch_1024x32b(benchmark::State& state)
+{
+    std::vector<h256> keys(1024), hashes(1024);
+    std::vector<bytesConstRef> inputs;
+    for (unsigned i = 0; i < keys.size(); ++i) {
+        keys[i] = h256(i);
+        inputs.push_back(keys[i].ref());
+    }
+    while (state.KeepRunning())
+        dev::sha3Batch(inputs.data(), hashes.data(), inputs.size());
+}
+
+// Hashing the keys and the nodes of a secure trie as a commit of 256 slots does
+static void SecureTrieInsert_256(benchmark::State& state)
+{
+    std::vector<h256> keys;
+    for (unsigned i = 0; i < 256; ++i)
+        keys.push_back(h256(i));
+    bytes value(32, 0x42);
+    while (state.KeepRunning()) {
+        dev::MemoryDB db;
+        dev::SpecificTrieDB<dev::HashedGenericTrieDB<dev::MemoryDB>, h256> trie(&db);
+        trie.init();
+        std::vector<bytesConstRef> inputs;
+        for (h256 const& key : keys)
+            inputs.push_back(key.ref());
+        std::vector<h256> hashed(keys.size());
+        dev::sha3Batch(inputs.data(), hashed.data(), keys.size());
+        for (unsigned i = 0; i < keys.size(); ++i)
+            trie.insertHashed(keys[i], hashed[i], bytesConstRef(&value));
+    }
+}
+
+BENCHMARK(Keccak256_32b);
+BENCHMARK(Keccak256_1M);
+BENCHMARK(Keccak256Batch_1024x32b);
+BENCHMARK(SecureTrieInsert_256);
@@ -0,0 +1,32 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+
+// Per-execution setup cost paid by every OP_CREATE/OP_CALL output before the
+// seal engine was shared: parse the genesis JSON and build a fresh engine.
+static void SealEngineFromGenesis(benchmark::State& state)
+{
+    dev::eth::Ethash::init();
+    dev::eth::EnvInfo env;
+    while (state.KeepRunning()) {
+        std::unique_ptr<dev::eth::SealEngineFace> se(dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::HomesteadTest)).createSealEngine());
+        se->evmSchedule(env);
+    }
+}
+
+// Per-execution setup cost with the engine built once at startup.
+static void SealEngineShared(benchmark::State& state)
+{
+    dev::eth::Ethash::init();
+    std::unique_ptr<dev::eth::SealEngineFace> se(dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::HomesteadTest)).createSealEngine());
+    dev::eth::EnvInfo env;
+    while (state.KeepRunning()) {
+        se->evmSchedule(env);
+    }
+}
+
+BENCHMARK(SealEngineFromGenesis);
+BENCHMARK(SealEngineShared);
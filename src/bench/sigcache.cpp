@@ -0,0 +1,68 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <boost/thread.hpp>
+
+namespace {
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher> SigCache;
+
+const int THREADS = 4;
+const int LOOKUPS_PER_THREAD = 4096;
+
+// Each thread looks up its own share of entries under the shared lock, the way
+// the -par script check threads and mempool acceptance hit the signature cache
+// at once, while the last one also inserts fresh entries under the exclusive lock.
+void Lookups(SigCache& cache, boost::shared_mutex& mtx, const std::vector<uint256>& hashes, int thread, bool erase)
+{
+    for (int i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+        const uint256& hash = hashes[(thread * LOOKUPS_PER_THREAD + i) % hashes.size()];
+        if (thread == THREADS - 1 && i % 16 == 0) {
+            boost::unique_lock<boost::shared_mutex> lock(mtx);
+            cache.insert(GetRandHash());
+        } else {
+            boost::shared_lock<boost::shared_mutex> lock(mtx);
+            cache.contains(hash, erase);
+        }
+    }
+}
+
+void Contention(benchmark::State& state, bool erase)
+{
+    SigCache cache;
+    boost::shared_mutex mtx;
+    std::vector<uint256> hashes(cache.setup_bytes(DEFAULT_MAX_SIG_CACHE_SIZE << 20) / 2);
+    for (uint256& hash : hashes) {
+        hash = GetRandHash();
+        cache.insert(hash);
+    }
+    while (state.KeepRunning()) {
+        boost::thread_group threads;
+        for (int i = 0; i < THREADS; ++i)
+            threads.create_thread(boost::bind(&Lookups, boost::ref(cache), boost::ref(mtx), boost::cref(hashes), i, erase));
+        threads.join_all();
+    }
+}
+
+}
+
+static void SigCacheContention(benchmark::State& state)
+{
+    Contention(state, false);
+}
+
+// Block validation looks entries up with erase, which only flips an atomic flag
+static void SigCacheContentionErase(benchmark::State& state)
+{
+    Contention(state, true);
+}
+
+BENCHMARK(SigCacheContention);
+BENCHMARK(SigCacheContentionErase);
@@ -0,0 +1,266 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprefetch.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+
+#include <set>
+
+#include <boost/thread.hpp>
+
+#include <libethereum/State.h>
+
+using namespace std;
+
+//! Coins read by one prefetch thread at a time; a block's inputs are spread over the threads in these
+static const size_t PREFETCH_BATCH_SIZE = 64;
+//! Most jobs waiting; blocks beyond are left to ConnectBlock
+static const size_t MAX_PREFETCH_JOBS = 2000;
+//! Number of block hashes remembered to skip blocks queued twice
+static const size_t PREFETCH_RECENT_BLOCKS = 64;
+
+CCoinsViewPrefetch* pcoinsPrefetch = NULL;
+CBlockPrefetcher blockPrefetcher;
+
+bool CCoinsViewPrefetch::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        map<COutPoint, Coin>::iterator it = mapPrefetched.find(outpoint);
+        if (it != mapPrefetched.end()) {
+            // The cache above keeps it from now on
+            coin = std::move(it->second);
+            mapPrefetched.erase(it);
+            nHits++;
+            return true;
+        }
+        nMisses++;
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewPrefetch::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (mapPrefetched.count(outpoint))
+            return true;
+    }
+    return base->HaveCoin(outpoint);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fWriting = true;
+        mapPrefetched.clear();
+    }
+    bool fOk = base->BatchWrite(mapCoins, hashBlock);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fWriting = false;
+    nGeneration++;
+    return fOk;
+}
+
+void CCoinsViewPrefetch::Prefetch(const vector<COutPoint>& vOutpoints)
+{
+    uint64_t nGenerationStart;
+    vector<const COutPoint*> vMissing;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting)
+            return;
+        nGenerationStart = nGeneration;
+        // Coins the cache above already had are never looked up here, start over rather than fill up with them
+        if (mapPrefetched.size() + vOutpoints.size() > MAX_PREFETCHED_COINS)
+            mapPrefetched.clear();
+        for (const COutPoint& outpoint : vOutpoints) {
+            if (!mapPrefetched.count(outpoint))
+                vMissing.push_back(&outpoint);
+        }
+    }
+    vector<pair<COutPoint, Coin> > vRead;
+    vRead.reserve(vMissing.size());
+    for (const COutPoint* poutpoint : vMissing) {
+        boost::this_thread::interruption_point();
+        Coin coin;
+        if (base->GetCoin(*poutpoint, coin) && !coin.IsSpent())
+            vRead.push_back(make_pair(*poutpoint, std::move(coin)));
+    }
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // What was read may predate a write that finished meanwhile
+    if (fWriting || nGeneration != nGenerationStart)
+        return;
+    for (pair<COutPoint, Coin>& i : vRead)
+        mapPrefetched.insert(std::move(i));
+}
+
+void CCoinsViewPrefetch::GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nHitsOut = nHits;
+    nMissesOut = nMisses;
+}
+
+/** The outputs spent by a block that were created before it, and the contracts its outputs call. */
+static void CollectInputs(const CBlock& block, vector<COutPoint>& vOutpoints, vector<dev::Address>& vContracts)
+{
+    set<uint256> setBlockTx;
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin) {
+                if (!setBlockTx.count(txin.prevout.hash))
+                    vOutpoints.push_back(txin.prevout);
+            }
+        }
+        for (const CTxOut& txout : tx.vout) {
+            if (!txout.scriptPubKey.HasOpAssign())
+                continue;
+            // The address is the push in front of OP_EXEC_ASSIGN
+            CScript::const_iterator pc = txout.scriptPubKey.begin();
+            opcodetype opcode;
+            valtype vch, vchLast;
+            while (txout.scriptPubKey.GetOp(pc, opcode, vch)) {
+                if (opcode == OP_EXEC_ASSIGN) {
+                    if (vchLast.size() == dev::Address::size)
+                        vContracts.push_back(dev::Address(vchLast));
+                    break;
+                }
+                vchLast.swap(vch);
+            }
+        }
+        setBlockTx.insert(tx.GetHash());
+    }
+}
+
+bool CBlockPrefetcher::IsRecentLocked(const uint256& hash)
+{
+    if (find(recent.begin(), recent.end(), hash) != recent.end())
+        return true;
+    recent.push_back(hash);
+    if (recent.size() > PREFETCH_RECENT_BLOCKS)
+        recent.pop_front();
+    return false;
+}
+
+shared_ptr<dev::eth::QtumState> CBlockPrefetcher::SnapshotTip()
+{
+    AssertLockHeld(cs_main);
+    CBlockIndex* tip = chainActive.Tip();
+    if (!tip || !csGlobalState)
+        return nullptr;
+    try {
+        return make_shared<dev::eth::QtumState>(csGlobalState->snapshot(uintToh256(tip->hashStateRoot), uintToh256(tip->hashUTXORoot)));
+    } catch (const dev::RootNotFound&) {
+        return nullptr;
+    }
+}
+
+void CBlockPrefetcher::QueueLocked(Job& job)
+{
+    if (queue.size() >= MAX_PREFETCH_JOBS)
+        return;
+    // Coins first, as they are what ConnectBlock needs first
+    for (size_t i = 0; i < job.vOutpoints.size(); i += PREFETCH_BATCH_SIZE) {
+        Job part;
+        part.vOutpoints.assign(job.vOutpoints.begin() + i, job.vOutpoints.begin() + min(i + PREFETCH_BATCH_SIZE, job.vOutpoints.size()));
+        queue.push_back(std::move(part));
+    }
+    if (!job.vContracts.empty() && job.pstate) {
+        Job part;
+        part.vContracts.swap(job.vContracts);
+        part.pstate = job.pstate;
+        queue.push_back(std::move(part));
+    }
+    cond.notify_all();
+}
+
+void CBlockPrefetcher::Queue(const CBlock& block)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nThreads == 0 || IsRecentLocked(block.GetHash()))
+            return;
+    }
+    Job job;
+    CollectInputs(block, job.vOutpoints, job.vContracts);
+    if (!job.vContracts.empty())
+        job.pstate = SnapshotTip();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    QueueLocked(job);
+}
+
+void CBlockPrefetcher::Queue(const CBlockIndex* pindex)
+{
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+        return;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nThreads == 0 || queue.size() >= MAX_PREFETCH_JOBS || IsRecentLocked(pindex->GetBlockHash()))
+            return;
+    }
+    Job job;
+    job.pos = pindex->GetBlockPos();
+    // Whether the block calls any contract is only known once it is read
+    job.pstate = SnapshotTip();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    queue.push_back(std::move(job));
+    cond.notify_one();
+}
+
+void CBlockPrefetcher::Process(Job& job)
+{
+    if (!job.pos.IsNull()) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, job.pos, Params().GetConsensus()))
+            return;
+        CollectInputs(block, job.vOutpoints, job.vContracts);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        QueueLocked(job);
+        return;
+    }
+    if (!job.vOutpoints.empty() && pcoinsPrefetch)
+        pcoinsPrefetch->Prefetch(job.vOutpoints);
+    // Walking the state trie down to the account and reading the code leaves the nodes in the trie
+    // node cache, which the snapshot shares with the state the block is connected on
+    for (const dev::Address& address : job.vContracts) {
+        boost::this_thread::interruption_point();
+        try {
+            if (job.pstate->addressHasCode(address))
+                job.pstate->code(address);
+        } catch (const std::exception&) {
+            // Left to ConnectBlock
+        }
+    }
+}
+
+void CBlockPrefetcher::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads++;
+    }
+    while (true) {
+        boost::this_thread::interruption_point();
+        Job job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                cond.wait(lock);
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        Process(job);
+    }
+}
+
+void ThreadBlockPrefetch()
+{
+    RenameThread("quantum-prefetch");
+    blockPrefetcher.Thread();
+}
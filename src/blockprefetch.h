@@ -0,0 +1,116 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QUANTUM_BLOCKPREFETCH_H
+#define QUANTUM_BLOCKPREFETCH_H
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <libdevcrypto/Common.h>
+
+namespace dev { namespace eth { class QtumState; } }
+
+//! -prefetchthreads default, the number of threads reading block inputs ahead of ConnectBlock
+static const int DEFAULT_PREFETCH_THREADS = 4;
+//! Maximum number of prefetch threads allowed
+static const int MAX_PREFETCH_THREADS = 16;
+//! Most coins kept read ahead at once
+static const size_t MAX_PREFETCHED_COINS = 100000;
+
+/**
+ * Layer between the coins cache of the tip and the database, holding coins read from the
+ * database ahead of ConnectBlock by the prefetch threads. A coin is handed to the cache
+ * above on its first lookup and dropped from here.
+ *
+ * Prefetched coins are copies of the database, which only changes through BatchWrite: a
+ * write drops everything prefetched and discards the reads that overlapped with it.
+ */
+class CCoinsViewPrefetch : public CCoinsViewBacked
+{
+private:
+    mutable boost::mutex mutex;
+    mutable std::map<COutPoint, Coin> mapPrefetched;
+    //! Bumped by every write; reads started before it are not kept
+    uint64_t nGeneration;
+    bool fWriting;
+    //! Lookups served from mapPrefetched, and those passed on to the database
+    mutable uint64_t nHits;
+    mutable uint64_t nMisses;
+
+public:
+    CCoinsViewPrefetch(CCoinsView* view) : CCoinsViewBacked(view), nGeneration(0), fWriting(false), nHits(0), nMisses(0) {}
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+
+    //! Read the unspent outputs among vOutpoints from the database. Called by the prefetch threads.
+    void Prefetch(const std::vector<COutPoint>& vOutpoints);
+
+    //! Totals of the lookups that reached this layer since startup
+    void GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut) const;
+};
+
+/**
+ * Pool of threads warming the caches for blocks about to be connected: the coins their inputs
+ * spend go to CCoinsViewPrefetch, and the accounts and code of the contracts they call to the
+ * trie node cache of the contract state. Reads run against the state of the tip, while the
+ * previous block is still being connected.
+ */
+class CBlockPrefetcher
+{
+private:
+    struct Job
+    {
+        //! Block to read from disk and collect the inputs of, if not null
+        CDiskBlockPos pos;
+        std::vector<COutPoint> vOutpoints;
+        std::vector<dev::Address> vContracts;
+        //! Contract state of the tip the contracts are looked up in
+        std::shared_ptr<dev::eth::QtumState> pstate;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<Job> queue;
+    //! Blocks queued lately, so a block is not read twice
+    std::deque<uint256> recent;
+    //! The number of threads started
+    int nThreads;
+
+    bool IsRecentLocked(const uint256& hash);
+    std::shared_ptr<dev::eth::QtumState> SnapshotTip();
+    void QueueLocked(Job& job);
+    void Process(Job& job);
+
+public:
+    CBlockPrefetcher() : nThreads(0) {}
+
+    //! Prefetch the inputs of a block that was checked or is about to be connected. Requires cs_main.
+    void Queue(const CBlock& block);
+
+    //! Same for a block on disk, read by the prefetch thread. Requires cs_main.
+    void Queue(const CBlockIndex* pindex);
+
+    //! Worker loop, interrupted through boost::thread::interrupt()
+    void Thread();
+};
+
+extern CCoinsViewPrefetch* pcoinsPrefetch;
+extern CBlockPrefetcher blockPrefetcher;
+
+void ThreadBlockPrefetch();
+
+#endif // QUANTUM_BLOCKPREFETCH_H
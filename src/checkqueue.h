@@ -6,16 +6,23 @@
 #define QUANTUM_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
 
+//! Number of per-thread queues: one for the master and one for each of up to MAX_SCRIPTCHECK_THREADS workers.
+//! Any further workers share queues.
+static const unsigned int MAX_CHECKQUEUE_SLOTS = 65;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,136 +32,216 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread owns a queue of its own. The master deals each batch out
+  * over the workers' queues; a worker takes from the back of its own queue
+  * and, once that runs dry, steals from the front of the others. Handing out
+  * work only ever locks the queue involved, so there is no global lock on
+  * the hot path: the shared mutex is only taken to go to sleep or to wake
+  * sleeping threads up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
-
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
-
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+    //! The pending checks of one thread, with their count readable without the lock.
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        std::atomic<unsigned int> nSize;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+        WorkerQueue() : nSize(0) {}
+    };
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Slot 0 belongs to the master, the others to the worker threads in start order.
+    WorkerQueue queues[MAX_CHECKQUEUE_SLOTS];
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads that have started (not counting the master).
+    std::atomic<unsigned int> nWorkers;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Number of verifications that are queued and not taken by any thread yet.
+    std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still in a
+     * thread's own batch.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! The number of workers blocked on condWorker.
+    std::atomic<int> nSleeping;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! The worker slot receiving the next chunk of checks. Only used by the master.
+    unsigned int nNextSlot;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Mutex the idle threads sleep on; never held while handing out work
+    boost::mutex mutexSleep;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+
+    //! How often a thread out of work yields before going to sleep
+    static const unsigned int SPIN_COUNT = 64;
+
+    unsigned int NumSlots() const
+    {
+        return std::min((unsigned int)nWorkers, MAX_CHECKQUEUE_SLOTS - 1) + 1;
+    }
+
+    /**
+     * Move up to nBatchSize checks out of one queue. The owner takes from the
+     * back, which it filled last; a thief takes at most half of what is left
+     * from the front, so the owner and other thieves still find work.
+     */
+    unsigned int Take(WorkerQueue& q, bool fSteal, std::vector<T>& vChecks)
+    {
+        if (q.nSize == 0)
+            return 0;
+        boost::unique_lock<boost::mutex> lock(q.mutex);
+        unsigned int nSize = q.checks.size();
+        unsigned int nNow = std::min(nBatchSize, fSteal ? (nSize + 1) / 2 : nSize);
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs out of the queue instead of copying, to keep the lock short
+            if (fSteal) {
+                vChecks[i].swap(q.checks.front());
+                q.checks.pop_front();
+            } else {
+                vChecks[i].swap(q.checks.back());
+                q.checks.pop_back();
+            }
+        }
+        q.nSize = nSize - nNow;
+        nQueued -= nNow;
+        return nNow;
+    }
+
+    //! Fill vChecks from the own queue, or failing that from another one.
+    bool FindWork(unsigned int nSelf, std::vector<T>& vChecks)
+    {
+        if (Take(queues[nSelf], false, vChecks))
+            return true;
+        unsigned int nSlots = NumSlots();
+        for (unsigned int i = 1; i < nSlots; i++) {
+            if (Take(queues[(nSelf + i) % nSlots], true, vChecks))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSelf, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        unsigned int nSpin = 0;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+            if (FindWork(nSelf, vChecks)) {
+                nSpin = 0;
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk;
+                BOOST_FOREACH (T& check, vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutexSleep);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+            if (fMaster && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
+            }
+            // The next batch usually follows quickly while a block is being connected
+            if (nSpin++ < SPIN_COUNT) {
+                boost::this_thread::yield();
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            if (fMaster) {
+                // Only the master adds work, so all that is left is in the other threads' batches
+                while (nTodo != 0)
+                    condMaster.wait(lock);
+            } else {
+                nSleeping++;
+                while (nQueued == 0)
+                    condWorker.wait(lock); // wait
+                nSleeping--;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            nSpin = 0;
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nQueued(0), nTodo(0), fAllOk(true), nSleeping(0), nNextSlot(1), nBatchSize(std::max(1U, nBatchSizeIn)) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(1 + nWorkers++ % (MAX_CHECKQUEUE_SLOTS - 1));
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        // Account for the whole batch first, so no thread sees it complete early
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        nQueued += vChecks.size();
+        // Deal the batch out over the workers' queues in as many chunks as there are workers,
+        // continuing with the next worker on the next call. Without workers the master keeps it.
+        unsigned int nSlots = NumSlots();
+        unsigned int nChunk = nSlots == 1 ? vChecks.size() : (vChecks.size() + nSlots - 2) / (nSlots - 1);
+        for (unsigned int nStart = 0; nStart < vChecks.size(); nStart += nChunk) {
+            unsigned int nSlot = 0;
+            if (nSlots > 1) {
+                if (nNextSlot >= nSlots)
+                    nNextSlot = 1;
+                nSlot = nNextSlot++;
+            }
+            WorkerQueue& q = queues[nSlot];
+            unsigned int nEnd = std::min<unsigned int>(nStart + nChunk, vChecks.size());
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (unsigned int i = nStart; i < nEnd; i++) {
+                q.checks.push_back(T());
+                vChecks[i].swap(q.checks.back());
+            }
+            q.nSize = q.checks.size();
+        }
+        if (nSleeping > 0) {
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -163,8 +250,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo == 0 && nQueued == 0 && fAllOk;
     }
 
 };
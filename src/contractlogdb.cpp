@@ -0,0 +1,216 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "contractlogdb.h"
+
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+static const char DB_RECEIPT = 'r';
+static const char DB_BLOCK_LOGS = 'b';
+static const char DB_RANGE_BLOOM = 'R';
+
+static pair<char, pair<unsigned char, int> > RangeBloomKey(int nLevel, int nRange)
+{
+    return make_pair(DB_RANGE_BLOOM, make_pair((unsigned char)nLevel, nRange));
+}
+
+CContractLog::CContractLog(const dev::eth::LogEntry& entry) : address(entry.address), data(entry.data)
+{
+    for (const dev::h256& topic : entry.topics)
+        topics.push_back(h256Touint(topic));
+}
+
+dev::LogBloom CContractLog::GetBloom() const
+{
+    dev::LogBloom bloom;
+    bloom.shiftBloom<3>(dev::sha3(address.ref()));
+    for (const uint256& topic : topics)
+        bloom.shiftBloom<3>(dev::sha3(uintToh256(topic).ref()));
+    return bloom;
+}
+
+CContractReceipt::CContractReceipt(const COutPoint& outpointIn, const dev::eth::TransactionReceipt& receipt) : outpoint(outpointIn)
+{
+    nGasUsed = receipt.gasUsed() > std::numeric_limits<uint64_t>::max() ? std::numeric_limits<uint64_t>::max() : uint64_t(receipt.gasUsed());
+    for (const dev::eth::LogEntry& entry : receipt.log())
+        logs.push_back(CContractLog(entry));
+}
+
+bool CLogFilter::Matches(const dev::LogBloom& bloom) const
+{
+    if (!addresses.empty()) {
+        bool fFound = false;
+        for (const dev::Address& address : addresses) {
+            if (bloom.contains(dev::LogBloom().shiftBloom<3>(dev::sha3(address.ref())))) {
+                fFound = true;
+                break;
+            }
+        }
+        if (!fFound)
+            return false;
+    }
+    for (const boost::optional<uint256>& topic : topics) {
+        if (topic && !bloom.contains(dev::LogBloom().shiftBloom<3>(dev::sha3(uintToh256(*topic).ref()))))
+            return false;
+    }
+    return true;
+}
+
+bool CLogFilter::Matches(const CContractLog& log) const
+{
+    if (!addresses.empty() && std::find(addresses.begin(), addresses.end(), log.address) == addresses.end())
+        return false;
+    if (topics.size() > log.topics.size())
+        return false;
+    for (size_t i = 0; i < topics.size(); i++) {
+        if (topics[i] && *topics[i] != log.topics[i])
+            return false;
+    }
+    return true;
+}
+
+CContractLogDB::CContractLogDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "logevents", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CContractLogDB::WriteBlockLogs(int nHeight, const uint256& hashBlock, const vector<CContractReceipt>& receipts)
+{
+    CDBBatch batch(*this);
+    CBlockLogs blockLogs;
+    blockLogs.hashBlock = hashBlock;
+    for (const CContractReceipt& receipt : receipts) {
+        for (const CContractLog& log : receipt.logs)
+            blockLogs.bloom |= log.GetBloom();
+        blockLogs.vReceipts.push_back(receipt.outpoint);
+        batch.Write(make_pair(DB_RECEIPT, receipt.outpoint), receipt);
+    }
+    batch.Write(make_pair(DB_BLOCK_LOGS, nHeight), blockLogs);
+
+    // Range blooms only ever gain bits here; a block connected again after a crash sets the same ones
+    for (int nLevel = 0; nLevel < LOG_BLOOM_LEVELS; nLevel++) {
+        int nRange = nHeight / LOG_BLOOM_RANGES[nLevel];
+        dev::LogBloom bloom;
+        ReadRangeBloom(nLevel, nRange, bloom);
+        if (bloom.contains(blockLogs.bloom))
+            continue;
+        bloom |= blockLogs.bloom;
+        batch.Write(RangeBloomKey(nLevel, nRange), bloom.asBytes());
+    }
+    return WriteBatch(batch);
+}
+
+bool CContractLogDB::EraseBlockLogs(int nHeight)
+{
+    CBlockLogs blockLogs;
+    if (!ReadBlockLogs(nHeight, blockLogs))
+        return true;
+
+    CDBBatch batch(*this);
+    for (const COutPoint& outpoint : blockLogs.vReceipts)
+        batch.Erase(make_pair(DB_RECEIPT, outpoint));
+    batch.Erase(make_pair(DB_BLOCK_LOGS, nHeight));
+
+    // Bits cannot be taken out of a bloom, so the ranges holding the block are made up again from
+    // the blocks, or the ranges of the level below, that remain.
+    dev::LogBloom below;
+    for (int nLevel = 0; nLevel < LOG_BLOOM_LEVELS; nLevel++) {
+        int nRange = nHeight / LOG_BLOOM_RANGES[nLevel];
+        dev::LogBloom bloom;
+        if (nLevel == 0) {
+            for (int nBlock = nRange * LOG_BLOOM_RANGES[0]; nBlock < (nRange + 1) * LOG_BLOOM_RANGES[0]; nBlock++) {
+                CBlockLogs other;
+                if (nBlock != nHeight && ReadBlockLogs(nBlock, other))
+                    bloom |= other.bloom;
+            }
+        } else {
+            int nRatio = LOG_BLOOM_RANGES[nLevel] / LOG_BLOOM_RANGES[nLevel - 1];
+            int nRangeBelow = nHeight / LOG_BLOOM_RANGES[nLevel - 1];
+            for (int nChild = nRange * nRatio; nChild < (nRange + 1) * nRatio; nChild++) {
+                dev::LogBloom child;
+                if (nChild == nRangeBelow)
+                    bloom |= below;
+                else if (ReadRangeBloom(nLevel - 1, nChild, child))
+                    bloom |= child;
+            }
+        }
+        if (bloom)
+            batch.Write(RangeBloomKey(nLevel, nRange), bloom.asBytes());
+        else
+            batch.Erase(RangeBloomKey(nLevel, nRange));
+        below = bloom;
+    }
+    return WriteBatch(batch);
+}
+
+bool CContractLogDB::ReadBlockLogs(int nHeight, CBlockLogs& blockLogs) const
+{
+    return Read(make_pair(DB_BLOCK_LOGS, nHeight), blockLogs);
+}
+
+bool CContractLogDB::ReadRangeBloom(int nLevel, int nRange, dev::LogBloom& bloom) const
+{
+    vector<unsigned char> vch;
+    if (!Read(RangeBloomKey(nLevel, nRange), vch) || vch.size() != dev::LogBloom::size)
+        return false;
+    bloom = dev::LogBloom(vch);
+    return true;
+}
+
+bool CContractLogDB::ReadReceipt(const COutPoint& outpoint, CContractReceipt& receipt) const
+{
+    return Read(make_pair(DB_RECEIPT, outpoint), receipt);
+}
+
+bool CContractLogDB::ReadReceipts(const uint256& txid, vector<CContractReceipt>& receipts)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    // The outputs of a transaction are next to each other, as the key starts with its hash
+    pcursor->Seek(make_pair(DB_RECEIPT, COutPoint(txid, 0)));
+    while (pcursor->Valid()) {
+        pair<char, COutPoint> key;
+        if (!pcursor->GetKey(key) || key.first != DB_RECEIPT || key.second.hash != txid)
+            break;
+        CContractReceipt receipt;
+        if (!pcursor->GetValue(receipt))
+            return error("%s: failed to read receipt of %s", __func__, key.second.ToString());
+        receipts.push_back(receipt);
+        pcursor->Next();
+    }
+    return true;
+}
+
+void CContractLogDB::FindBlockLogs(const CLogFilter& filter, int nFrom, int nTo, vector<pair<int, CBlockLogs> >& blocks) const
+{
+    FindBlockLogs(filter, LOG_BLOOM_LEVELS - 1, nFrom, nTo, blocks);
+}
+
+void CContractLogDB::FindBlockLogs(const CLogFilter& filter, int nLevel, int nFrom, int nTo, vector<pair<int, CBlockLogs> >& blocks) const
+{
+    if (nLevel < 0) {
+        for (int nHeight = nFrom; nHeight <= nTo; nHeight++) {
+            CBlockLogs blockLogs;
+            if (ReadBlockLogs(nHeight, blockLogs) && blockLogs.bloom && filter.Matches(blockLogs.bloom))
+                blocks.push_back(make_pair(nHeight, blockLogs));
+        }
+        return;
+    }
+
+    int nSize = LOG_BLOOM_RANGES[nLevel];
+    for (int nRange = nFrom / nSize; nRange <= nTo / nSize; nRange++) {
+        boost::this_thread::interruption_point();
+        dev::LogBloom bloom;
+        if (!ReadRangeBloom(nLevel, nRange, bloom) || !filter.Matches(bloom))
+            continue;
+        FindBlockLogs(filter, nLevel - 1, std::max(nFrom, nRange * nSize), std::min(nTo, nRange * nSize + nSize - 1), blocks);
+    }
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QUANTUM_CONTRACTLOGDB_H
+#define QUANTUM_CONTRACTLOGDB_H
+
+#include "dbwrapper.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include <libethereum/TransactionReceipt.h>
+#include <libevm/ExtVMFace.h>
+
+//! Max memory allocated to the contract event log database (MiB)
+static const int64_t nMaxLogEventsDBCache = 64;
+
+/**
+ * Blocks covered by one range bloom, for each level of the range bloom
+ * hierarchy from the bottom up. Every level holds a whole number of ranges
+ * of the level below it.
+ */
+static const int LOG_BLOOM_RANGES[] = {1024, 65536};
+static const int LOG_BLOOM_LEVELS = sizeof(LOG_BLOOM_RANGES) / sizeof(LOG_BLOOM_RANGES[0]);
+
+/** An event emitted by a contract */
+struct CContractLog
+{
+    dev::Address address;
+    std::vector<uint256> topics; // in the byte order of the VM, as h256Touint leaves them
+    std::vector<unsigned char> data;
+
+    CContractLog() {}
+    explicit CContractLog(const dev::eth::LogEntry& entry);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(FLATDATA(address));
+        READWRITE(topics);
+        READWRITE(data);
+    }
+
+    dev::LogBloom GetBloom() const;
+};
+
+/** Receipt of the execution of one contract output */
+struct CContractReceipt
+{
+    COutPoint outpoint;
+    uint64_t nGasUsed;
+    std::vector<CContractLog> logs;
+
+    CContractReceipt() : nGasUsed(0) {}
+    CContractReceipt(const COutPoint& outpointIn, const dev::eth::TransactionReceipt& receipt);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(outpoint);
+        READWRITE(VARINT(nGasUsed));
+        READWRITE(logs);
+    }
+};
+
+/** The contract outputs a block executed, with the bloom of all the events they emitted */
+struct CBlockLogs
+{
+    uint256 hashBlock;
+    dev::LogBloom bloom;
+    std::vector<COutPoint> vReceipts;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(FLATDATA(bloom));
+        READWRITE(vReceipts);
+    }
+};
+
+/**
+ * Selects events by emitting contract and topics. An event matches if it was
+ * emitted by any of the addresses and has every topic that is set at the same
+ * position. Empty addresses and unset topics match anything.
+ */
+class CLogFilter
+{
+public:
+    std::vector<dev::Address> addresses;
+    std::vector<boost::optional<uint256> > topics;
+
+    bool Matches(const dev::LogBloom& bloom) const;
+    bool Matches(const CContractLog& log) const;
+};
+
+/** Access to the contract event log database (logevents/) */
+class CContractLogDB : public CDBWrapper
+{
+public:
+    CContractLogDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CContractLogDB(const CContractLogDB&);
+    void operator=(const CContractLogDB&);
+public:
+    /** Stores the receipts of a connected block and adds its events to the range blooms */
+    bool WriteBlockLogs(int nHeight, const uint256& hashBlock, const std::vector<CContractReceipt>& receipts);
+    /** Removes the receipts of a disconnected block and rebuilds the range blooms it was part of */
+    bool EraseBlockLogs(int nHeight);
+    bool ReadBlockLogs(int nHeight, CBlockLogs& blockLogs) const;
+    bool ReadRangeBloom(int nLevel, int nRange, dev::LogBloom& bloom) const;
+    bool ReadReceipt(const COutPoint& outpoint, CContractReceipt& receipt) const;
+    bool ReadReceipts(const uint256& txid, std::vector<CContractReceipt>& receipts);
+    /**
+     * Finds the blocks in [nFrom, nTo] that may have events matching the
+     * filter, descending only into the ranges whose bloom matches.
+     */
+    void FindBlockLogs(const CLogFilter& filter, int nFrom, int nTo, std::vector<std::pair<int, CBlockLogs> >& blocks) const;
+private:
+    void FindBlockLogs(const CLogFilter& filter, int nLevel, int nFrom, int nTo, std::vector<std::pair<int, CBlockLogs> >& blocks) const;
+};
+
+#endif // QUANTUM_CONTRACTLOGDB_H
@@ -0,0 +1,258 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "contractspeculator.h"
+
+#include "timedata.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+#include <libevm/CodeAnalysis.h>
+
+using namespace std;
+
+//! Transactions speculated on one snapshot of the tip
+static const size_t SPECULATION_BATCH_SIZE = 100;
+
+CContractSpeculator mempoolSpeculator;
+
+/** Whether any code among the accessed addresses may make the outcome depend on more than the tip. */
+static bool ReadsBlockInfo(const dev::eth::QtumState& state, const dev::AddressHash& accessed, const dev::eth::EVMSchedule& schedule)
+{
+    for (const dev::Address& address : accessed) {
+        if (!state.addressHasCode(address))
+            continue;
+        if (dev::eth::CodeAnalysisCache::get(state.codeHash(address), &state.code(address), schedule)->readsBlockInfo)
+            return true;
+    }
+    return false;
+}
+
+void CContractSpeculator::QueueLocked(const uint256& txid)
+{
+    if (setQueued.insert(txid).second)
+        queue.push_back(txid);
+}
+
+void CContractSpeculator::Queue(const uint256& txid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    QueueLocked(txid);
+    cond.notify_one();
+}
+
+void CContractSpeculator::BlockConnected(const CBlock& block, const dev::AddressHash& setWritten)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (block.hashPrevBlock != hashTip) {
+        for (const auto& i : mapSpeculation)
+            QueueLocked(i.first.hash);
+        mapSpeculation.clear();
+    } else {
+        set<uint256> setBlockTx;
+        for (const CTransaction& tx : block.vtx)
+            setBlockTx.insert(tx.GetHash());
+        for (auto it = mapSpeculation.begin(); it != mapSpeculation.end();) {
+            const dev::AddressHash& accessed = it->second->changes.accessed;
+            if (setBlockTx.count(it->first.hash)) {
+                mapSpeculation.erase(it++);
+            } else if (any_of(accessed.begin(), accessed.end(), [&](const dev::Address& a){ return setWritten.count(a); })) {
+                QueueLocked(it->first.hash);
+                mapSpeculation.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+    hashTip = block.GetHash();
+    fPrune = true;
+    cond.notify_one();
+}
+
+void CContractSpeculator::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (const auto& i : mapSpeculation)
+        QueueLocked(i.first.hash);
+    mapSpeculation.clear();
+    hashTip.SetNull();
+    cond.notify_one();
+}
+
+shared_ptr<const CContractSpeculation> CContractSpeculator::Find(const COutPoint& out, const uint256& hashTipIn, const dev::AddressHash& setWritten)
+{
+    shared_ptr<const CContractSpeculation> speculation;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (hashTipIn != hashTip)
+            return nullptr;
+        auto it = mapSpeculation.find(out);
+        if (it == mapSpeculation.end())
+            return nullptr;
+        speculation = it->second;
+    }
+    const dev::AddressHash& accessed = speculation->changes.accessed;
+    if (any_of(accessed.begin(), accessed.end(), [&](const dev::Address& a){ return setWritten.count(a); }))
+        return nullptr;
+    return speculation;
+}
+
+bool CContractSpeculator::Store(const uint256& hashSnapshot, const vector<pair<COutPoint, shared_ptr<const CContractSpeculation> > >& vSpeculation)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (hashTip.IsNull())
+        hashTip = hashSnapshot;
+    if (hashTip != hashSnapshot)
+        return false;
+    for (const auto& i : vSpeculation) {
+        if (mapSpeculation.size() >= MAX_MEMPOOL_SPECULATIONS)
+            break;
+        mapSpeculation[i.first] = i.second;
+    }
+    return true;
+}
+
+shared_ptr<const CContractSpeculation> CContractSpeculator::SpeculateOutput(const dev::eth::QtumState& state, const dev::eth::EnvInfo& env, const dev::eth::QtumTransaction& ethTx)
+{
+    using OnOpFunc = std::function<void(uint64_t /*steps*/, uint64_t /* PC */, dev::eth::Instruction /*instr*/, dev::bigint /*newMemSize*/, dev::bigint /*gasCost*/, dev::bigint /*gas*/, dev::eth::VM*, dev::eth::ExtVMFace const*)>;
+
+    // Init code is in no account, so ReadsBlockInfo could not vet it
+    if (ethTx.isCreation())
+        return nullptr;
+    dev::eth::QtumState stateOut(state);
+    stateOut.setRecordAccess(true);
+    shared_ptr<CContractSpeculation> speculation = make_shared<CContractSpeculation>();
+    speculation->result = stateOut.execute(env, globalSealEngine.get(), ethTx, dev::eth::Permanence::Uncommitted, OnOpFunc());
+    speculation->changes = stateOut.takeChanges();
+    if (speculation->result.execRes.excepted != dev::eth::TransactionException::None)
+        return nullptr;
+    if (ReadsBlockInfo(stateOut, speculation->changes.accessed, globalSealEngine->evmSchedule(env)))
+        return nullptr;
+    speculation->fDone = true;
+    return speculation;
+}
+
+void CContractSpeculator::Prune()
+{
+    set<uint256> setTxid;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (const auto& i : mapSpeculation)
+            setTxid.insert(i.first.hash);
+    }
+    set<uint256> setGone;
+    for (const uint256& txid : setTxid)
+        if (!mempool.exists(txid))
+            setGone.insert(txid);
+    if (setGone.empty())
+        return;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (auto it = mapSpeculation.begin(); it != mapSpeculation.end();) {
+        if (setGone.count(it->first.hash))
+            mapSpeculation.erase(it++);
+        else
+            ++it;
+    }
+}
+
+void CContractSpeculator::Speculate(const vector<uint256>& vTxid)
+{
+    unique_ptr<dev::eth::QtumState> state;
+    dev::eth::EnvInfo env;
+    uint256 hashSnapshot;
+    vector<CTransaction> vtx;
+    vector<valtype> vSender;
+    {
+        LOCK(cs_main);
+        if (IsInitialBlockDownload())
+            return;
+        CBlockIndex* tip = chainActive.Tip();
+        try {
+            state.reset(new dev::eth::QtumState(csGlobalState->snapshot(uintToh256(tip->hashStateRoot), uintToh256(tip->hashUTXORoot))));
+        } catch (const dev::RootNotFound&) {
+            return;
+        }
+        // The coinbase output of a proof-of-stake block is empty, so its author is null
+        CBlock block;
+        block.nTime = GetAdjustedTime();
+        block.nBits = tip->nBits;
+        CMutableTransaction coinbase;
+        coinbase.vout.resize(1);
+        coinbase.vout[0].SetEmpty();
+        block.vtx.push_back(coinbase);
+        env = BCExecutor(block, block.vtx[0], 0, valtype()).BuildEVMEnvironment();
+        hashSnapshot = tip->GetBlockHash();
+
+        {
+            LOCK(mempool.cs);
+            for (const uint256& txid : vTxid) {
+                CTxMemPool::indexed_transaction_set::const_iterator it = mempool.mapTx.find(txid);
+                if (it == mempool.mapTx.end())
+                    continue;
+                vtx.push_back(it->GetTx());
+                vSender.push_back(it->GetSender());
+            }
+        }
+    }
+
+    vector<pair<COutPoint, shared_ptr<const CContractSpeculation> > > vSpeculation;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        const CTransaction& tx = vtx[i];
+        if (tx.vin[0].scriptSig.HasOpTXHASH())
+            continue;
+        for (unsigned int q = 0; q < tx.vout.size(); q++) {
+            boost::this_thread::interruption_point();
+            if (!tx.vout[q].scriptPubKey.HasOpExec() && !tx.vout[q].scriptPubKey.HasOpAssign())
+                continue;
+            try {
+                shared_ptr<const CContractSpeculation> speculation = SpeculateOutput(*state, env, BitTxToEthTx(tx, q, vSender[i]).getEthTx());
+                if (speculation)
+                    vSpeculation.push_back(make_pair(COutPoint(tx.GetHash(), q), speculation));
+            } catch (const boost::thread_interrupted&) {
+                throw;
+            } catch (...) {
+                // Left to BlockAssembler
+            }
+        }
+    }
+
+    if (!Store(hashSnapshot, vSpeculation)) {
+        // A block came in meanwhile, try again on top of it
+        for (const CTransaction& tx : vtx)
+            Queue(tx.GetHash());
+    }
+}
+
+void CContractSpeculator::Thread()
+{
+    while (true) {
+        boost::this_thread::interruption_point();
+        vector<uint256> vTxid;
+        bool fPruneNow;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() && !fPrune)
+                cond.wait(lock);
+            fPruneNow = fPrune;
+            fPrune = false;
+            while (!queue.empty() && vTxid.size() < SPECULATION_BATCH_SIZE) {
+                vTxid.push_back(queue.front());
+                setQueued.erase(queue.front());
+                queue.pop_front();
+            }
+        }
+        if (fPruneNow)
+            Prune();
+        if (!vTxid.empty())
+            Speculate(vTxid);
+    }
+}
+
+void ThreadMempoolSpeculation()
+{
+    RenameThread("quantum-speculate");
+    mempoolSpeculator.Thread();
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QUANTUM_CONTRACTSPECULATOR_H
+#define QUANTUM_CONTRACTSPECULATOR_H
+
+#include "main.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <libdevcrypto/Common.h>
+
+//! Most contract outputs kept speculated at once
+static const size_t MAX_MEMPOOL_SPECULATIONS = 10000;
+
+/**
+ * Speculative executions of the contract outputs of mempool transactions against the
+ * state of the chain tip, made on a background thread as the transactions are accepted.
+ * BlockAssembler commits a speculation in place of executing the output again when
+ * nothing it accessed was written by the outputs placed before it in the template.
+ *
+ * Outputs are not speculated when their outcome may depend on more than the tip: contract
+ * creations and executions running code that reads the block author, time, difficulty,
+ * number, gas limit or block hashes (see dev::eth::CodeAnalysis::readsBlockInfo), which
+ * would be stale once a speculation is carried over to the next tip. Speculations run with
+ * the null author of proof-of-stake blocks.
+ */
+class CContractSpeculator
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! Transactions waiting to be speculated
+    std::deque<uint256> queue;
+    std::set<uint256> setQueued;
+    //! The block the speculations were made on; null until the first one is stored
+    uint256 hashTip;
+    std::map<COutPoint, std::shared_ptr<const CContractSpeculation> > mapSpeculation;
+    //! Whether a block went by since the speculations of dropped transactions were last pruned
+    bool fPrune;
+
+    void QueueLocked(const uint256& txid);
+    void Prune();
+    void Speculate(const std::vector<uint256>& vTxid);
+
+public:
+    CContractSpeculator() : fPrune(false) {}
+
+    //! Speculate the contract outputs of a transaction just added to the mempool
+    void Queue(const uint256& txid);
+
+    /**
+     * Move the speculations on to a block connected on top of the chain. Those of the block's
+     * own transactions and those that accessed an address the block wrote are dropped, and
+     * the transactions of the latter speculated again. On any other block everything is dropped.
+     */
+    void BlockConnected(const CBlock& block, const dev::AddressHash& setWritten);
+
+    //! Drop all speculations, for a block disconnected from the tip
+    void Clear();
+
+    /**
+     * Look up the speculation of a contract output made on block hashTipIn, unless it
+     * accessed one of the addresses in setWritten, which it must then be executed again on.
+     * Only executions that finished without an exception are kept.
+     */
+    std::shared_ptr<const CContractSpeculation> Find(const COutPoint& out, const uint256& hashTipIn, const dev::AddressHash& setWritten);
+
+    /**
+     * Keep speculations made on block hashSnapshot. Returns false, keeping none, if the
+     * tip moved on from it meanwhile.
+     */
+    bool Store(const uint256& hashSnapshot, const std::vector<std::pair<COutPoint, std::shared_ptr<const CContractSpeculation> > >& vSpeculation);
+
+    /**
+     * Execute a contract output on a copy of state, for reuse on any state with the same roots.
+     * Returns null if the outcome cannot be reused: an exception, a contract creation or
+     * code reading the block info.
+     */
+    static std::shared_ptr<const CContractSpeculation> SpeculateOutput(const dev::eth::QtumState& state, const dev::eth::EnvInfo& env, const dev::eth::QtumTransaction& ethTx);
+
+    //! Worker loop, interrupted through boost::thread::interrupt()
+    void Thread();
+};
+
+extern CContractSpeculator mempoolSpeculator;
+
+void ThreadMempoolSpeculation();
+
+#endif // QUANTUM_CONTRACTSPECULATOR_H
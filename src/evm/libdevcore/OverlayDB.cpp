@@ -32,6 +32,12 @@ namespace dev
 
 h256 const EmptyTrie = sha3(rlp(""));
 
+OverlayDB::OverlayDB(std::shared_ptr<ldb::DB> const& _db, size_t _nodeCacheSize):
+	m_db(_db),
+	m_nodeCache(_nodeCacheSize ? make_shared<TrieNodeCache>(_nodeCacheSize) : nullptr)
+{
+}
+
 OverlayDB::~OverlayDB()
 {
 	if (m_db.use_count() == 1 && m_db.get())
@@ -58,7 +64,12 @@ void OverlayDB::commit()
 			for (auto const& i: m_main)
 			{
 				if (i.second.second)
+				{
 					batch.Put(ldb::Slice((char const*)i.first.data(), i.first.size), ldb::Slice(i.second.first.data(), i.second.first.size()));
+					// freshly written nodes are the ones the next block is most likely to read
+					if (m_nodeCache)
+						m_nodeCache->insert(i.first, i.second.first);
+				}
 //				cnote << i.first << "#" << m_main[i.first].second;
 			}
 			for (auto const& i: m_aux)
@@ -122,7 +133,13 @@ std::string OverlayDB::lookup(h256 const& _h) const
 {
 	std::string ret = MemoryDB::lookup(_h);
 	if (ret.empty() && m_db)
+	{
+		if (m_nodeCache && m_nodeCache->lookup(_h, ret))
+			return ret;
 		m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
+		if (m_nodeCache && !ret.empty())
+			m_nodeCache->insert(_h, ret);
+	}
 	return ret;
 }
 
@@ -131,8 +148,12 @@ bool OverlayDB::exists(h256 const& _h) const
 	if (MemoryDB::exists(_h))
 		return true;
 	std::string ret;
+	if (m_nodeCache && m_nodeCache->lookup(_h, ret))
+		return true;
 	if (m_db)
 		m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
+	if (m_nodeCache && !ret.empty())
+		m_nodeCache->insert(_h, ret);
 	return !ret.empty();
 }
 
@@ -162,6 +183,8 @@ bool OverlayDB::deepkill(h256 const& _h)
 	kill(_h);
 
 	//kill in overlayDB
+	if (m_nodeCache)
+		m_nodeCache->remove(_h);
 	ldb::Status s = m_db->Delete(m_writeOptions, ldb::Slice((char const*)_h.data(), 32));
 	if (s.ok())
 		return true;
@@ -26,6 +26,7 @@
 #include <libdevcore/Common.h>
 #include <libdevcore/Log.h>
 #include <libdevcore/MemoryDB.h>
+#include <libdevcore/TrieNodeCache.h>
 
 #include "util.h" // TODO temp qtumLog
 
@@ -36,9 +37,12 @@ class OverlayDB: public MemoryDB
 {
 public:
 	OverlayDB(ldb::DB* _db = nullptr): m_db(_db) {}
+	/// @param _nodeCacheSize bytes of nodes read from @a _db to keep in memory, shared by all copies of this overlay.
+	OverlayDB(std::shared_ptr<ldb::DB> const& _db, size_t _nodeCacheSize);
 	~OverlayDB();
 
 	ldb::DB* db() const { return m_db.get(); }
+	TrieNodeCache const* nodeCache() const { return m_nodeCache.get(); }
 
 	void commit();
 	void rollback();
@@ -47,6 +51,8 @@ public:
 	bool exists(h256 const& _h) const;
 	void kill(h256 const& _h);
 	bool deepkill(h256 const& _h);
+	/// Forget any cached copy of @a _h after it has been deleted from disk behind the overlay's back.
+	void evict(h256 const& _h) { if (m_nodeCache) m_nodeCache->remove(_h); }
 
 	bytes lookupAux(h256 const& _h) const;
 
@@ -54,6 +60,7 @@ private:
 	using MemoryDB::clear;
 
 	std::shared_ptr<ldb::DB> m_db;
+	std::shared_ptr<TrieNodeCache> m_nodeCache;
 
 	ldb::ReadOptions m_readOptions;
 	ldb::WriteOptions m_writeOptions;
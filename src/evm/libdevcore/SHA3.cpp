@@ -19,7 +19,12 @@
  * @date 2014
  */
 
+#if defined(HAVE_CONFIG_H)
+#include "config/quantum-config.h"
+#endif
+
 #include "SHA3.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -63,16 +68,6 @@ decsha3(512)
 /******** The Keccak-f[1600] permutation ********/
 
 /*** Constants. ***/
-static const uint8_t rho[24] = \
-  { 1,  3,   6, 10, 15, 21,
-	28, 36, 45, 55,  2, 14,
-	27, 41, 56,  8, 25, 43,
-	62, 18, 39, 61, 20, 44};
-static const uint8_t pi[24] = \
-  {10,  7, 11, 17, 18, 3,
-	5, 16,  8, 21, 24, 4,
-   15, 23, 19, 13, 12, 2,
-   20, 14, 22,  9, 6,  1};
 static const uint64_t RC[24] = \
   {1ULL, 0x8082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
    0x808bULL, 0x80000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
@@ -81,48 +76,97 @@ static const uint64_t RC[24] = \
    0x8000000000008002ULL, 0x8000000000000080ULL, 0x800aULL, 0x800000008000000aULL,
    0x8000000080008081ULL, 0x8000000000008080ULL, 0x80000001ULL, 0x8000000080008008ULL};
 
-/*** Helper macros to unroll the permutation. ***/
+/*** Helper macro for the rotations. ***/
 #define rol(x, s) (((x) << s) | ((x) >> (64 - s)))
-#define REPEAT6(e) e e e e e e
-#define REPEAT24(e) REPEAT6(e e e e)
-#define REPEAT5(e) e e e e e
-#define FOR5(v, s, e) \
-  v = 0;            \
-  REPEAT5(e; v += s;)
 
 /*** Keccak-f[1600] ***/
+// Unrolled, with the 25 lanes kept in locals: a[x + 5y] is lane (x, y), b the lanes after rho and pi.
 static inline void keccakf(void* state) {
   uint64_t* a = (uint64_t*)state;
-  uint64_t b[5] = {0};
-  uint64_t t = 0;
-  uint8_t x, y;
+  uint64_t a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3], a4 = a[4];
+  uint64_t a5 = a[5], a6 = a[6], a7 = a[7], a8 = a[8], a9 = a[9];
+  uint64_t a10 = a[10], a11 = a[11], a12 = a[12], a13 = a[13], a14 = a[14];
+  uint64_t a15 = a[15], a16 = a[16], a17 = a[17], a18 = a[18], a19 = a[19];
+  uint64_t a20 = a[20], a21 = a[21], a22 = a[22], a23 = a[23], a24 = a[24];
+  uint64_t b0, b1, b2, b3, b4;
+  uint64_t b5, b6, b7, b8, b9;
+  uint64_t b10, b11, b12, b13, b14;
+  uint64_t b15, b16, b17, b18, b19;
+  uint64_t b20, b21, b22, b23, b24;
 
   for (int i = 0; i < 24; i++) {
 	// Theta
-	FOR5(x, 1,
-		 b[x] = 0;
-		 FOR5(y, 5,
-			  b[x] ^= a[x + y]; ))
-	FOR5(x, 1,
-		 FOR5(y, 5,
-			  a[y + x] ^= b[(x + 4) % 5] ^ rol(b[(x + 1) % 5], 1); ))
+	uint64_t c0 = a0 ^ a5 ^ a10 ^ a15 ^ a20;
+	uint64_t c1 = a1 ^ a6 ^ a11 ^ a16 ^ a21;
+	uint64_t c2 = a2 ^ a7 ^ a12 ^ a17 ^ a22;
+	uint64_t c3 = a3 ^ a8 ^ a13 ^ a18 ^ a23;
+	uint64_t c4 = a4 ^ a9 ^ a14 ^ a19 ^ a24;
+	uint64_t d0 = c4 ^ rol(c1, 1);
+	uint64_t d1 = c0 ^ rol(c2, 1);
+	uint64_t d2 = c1 ^ rol(c3, 1);
+	uint64_t d3 = c2 ^ rol(c4, 1);
+	uint64_t d4 = c3 ^ rol(c0, 1);
 	// Rho and pi
-	t = a[1];
-	x = 0;
-	REPEAT24(b[0] = a[pi[x]];
-			 a[pi[x]] = rol(t, rho[x]);
-			 t = b[0];
-			 x++; )
+	b0 = a0 ^ d0;
+	b10 = rol(a1 ^ d1, 1);
+	b20 = rol(a2 ^ d2, 62);
+	b5 = rol(a3 ^ d3, 28);
+	b15 = rol(a4 ^ d4, 27);
+	b16 = rol(a5 ^ d0, 36);
+	b1 = rol(a6 ^ d1, 44);
+	b11 = rol(a7 ^ d2, 6);
+	b21 = rol(a8 ^ d3, 55);
+	b6 = rol(a9 ^ d4, 20);
+	b7 = rol(a10 ^ d0, 3);
+	b17 = rol(a11 ^ d1, 10);
+	b2 = rol(a12 ^ d2, 43);
+	b12 = rol(a13 ^ d3, 25);
+	b22 = rol(a14 ^ d4, 39);
+	b23 = rol(a15 ^ d0, 41);
+	b8 = rol(a16 ^ d1, 45);
+	b18 = rol(a17 ^ d2, 15);
+	b3 = rol(a18 ^ d3, 21);
+	b13 = rol(a19 ^ d4, 8);
+	b14 = rol(a20 ^ d0, 18);
+	b24 = rol(a21 ^ d1, 2);
+	b9 = rol(a22 ^ d2, 61);
+	b19 = rol(a23 ^ d3, 56);
+	b4 = rol(a24 ^ d4, 14);
 	// Chi
-	FOR5(y,
-	   5,
-	   FOR5(x, 1,
-			b[x] = a[y + x];)
-	   FOR5(x, 1,
-			a[y + x] = b[x] ^ ((~b[(x + 1) % 5]) & b[(x + 2) % 5]); ))
+	a0 = b0 ^ (~b1 & b2);
+	a1 = b1 ^ (~b2 & b3);
+	a2 = b2 ^ (~b3 & b4);
+	a3 = b3 ^ (~b4 & b0);
+	a4 = b4 ^ (~b0 & b1);
+	a5 = b5 ^ (~b6 & b7);
+	a6 = b6 ^ (~b7 & b8);
+	a7 = b7 ^ (~b8 & b9);
+	a8 = b8 ^ (~b9 & b5);
+	a9 = b9 ^ (~b5 & b6);
+	a10 = b10 ^ (~b11 & b12);
+	a11 = b11 ^ (~b12 & b13);
+	a12 = b12 ^ (~b13 & b14);
+	a13 = b13 ^ (~b14 & b10);
+	a14 = b14 ^ (~b10 & b11);
+	a15 = b15 ^ (~b16 & b17);
+	a16 = b16 ^ (~b17 & b18);
+	a17 = b17 ^ (~b18 & b19);
+	a18 = b18 ^ (~b19 & b15);
+	a19 = b19 ^ (~b15 & b16);
+	a20 = b20 ^ (~b21 & b22);
+	a21 = b21 ^ (~b22 & b23);
+	a22 = b22 ^ (~b23 & b24);
+	a23 = b23 ^ (~b24 & b20);
+	a24 = b24 ^ (~b20 & b21);
 	// Iota
-	a[0] ^= RC[i];
+	a0 ^= RC[i];
   }
+
+  a[0] = a0; a[1] = a1; a[2] = a2; a[3] = a3; a[4] = a4;
+  a[5] = a5; a[6] = a6; a[7] = a7; a[8] = a8; a[9] = a9;
+  a[10] = a10; a[11] = a11; a[12] = a12; a[13] = a13; a[14] = a14;
+  a[15] = a15; a[16] = a16; a[17] = a17; a[18] = a18; a[19] = a19;
+  a[20] = a20; a[21] = a21; a[22] = a22; a[23] = a23; a[24] = a24;
 }
 
 /******** The FIPS202-defined functions. ********/
@@ -209,6 +253,68 @@ defsha3(256)
 defsha3(384)
 defsha3(512)
 
+/******** Four SHA3-256 at once, on AVX2 ********/
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_QUANTUM_INTERNAL) && (defined(__x86_64__) || defined(__i386__))
+#define ETH_KECCAK_AVX2 1
+
+/// Keccak-f[1600] on four states at once, with lane w of state l at _states[4 * w + l] (SHA3AVX2.cpp).
+void keccakf4(uint64_t* _states);
+
+static bool haveAVX2()
+{
+	static bool const s_have = __builtin_cpu_supports("avx2");
+	return s_have;
+}
+
+/// The sponge of hash() for sha3_256 over four inputs, each running as many permutations as its length asks for.
+static void sha3_256x4(bytesConstRef const* _inputs, h256* o_outputs)
+{
+	static size_t const rate = 200 - 256 / 4;
+	uint64_t a[25 * 4] = {0};
+	size_t blocks[4];
+	size_t most = 0;
+	for (unsigned l = 0; l < 4; ++l)
+	{
+		blocks[l] = _inputs[l].size() / rate + 1;
+		most = std::max(most, blocks[l]);
+	}
+	uint8_t block[rate];
+	for (size_t b = 0; b < most; ++b)
+	{
+		for (unsigned l = 0; l < 4; ++l)
+		{
+			if (b >= blocks[l])
+				continue;	// done, the permutations of the others leave its output alone
+			uint8_t const* in = _inputs[l].data() + b * rate;
+			if (b + 1 < blocks[l])
+				memcpy(block, in, rate);
+			else
+			{
+				// Xor in the DS and pad frame.
+				size_t left = _inputs[l].size() - b * rate;
+				memset(block, 0, rate);
+				if (left)
+					memcpy(block, in, left);
+				block[left] ^= 0x01;
+				block[rate - 1] ^= 0x80;
+			}
+			for (size_t w = 0; w < rate / 8; ++w)
+			{
+				uint64_t lane;
+				memcpy(&lane, block + 8 * w, 8);
+				a[4 * w + l] ^= lane;
+			}
+		}
+		keccakf4(a);
+		for (unsigned l = 0; l < 4; ++l)
+			if (b + 1 == blocks[l])
+				for (size_t w = 0; w < 4; ++w)
+					memcpy(o_outputs[l].data() + 8 * w, &a[4 * w + l], 8);
+	}
+}
+#endif
+
 }
 
 unsigned g_sha3Counter = 0;
@@ -224,4 +330,17 @@ bool sha3(bytesConstRef _input, bytesRef o_output)
 	return true;
 }
 
+void sha3Batch(bytesConstRef const* _inputs, h256* o_outputs, size_t _count)
+{
+	g_sha3Counter += _count;
+	size_t i = 0;
+#if ETH_KECCAK_AVX2
+	if (keccak::haveAVX2())
+		for (; i + 4 <= _count; i += 4)
+			keccak::sha3_256x4(_inputs + i, o_outputs + i);
+#endif
+	for (; i < _count; ++i)
+		keccak::sha3_256(o_outputs[i].data(), 32, _inputs[i].data(), _inputs[i].size());
+}
+
 }
@@ -36,6 +36,10 @@ namespace dev
 /// @returns false if o_output.size() != 32.
 bool sha3(bytesConstRef _input, bytesRef o_output);
 
+/// Calculate the SHA3-256 hashes of @a _count inputs at once, o_outputs[i] being that of _inputs[i].
+/// Where the CPU has AVX2 they are worked out four at a time, which pays off for many short inputs like trie keys.
+void sha3Batch(bytesConstRef const* _inputs, h256* o_outputs, size_t _count);
+
 /// Calculate SHA3-256 hash of the given input, returning as a 256-bit hash.
 inline h256 sha3(bytesConstRef _input) { h256 ret; sha3(_input, ret.ref()); return ret; }
 inline SecureFixedHash<32> sha3Secure(bytesConstRef _input) { SecureFixedHash<32> ret; sha3(_input, ret.writable().ref()); return ret; }
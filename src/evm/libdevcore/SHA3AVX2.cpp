@@ -0,0 +1,141 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file SHA3AVX2.cpp
+ * Keccak-f[1600] on four states at once, one in each 64-bit lane of the AVX2 registers.
+ * Built with the AVX2 flags and only called by sha3Batch() once the CPU is known to have it.
+ */
+
+#ifdef ENABLE_AVX2
+
+#include <cstdint>
+#include <immintrin.h>
+
+namespace dev
+{
+namespace keccak
+{
+
+namespace
+{
+
+uint64_t const RC[24] = {
+	1ULL, 0x8082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+	0x808bULL, 0x80000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+	0x8aULL, 0x88ULL, 0x80008009ULL, 0x8000000aULL,
+	0x8000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+	0x8000000000008002ULL, 0x8000000000000080ULL, 0x800aULL, 0x800000008000000aULL,
+	0x8000000080008081ULL, 0x8000000000008080ULL, 0x80000001ULL, 0x8000000080008008ULL};
+
+inline __m256i rol(__m256i _x, int _s) { return _mm256_or_si256(_mm256_slli_epi64(_x, _s), _mm256_srli_epi64(_x, 64 - _s)); }
+inline __m256i load(uint64_t const* _states, int _w) { return _mm256_loadu_si256((__m256i const*)(_states + 4 * _w)); }
+inline void store(uint64_t* _states, int _w, __m256i _v) { _mm256_storeu_si256((__m256i*)(_states + 4 * _w), _v); }
+
+}
+
+void keccakf4(uint64_t* _states)
+{
+	__m256i a0 = load(_states, 0), a1 = load(_states, 1), a2 = load(_states, 2), a3 = load(_states, 3), a4 = load(_states, 4);
+	__m256i a5 = load(_states, 5), a6 = load(_states, 6), a7 = load(_states, 7), a8 = load(_states, 8), a9 = load(_states, 9);
+	__m256i a10 = load(_states, 10), a11 = load(_states, 11), a12 = load(_states, 12), a13 = load(_states, 13), a14 = load(_states, 14);
+	__m256i a15 = load(_states, 15), a16 = load(_states, 16), a17 = load(_states, 17), a18 = load(_states, 18), a19 = load(_states, 19);
+	__m256i a20 = load(_states, 20), a21 = load(_states, 21), a22 = load(_states, 22), a23 = load(_states, 23), a24 = load(_states, 24);
+	__m256i b0, b1, b2, b3, b4;
+	__m256i b5, b6, b7, b8, b9;
+	__m256i b10, b11, b12, b13, b14;
+	__m256i b15, b16, b17, b18, b19;
+	__m256i b20, b21, b22, b23, b24;
+
+	for (int i = 0; i < 24; i++)
+	{
+		// Theta
+		__m256i c0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a0, a5), a10), a15), a20);
+		__m256i c1 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a1, a6), a11), a16), a21);
+		__m256i c2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a2, a7), a12), a17), a22);
+		__m256i c3 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a3, a8), a13), a18), a23);
+		__m256i c4 = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a4, a9), a14), a19), a24);
+		__m256i d0 = _mm256_xor_si256(c4, rol(c1, 1));
+		__m256i d1 = _mm256_xor_si256(c0, rol(c2, 1));
+		__m256i d2 = _mm256_xor_si256(c1, rol(c3, 1));
+		__m256i d3 = _mm256_xor_si256(c2, rol(c4, 1));
+		__m256i d4 = _mm256_xor_si256(c3, rol(c0, 1));
+		// Rho and pi
+		b0 = _mm256_xor_si256(a0, d0);
+		b10 = rol(_mm256_xor_si256(a1, d1), 1);
+		b20 = rol(_mm256_xor_si256(a2, d2), 62);
+		b5 = rol(_mm256_xor_si256(a3, d3), 28);
+		b15 = rol(_mm256_xor_si256(a4, d4), 27);
+		b16 = rol(_mm256_xor_si256(a5, d0), 36);
+		b1 = rol(_mm256_xor_si256(a6, d1), 44);
+		b11 = rol(_mm256_xor_si256(a7, d2), 6);
+		b21 = rol(_mm256_xor_si256(a8, d3), 55);
+		b6 = rol(_mm256_xor_si256(a9, d4), 20);
+		b7 = rol(_mm256_xor_si256(a10, d0), 3);
+		b17 = rol(_mm256_xor_si256(a11, d1), 10);
+		b2 = rol(_mm256_xor_si256(a12, d2), 43);
+		b12 = rol(_mm256_xor_si256(a13, d3), 25);
+		b22 = rol(_mm256_xor_si256(a14, d4), 39);
+		b23 = rol(_mm256_xor_si256(a15, d0), 41);
+		b8 = rol(_mm256_xor_si256(a16, d1), 45);
+		b18 = rol(_mm256_xor_si256(a17, d2), 15);
+		b3 = rol(_mm256_xor_si256(a18, d3), 21);
+		b13 = rol(_mm256_xor_si256(a19, d4), 8);
+		b14 = rol(_mm256_xor_si256(a20, d0), 18);
+		b24 = rol(_mm256_xor_si256(a21, d1), 2);
+		b9 = rol(_mm256_xor_si256(a22, d2), 61);
+		b19 = rol(_mm256_xor_si256(a23, d3), 56);
+		b4 = rol(_mm256_xor_si256(a24, d4), 14);
+		// Chi
+		a0 = _mm256_xor_si256(b0, _mm256_andnot_si256(b1, b2));
+		a1 = _mm256_xor_si256(b1, _mm256_andnot_si256(b2, b3));
+		a2 = _mm256_xor_si256(b2, _mm256_andnot_si256(b3, b4));
+		a3 = _mm256_xor_si256(b3, _mm256_andnot_si256(b4, b0));
+		a4 = _mm256_xor_si256(b4, _mm256_andnot_si256(b0, b1));
+		a5 = _mm256_xor_si256(b5, _mm256_andnot_si256(b6, b7));
+		a6 = _mm256_xor_si256(b6, _mm256_andnot_si256(b7, b8));
+		a7 = _mm256_xor_si256(b7, _mm256_andnot_si256(b8, b9));
+		a8 = _mm256_xor_si256(b8, _mm256_andnot_si256(b9, b5));
+		a9 = _mm256_xor_si256(b9, _mm256_andnot_si256(b5, b6));
+		a10 = _mm256_xor_si256(b10, _mm256_andnot_si256(b11, b12));
+		a11 = _mm256_xor_si256(b11, _mm256_andnot_si256(b12, b13));
+		a12 = _mm256_xor_si256(b12, _mm256_andnot_si256(b13, b14));
+		a13 = _mm256_xor_si256(b13, _mm256_andnot_si256(b14, b10));
+		a14 = _mm256_xor_si256(b14, _mm256_andnot_si256(b10, b11));
+		a15 = _mm256_xor_si256(b15, _mm256_andnot_si256(b16, b17));
+		a16 = _mm256_xor_si256(b16, _mm256_andnot_si256(b17, b18));
+		a17 = _mm256_xor_si256(b17, _mm256_andnot_si256(b18, b19));
+		a18 = _mm256_xor_si256(b18, _mm256_andnot_si256(b19, b15));
+		a19 = _mm256_xor_si256(b19, _mm256_andnot_si256(b15, b16));
+		a20 = _mm256_xor_si256(b20, _mm256_andnot_si256(b21, b22));
+		a21 = _mm256_xor_si256(b21, _mm256_andnot_si256(b22, b23));
+		a22 = _mm256_xor_si256(b22, _mm256_andnot_si256(b23, b24));
+		a23 = _mm256_xor_si256(b23, _mm256_andnot_si256(b24, b20));
+		a24 = _mm256_xor_si256(b24, _mm256_andnot_si256(b20, b21));
+		// Iota
+		a0 = _mm256_xor_si256(a0, _mm256_set1_epi64x(RC[i]));
+	}
+
+	store(_states, 0, a0); store(_states, 1, a1); store(_states, 2, a2); store(_states, 3, a3); store(_states, 4, a4);
+	store(_states, 5, a5); store(_states, 6, a6); store(_states, 7, a7); store(_states, 8, a8); store(_states, 9, a9);
+	store(_states, 10, a10); store(_states, 11, a11); store(_states, 12, a12); store(_states, 13, a13); store(_states, 14, a14);
+	store(_states, 15, a15); store(_states, 16, a16); store(_states, 17, a17); store(_states, 18, a18); store(_states, 19, a19);
+	store(_states, 20, a20); store(_states, 21, a21); store(_states, 22, a22); store(_states, 23, a23); store(_states, 24, a24);
+}
+
+}
+}
+
+#endif
@@ -334,6 +334,10 @@ public:
 	void insert(KeyType _k, bytes const& _value) { insert(_k, bytesConstRef(&_value)); }
 	void remove(KeyType _k) { Generic::remove(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
 
+	/// Insert or remove with the key already hashed, as by sha3Batch() over many keys. Only for hashing Generic types.
+	void insertHashed(KeyType _k, h256 const& _hashedKey, bytesConstRef _value) { Generic::insertHashed(bytesConstRef((byte const*)&_k, sizeof(KeyType)), _hashedKey, _value); }
+	void removeHashed(h256 const& _hashedKey) { Generic::removeHashed(_hashedKey); }
+
 	class iterator: public Generic::iterator
 	{
 	public:
@@ -394,6 +398,8 @@ public:
 	bool contains(bytesConstRef _key) { return Super::contains(sha3(_key)); }
 	void insert(bytesConstRef _key, bytesConstRef _value) { Super::insert(sha3(_key), _value); }
 	void remove(bytesConstRef _key) { Super::remove(sha3(_key)); }
+	void insertHashed(bytesConstRef, h256 const& _hashedKey, bytesConstRef _value) { Super::insert(_hashedKey, _value); }
+	void removeHashed(h256 const& _hashedKey) { Super::remove(_hashedKey); }
 
 	// empty from the PoV of the iterator interface; still need a basic iterator impl though.
 	class iterator
@@ -452,6 +458,13 @@ public:
 
 	void remove(bytesConstRef _key) { Super::remove(sha3(_key)); }
 
+	void insertHashed(bytesConstRef _key, h256 const& _hashedKey, bytesConstRef _value)
+	{
+		Super::insert(_hashedKey, _value);
+		Super::db()->insertAux(_hashedKey, _key);
+	}
+	void removeHashed(h256 const& _hashedKey) { Super::remove(_hashedKey); }
+
 	//friend class iterator;
 
 	class iterator : public GenericTrieDB<_DB>::iterator
@@ -461,6 +474,8 @@ public:
 
 		iterator() { }
 		iterator(FatGenericTrieDB const* _trie): Super(_trie) { }
+		/// Starts at the first key whose hash is not less than @a _hashedKey.
+		iterator(FatGenericTrieDB const* _trie, bytesConstRef _hashedKey): Super(_trie, _hashedKey) { }
 
 		typename Super::value_type at() const
 		{
@@ -813,7 +828,8 @@ template <class DB> std::string GenericTrieDB<DB>::atAux(RLP const& _here, Nibbl
 
 template <class DB> bytes GenericTrieDB<DB>::mergeAt(RLP const& _orig, NibbleSlice _k, bytesConstRef _v, bool _inLine)
 {
-	return mergeAt(_orig, sha3(_orig.data()), _k, _v, _inLine);
+	// The hash is only needed to kill a node that is not inline.
+	return mergeAt(_orig, _inLine ? h256() : sha3(_orig.data()), _k, _v, _inLine);
 }
 
 template <class DB> bytes GenericTrieDB<DB>::mergeAt(RLP const& _orig, h256 const& _origHash, NibbleSlice _k, bytesConstRef _v, bool _inLine)
@@ -909,7 +925,8 @@ template <class DB> void GenericTrieDB<DB>::mergeAtAux(RLPStream& _out, RLP cons
 		assert(!r.isNull());
 		isRemovable = true;
 	}
-	bytes b = mergeAt(r, _k, _v, !isRemovable);
+	// A node referenced by hash is killed by that hash, no need to work it out again.
+	bytes b = isRemovable ? mergeAt(r, _orig.toHash<h256>(), _k, _v) : mergeAt(r, h256(), _k, _v, true);
 	streamNode(_out, b);
 }
 
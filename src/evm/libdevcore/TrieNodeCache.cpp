@@ -0,0 +1,120 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file TrieNodeCache.cpp
+ */
+
+#include "TrieNodeCache.h"
+
+using namespace std;
+using namespace dev;
+
+const unsigned TrieNodeCache::c_shards;
+
+TrieNodeCache::TrieNodeCache(size_t _maxBytes):
+	m_maxBytes(_maxBytes),
+	m_shardBytes(_maxBytes / c_shards)
+{
+}
+
+bool TrieNodeCache::lookup(h256 const& _h, string& o_value)
+{
+	Shard& s = shardFor(_h);
+	lock_guard<mutex> l(s.x_shard);
+	auto it = s.index.find(_h);
+	if (it == s.index.end())
+	{
+		++s.misses;
+		return false;
+	}
+	++s.hits;
+	s.lru.splice(s.lru.begin(), s.lru, it->second);
+	o_value = it->second->second;
+	return true;
+}
+
+void TrieNodeCache::insert(h256 const& _h, string const& _value)
+{
+	if (entrySize(_value) > m_shardBytes)
+		return;
+	Shard& s = shardFor(_h);
+	lock_guard<mutex> l(s.x_shard);
+	auto it = s.index.find(_h);
+	if (it != s.index.end())
+	{
+		s.lru.splice(s.lru.begin(), s.lru, it->second);
+		return;
+	}
+	s.lru.emplace_front(_h, _value);
+	s.index[_h] = s.lru.begin();
+	s.bytes += entrySize(_value);
+	evict(s);
+}
+
+void TrieNodeCache::remove(h256 const& _h)
+{
+	Shard& s = shardFor(_h);
+	lock_guard<mutex> l(s.x_shard);
+	auto it = s.index.find(_h);
+	if (it == s.index.end())
+		return;
+	s.bytes -= entrySize(it->second->second);
+	s.lru.erase(it->second);
+	s.index.erase(it);
+}
+
+void TrieNodeCache::evict(Shard& _s)
+{
+	while (_s.bytes > m_shardBytes && !_s.lru.empty())
+	{
+		_s.bytes -= entrySize(_s.lru.back().second);
+		_s.index.erase(_s.lru.back().first);
+		_s.lru.pop_back();
+	}
+}
+
+size_t TrieNodeCache::size() const
+{
+	size_t ret = 0;
+	for (Shard const& s: m_shards)
+	{
+		lock_guard<mutex> l(s.x_shard);
+		ret += s.bytes;
+	}
+	return ret;
+}
+
+uint64_t TrieNodeCache::hits() const
+{
+	uint64_t ret = 0;
+	for (Shard const& s: m_shards)
+	{
+		lock_guard<mutex> l(s.x_shard);
+		ret += s.hits;
+	}
+	return ret;
+}
+
+uint64_t TrieNodeCache::misses() const
+{
+	uint64_t ret = 0;
+	for (Shard const& s: m_shards)
+	{
+		lock_guard<mutex> l(s.x_shard);
+		ret += s.misses;
+	}
+	return ret;
+}
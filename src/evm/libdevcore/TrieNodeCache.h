@@ -0,0 +1,80 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file TrieNodeCache.h
+ *
+ * Bounded cache of trie nodes read from disk.
+ */
+
+#pragma once
+
+#include <array>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "FixedHash.h"
+
+namespace dev
+{
+
+/**
+ * LRU cache of trie nodes keyed by their hash, split into independently locked shards so that
+ * concurrent readers of the same database rarely contend. Nodes are content addressed, so an
+ * entry never goes stale; it only has to be dropped when the node is deleted from disk.
+ */
+class TrieNodeCache
+{
+public:
+	explicit TrieNodeCache(size_t _maxBytes);
+
+	/// @returns true and sets @a o_value if @a _h is cached.
+	bool lookup(h256 const& _h, std::string& o_value);
+	void insert(h256 const& _h, std::string const& _value);
+	void remove(h256 const& _h);
+
+	/// Memory held by the cached nodes, approximately.
+	size_t size() const;
+	size_t maxSize() const { return m_maxBytes; }
+
+	uint64_t hits() const;
+	uint64_t misses() const;
+
+private:
+	static const unsigned c_shards = 16;
+
+	struct Shard
+	{
+		typedef std::list<std::pair<h256, std::string>> Entries;
+
+		mutable std::mutex x_shard;
+		Entries lru;			///< Most recently used first.
+		std::unordered_map<h256, Entries::iterator> index;
+		size_t bytes = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+
+	Shard& shardFor(h256 const& _h) { return m_shards[_h[0] % c_shards]; }
+	static size_t entrySize(std::string const& _value) { return _value.size() + 96; }
+	void evict(Shard& _s);
+
+	size_t m_maxBytes;
+	size_t m_shardBytes;
+	std::array<Shard, c_shards> m_shards;
+};
+
+}
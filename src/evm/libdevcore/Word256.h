@@ -0,0 +1,565 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file Word256.h
+ *
+ * Fixed-width 256-bit machine word used by the interpreter stack.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "Common.h"
+#include "FixedHash.h"
+
+namespace dev
+{
+
+namespace word256
+{
+
+/// @returns the high 64 bits of _a * _b and stores the low 64 bits in o_lo.
+inline uint64_t mul128(uint64_t _a, uint64_t _b, uint64_t& o_lo)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)_a * _b;
+	o_lo = (uint64_t)p;
+	return (uint64_t)(p >> 64);
+#else
+	uint64_t a0 = _a & 0xffffffff, a1 = _a >> 32;
+	uint64_t b0 = _b & 0xffffffff, b1 = _b >> 32;
+	uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+	uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+	o_lo = (mid << 32) | (p00 & 0xffffffff);
+	return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+/// @returns the number of leading zero bits of _x, which must not be zero.
+inline unsigned clz64(uint64_t _x)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(_x);
+#else
+	unsigned n = 0;
+	for (; !(_x & (uint64_t(1) << 63)); _x <<= 1)
+		++n;
+	return n;
+#endif
+}
+
+/// Divides the 128-bit number (_hi, _lo) by _d, which must be greater than _hi.
+/// @returns the quotient and stores the remainder in o_r.
+inline uint64_t div128(uint64_t _hi, uint64_t _lo, uint64_t _d, uint64_t& o_r)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 n = ((unsigned __int128)_hi << 64) | _lo;
+	o_r = (uint64_t)(n % _d);
+	return (uint64_t)(n / _d);
+#else
+	// Hacker's Delight divlu: two 64/32 steps on the normalised divisor.
+	uint64_t const b = uint64_t(1) << 32;
+	unsigned s = clz64(_d);
+	_d <<= s;
+	uint64_t vn1 = _d >> 32, vn0 = _d & 0xffffffff;
+	uint64_t un32 = s ? (_hi << s) | (_lo >> (64 - s)) : _hi;
+	uint64_t un10 = _lo << s;
+	uint64_t un1 = un10 >> 32, un0 = un10 & 0xffffffff;
+	uint64_t q1 = un32 / vn1, rhat = un32 - q1 * vn1;
+	while (q1 >= b || q1 * vn0 > b * rhat + un1)
+	{
+		--q1;
+		rhat += vn1;
+		if (rhat >= b)
+			break;
+	}
+	uint64_t un21 = un32 * b + un1 - q1 * _d;
+	uint64_t q0 = un21 / vn1;
+	rhat = un21 - q0 * vn1;
+	while (q0 >= b || q0 * vn0 > b * rhat + un0)
+	{
+		--q0;
+		rhat += vn1;
+		if (rhat >= b)
+			break;
+	}
+	o_r = (un21 * b + un0 - q0 * _d) >> s;
+	return q1 * b + q0;
+#endif
+}
+
+/// Knuth's algorithm D on little-endian 64-bit limbs.
+/// @a _u has @a _m limbs (at most 8), @a _v has @a _n limbs (at most 4) and a non-zero top limb, @a _m >= @a _n.
+/// Writes _m - _n + 1 quotient limbs to o_q and _n remainder limbs to o_r; either may be null.
+inline void divmodLimbs(uint64_t const* _u, unsigned _m, uint64_t const* _v, unsigned _n, uint64_t* o_q, uint64_t* o_r)
+{
+	if (_n == 1)
+	{
+		uint64_t r = 0;
+		for (unsigned i = _m; i-- > 0;)
+		{
+			uint64_t q = div128(r, _u[i], _v[0], r);
+			if (o_q)
+				o_q[i] = q;
+		}
+		if (o_r)
+			o_r[0] = r;
+		return;
+	}
+
+	// Normalise so the top limb of the divisor has its high bit set.
+	unsigned s = clz64(_v[_n - 1]);
+	uint64_t vn[4];
+	uint64_t un[9];
+	for (unsigned i = _n - 1; i > 0; --i)
+		vn[i] = s ? (_v[i] << s) | (_v[i - 1] >> (64 - s)) : _v[i];
+	vn[0] = _v[0] << s;
+	un[_m] = s ? _u[_m - 1] >> (64 - s) : 0;
+	for (unsigned i = _m - 1; i > 0; --i)
+		un[i] = s ? (_u[i] << s) | (_u[i - 1] >> (64 - s)) : _u[i];
+	un[0] = _u[0] << s;
+
+	for (unsigned j = _m - _n + 1; j-- > 0;)
+	{
+		// Estimate the quotient limb from the top two limbs and correct it at most twice.
+		uint64_t qhat;
+		uint64_t rhat;
+		bool rhatOverflow = false;
+		if (un[j + _n] >= vn[_n - 1])
+		{
+			qhat = ~uint64_t(0);
+			rhat = un[j + _n - 1] + vn[_n - 1];
+			rhatOverflow = rhat < vn[_n - 1];
+		}
+		else
+			qhat = div128(un[j + _n], un[j + _n - 1], vn[_n - 1], rhat);
+		while (!rhatOverflow)
+		{
+			uint64_t lo;
+			uint64_t hi = mul128(qhat, vn[_n - 2], lo);
+			if (hi < rhat || (hi == rhat && lo <= un[j + _n - 2]))
+				break;
+			--qhat;
+			rhat += vn[_n - 1];
+			rhatOverflow = rhat < vn[_n - 1];
+		}
+
+		// Multiply and subtract.
+		uint64_t carry = 0;
+		uint64_t borrow = 0;
+		for (unsigned i = 0; i < _n; ++i)
+		{
+			uint64_t lo;
+			uint64_t hi = mul128(qhat, vn[i], lo);
+			lo += carry;
+			hi += lo < carry;
+			carry = hi;
+			uint64_t t = un[i + j] - lo;
+			uint64_t b = un[i + j] < lo;
+			un[i + j] = t - borrow;
+			borrow = b + (t < borrow);
+		}
+		uint64_t t = un[j + _n] - carry;
+		uint64_t b = un[j + _n] < carry;
+		un[j + _n] = t - borrow;
+		borrow = b + (t < borrow);
+
+		// The estimate was one too large: add the divisor back.
+		if (borrow)
+		{
+			--qhat;
+			uint64_t c = 0;
+			for (unsigned i = 0; i < _n; ++i)
+			{
+				uint64_t sum = un[i + j] + vn[i];
+				uint64_t c1 = sum < vn[i];
+				un[i + j] = sum + c;
+				c = c1 + (un[i + j] < c);
+			}
+			un[j + _n] += c;
+		}
+		if (o_q)
+			o_q[j] = qhat;
+	}
+
+	if (o_r)
+		for (unsigned i = 0; i < _n; ++i)
+			o_r[i] = s ? (un[i] >> s) | (un[i + 1] << (64 - s)) : un[i];
+}
+
+/// @returns the number of limbs of @a _w up to and including the most significant non-zero one.
+inline unsigned significantLimbs(uint64_t const* _w, unsigned _n)
+{
+	while (_n > 0 && !_w[_n - 1])
+		--_n;
+	return _n;
+}
+
+}
+
+/**
+ * 256-bit unsigned integer held in four native 64-bit limbs, least significant first.
+ * Arithmetic wraps modulo 2^256 exactly like u256 but never allocates and has no
+ * generic bignum dispatch, so the interpreter keeps its whole stack in this type and
+ * converts to u256 only when crossing into ExtVMFace.
+ * Division and modulo by zero yield zero, as the EVM defines them.
+ */
+class Word256
+{
+public:
+	constexpr Word256(): m_w{0, 0, 0, 0} {}
+	constexpr Word256(uint64_t _v): m_w{_v, 0, 0, 0} {}
+	/// Construct from limbs given most significant first.
+	constexpr Word256(uint64_t _w3, uint64_t _w2, uint64_t _w1, uint64_t _w0): m_w{_w0, _w1, _w2, _w3} {}
+	Word256(u256 const& _v)
+	{
+		static u256 const c_mask = ~uint64_t(0);
+		for (unsigned i = 0; i < 4; ++i)
+			m_w[i] = static_cast<uint64_t>((_v >> (64 * i)) & c_mask);
+	}
+	explicit Word256(h256 const& _h) { *this = fromBigEndian(_h.data()); }
+
+	/// Load 32 big-endian bytes, as found in EVM memory and call data.
+	static Word256 fromBigEndian(byte const* _p)
+	{
+		Word256 ret;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			uint64_t w = 0;
+			for (unsigned j = 0; j < 8; ++j)
+				w = (w << 8) | _p[(3 - i) * 8 + j];
+			ret.m_w[i] = w;
+		}
+		return ret;
+	}
+
+	/// Store as 32 big-endian bytes.
+	void toBigEndian(byte* o_p) const
+	{
+		for (unsigned i = 0; i < 4; ++i)
+			for (unsigned j = 0; j < 8; ++j)
+				o_p[(3 - i) * 8 + j] = (byte)(m_w[i] >> (56 - 8 * j));
+	}
+
+	u256 toU256() const
+	{
+		u256 ret = m_w[3];
+		for (unsigned i = 3; i-- > 0;)
+		{
+			ret <<= 64;
+			ret |= m_w[i];
+		}
+		return ret;
+	}
+
+	h256 toHash() const { h256 ret; toBigEndian(ret.data()); return ret; }
+
+	constexpr uint64_t limb(unsigned _i) const { return m_w[_i]; }
+
+	/// Truncates to the low 64 bits, like a cast of u256.
+	explicit operator uint64_t() const { return m_w[0]; }
+	explicit operator bool() const { return (m_w[0] | m_w[1] | m_w[2] | m_w[3]) != 0; }
+	bool operator!() const { return !(m_w[0] | m_w[1] | m_w[2] | m_w[3]); }
+
+	/// @returns true if the value is below 2^64.
+	bool fitsUint64() const { return !(m_w[1] | m_w[2] | m_w[3]); }
+	bool bit(unsigned _n) const { return _n < 256 && ((m_w[_n / 64] >> (_n % 64)) & 1); }
+	/// @returns the number of bytes needed to hold the value, 0 for zero.
+	unsigned byteLength() const
+	{
+		for (unsigned i = 4; i-- > 0;)
+			if (m_w[i])
+				return i * 8 + (64 - word256::clz64(m_w[i]) + 7) / 8;
+		return 0;
+	}
+	/// Two's complement sign bit.
+	bool isNegative() const { return (m_w[3] >> 63) != 0; }
+
+	Word256& operator+=(Word256 const& _b)
+	{
+		uint64_t carry = 0;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			uint64_t s = m_w[i] + _b.m_w[i];
+			uint64_t c = s < m_w[i];
+			m_w[i] = s + carry;
+			carry = c + (m_w[i] < carry);
+		}
+		return *this;
+	}
+
+	Word256& operator-=(Word256 const& _b)
+	{
+		uint64_t borrow = 0;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			uint64_t d = m_w[i] - _b.m_w[i];
+			uint64_t b = m_w[i] < _b.m_w[i];
+			m_w[i] = d - borrow;
+			borrow = b + (d < borrow);
+		}
+		return *this;
+	}
+
+	Word256& operator*=(Word256 const& _b)
+	{
+		uint64_t r[4] = {0, 0, 0, 0};
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			if (!m_w[i])
+				continue;
+			uint64_t carry = 0;
+			for (unsigned j = 0; i + j < 4; ++j)
+			{
+				uint64_t lo;
+				uint64_t hi = word256::mul128(m_w[i], _b.m_w[j], lo);
+				lo += carry;
+				hi += lo < carry;
+				lo += r[i + j];
+				hi += lo < r[i + j];
+				r[i + j] = lo;
+				carry = hi;
+			}
+		}
+		for (unsigned i = 0; i < 4; ++i)
+			m_w[i] = r[i];
+		return *this;
+	}
+
+	Word256& operator/=(Word256 const& _b) { divmod(*this, _b, this, nullptr); return *this; }
+	Word256& operator%=(Word256 const& _b) { divmod(*this, _b, nullptr, this); return *this; }
+
+	Word256& operator&=(Word256 const& _b) { for (unsigned i = 0; i < 4; ++i) m_w[i] &= _b.m_w[i]; return *this; }
+	Word256& operator|=(Word256 const& _b) { for (unsigned i = 0; i < 4; ++i) m_w[i] |= _b.m_w[i]; return *this; }
+	Word256& operator^=(Word256 const& _b) { for (unsigned i = 0; i < 4; ++i) m_w[i] ^= _b.m_w[i]; return *this; }
+	Word256 operator~() const { return Word256(~m_w[3], ~m_w[2], ~m_w[1], ~m_w[0]); }
+	Word256 operator-() const { return Word256() - *this; }
+
+	Word256& operator<<=(unsigned _n)
+	{
+		if (_n >= 256)
+			return *this = Word256();
+		unsigned limbs = _n / 64, bits = _n % 64;
+		for (unsigned i = 4; i-- > 0;)
+		{
+			uint64_t w = i >= limbs ? m_w[i - limbs] << bits : 0;
+			if (bits && i > limbs)
+				w |= m_w[i - limbs - 1] >> (64 - bits);
+			m_w[i] = w;
+		}
+		return *this;
+	}
+
+	Word256& operator>>=(unsigned _n)
+	{
+		if (_n >= 256)
+			return *this = Word256();
+		unsigned limbs = _n / 64, bits = _n % 64;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			uint64_t w = i + limbs < 4 ? m_w[i + limbs] >> bits : 0;
+			if (bits && i + limbs + 1 < 4)
+				w |= m_w[i + limbs + 1] << (64 - bits);
+			m_w[i] = w;
+		}
+		return *this;
+	}
+
+	friend Word256 operator+(Word256 _a, Word256 const& _b) { return _a += _b; }
+	friend Word256 operator-(Word256 _a, Word256 const& _b) { return _a -= _b; }
+	friend Word256 operator*(Word256 _a, Word256 const& _b) { return _a *= _b; }
+	friend Word256 operator/(Word256 _a, Word256 const& _b) { return _a /= _b; }
+	friend Word256 operator%(Word256 _a, Word256 const& _b) { return _a %= _b; }
+	friend Word256 operator&(Word256 _a, Word256 const& _b) { return _a &= _b; }
+	friend Word256 operator|(Word256 _a, Word256 const& _b) { return _a |= _b; }
+	friend Word256 operator^(Word256 _a, Word256 const& _b) { return _a ^= _b; }
+	friend Word256 operator<<(Word256 _a, unsigned _n) { return _a <<= _n; }
+	friend Word256 operator>>(Word256 _a, unsigned _n) { return _a >>= _n; }
+
+	friend bool operator==(Word256 const& _a, Word256 const& _b)
+	{
+		return ((_a.m_w[0] ^ _b.m_w[0]) | (_a.m_w[1] ^ _b.m_w[1]) | (_a.m_w[2] ^ _b.m_w[2]) | (_a.m_w[3] ^ _b.m_w[3])) == 0;
+	}
+	friend bool operator!=(Word256 const& _a, Word256 const& _b) { return !(_a == _b); }
+	friend bool operator<(Word256 const& _a, Word256 const& _b)
+	{
+		for (unsigned i = 4; i-- > 0;)
+			if (_a.m_w[i] != _b.m_w[i])
+				return _a.m_w[i] < _b.m_w[i];
+		return false;
+	}
+	friend bool operator>(Word256 const& _a, Word256 const& _b) { return _b < _a; }
+	friend bool operator<=(Word256 const& _a, Word256 const& _b) { return !(_b < _a); }
+	friend bool operator>=(Word256 const& _a, Word256 const& _b) { return !(_a < _b); }
+
+	/// Unsigned division with remainder; either output may be null. A zero divisor yields zeros.
+	static void divmod(Word256 const& _a, Word256 const& _b, Word256* o_q, Word256* o_r)
+	{
+		unsigned n = word256::significantLimbs(_b.m_w, 4);
+		unsigned m = word256::significantLimbs(_a.m_w, 4);
+		if (n == 0 || m < n)
+		{
+			Word256 r = n ? _a : Word256();
+			if (o_q)
+				*o_q = Word256();
+			if (o_r)
+				*o_r = r;
+			return;
+		}
+		if (m == 1)
+		{
+			uint64_t a = _a.m_w[0], b = _b.m_w[0];
+			if (o_q)
+				*o_q = Word256(a / b);
+			if (o_r)
+				*o_r = Word256(a % b);
+			return;
+		}
+		Word256 q;
+		Word256 r;
+		word256::divmodLimbs(_a.m_w, m, _b.m_w, n, q.m_w, r.m_w);
+		if (o_q)
+			*o_q = q;
+		if (o_r)
+			*o_r = r;
+	}
+
+	/// _base ^ _exponent mod 2^256.
+	static Word256 exp(Word256 _base, Word256 _exponent)
+	{
+		Word256 ret(1);
+		for (unsigned i = 0, bits = _exponent.byteLength() * 8; i < bits; ++i)
+		{
+			if (_exponent.bit(i))
+				ret *= _base;
+			_base *= _base;
+		}
+		return ret;
+	}
+
+	/// (_a + _b) mod _m without wrapping at 2^256; zero if _m is zero.
+	static Word256 addmod(Word256 const& _a, Word256 const& _b, Word256 const& _m)
+	{
+		unsigned n = word256::significantLimbs(_m.m_w, 4);
+		if (!n)
+			return Word256();
+		uint64_t sum[5];
+		uint64_t carry = 0;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			uint64_t s = _a.m_w[i] + _b.m_w[i];
+			uint64_t c = s < _a.m_w[i];
+			sum[i] = s + carry;
+			carry = c + (sum[i] < carry);
+		}
+		sum[4] = carry;
+		return modLimbs(sum, 5, _m, n);
+	}
+
+	/// (_a * _b) mod _m without wrapping at 2^256; zero if _m is zero.
+	static Word256 mulmod(Word256 const& _a, Word256 const& _b, Word256 const& _m)
+	{
+		unsigned n = word256::significantLimbs(_m.m_w, 4);
+		if (!n)
+			return Word256();
+		uint64_t p[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			uint64_t carry = 0;
+			for (unsigned j = 0; j < 4; ++j)
+			{
+				uint64_t lo;
+				uint64_t hi = word256::mul128(_a.m_w[i], _b.m_w[j], lo);
+				lo += carry;
+				hi += lo < carry;
+				lo += p[i + j];
+				hi += lo < p[i + j];
+				p[i + j] = lo;
+				carry = hi;
+			}
+			p[i + 4] = carry;
+		}
+		return modLimbs(p, 8, _m, n);
+	}
+
+	/// Two's complement signed division, truncating towards zero; zero if _b is zero.
+	static Word256 sdiv(Word256 const& _a, Word256 const& _b)
+	{
+		if (!_b)
+			return Word256();
+		Word256 q = (_a.isNegative() ? -_a : _a) / (_b.isNegative() ? -_b : _b);
+		return _a.isNegative() != _b.isNegative() ? -q : q;
+	}
+
+	/// Two's complement signed remainder, taking the sign of _a; zero if _b is zero.
+	static Word256 smod(Word256 const& _a, Word256 const& _b)
+	{
+		if (!_b)
+			return Word256();
+		Word256 r = (_a.isNegative() ? -_a : _a) % (_b.isNegative() ? -_b : _b);
+		return _a.isNegative() ? -r : r;
+	}
+
+	static bool slt(Word256 const& _a, Word256 const& _b)
+	{
+		return _a.isNegative() != _b.isNegative() ? _a.isNegative() : _a < _b;
+	}
+
+	/// The EVM SIGNEXTEND: extends the sign bit of byte _k (counting from the least significant).
+	static Word256 signextend(Word256 const& _k, Word256 _x)
+	{
+		if (_k < 31)
+		{
+			unsigned testBit = unsigned(_k.m_w[0]) * 8 + 7;
+			Word256 mask = (Word256(1) << testBit) - 1;
+			if (_x.bit(testBit))
+				_x |= ~mask;
+			else
+				_x &= mask;
+		}
+		return _x;
+	}
+
+	/// The EVM BYTE: byte _i of _x counting from the most significant, zero if _i >= 32.
+	static Word256 byteAt(Word256 const& _i, Word256 const& _x)
+	{
+		if (!(_i < 32))
+			return Word256();
+		unsigned pos = 31 - unsigned(_i.m_w[0]);
+		return Word256((_x.m_w[pos / 8] >> (pos % 8 * 8)) & 0xff);
+	}
+
+private:
+	static Word256 modLimbs(uint64_t const* _u, unsigned _m, Word256 const& _v, unsigned _n)
+	{
+		Word256 r;
+		_m = word256::significantLimbs(_u, _m);
+		if (_m < _n)
+		{
+			for (unsigned i = 0; i < _m; ++i)
+				r.m_w[i] = _u[i];
+			return r;
+		}
+		word256::divmodLimbs(_u, _m, _v.m_w, _n, nullptr, r.m_w);
+		return r;
+	}
+
+	uint64_t m_w[4];
+};
+
+using Word256s = std::vector<Word256>;
+
+}
@@ -28,7 +28,9 @@
 #include <rocksdb/write_batch.h>
 namespace ldb = rocksdb;
 #else
+#include <leveldb/cache.h>
 #include <leveldb/db.h>
+#include <leveldb/filter_policy.h>
 #include <leveldb/write_batch.h>
 namespace ldb = leveldb;
 #endif
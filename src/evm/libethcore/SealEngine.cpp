@@ -37,9 +37,14 @@ void Ethash::init()
 	ETH_REGISTER_SEAL_ENGINE(Ethash);
 }
 
+void Ethash::onChainParamsChanged()
+{
+	m_frontierCompatibilityModeLimit = chainParams().u256Param("frontierCompatibilityModeLimit");
+}
+
 EVMSchedule const& Ethash::evmSchedule(EnvInfo const& _envInfo) const
 {
-	if (_envInfo.number() >= chainParams().u256Param("frontierCompatibilityModeLimit"))
+	if (_envInfo.number() >= m_frontierCompatibilityModeLimit)
 		return HomesteadSchedule;
 	else
 		return FrontierSchedule;
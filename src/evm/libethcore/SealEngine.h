@@ -91,7 +91,7 @@ public:
 	// virtual void cancelGeneration() {}
 
 	ChainOperationParams const& chainParams() const { return m_params; }
-	void setChainParams(ChainOperationParams const& _params) { m_params = _params; }
+	void setChainParams(ChainOperationParams const& _params) { m_params = _params; onChainParamsChanged(); }
 	SealEngineFace* withChainParams(ChainOperationParams const& _params) { setChainParams(_params); return this; }
 
 	bool isPrecompiled(Address const& _a) const { return m_params.precompiled.count(_a); }
@@ -99,38 +99,9 @@ public:
 	void executePrecompiled(Address const& _a, bytesConstRef _in, bytesRef _out) const { return m_params.precompiled.at(_a).execute(_in, _out); }
 	virtual EVMSchedule const& evmSchedule(EnvInfo const&) const { return m_params.evmSchedule; }
 
-/////////////////////////////////////////////// // TODO temp dataToTx
-	std::vector<TxDataToGenerate> txData;
-	std::vector<Address> delAddresses;
-	Address qtumAddress;
-	void createQtumAddress(h256 hashTx, unsigned char voutNumber){
-		unsigned char version = 9;
-		UNUSED(version);
-		uint256 hashTXid(h256Touint(hashTx));
-		std::vector<unsigned char> txIdAndVout(hashTXid.begin(), hashTXid.end());
-		txIdAndVout.push_back(voutNumber);
-		
-		std::vector<unsigned char> SHA256TxVout(32);
-		CSHA256().Write(begin_ptr(txIdAndVout), txIdAndVout.size()).Finalize(begin_ptr(SHA256TxVout));
-
-		std::vector<unsigned char> hashTxIdAndVout(20);
-		CRIPEMD160().Write(begin_ptr(SHA256TxVout), SHA256TxVout.size()).Finalize(begin_ptr(hashTxIdAndVout));
-		
-		qtumAddress = h160(hashTxIdAndVout);
-
-		/*hashTxIdAndVout.insert(hashTxIdAndVout.begin(), version);
-
-		vector<unsigned char> checksumTemp(32);
-		vector<unsigned char> checksum(32);
-		CSHA256().Write(begin_ptr(hashTxIdAndVout), hashTxIdAndVout.size()).Finalize(begin_ptr(checksumTemp));
-		CSHA256().Write(begin_ptr(checksumTemp), checksumTemp.size()).Finalize(begin_ptr(checksum));
-
-		hashTxIdAndVout.insert(hashTxIdAndVout.end(), checksum[0]);
-		hashTxIdAndVout.insert(hashTxIdAndVout.end(), checksum[1]);
-		hashTxIdAndVout.insert(hashTxIdAndVout.end(), checksum[2]);
-		hashTxIdAndVout.insert(hashTxIdAndVout.end(), checksum[3]);*/
-	}
-///////////////////////////////////////////////
+protected:
+	/// Called whenever the chain params are replaced; lets engines precompute values derived from them.
+	virtual void onChainParamsChanged() {}
 
 // protected:
 // 	virtual bool onOptionChanging(std::string const&, bytes const&) { return true; }
@@ -232,6 +203,9 @@ public:
 	// static void ensurePrecomputed(unsigned _number);
 	static void init();
 
+protected:
+	void onChainParamsChanged() override;
+
 private:
 	// bool verifySeal(BlockHeader const& _bi) const;
 	// bool quickVerifySeal(BlockHeader const& _bi) const;
@@ -240,6 +214,8 @@ private:
 	// std::string m_sealer = "cpu";
 	// BlockHeader m_sealing;
 	std::function<void(bytes const&)> m_onSealGenerated;
+
+	u256 m_frontierCompatibilityModeLimit;	///< Parsed once from the chain params rather than on every evmSchedule() call.
 };
 
 }
@@ -113,6 +113,10 @@ public:
 	/// @returns true if the account is unchanged from creation.
 	bool isDirty() const { return !m_isUnchanged; }
 
+	/// Take the account as it is for the unchanged starting point, e.g. when copying it out of changes that
+	/// are committed but not yet written to the trie.
+	void untouch() { m_isUnchanged = true; }
+
 
 	/// @returns the balance of this account. Can be altered in place.
 	u256& balance() { return m_balance; }
@@ -155,17 +159,21 @@ public:
 	h256 codeHash() const { assert(!isFreshCode()); return m_codeHash; }
 
 	/// Sets the code of the account. Must only be called when isFreshCode() returns true.
-	void setCode(bytes&& _code) { assert(isFreshCode()); m_codeCache = std::move(_code); changed(); }
+	void setCode(bytes&& _code) { assert(isFreshCode()); m_codeCache = std::make_shared<bytes const>(std::move(_code)); changed(); }
 
 	/// @returns true if the account's code is available through code().
-	bool codeCacheValid() const { return m_codeHash == EmptySHA3 || m_codeHash == c_contractConceptionCodeHash || m_codeCache.size(); }
+	bool codeCacheValid() const { return m_codeHash == EmptySHA3 || m_codeHash == c_contractConceptionCodeHash || (m_codeCache && m_codeCache->size()); }
 
 	/// Specify to the object what the actual code is for the account. @a _code must have a SHA3 equal to
 	/// codeHash() and must only be called when isFreshCode() returns false.
-	void noteCode(bytesConstRef _code) { assert(sha3(_code) == m_codeHash); m_codeCache = _code.toBytes(); }
+	void noteCode(bytesConstRef _code) { assert(sha3(_code) == m_codeHash); m_codeCache = std::make_shared<bytes const>(_code.toBytes()); }
 
 	/// @returns the account's code. Must only be called when codeCacheValid returns true.
-	bytes const& code() const { assert(codeCacheValid()); return m_codeCache; }
+	bytes const& code() const { assert(codeCacheValid()); return m_codeCache ? *m_codeCache : NullBytes; }
+
+	/// @returns the account's code, shared with every copy of the account and null if empty. Must only
+	/// be called when codeCacheValid returns true.
+	std::shared_ptr<bytes const> const& sharedCode() const { assert(codeCacheValid()); return m_codeCache; }
 
 private:
 
@@ -200,8 +208,8 @@ private:
 	std::unordered_map<u256, u256> m_storageOverlay;
 
 	/// The associated code for this account. The SHA3 of this should be equal to m_codeHash unless m_codeHash
-	/// equals c_contractConceptionCodeHash.
-	bytes m_codeCache;
+	/// equals c_contractConceptionCodeHash. Copies of the account share it, it is never changed in place.
+	std::shared_ptr<bytes const> m_codeCache;
 
 	/// Value for m_codeHash when this account is having its code determined.
 	static const h256 c_contractConceptionCodeHash;
@@ -289,20 +289,20 @@ bool Executive::call(CallParameters const& _p, u256 const& _gasPrice, Address co
 		if (m_s.addressHasCode(_p.codeAddress))
 		{
 			m_outRef = _p.out; // Save ref to expected output buffer to be used in go()
-			bytes const& c = m_s.code(_p.codeAddress);
+			shared_ptr<bytes const> c = m_s.sharedCode(_p.codeAddress);
 			h256 codeHash = m_s.codeHash(_p.codeAddress);
-			m_ext = make_shared<QuantumExtVM>(m_s, m_envInfo, m_sealEngine, _p.receiveAddress, _p.senderAddress, _origin, _p.apparentValue, _gasPrice, _p.data, &c, codeHash, m_depth);
+			m_ext = make_shared<QuantumExtVM>(m_s, m_envInfo, m_sealEngine, _p.receiveAddress, _p.senderAddress, _origin, _p.apparentValue, _gasPrice, _p.data, c, codeHash, m_depth);
 		}
 	}
 
 //////////////////////////////////////////////////////////////
 	if(!m_s.addressInUse(_p.receiveAddress))
-		m_sealEngine->delAddresses.push_back(_p.receiveAddress);
+		m_s.delAddresses.push_back(_p.receiveAddress);
 //////////////////////////////////////////////////////////////
 
 	m_s.transferBalance(_p.senderAddress, _p.receiveAddress, _p.valueTransfer);
 
-	m_sealEngine->txData.push_back({_p.senderAddress, _p.receiveAddress, _p.valueTransfer, 0}); // TODO temp dataToTx
+	m_s.txData.push_back({_p.senderAddress, _p.receiveAddress, _p.valueTransfer, 0}); // TODO temp dataToTx
 
 	return !m_ext;
 }
@@ -314,12 +314,12 @@ bool Executive::create(Address _sender, u256 _endowment, u256 _gasPrice, u256 _g
 	// We can allow for the reverted state (i.e. that with which m_ext is constructed) to contain the m_newAddress, since
 	// we delete it explicitly if we decide we need to revert..
 
-	if(m_sealEngine->qtumAddress == Address()){
+	if(m_s.qtumAddress == Address()){
 		m_newAddress = right160(sha3(rlpList(_sender, m_s.transactionsFrom(_sender) - 1)));
 		m_s.addVin(m_newAddress, std::make_pair(COutPoint(uint256(), uint32_t(0)), CAmount(0)));
 	}else{
-		m_newAddress = m_sealEngine->qtumAddress;
-		m_sealEngine->qtumAddress = Address();
+		m_newAddress = m_s.qtumAddress;
+		m_s.qtumAddress = Address();
 	}
 
 	m_gas = _gas;
@@ -328,13 +328,17 @@ bool Executive::create(Address _sender, u256 _endowment, u256 _gasPrice, u256 _g
 	if (!_init.empty())
 		m_ext = make_shared<QuantumExtVM>(m_s, m_envInfo, m_sealEngine, m_newAddress, _sender, _origin, _endowment, _gasPrice, bytesConstRef(), _init, sha3(_init), m_depth);
 
+	m_s.noteChange(m_newAddress);
 	m_s.m_cache[m_newAddress] = Account(m_s.requireAccountStartNonce(), m_s.balance(m_newAddress), Account::ContractConception);
 	m_s.transferBalance(_sender, m_newAddress, _endowment);
 
-	m_sealEngine->txData.push_back({_sender, m_newAddress, _endowment, 0}); // TODO temp dataToTx
+	m_s.txData.push_back({_sender, m_newAddress, _endowment, 0}); // TODO temp dataToTx
 
 	if (_init.empty())
+	{
+		m_s.noteChange(m_newAddress);
 		m_s.m_cache[m_newAddress].setCode({});
+	}
 
 	return !m_ext;
 }
@@ -397,6 +401,7 @@ bool Executive::go(OnOpFunc const& _onOp)
 				}
 				if (m_res)
 					m_res->output = out; // copy output to execution result
+				m_s.noteChange(m_newAddress);
 				m_s.m_cache[m_newAddress].setCode(std::move(out)); // FIXME: Set only if Success?
 			}
 			else
@@ -472,7 +477,10 @@ void Executive::finalize()
 	// Suicides...
 	if (m_ext)
 		for (auto a: m_ext->sub.suicides)
+		{
+			m_s.noteChange(a);
 			m_s.m_cache[a].kill();
+		}
 
 	// Logs..
 	if (m_ext)
@@ -30,6 +30,7 @@
 #include <libevmcore/Instruction.h> //+
 #include <libethcore/Exceptions.h> //+
 #include <libevm/VMFactory.h> //+
+#include <libevm/VMProfiler.h>
 // #include "BlockChain.h"
 #include "Defaults.h" //+
 // #include "QuantumExtVM.h" // ExtVM
@@ -70,12 +71,20 @@ State::State(State const& _s):
 	m_db(_s.m_db),
 	m_state(&m_db, _s.m_state.root(), Verification::Skip),
 	m_cache(_s.m_cache),
+	m_pending(_s.m_pending),
+	m_pendingJournal(_s.m_pendingJournal),
 	m_touched(_s.m_touched),
 	m_accountStartNonce(_s.m_accountStartNonce)
 {
 	paranoia("after state cloning (copy cons).", true);
 }
 
+namespace
+{
+/// See State::setDBCacheSize.
+size_t g_dbCacheSize = 0;
+}
+
 OverlayDB State::openDB(std::string const& _basePath, h256 const& _genesisHash, WithExisting _we)
 {
 	std::string path = _basePath.empty() ? Defaults::get()->m_dbPath : _basePath;
@@ -93,10 +102,23 @@ OverlayDB State::openDB(std::string const& _basePath, h256 const& _genesisHash,
 	ldb::Options o;
 	o.max_open_files = 256;
 	o.create_if_missing = true;
+	size_t nodeCacheSize = g_dbCacheSize;
+#if !ETH_ROCKSDB
+	// Half of the budget keeps uncompressed table blocks, the rest trie nodes above them. The bloom
+	// filter lets a lookup of a node that is not on disk skip the table reads altogether.
+	static ldb::FilterPolicy const* const s_bloomFilter = ldb::NewBloomFilterPolicy(10);
+	o.filter_policy = s_bloomFilter;
+	ldb::Cache* blockCache = g_dbCacheSize ? ldb::NewLRUCache(g_dbCacheSize / 2) : nullptr;
+	o.block_cache = blockCache;
+	nodeCacheSize -= g_dbCacheSize / 2;
+#endif
 	ldb::DB* db = nullptr;
 	ldb::Status status = ldb::DB::Open(o, path + "/state", &db);
 	if (!status.ok() || !db)
 	{
+#if !ETH_ROCKSDB
+		delete blockCache;
+#endif
 		if (boost::filesystem::space(path + "/state").available < 1024)
 		{
 			cwarn << "Not enough available space found on hard drive. Please free some up and then re-run. Bailing.";
@@ -115,7 +137,17 @@ OverlayDB State::openDB(std::string const& _basePath, h256 const& _genesisHash,
 
 	LogPrintfVM("Opened state DB.\n"); // TODO temp qtumLog
 	// ctrace << "Opened state DB.";
-	return OverlayDB(db);
+#if !ETH_ROCKSDB
+	// the block cache must outlive the DB
+	return OverlayDB(shared_ptr<ldb::DB>(db, [blockCache](ldb::DB* _db) { delete _db; delete blockCache; }), nodeCacheSize);
+#else
+	return OverlayDB(shared_ptr<ldb::DB>(db), nodeCacheSize);
+#endif
+}
+
+void State::setDBCacheSize(size_t _bytes)
+{
+	g_dbCacheSize = _bytes;
 }
 
 void State::populateFrom(AccountMap const& _map)
@@ -163,6 +195,8 @@ State& State::operator=(State const& _s)
 	m_db = _s.m_db;
 	m_state.open(&m_db, _s.m_state.root(), Verification::Skip);
 	m_cache = _s.m_cache;
+	m_pending = _s.m_pending;
+	m_pendingJournal = _s.m_pendingJournal;
 	m_touched = _s.m_touched;
 	m_accountStartNonce = _s.m_accountStartNonce;
 	paranoia("after state cloning (assignment op)", true);
@@ -177,8 +211,8 @@ StateDiff State::diff(State const& _c, bool _quick) const
 	std::unordered_set<Address> trieAds;
 	std::unordered_set<Address> trieAdsD;
 
-	auto trie = SecureTrieDB<Address, OverlayDB>(const_cast<OverlayDB*>(&m_db), rootHash());
-	auto trieD = SecureTrieDB<Address, OverlayDB>(const_cast<OverlayDB*>(&_c.m_db), _c.rootHash());
+	auto trie = SecureTrieDB<Address, OverlayDB>(const_cast<OverlayDB*>(&m_db), m_state.root());
+	auto trieD = SecureTrieDB<Address, OverlayDB>(const_cast<OverlayDB*>(&_c.m_db), _c.m_state.root());
 
 	if (_quick)
 	{
@@ -221,19 +255,33 @@ void State::ensureCached(Address const& _a, bool _requireCode, bool _forceCreate
 
 void State::ensureCached(std::unordered_map<Address, Account>& _cache, const Address& _a, bool _requireCode, bool _forceCreate) const
 {
+	if (m_recordAccess)
+		m_accessed.insert(_a);
 	auto it = _cache.find(_a);
 	if (it == _cache.end())
 	{
-		// populate basic info.
-		string stateBack = m_state.at(_a);
-		if (stateBack.empty() && !_forceCreate)
-			return;
-		RLP state(stateBack);
 		Account s;
-		if (state.isNull())
-			s = Account(requireAccountStartNonce(), 0, Account::NormalCreation);
+		auto pit = m_pending.find(_a);
+		if (pit != m_pending.end() && pit->second.isAlive())
+		{
+			// committed, but not in the trie yet.
+			s = pit->second;
+			s.untouch();
+		}
 		else
-			s = Account(state[0].toInt<u256>(), state[1].toInt<u256>(), state[2].toHash<h256>(), state[3].toHash<h256>(), Account::Unchanged);
+		{
+			// populate basic info.
+			string stateBack = pit != m_pending.end() ? string() : m_state.at(_a);
+			if (stateBack.empty() && !_forceCreate)
+				return;
+			RLP state(stateBack);
+			if (state.isNull())
+				s = Account(requireAccountStartNonce(), 0, Account::NormalCreation);
+			else
+				s = Account(state[0].toInt<u256>(), state[1].toInt<u256>(), state[2].toHash<h256>(), state[3].toHash<h256>(), Account::Unchanged);
+		}
+		if (&_cache == &m_cache && s.isDirty())
+			noteChange(_a);
 		bool ok;
 		tie(it, ok) = _cache.insert(make_pair(_a, s));
 	}
@@ -243,10 +291,94 @@ void State::ensureCached(std::unordered_map<Address, Account>& _cache, const Add
 
 void State::commit()
 {
-	m_touched += dev::eth::commit(m_cache, m_state);
+	for (auto& i: m_cache)
+		if (i.second.isDirty())
+		{
+			auto it = m_pending.find(i.first);
+			if (it == m_pending.end())
+			{
+				m_pendingJournal.push_back(make_pair(i.first, shared_ptr<Account>()));
+				m_pending.insert(make_pair(i.first, move(i.second)));
+			}
+			else
+			{
+				m_pendingJournal.push_back(make_pair(i.first, make_shared<Account>(move(it->second))));
+				it->second = move(i.second);
+			}
+			m_touched.insert(i.first);
+			if (m_recordAccess)
+				m_written.insert(i.first);
+		}
 	m_cache.clear();
 }
 
+h256 State::rootHash()
+{
+	if (!m_pending.empty())
+	{
+		dev::eth::commit(m_pending, m_state);
+		m_pending.clear();
+		m_pendingJournal.clear();
+	}
+	return m_state.root();
+}
+
+void State::rollback(size_t _savepoint)
+{
+	assert(_savepoint <= m_pendingJournal.size());
+	while (m_pendingJournal.size() > _savepoint)
+	{
+		auto const& change = m_pendingJournal.back();
+		if (change.second)
+			m_pending[change.first] = *change.second;	// copies of the state may share the journal
+		else
+			m_pending.erase(change.first);
+		m_pendingJournal.pop_back();
+	}
+	m_cache.clear();
+}
+
+void State::revertFrame()
+{
+	assert(!m_frames.empty());
+	while (m_frameJournal.size() > m_frames.back())
+	{
+		FrameChange& change = m_frameJournal.back();
+		if (change.account)
+			m_cache[change.address] = move(*change.account);
+		else
+			m_cache.erase(change.address);
+		if (change.previous)
+			m_frameChanged[change.address] = change.previous;
+		else
+			m_frameChanged.erase(change.address);
+		m_frameJournal.pop_back();
+	}
+}
+
+void State::endFrame()
+{
+	assert(!m_frames.empty());
+	m_frames.pop_back();
+	if (m_frames.empty())
+	{
+		m_frameJournal.clear();
+		m_frameChanged.clear();
+	}
+}
+
+void State::noteChange(Address const& _a) const
+{
+	if (m_frames.empty())
+		return;
+	size_t& latest = m_frameChanged[_a];
+	if (latest > m_frames.back())
+		return;
+	auto it = m_cache.find(_a);
+	m_frameJournal.push_back(FrameChange{_a, it == m_cache.end() ? nullptr : make_shared<Account>(it->second), latest});
+	latest = m_frameJournal.size();
+}
+
 unordered_map<Address, u256> State::addresses() const
 {
 #if ETH_FATDB
@@ -254,8 +386,11 @@ unordered_map<Address, u256> State::addresses() const
 	for (auto i: m_cache)
 		if (i.second.isAlive())
 			ret[i.first] = i.second.balance();
+	for (auto const& i: m_pending)
+		if (i.second.isAlive() && m_cache.find(i.first) == m_cache.end())
+			ret[i.first] = i.second.balance();
 	for (auto const& i: m_state)
-		if (m_cache.find(i.first) == m_cache.end())
+		if (m_cache.find(i.first) == m_cache.end() && m_pending.find(i.first) == m_pending.end())
 			ret[i.first] = RLP(i.second)[1].toInt<u256>();
 	return ret;
 #else
@@ -263,9 +398,29 @@ unordered_map<Address, u256> State::addresses() const
 #endif
 }
 
+h256 State::forEachAccount(h256 const& _from, std::function<bool(Address const&, RLP const&)> const& _f) const
+{
+#if ETH_FATDB
+	// The trie is keyed by the hashes, so the iterator is seeked with one and yields the address it was made of.
+	for (SecureTrieDB<Address, OverlayDB>::iterator it(&m_state, _from.ref()); it != m_state.end(); ++it)
+	{
+		auto account = it.at();
+		if (!_f(account.first, RLP(account.second)))
+			return sha3(account.first);
+	}
+	return h256();
+#else
+	(void)_from;
+	(void)_f;
+	BOOST_THROW_EXCEPTION(InterfaceNotSupported("State::forEachAccount()"));
+#endif
+}
+
 void State::setRoot(h256 const& _r)
 {
 	m_cache.clear();
+	m_pending.clear();
+	m_pendingJournal.clear();
 	// m_touched.clear();
 	m_state.setRoot(_r);
 	paranoia("begin setRoot", true);
@@ -301,6 +456,7 @@ u256 State::balance(Address const& _id) const
 void State::noteSending(Address const& _id)
 {
 	ensureCached(_id, false, false);
+	noteChange(_id);
 	auto it = m_cache.find(_id);
 	if (asserts(it != m_cache.end()))
 	{
@@ -315,6 +471,7 @@ void State::noteSending(Address const& _id)
 void State::addBalance(Address const& _id, u256 const& _amount)
 {
 	ensureCached(_id, false, false);
+	noteChange(_id);
 	auto it = m_cache.find(_id);
 	if (it == m_cache.end())
 		m_cache[_id] = Account(requireAccountStartNonce(), _amount, Account::NormalCreation);
@@ -328,8 +485,8 @@ void State::subBalance(Address const& _id, bigint const& _amount)
 	auto it = m_cache.find(_id);
 	if (it == m_cache.end() || (bigint)it->second.balance() < _amount)
 		BOOST_THROW_EXCEPTION(NotEnoughCash());
-	else
-		it->second.addBalance(-_amount);
+	noteChange(_id);
+	it->second.addBalance(-_amount);
 }
 
 Address State::newContract(u256 const& _balance, bytes const& _code)
@@ -343,6 +500,7 @@ Address State::newContract(u256 const& _balance, bytes const& _code)
 		auto it = m_cache.find(ret);
 		if (it == m_cache.end())
 		{
+			noteChange(ret);
 			m_cache[ret] = Account(requireAccountStartNonce(), _balance, EmptyTrie, h, Account::Changed);
 			return ret;
 		}
@@ -374,9 +532,11 @@ u256 State::storage(Address const& _id, u256 const& _memory) const
 		return mit->second;
 
 	// Not in the storage cache - go to the DB.
+	VMProfiler::noteTrieMiss();
 	SecureTrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&m_db), it->second.baseRoot());			// promise we won't change the overlay! :)
 	string payload = memdb.at(_memory);
 	u256 ret = payload.size() ? RLP(payload).toInt<u256>() : 0;
+	noteChange(_id);
 	it->second.setStorage(_memory, ret);
 	return ret;
 }
@@ -407,6 +567,28 @@ unordered_map<u256, u256> State::storage(Address const& _id) const
 	return ret;
 }
 
+h256 State::forEachStorage(Address const& _contract, h256 const& _from, std::function<bool(u256 const&, u256 const&)> const& _f) const
+{
+#if ETH_FATDB
+	h256 root = storageRoot(_contract);
+	if (root == EmptyTrie)
+		return h256();
+	SecureTrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&m_db), root);		// promise we won't alter the overlay! :)
+	for (SecureTrieDB<h256, OverlayDB>::iterator it(&memdb, _from.ref()); it != memdb.end(); ++it)
+	{
+		auto entry = it.at();
+		if (!_f(u256(entry.first), RLP(entry.second).toInt<u256>()))
+			return sha3(entry.first);
+	}
+	return h256();
+#else
+	(void)_contract;
+	(void)_from;
+	(void)_f;
+	BOOST_THROW_EXCEPTION(InterfaceNotSupported("State::forEachStorage()"));
+#endif
+}
+
 h256 State::storageRoot(Address const& _id) const
 {
 	string s = m_state.at(_id);
@@ -426,6 +608,14 @@ bytes const& State::code(Address const& _contract) const
 	return m_cache[_contract].code();
 }
 
+shared_ptr<bytes const> State::sharedCode(Address const& _contract) const
+{
+	if (!addressHasCode(_contract))
+		return nullptr;
+	ensureCached(_contract, true, false);
+	return m_cache[_contract].sharedCode();
+}
+
 h256 State::codeHash(Address const& _contract) const
 {
 	if (!addressHasCode(_contract))
@@ -470,6 +660,20 @@ bool State::isTrieGood(bool _enforceRefs, bool _requireNoLeftOvers) const
 	return true;
 }
 
+void State::createQtumAddress(h256 hashTx, unsigned char voutNumber){
+	uint256 hashTXid(h256Touint(hashTx));
+	std::vector<unsigned char> txIdAndVout(hashTXid.begin(), hashTXid.end());
+	txIdAndVout.push_back(voutNumber);
+
+	std::vector<unsigned char> SHA256TxVout(32);
+	CSHA256().Write(begin_ptr(txIdAndVout), txIdAndVout.size()).Finalize(begin_ptr(SHA256TxVout));
+
+	std::vector<unsigned char> hashTxIdAndVout(20);
+	CRIPEMD160().Write(begin_ptr(SHA256TxVout), SHA256TxVout.size()).Finalize(begin_ptr(hashTxIdAndVout));
+
+	qtumAddress = h160(hashTxIdAndVout);
+}
+
 std::pair<ExecutionResult, TransactionReceipt> State::execute(EnvInfo const& _envInfo, SealEngineFace* _sealEngine, Transaction const& _t, Permanence _p, OnOpFunc const& _onOp)
 {
 	auto onOp = _onOp;
@@ -491,7 +695,7 @@ std::pair<ExecutionResult, TransactionReceipt> State::execute(EnvInfo const& _en
 
 	if (_p == Permanence::Reverted)
 		m_cache.clear();
-	else
+	else if (_p == Permanence::Committed)
 	{
 		commit();
 		// TODO: CHECK TRIE after level DB flush to make sure exactly the same.
@@ -503,10 +707,10 @@ std::pair<ExecutionResult, TransactionReceipt> State::execute(EnvInfo const& _en
 
 std::ostream& dev::eth::operator<<(std::ostream& _out, State const& _s)
 {
-	_out << "--- " << _s.rootHash() << std::endl;
+	_out << "--- " << _s.m_state.root() << std::endl;
 	std::set<Address> d;
 	std::set<Address> dtr;
-	auto trie = SecureTrieDB<Address, OverlayDB>(const_cast<OverlayDB*>(&_s.m_db), _s.rootHash());
+	auto trie = SecureTrieDB<Address, OverlayDB>(const_cast<OverlayDB*>(&_s.m_db), _s.m_state.root());
 	for (auto i: trie)
 		d.insert(i.first), dtr.insert(i.first);
 	for (auto i: _s.m_cache)
@@ -620,37 +824,58 @@ void QtumState::ensureCachedUTXO(Address const& _a){
 	ensureCachedUTXO(m_cache_utxo, _a);
 }
 
-void QtumState::ensureCachedUTXO(std::unordered_map<Address, VinsInfo>& _cache, const Address& _a){
+void QtumState::ensureCachedUTXO(std::unordered_map<Address, ContractVins>& _cache, const Address& _a){
+	if (m_recordAccess)
+		m_accessed.insert(_a);
 	auto it = _cache.find(_a);
 	if (it == _cache.end())
 	{
+		auto pit = m_pending_utxo.find(_a);
+		if (pit != m_pending_utxo.end())
+		{
+			// committed, but not in the trie yet.
+			if (pit->second)
+				_cache.insert(make_pair(_a, *pit->second));
+			return;
+		}
 		// populate basic info.
 		string stateBack = m_state_utxo.at(_a);
 		if (stateBack.empty())
 			return;
 		RLP state(stateBack);
-		VinsInfo s;
-		if (state.isNull())
-			s = VinsInfo();
-		else
-			s = VinsInfoDeserialize(state[0].toVector<std::pair<std::pair<u256, bigint>, u256>>());
+		ContractVins s;
+		if (!state.isNull())
+			s = ContractVins(state[0]);
 		bool ok;
-		tie(it, ok) = _cache.insert(make_pair(_a, s));
+		tie(it, ok) = _cache.insert(make_pair(_a, move(s)));
 	}
 }
 
-VinsInfoSerial QtumState::VinsInfoSerialization(VinsInfo vins){
-	VinsInfoSerial res;
-	for(size_t i = 0; i < vins.size(); i++){
-		res.push_back(std::make_pair(std::make_pair(u256(uintToh256(vins[i].first.hash)), vins[i].first.n), vins[i].second));
+ContractVins::ContractVins(RLP const& _r){
+	if (!_r.isList())
+		return;
+	for (auto const& i: _r){
+		auto vin = i.toPair<std::pair<u256, bigint>, u256>(RLP::LaissezFaire);
+		m_vins.push_back(std::make_pair(COutPoint(h256Touint(h256(vin.first.first)), uint32_t(vin.first.second)), CAmount(vin.second)));
+	}
+}
+
+void ContractVins::streamRLP(RLPStream& _s) const{
+	_s.appendList(m_vins.size());
+	for (auto const& i: m_vins){
+		_s.appendList(2);
+		_s.appendList(2) << u256(uintToh256(i.first.hash)) << bigint(i.first.n);
+		_s << u256(i.second);
 	}
-	return res;
 }
 
-VinsInfo QtumState::VinsInfoDeserialize(VinsInfoSerial vins){
+VinsInfo ContractVins::select(CAmount const& _value, CAmount& io_sum) const{
 	VinsInfo res;
-	for(size_t i = 0; i < vins.size(); i++){
-		res.push_back(std::make_pair(COutPoint(h256Touint(h256(vins[i].first.first)), uint32_t(vins[i].first.second)), CAmount(vins[i].second)));
+	for (auto it = m_vins.begin() + (m_vins.empty() ? 0 : 1); it != m_vins.end(); ++it){
+		io_sum += it->second;
+		res.push_back(*it);
+		if (_value <= io_sum)
+			break;
 	}
 	return res;
 }
@@ -666,33 +891,64 @@ VinsInfo QtumState::VinsInfoDeserialize(VinsInfoSerial vins){
 // 	}
 // }
 
-void QtumState::sortOutPoints(VinsInfo& vins){
+QtumState::QtumState(QtumState const& _s):
+	State(_s),
+	m_db_utxo(_s.m_db_utxo),
+	m_state_utxo(&m_db_utxo, _s.m_state_utxo.root(), Verification::Skip),
+	m_cache_utxo(_s.m_cache_utxo),
+	m_pending_utxo(_s.m_pending_utxo),
+	m_pendingJournal_utxo(_s.m_pendingJournal_utxo)
+{
+}
 
-		std::pair<COutPoint, CAmount> tempOutPoint;
+QtumState::QtumState(QtumState const& _s, h256 const& _root, h256 const& _rootUTXO):
+	State(_s.m_accountStartNonce, _s.m_db, BaseState::PreExisting),
+	m_db_utxo(_s.m_db_utxo),
+	m_state_utxo(&m_db_utxo, _rootUTXO)
+{
+	setRoot(_root);
+}
 
-		for(unsigned int i = 0; i < vins.size(); i++){
-			for(unsigned int j = i + 1; j < vins.size(); j++){
-						
-				if(vins[i].second < vins[j].second){
-					tempOutPoint = vins[j];
-					vins[j] = vins[i];
-					vins[i] = tempOutPoint;
-				}
+QtumState QtumState::snapshot(h256 const& _root, h256 const& _rootUTXO) const{
+	return QtumState(*this, _root, _rootUTXO);
+}
 
-				if(vins[i].second == vins[j].second){
+AddressHash QtumStateChanges::written() const{
+	AddressHash ret;
+	for (auto const& i: accounts)
+		if (i.second.isDirty())
+			ret.insert(i.first);
+	// commitUTXO() rewrites every cached vins entry, dirty or not.
+	for (auto const& i: vins)
+		ret.insert(i.first);
+	return ret;
+}
 
-					dev::u256 hashAndVoutI(dev::u256(uintToh256(vins[i].first.hash)) + dev::u256(vins[i].first.n));
-					dev::u256 hashAndVoutJ(dev::u256(uintToh256(vins[j].first.hash)) + dev::u256(vins[j].first.n));
+QtumStateChanges QtumState::takeChanges(){
+	QtumStateChanges ret;
+	ret.accounts.swap(m_cache);
+	ret.vins.swap(m_cache_utxo);
+	ret.accessed.swap(m_accessed);
+	return ret;
+}
 
-					if(hashAndVoutI < hashAndVoutJ){
-						tempOutPoint = vins[j];
-						vins[j] = vins[i];
-						vins[i] = tempOutPoint;
-					}
-				}
-			}
-		}
-	}
+void QtumState::applyChanges(QtumStateChanges const& _changes){
+	for (auto const& i: _changes.accounts)
+		m_cache[i.first] = i.second;
+	for (auto const& i: _changes.vins)
+		m_cache_utxo[i.first] = i.second;
+	QtumState::commit();
+	dbUTXO().commit();
+}
+
+AddressHash QtumState::cachedAddresses() const{
+	AddressHash ret;
+	for (auto const& i: m_cache)
+		ret.insert(i.first);
+	for (auto const& i: m_cache_utxo)
+		ret.insert(i.first);
+	return ret;
+}
 
 void QtumState::initUTXODB(std::string const& _path, h256 const& _genesisHash, WithExisting _we){
 	m_db_utxo = State::openDB(_path + "/qtumDB", _genesisHash, _we);
@@ -700,13 +956,16 @@ void QtumState::initUTXODB(std::string const& _path, h256 const& _genesisHash, W
 }
 
 ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace* _sealEngine, QtumTransaction const& _t, Permanence _p, OnOpFunc const& _onOp){ // TODO temp QtumTransaction
+	// The receipts carry no intermediate state root, which is only worked out once per block by rootHash().
 	if(processingVersionNullAndOne(_sealEngine, _t, _p))
- 		return ResultExecute{ExecutionResult(), TransactionReceipt(rootHash(), u256(), LogEntries()), std::vector<CTransaction>()};
+ 		return ResultExecute{ExecutionResult(), TransactionReceipt(h256(), u256(), LogEntries()), std::vector<CTransaction>()};
 	
 	auto onOp = _onOp;
 	std::vector<CTransaction> transactions;
+	txData.clear();
+	qtumAddress = Address();
+	delAddresses = {_t.sender(), _envInfo.author()};
 	addBalance(_t.sender(), (_t.gas() * _t.gasPrice()) + _t.endowment()); // TODO temp dataToTx
-	_sealEngine->delAddresses.insert(_sealEngine->delAddresses.end(), {_t.sender(), _envInfo.author()});
 
 	// Create and initialize the executive. This will throw fairly cheaply and quickly if the
 	// transaction is bad in any way.
@@ -721,8 +980,8 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace* _sealE
     }
 
 	if(_t.isCreation()){ // TODO temp dataToTx
-		_sealEngine->createQtumAddress(_t.getHashWith(), _t.getVoutNumber());
-		addVin(_sealEngine->qtumAddress, std::make_pair(COutPoint(h256Touint(_t.getHashWith()), uint32_t(_t.getVoutNumber())), CAmount(0)));
+		createQtumAddress(_t.getHashWith(), _t.getVoutNumber());
+		addVin(qtumAddress, std::make_pair(COutPoint(h256Touint(_t.getHashWith()), uint32_t(_t.getVoutNumber())), CAmount(0)));
 	}
 
 	// OK - transaction looks valid - execute.
@@ -731,53 +990,99 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace* _sealE
 		e.go(onOp);
 	e.finalize();
 
-	for(Address addr : _sealEngine->delAddresses){
+	for(Address addr : delAddresses){
 		m_cache.erase(addr);
 		m_cache_utxo.erase(addr);
 	}
 
 	if(res.excepted != TransactionException::None){
 		LogPrintfVM("VMException: %s\n", res.excepted);
-		return exceptionHandling(_t, _envInfo);
+		// Keep what went wrong for the callers that report it
+		ResultExecute ret = exceptionHandling(_t, _envInfo);
+		ret.execRes.excepted = res.excepted;
+		ret.execRes.gasUsed = res.gasUsed;
+		return ret;
 	}
 	
-	for(size_t i = 0; i < _sealEngine->txData.size(); i++){
-		if(_sealEngine->txData[i].value > 0 && !(_t.getVersion() == 1 && _t.value() > 0 && i == 0)){
-			transactions.push_back(TxGeneration(_sealEngine->txData[i], _envInfo, _t.sender()));
-			savedVinToAccount(transactions.back(), _sealEngine->txData[i]);
+	for(size_t i = 0; i < txData.size(); i++){
+		if(txData[i].value > 0 && !(_t.getVersion() == 1 && _t.value() > 0 && i == 0)){
+			transactions.push_back(TxGeneration(txData[i], _envInfo, _t.sender()));
+			savedVinToAccount(transactions.back(), txData[i]);
 		}
 	}
 
 	if (_p == Permanence::Reverted){
 		m_cache.clear();
 		m_cache_utxo.clear();
-	} else {
+	} else if (_p == Permanence::Committed){
 		QtumState::commit();
 		dbUTXO().commit();
 	}
 
 	res.gasRefunded = e.gas();
 	std::cout << "New account address: " << e.newAddress().hex() << std::endl << "Balance: " << balance(e.newAddress()) << std::endl << std::endl;
-	return ResultExecute{res, TransactionReceipt(rootHash(), startGasUsed + e.gasUsed(), e.logs()), transactions};
+	return ResultExecute{res, TransactionReceipt(h256(), startGasUsed + e.gasUsed(), e.logs()), transactions};
 }
 
 AddressHash QtumState::commitUTXO(){
 	AddressHash ret;
-	for (auto const& i: m_cache_utxo){
-		if (!addressInUse(i.first))
-			m_state_utxo.remove(i.first);
-		else {
-			RLPStream s(1);
-			s.append(VinsInfoSerialization(i.second));
-
-			m_state_utxo.insert(i.first, &s.out());
+	for (auto& i: m_cache_utxo){
+		shared_ptr<ContractVins const> vins;
+		if (addressInUse(i.first))
+			vins = make_shared<ContractVins>(move(i.second));
+		auto it = m_pending_utxo.find(i.first);
+		if (it == m_pending_utxo.end()) {
+			m_pendingJournal_utxo.push_back(PendingVinsChange{i.first, false, nullptr});
+			m_pending_utxo.insert(make_pair(i.first, move(vins)));
+		} else {
+			m_pendingJournal_utxo.push_back(PendingVinsChange{i.first, true, move(it->second)});
+			it->second = move(vins);
 		}
 		ret.insert(i.first);
+		if (m_recordAccess)
+			m_written.insert(i.first);
 	}
 	m_cache_utxo.clear();
 	return ret;
 }
 
+h256 QtumState::rootHashUTXO(){
+	std::vector<bytesConstRef> keys;
+	keys.reserve(m_pending_utxo.size());
+	for (auto const& i: m_pending_utxo)
+		keys.push_back(i.first.ref());
+	std::vector<h256> hashes(keys.size());
+	sha3Batch(keys.data(), hashes.data(), keys.size());
+	h256 const* hash = hashes.data();
+	for (auto const& i: m_pending_utxo){
+		if (!i.second)
+			m_state_utxo.removeHashed(*hash);
+		else {
+			RLPStream s(1);
+			i.second->streamRLP(s);
+			m_state_utxo.insertHashed(i.first, *hash, &s.out());
+		}
+		++hash;
+	}
+	m_pending_utxo.clear();
+	m_pendingJournal_utxo.clear();
+	return m_state_utxo.root();
+}
+
+void QtumState::rollback(Checkpoint const& _checkpoint){
+	State::rollback(_checkpoint.accounts);
+	assert(_checkpoint.vins <= m_pendingJournal_utxo.size());
+	while (m_pendingJournal_utxo.size() > _checkpoint.vins){
+		auto const& change = m_pendingJournal_utxo.back();
+		if (change.pending)
+			m_pending_utxo[change.address] = change.vins;
+		else
+			m_pending_utxo.erase(change.address);
+		m_pendingJournal_utxo.pop_back();
+	}
+	m_cache_utxo.clear();
+}
+
 bool QtumState::processingVersionNullAndOne(SealEngineFace* _sealEngine, QtumTransaction const& _t, Permanence _p){ // TODO temp QtumTransaction
 	if(_t.getVersion() == 0){
 		addVin(_t.receiveAddress(), std::make_pair(COutPoint(h256Touint(_t.getHashWith()), _t.getVoutNumber()), CAmount(_t.value())));
@@ -786,7 +1091,7 @@ bool QtumState::processingVersionNullAndOne(SealEngineFace* _sealEngine, QtumTra
  			commit();
  			dbUTXO().commit();
  			db().commit();
- 		} else {
+ 		} else if (_p == Permanence::Reverted) {
  			m_cache.clear();
  			m_cache_utxo.clear();
  		}
@@ -811,11 +1116,13 @@ ResultExecute QtumState::exceptionHandling(QtumTransaction const& _t, EnvInfo co
     }
 	ExecutionResult res;
 	res.gasRefunded = 0;
-	return ResultExecute{res, TransactionReceipt(rootHash(), _t.gas(), LogEntries()), transactions};
+	return ResultExecute{res, TransactionReceipt(h256(), _t.gas(), LogEntries()), transactions};
 }
 
 void QtumState::setRootUTXO(h256 const& _r){
 	m_cache_utxo.clear();
+	m_pending_utxo.clear();
+	m_pendingJournal_utxo.clear();
 	// m_touched.clear();
 	m_state_utxo.setRoot(_r);
 	paranoia("begin setRootUTXO", true);
@@ -834,16 +1141,14 @@ VinsInfo QtumState::getVins(Address const& _id){
 	auto it = m_cache_utxo.find(_id);
 	if (it == m_cache_utxo.end())
 		return VinsInfo();
-	return it->second;
+	return it->second.toVector();
 }
 
-void QtumState::setVins(Address const& _id, VinsInfo _amount){
+void QtumState::setVins(Address const& _id, VinsInfo const& _amount){
 	ensureCachedUTXO(_id);
-	auto it = m_cache_utxo.find(_id);
-	if (it == m_cache_utxo.end())
-		m_cache_utxo[_id] = _amount;
-	else
-		it->second = _amount;
+	ContractVins vins;
+	vins.append(_amount);
+	m_cache_utxo[_id] = move(vins);
 }
 
 void QtumState::addVin(Address const& _id, vinInfo _amount){
@@ -856,14 +1161,9 @@ void QtumState::addVin(Address const& _id, vinInfo _amount){
 	}
 }
 
-void QtumState::addVins(Address const& _id, VinsInfo _amount){
+void QtumState::addVins(Address const& _id, VinsInfo const& _amount){
 	ensureCachedUTXO(_id);
-	auto it = m_cache_utxo.find(_id);
-	if (it == m_cache_utxo.end()){
-		m_cache_utxo[_id] = _amount;
-	} else {
-		it->second.insert(it->second.end(), _amount.begin(), _amount.end());
-	}
+	m_cache_utxo[_id].append(_amount);
 }
 
 void QtumState::subVins(Address const& _id, size_t _amount){
@@ -872,8 +1172,7 @@ void QtumState::subVins(Address const& _id, size_t _amount){
 	if (it == m_cache_utxo.end() || (bigint)it->second.size() < _amount)
 		BOOST_THROW_EXCEPTION(NotEnoughCash());
 	else
-		for(size_t i = 0; i < _amount; i++)
-			it->second.erase(it->second.begin() + 1);
+		it->second.spend(_amount);
 }
 
 bool QtumState::vinsInUse(Address const& _id){
@@ -884,19 +1183,7 @@ bool QtumState::vinsInUse(Address const& _id){
 	return true;
 }
 
-VinsInfo QtumState::SelectOutputs(VinsInfo& vins, dev::Address const& _from, CAmount const& _value, CAmount& sum){
-    VinsInfo res;
-	for(unsigned int i = 1; i < vins.size(); i++){
-        sum += vins[i].second;
-        res.push_back(vins[i]);
-        if(_value <= sum){
-            break;
-        }
-    }
-    return res;
-}
-
-vector<CTxIn> QtumState::CreateInputs(VinsInfo outs){
+vector<CTxIn> QtumState::CreateInputs(VinsInfo const& outs){
 
     vector<CTxIn> res;
     for(size_t i = 0; i < outs.size(); i++){
@@ -921,21 +1208,19 @@ vector<CTxOut> QtumState::CreateOutputs(dev::Address const& _from, dev::Address
     return res;
 }
 
-void QtumState::RemoveVout(VinsInfo& outs, dev::Address const& _from, size_t size){
-    for(size_t i = 0; i < size; i++){
-		outs.erase(outs.begin() + 1);
-    }
-}
-
 CTransaction QtumState::TxGeneration(TxDataToGenerate& txData, EnvInfo const& _envInfo, Address sender){
 	CTransaction transactionUTXO;
 
-    VinsInfo vinsReceiver(getVins(txData.receiver));
-    VinsInfo vinsSender(getVins(txData.sender));
+    // The receiver's vins are loaded too, so commitUTXO() writes them back as it always has.
+    ensureCachedUTXO(txData.receiver);
+    ensureCachedUTXO(txData.sender);
 
     CMutableTransaction res;
     CAmount sum = 0;
-    vector<CTxIn> vinIn = CreateInputs(SelectOutputs(vinsSender ,txData.sender, CAmount(txData.value), sum));
+    vector<CTxIn> vinIn;
+    auto itSender = m_cache_utxo.find(txData.sender);
+    if (itSender != m_cache_utxo.end())
+        vinIn = CreateInputs(itSender->second.select(CAmount(txData.value), sum));
 
     if (!vinIn.empty()){
         res.vin = vinIn;
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <array>
+#include <deque>
 #include <unordered_map>
 #include <libdevcore/Common.h> //+
 #include <libdevcore/RLP.h> //+
@@ -39,6 +40,7 @@
 #include "libethereum/Transaction.h"
 #include "AccountDiff.h" //+
 #include "GasPricer.h" //+
+#include "StatePruner.h"
 
 namespace dev
 {
@@ -68,7 +70,44 @@ using LogBloomRequirementError = boost::tuple<errinfo_required_LogBloom, errinfo
 
 using vinInfo = std::pair<COutPoint, CAmount>;
 using VinsInfo = std::vector<std::pair<COutPoint, CAmount>>;
-using VinsInfoSerial = std::vector<std::pair<std::pair<u256, bigint>, u256>>;
+
+/**
+ * The outputs held by a contract, oldest first.
+ *
+ * The first one, from the transaction that created or first paid the contract, is never spent; payments
+ * spend the oldest ones behind it. Keeping them in a deque makes spending them and receiving new ones
+ * cost the same however many outputs the contract holds, where a vector moved all of them on each spend.
+ */
+class ContractVins
+{
+public:
+	ContractVins() = default;
+
+	/// Decode the list of outputs of an entry of the UTXO trie.
+	explicit ContractVins(RLP const& _r);
+
+	/// Append the list of outputs as stored in the UTXO trie: [[[txid, n], amount], ...].
+	void streamRLP(RLPStream& _s) const;
+
+	size_t size() const { return m_vins.size(); }
+
+	void push_back(vinInfo const& _vin) { m_vins.push_back(_vin); }
+	void append(VinsInfo const& _vins) { m_vins.insert(m_vins.end(), _vins.begin(), _vins.end()); }
+
+	/// @returns the oldest spendable outputs that together pay @a _value, or all of them if they fall short.
+	/// @a io_sum is increased by their total.
+	VinsInfo select(CAmount const& _value, CAmount& io_sum) const;
+
+	/// Spend the @a _count oldest spendable outputs. There must be at least @a _count of them.
+	void spend(size_t _count) { m_vins.erase(m_vins.begin() + 1, m_vins.begin() + 1 + _count); }
+
+	VinsInfo toVector() const { return VinsInfo(m_vins.begin(), m_vins.end()); }
+
+	bool operator==(ContractVins const& _c) const { return m_vins == _c.m_vins; }
+
+private:
+	std::deque<vinInfo> m_vins;
+};
 
 // class BlockChain;
 class State;
@@ -89,7 +128,8 @@ enum class BaseState
 enum class Permanence
 {
 	Reverted,
-	Committed
+	Committed,
+	Uncommitted	///< Leave the changes in the caches; see QtumState::takeChanges().
 };
 
 #define ETH_FATDB 1 // TODO temp
@@ -150,6 +190,8 @@ public:
 	/// Open a DB - useful for passing into the constructor & keeping for other states that are necessary.
 	static OverlayDB openDB(std::string const& _path, h256 const& _genesisHash, WithExisting _we = WithExisting::Trust);
 	static OverlayDB openDB(h256 const& _genesisHash, WithExisting _we = WithExisting::Trust) { return openDB(std::string(), _genesisHash, _we); }
+	/// Memory each DB opened afterwards may use for its block and trie node caches; 0 (the default) disables both.
+	static void setDBCacheSize(size_t _bytes);
 	OverlayDB const& db() const { return m_db; }
 	OverlayDB& db() { return m_db; }
 
@@ -161,6 +203,12 @@ public:
 	/// @throws InterfaceNotSupported if compiled without ETH_FATDB.
 	std::unordered_map<Address, u256> addresses() const;
 
+	/// Visits the accounts of the trie in the order of their hashed addresses, from the first whose hash is not
+	/// less than @a _from, until @a _f returns false. Changes rootHash() has not yet written to the trie are not seen.
+	/// @returns the hashed address of the account @a _f returned false for, or a zero hash if it never did.
+	/// @throws InterfaceNotSupported if compiled without ETH_FATDB.
+	h256 forEachAccount(h256 const& _from, std::function<bool(Address const&, RLP const&)> const& _f) const;
+
 	/// Execute a given transaction.
 	/// This will change the state accordingly.
 	std::pair<ExecutionResult, TransactionReceipt> execute(EnvInfo const& _envInfo, SealEngineFace* _sealEngine, Transaction const& _t, Permanence _p = Permanence::Committed, OnOpFunc const& _onOp = OnOpFunc());
@@ -193,7 +241,7 @@ public:
 	 */
 	void transferBalance(Address const& _from, Address const& _to, u256 const& _value) { subBalance(_from, _value); addBalance(_to, _value); } // TODO temp OutPoints
 
-	/// Get the root of the storage of an account.
+	/// Get the root of the storage of an account, as of the last rootHash().
 	h256 storageRoot(Address const& _contract) const;
 
 	/// Get the value of a storage position of an account.
@@ -201,7 +249,7 @@ public:
 	u256 storage(Address const& _contract, u256 const& _memory) const;
 
 	/// Set the value of a storage position of an account.
-	void setStorage(Address const& _contract, u256 const& _location, u256 const& _value) { m_cache[_contract].setStorage(_location, _value); }
+	void setStorage(Address const& _contract, u256 const& _location, u256 const& _value) { noteChange(_contract); m_cache[_contract].setStorage(_location, _value); }
 
 	/// Create a new contract.
 	Address newContract(u256 const& _balance, bytes const& _code);
@@ -211,10 +259,20 @@ public:
 	/// @returns std::unordered_map<u256, u256> if no account exists at that address.
 	std::unordered_map<u256, u256> storage(Address const& _contract) const;
 
+	/// Visits the storage of @a _contract in the order of the hashed keys, from the first whose hash is not less
+	/// than @a _from, until @a _f returns false. Only the storage the account trie refers to is seen.
+	/// @returns the hashed key of the entry @a _f returned false for, or a zero hash if it never did.
+	/// @throws InterfaceNotSupported if compiled without ETH_FATDB.
+	h256 forEachStorage(Address const& _contract, h256 const& _from, std::function<bool(u256 const&, u256 const&)> const& _f) const;
+
 	/// Get the code of an account.
 	/// @returns bytes() if no account exists at that address.
 	bytes const& code(Address const& _contract) const;
 
+	/// Get the code of an account without copying it; it stays valid whatever happens to the account.
+	/// @returns null if no account exists at that address or if it has no code.
+	std::shared_ptr<bytes const> sharedCode(Address const& _contract) const;
+
 	/// Get the code hash of an account.
 	/// @returns EmptySHA3 if no account exists at that address or if there is no code associated with the address.
 	h256 codeHash(Address const& _contract) const;
@@ -226,20 +284,28 @@ public:
 	/// @returns 0 if the address has never been used.
 	u256 transactionsFrom(Address const& _address) const;
 
-	/// The hash of the root of our state tree.
-	h256 rootHash() const { return m_state.root(); }
+	/// The hash of the root of our state tree. Writes the changes committed since the last call into it first.
+	h256 rootHash();
 
 	/// @return the difference between this state (origin) and @a _c (destination).
 	/// @param _quick if true doesn't check all addresses possible (/very/ slow for a full chain)
 	/// but rather only those touched by the transactions in creating the two States.
 	StateDiff diff(State const& _c, bool _quick = false) const;
 
-	/// Commit all changes waiting in the address cache to the DB.
+	/// Commit all changes waiting in the address cache to the pending changes, which rootHash() writes
+	/// into the state tree in one go.
 	void commit();
 
 	/// Resets any uncommitted changes to the cache.
 	void setRoot(h256 const& _root);
 
+	/// @returns the position of the pending changes to go back to with rollback().
+	size_t savepoint() const { return m_pendingJournal.size(); }
+
+	/// Drop the address cache and the changes committed since @a _savepoint, which must have been
+	/// taken after the last rootHash().
+	void rollback(size_t _savepoint);
+
 	/// Get the account start nonce. May be required.
 	u256 const& accountStartNonce() const { return m_accountStartNonce; }
 	u256 const& requireAccountStartNonce() const;
@@ -247,6 +313,24 @@ public:
 
 	virtual void addVin(Address const& _id, vinInfo _amount) {}
 
+	/// Start (and reset) or stop recording every address loaded into the caches and every address committed.
+	void setRecordAccess(bool _record) { m_recordAccess = _record; m_accessed.clear(); m_written.clear(); }
+
+	/// @returns the addresses loaded since setRecordAccess(true); all reads and writes go through the caches.
+	AddressHash const& accessed() const { return m_accessed; }
+
+	/// @returns the addresses whose changes were committed since setRecordAccess(true).
+	AddressHash const& written() const { return m_written; }
+
+/////////////////////////////////////////////// // TODO temp dataToTx
+	/// Per-execution scratch filled in by Executive/QuantumExtVM. It lives here rather than in the
+	/// SealEngineFace so a single engine can be shared by every execution.
+	std::vector<TxDataToGenerate> txData;
+	std::vector<Address> delAddresses;
+	Address qtumAddress;
+	void createQtumAddress(h256 hashTx, unsigned char voutNumber);
+///////////////////////////////////////////////
+
 // private:
 protected: // TODO temp dataToTx
 
@@ -259,6 +343,20 @@ protected: // TODO temp dataToTx
 	/// Retrieve all information about a given address into a cache.
 	void ensureCached(std::unordered_map<Address, Account>& _cache, Address const& _a, bool _requireCode, bool _forceCreate) const;
 
+	/// Start a call frame: until endFrame(), each address cache entry is saved before it is first
+	/// changed so revertFrame() can put it back. Frames nest.
+	void beginFrame() { m_frames.push_back(m_frameJournal.size()); }
+
+	/// Undo the changes to the address cache made since the innermost frame began.
+	void revertFrame();
+
+	/// Close the innermost frame; its changes stay, to be undone if an enclosing frame is reverted.
+	void endFrame();
+
+	/// Save the cache entry of @a _a for revertFrame() unless the innermost frame already did.
+	/// Must be called before every change to m_cache.
+	void noteChange(Address const& _a) const;
+
 	/// Debugging only. Good for checking the Trie is in shape.
 	bool isTrieGood(bool _enforceRefs, bool _requireNoLeftOvers) const;
 
@@ -268,10 +366,27 @@ protected: // TODO temp dataToTx
 	OverlayDB m_db;								///< Our overlay for the state tree.
 	SecureTrieDB<Address, OverlayDB> m_state;	///< Our state tree, as an OverlayDB DB.
 	mutable std::unordered_map<Address, Account> m_cache;	///< Our address cache. This stores the states of each address that has (or at least might have) been changed.
+	std::unordered_map<Address, Account> m_pending;	///< Accounts committed since the last rootHash(), dead ones included.
+	std::vector<std::pair<Address, std::shared_ptr<Account>>> m_pendingJournal;	///< The pending account each commit replaced, null if none.
 	AddressHash m_touched;						///< Tracks all addresses touched so far.
 
+	/// An address cache entry as it was before a call frame first changed it.
+	struct FrameChange
+	{
+		Address address;
+		std::shared_ptr<Account> account;		///< Null if the address was not cached.
+		size_t previous;						///< m_frameChanged of the address before this change.
+	};
+	mutable std::vector<FrameChange> m_frameJournal;	///< Changes of the open call frames, oldest first.
+	mutable std::unordered_map<Address, size_t> m_frameChanged;	///< Position after the latest change of each address in m_frameJournal.
+	std::vector<size_t> m_frames;				///< Where in m_frameJournal each open call frame begins.
+
 	u256 m_accountStartNonce;
 
+	bool m_recordAccess = false;
+	mutable AddressHash m_accessed;				///< Addresses loaded while m_recordAccess is set.
+	AddressHash m_written;						///< Addresses committed while m_recordAccess is set.
+
 	static std::string c_defaultPath;
 
 	friend std::ostream& operator<<(std::ostream& _out, State const& _s);
@@ -285,6 +400,17 @@ struct ResultExecute{
 	std::vector<CTransaction> txs;
 };
 
+/// Uncommitted changes of an execution run with Permanence::Uncommitted, as harvested by
+/// QtumState::takeChanges() for replay onto another QtumState with QtumState::applyChanges().
+struct QtumStateChanges{
+	std::unordered_map<Address, Account> accounts;
+	std::unordered_map<Address, ContractVins> vins;
+	AddressHash accessed;	///< Every address read or written while producing the changes.
+
+	/// @returns the addresses whose committed state would change if the changes were applied.
+	AddressHash written() const;
+};
+
 class QtumState : public State{
 
 public:
@@ -292,46 +418,73 @@ public:
 	explicit QtumState(u256 const& _accountStartNonce, OverlayDB const& _db, std::string const& _path, h256 const& _genesisHash, BaseState _bs = BaseState::PreExisting) : State(_accountStartNonce, _db, _bs) {
 		initUTXODB(_path, _genesisHash);
 	};
+
+	/// Copy state object. The copy shares both databases but executes independently of the original.
+	QtumState(QtumState const& _s);
+
+	/// A copy at @a _root and @a _rootUTXO without any uncommitted changes, for reading a state committed
+	/// to the databases on another thread. Throws dev::RootNotFound if the state is not in the databases.
+	QtumState snapshot(h256 const& _root, h256 const& _rootUTXO) const;
 	
 	ResultExecute execute(EnvInfo const& _envInfo, SealEngineFace* _sealEngine, QtumTransaction const& _t, Permanence _p = Permanence::Committed, OnOpFunc const& _onOp = OnOpFunc()); // TODO temp QtumTransaction
 
-	h256 rootHashUTXO() const { return m_state_utxo.root(); }
+	h256 rootHashUTXO();
 
 	void setRootUTXO(h256 const& _root);
 
-	OverlayDB dbUTXO(){ return m_db_utxo; }
+	/// Positions of both kinds of pending changes. Taking one is cheap, unlike the roots.
+	struct Checkpoint{
+		size_t accounts;
+		size_t vins;
+	};
+
+	Checkpoint checkpoint() const { return Checkpoint{savepoint(), m_pendingJournal_utxo.size()}; }
+
+	/// Drop both caches and the account and vins changes committed since @a _checkpoint, which must
+	/// have been taken after the last rootHash() and rootHashUTXO().
+	void rollback(Checkpoint const& _checkpoint);
+	using State::rollback;
+
+	OverlayDB& dbUTXO(){ return m_db_utxo; }
+
+	/// Reference counting of the trie nodes of each database, for -statepruning.
+	StatePruner pruner(){ return StatePruner(m_db, StatePruner::AccountTrie); }
+	StatePruner prunerUTXO(){ return StatePruner(m_db_utxo, StatePruner::PlainTrie); }
 
 	VinsInfo getVins(Address const& _id);
 
 	void addVin(Address const& _id, vinInfo _amount);
 
+	/// Move the uncommitted account and vins caches (and the recorded accesses) out of the state.
+	QtumStateChanges takeChanges();
+
+	/// Load changes harvested from another state on the same root into the caches and commit them.
+	void applyChanges(QtumStateChanges const& _changes);
+
+	/// @returns the addresses with entries in the account or vins cache that are not committed yet.
+	AddressHash cachedAddresses() const;
+
 private:
 
+	/// See snapshot(). Unlike the copy constructor it leaves the caches and the touched addresses behind.
+	QtumState(QtumState const& _s, h256 const& _root, h256 const& _rootUTXO);
+
 	enum TransferType {ContractToContract, ContractToPubkeyhash};
 
 	CTransaction createP2PHTx(h256 hashWith, unsigned char voutNum, u256 value, Address sender);
 
-    VinsInfo SelectOutputs(VinsInfo& vins, Address const& _from, CAmount const& _value, CAmount& sum);
-
-    std::vector<CTxIn> CreateInputs(VinsInfo outs);
+    std::vector<CTxIn> CreateInputs(VinsInfo const& outs);
 
     std::vector<CTxOut> CreateOutputs(Address const& _from, Address const& _to, CAmount const& _value, CAmount& sum, TransferType type);
 	
-    void RemoveVout(VinsInfo& outs, Address const& _from, size_t size);
 
 	CTransaction TxGeneration(TxDataToGenerate& txData, EnvInfo const& _envInfo, Address sender);
 
 	void savedVinToAccount(CTransaction& tx,TxDataToGenerate& txData);
 
-	VinsInfoSerial VinsInfoSerialization(VinsInfo vins);
-
-	VinsInfo VinsInfoDeserialize(VinsInfoSerial vins);
-
-	void sortOutPoints(VinsInfo& vins);
-
 	void ensureCachedUTXO(Address const& _a);
 
-	void ensureCachedUTXO(std::unordered_map<Address, VinsInfo>& _cache, const Address& _a);
+	void ensureCachedUTXO(std::unordered_map<Address, ContractVins>& _cache, const Address& _a);
 
 	void initUTXODB(std::string const& _path, h256 const& _genesisHash, WithExisting _we = WithExisting::Trust);
 
@@ -343,9 +496,9 @@ private:
 
 	void commit(){ State::commit(); commitUTXO(); }
 
-	void setVins(Address const& _id, VinsInfo _amount);
+	void setVins(Address const& _id, VinsInfo const& _amount);
 
-	void addVins(Address const& _id, VinsInfo _amount);
+	void addVins(Address const& _id, VinsInfo const& _amount);
 
 	void subVins(Address const& _id, size_t _amount);
 
@@ -355,7 +508,19 @@ private:
 
 	SecureTrieDB<Address, OverlayDB> m_state_utxo;
 
-	std::unordered_map<Address, VinsInfo> m_cache_utxo;
+	std::unordered_map<Address, ContractVins> m_cache_utxo;
+
+	/// Vins committed since the last rootHashUTXO(), null if removed. Shared with the journal and copies of the state.
+	std::unordered_map<Address, std::shared_ptr<ContractVins const>> m_pending_utxo;
+
+	/// What each commitUTXO() replaced in m_pending_utxo.
+	struct PendingVinsChange{
+		Address address;
+		bool pending;
+		std::shared_ptr<ContractVins const> vins;
+	};
+
+	std::vector<PendingVinsChange> m_pendingJournal_utxo;
 };
 ////////////////////////////////////////////////////////////////////////////////////
 
@@ -364,47 +529,78 @@ std::ostream& operator<<(std::ostream& _out, State const& _s);
 template <class DB>
 AddressHash commit(AccountMap const& _cache, SecureTrieDB<Address, DB>& _state)
 {
-	AddressHash ret;
+	// The trie keys are hashes of the addresses and storage slots; work them all out in one batch up front.
+	std::vector<AccountMap::value_type const*> dirty;
+	std::vector<h256> slots;
 	for (auto const& i: _cache)
 		if (i.second.isDirty())
 		{
-			if (!i.second.isAlive())
-				_state.remove(i.first);
-			else
-			{
-				RLPStream s(4);
-				s << i.second.nonce() << i.second.balance();
+			dirty.push_back(&i);
+			if (i.second.isAlive())
+				for (auto const& j: i.second.storageOverlay())
+					slots.push_back(h256(j.first));
+		}
+	std::vector<bytesConstRef> keys;
+	keys.reserve(dirty.size() + slots.size());
+	for (auto i: dirty)
+		keys.push_back(i->first.ref());
+	for (auto const& j: slots)
+		keys.push_back(j.ref());
+	std::vector<h256> hashes(keys.size());
+	sha3Batch(keys.data(), hashes.data(), keys.size());
 
-				if (i.second.storageOverlay().empty())
-				{
-					assert(i.second.baseRoot());
-					s.append(i.second.baseRoot());
-				}
-				else
-				{
-					SecureTrieDB<h256, DB> storageDB(_state.db(), i.second.baseRoot());
-					for (auto const& j: i.second.storageOverlay())
-						if (j.second)
-							storageDB.insert(j.first, rlp(j.second));
-						else
-							storageDB.remove(j.first);
-					assert(storageDB.root());
-					s.append(storageDB.root());
-				}
+	AddressHash ret;
+	h256 const* accountHash = hashes.data();
+	h256 const* slot = slots.data();
+	h256 const* slotHash = hashes.data() + dirty.size();
+	for (auto i: dirty)
+	{
+		Account const& account = i->second;
+		if (!account.isAlive())
+			_state.removeHashed(*accountHash);
+		else
+		{
+			RLPStream s(4);
+			s << account.nonce() << account.balance();
 
-				if (i.second.isFreshCode())
+			if (account.storageOverlay().empty())
+			{
+				assert(account.baseRoot());
+				s.append(account.baseRoot());
+			}
+			else
+			{
+				SecureTrieDB<h256, DB> storageDB(_state.db(), account.baseRoot());
+				for (auto const& j: account.storageOverlay())
 				{
-					h256 ch = sha3(i.second.code());
-					_state.db()->insert(ch, &i.second.code());
-					s << ch;
+					if (j.second)
+					{
+						bytes value = rlp(j.second);
+						storageDB.insertHashed(*slot, *slotHash, &value);
+					}
+					else
+						storageDB.removeHashed(*slotHash);
+					++slot;
+					++slotHash;
 				}
-				else
-					s << i.second.codeHash();
+				assert(storageDB.root());
+				s.append(storageDB.root());
+			}
 
-				_state.insert(i.first, &s.out());
+			if (account.isFreshCode())
+			{
+				h256 ch = sha3(account.code());
+				_state.db()->insert(ch, &account.code());
+				s << ch;
 			}
-			ret.insert(i.first);
+			else
+				s << account.codeHash();
+
+			_state.insertHashed(i->first, *accountHash, &s.out());
 		}
+		++accountHash;
+		ret.insert(i->first);
+	}
 	return ret;
 }
 
@@ -0,0 +1,276 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StatePruner.cpp
+ */
+
+#include "StatePruner.h"
+#include <memory>
+#include <libdevcore/SHA3.h>
+#include <libdevcore/TrieDB.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+// None of the pruning keys is 32 bytes long, so they never clash with a node.
+string const c_countedRootKey = "prune.root";
+string const c_journalPrefix = "prune.block";
+
+string refKey(h256 const& _h)
+{
+	string ret((char const*)_h.data(), 32);
+	ret.push_back((char)254);	// aux entries end in 255
+	return ret;
+}
+
+/// Big endian height first, so that the journal is iterated in height order.
+string journalKey(unsigned _height, h256 const& _hash)
+{
+	string ret = c_journalPrefix;
+	for (int i = 24; i >= 0; i -= 8)
+		ret.push_back((char)(_height >> i));
+	ret.append((char const*)_hash.data(), 32);
+	return ret;
+}
+
+unsigned journalHeight(ldb::Slice const& _key)
+{
+	unsigned ret = 0;
+	for (unsigned i = 0; i < 4; ++i)
+		ret = (ret << 8) | (byte)_key[c_journalPrefix.size() + i];
+	return ret;
+}
+
+bytesConstRef asRef(ldb::Slice const& _s)
+{
+	return bytesConstRef((byte const*)_s.data(), _s.size());
+}
+
+/// Nodes every trie may point at without owning them.
+bool isShared(h256 const& _h)
+{
+	return !_h || _h == EmptyTrie || _h == EmptySHA3;
+}
+
+}
+
+bool StatePruner::enabled() const
+{
+	string v;
+	return m_db.db()->Get(ldb::ReadOptions(), c_countedRootKey, &v).ok();
+}
+
+void StatePruner::setEnabled(bool _enabled)
+{
+	if (_enabled == enabled())
+		return;
+	if (_enabled)
+		m_db.db()->Put(ldb::WriteOptions(), c_countedRootKey, string());
+	else
+		m_db.db()->Delete(ldb::WriteOptions(), c_countedRootKey);
+}
+
+StatePruner::Ref StatePruner::loadRef(h256 const& _h) const
+{
+	Ref ret;
+	string v;
+	if (m_db.db()->Get(ldb::ReadOptions(), refKey(_h), &v).ok())
+	{
+		RLP r(v);
+		ret.count = r[0].toInt<unsigned>();
+		ret.releasedAt = r[1].toInt<unsigned>();
+	}
+	return ret;
+}
+
+StatePruner::Ref& StatePruner::ref(h256 const& _h)
+{
+	auto it = m_refs.find(_h);
+	if (it == m_refs.end())
+		it = m_refs.insert(make_pair(_h, loadRef(_h))).first;
+	return it->second;
+}
+
+void StatePruner::leafChildren(bytesConstRef _v, NodeKind _kind, Children& o_children)
+{
+	if (_kind != AccountTrie)
+		return;
+	RLP account(_v);
+	if (account.isList() && account.itemCount() == 4)
+	{
+		o_children.push_back(make_pair(account[2].toHash<h256>(), PlainTrie));
+		o_children.push_back(make_pair(account[3].toHash<h256>(), Code));
+	}
+}
+
+void StatePruner::childEntry(RLP const& _e, NodeKind _kind, Children& o_children)
+{
+	if (_e.isData() && _e.size() == 32)
+		o_children.push_back(make_pair(_e.toHash<h256>(), _kind));
+	else if (_e.isList())
+		children(_e, _kind, o_children);	// inlined node
+}
+
+void StatePruner::children(RLP const& _n, NodeKind _kind, Children& o_children)
+{
+	if (_n.isList() && _n.itemCount() == 2)
+	{
+		if (isLeaf(_n))
+			leafChildren(_n[1].payload(), _kind, o_children);
+		else
+			childEntry(_n[1], _kind, o_children);
+	}
+	else if (_n.isList() && _n.itemCount() == 17)
+	{
+		for (unsigned i = 0; i < 16; ++i)
+			if (!_n[i].isEmpty())
+				childEntry(_n[i], _kind, o_children);
+		if (!_n[16].isEmpty())
+			leafChildren(_n[16].payload(), _kind, o_children);
+	}
+}
+
+void StatePruner::addRef(h256 const& _h, NodeKind _kind)
+{
+	if (isShared(_h) || ref(_h).count++ || _kind == Code)
+		return;
+	// First reference since the node was written or released: it now holds on to its children again.
+	Children c;
+	children(RLP(m_db.lookup(_h)), _kind, c);
+	for (auto const& i: c)
+		addRef(i.first, i.second);
+}
+
+void StatePruner::release(h256 const& _h, NodeKind _kind, unsigned _height, Released& o_released)
+{
+	if (isShared(_h))
+		return;
+	Ref& r = ref(_h);
+	if (!r.count)
+	{
+		cwarn << "Releasing a state node with no references:" << _h;
+		return;
+	}
+	if (--r.count)
+		return;
+	r.releasedAt = _height;
+	string node = m_db.lookup(_h);
+	o_released.push_back(make_pair(_h, (unsigned)node.size()));
+	if (_kind == Code)
+		return;
+	Children c;
+	children(RLP(node), _kind, c);
+	for (auto const& i: c)
+		release(i.first, i.second, _height, o_released);
+}
+
+void StatePruner::journal(h256 const& _root, unsigned _height, h256 const& _hash)
+{
+	string counted;
+	if (!m_db.db()->Get(ldb::ReadOptions(), c_countedRootKey, &counted).ok())
+		return;
+	h256 old = counted.size() == 32 ? h256(counted, h256::FromBinary) : h256();
+	if (old == _root)
+		return;
+
+	// Count the new root in first, so that the nodes it shares with the old one never reach zero.
+	addRef(_root, m_kind);
+	Released released;
+	release(old, m_kind, _height, released);
+
+	ldb::WriteBatch batch;
+	for (auto const& i: m_refs)
+	{
+		RLPStream s(2);
+		s << i.second.count << i.second.releasedAt;
+		batch.Put(refKey(i.first), ldb::Slice((char const*)s.out().data(), s.out().size()));
+	}
+	if (!released.empty())
+	{
+		// A block connected again after a restart adds to what it released the first time.
+		string key = journalKey(_height, _hash);
+		string prev;
+		if (m_db.db()->Get(ldb::ReadOptions(), key, &prev).ok())
+			for (auto const& i: RLP(prev))
+				released.push_back(make_pair(i[0].toHash<h256>(), i[1].toInt<unsigned>()));
+		RLPStream s(released.size());
+		for (auto const& i: released)
+			s.appendList(2) << i.first << i.second;
+		batch.Put(key, ldb::Slice((char const*)s.out().data(), s.out().size()));
+	}
+	batch.Put(c_countedRootKey, ldb::Slice((char const*)_root.data(), 32));
+
+	ldb::Status o = m_db.db()->Write(ldb::WriteOptions(), &batch);
+	if (!o.ok())
+		cwarn << "Error writing state node references: " << o.ToString();
+	m_refs.clear();
+}
+
+size_t StatePruner::prune(unsigned _height, size_t _max)
+{
+	ldb::WriteBatch batch;
+	h256Hash deleted;
+	unique_ptr<ldb::Iterator> it(m_db.db()->NewIterator(ldb::ReadOptions()));
+	for (it->Seek(c_journalPrefix); it->Valid() && deleted.size() < _max; it->Next())
+	{
+		ldb::Slice key = it->key();
+		if (!key.starts_with(c_journalPrefix) || journalHeight(key) > _height)
+			break;
+		for (auto const& i: RLP(asRef(it->value())))
+		{
+			h256 h = i[0].toHash<h256>();
+			// Nodes referenced again, or released again by a block above _height, have to stay for now.
+			Ref const& r = ref(h);
+			if (r.count || r.releasedAt > _height || !deleted.insert(h).second)
+				continue;
+			batch.Delete(ldb::Slice((char const*)h.data(), 32));
+			batch.Delete(refKey(h));
+		}
+		batch.Delete(key);
+	}
+
+	ldb::Status o = m_db.db()->Write(ldb::WriteOptions(), &batch);
+	if (!o.ok())
+	{
+		cwarn << "Error pruning state nodes: " << o.ToString();
+		deleted.clear();
+	}
+	for (auto const& h: deleted)
+		m_db.evict(h);
+	m_refs.clear();
+	return deleted.size();
+}
+
+StatePruner::Info StatePruner::info() const
+{
+	Info ret;
+	unique_ptr<ldb::Iterator> it(m_db.db()->NewIterator(ldb::ReadOptions()));
+	for (it->Seek(c_journalPrefix); it->Valid() && it->key().starts_with(c_journalPrefix); it->Next())
+	{
+		++ret.blocks;
+		for (auto const& i: RLP(asRef(it->value())))
+			if (!loadRef(i[0].toHash<h256>()).count)
+			{
+				++ret.nodes;
+				ret.bytes += i[1].toInt<unsigned>();
+			}
+	}
+	return ret;
+}
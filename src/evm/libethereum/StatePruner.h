@@ -0,0 +1,98 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StatePruner.h
+ *
+ * Reference counting and deferred deletion of state trie nodes.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <libdevcore/OverlayDB.h>
+#include <libdevcore/RLP.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/**
+ * Keeps a state database from growing with every historical root.
+ *
+ * Every node on disk carries the number of references to it from the counted root and from the
+ * nodes reachable from it. journal() moves the counted root to the trie committed for a block:
+ * nodes of the new root are counted in, and nodes only the old root reached drop to zero and are
+ * listed against the block. prune() later deletes the listed nodes of blocks deep enough that no
+ * reorg returns to a root using them, unless a later root has referenced them again.
+ *
+ * Only journalled roots are counted, so counting has to start on an empty database. Nodes
+ * committed for roots that are never journalled, such as block templates, are never deleted.
+ */
+class StatePruner
+{
+public:
+	/// What a trie's leaves refer to: accounts to a storage trie and code, plain leaves to nothing.
+	enum NodeKind { AccountTrie, PlainTrie, Code };
+
+	struct Info
+	{
+		unsigned blocks = 0;	///< Blocks whose released nodes are waiting to be pruned.
+		size_t nodes = 0;		///< Released nodes that are still unreferenced.
+		size_t bytes = 0;		///< Their size, uncompressed.
+	};
+
+	StatePruner(OverlayDB& _db, NodeKind _kind): m_db(_db), m_kind(_kind) {}
+
+	/// @returns true if the nodes of the database are being counted.
+	bool enabled() const;
+	/// Start counting on an empty database, or stop counting for good.
+	void setEnabled(bool _enabled);
+
+	/// Make @a _root, committed by block @a _hash at @a _height, the counted root.
+	void journal(h256 const& _root, unsigned _height, h256 const& _hash);
+	/// Delete the still unreferenced nodes released by blocks at or below @a _height, stopping after
+	/// the block that takes the total past @a _max. @returns the number of nodes deleted.
+	size_t prune(unsigned _height, size_t _max);
+
+	Info info() const;
+
+private:
+	struct Ref
+	{
+		unsigned count = 0;
+		unsigned releasedAt = 0;	///< Height of the block that last dropped count to zero.
+	};
+	/// Nodes whose count a block dropped to zero, with their sizes.
+	using Released = std::vector<std::pair<h256, unsigned>>;
+	using Children = std::vector<std::pair<h256, NodeKind>>;
+
+	Ref loadRef(h256 const& _h) const;
+	Ref& ref(h256 const& _h);
+	void addRef(h256 const& _h, NodeKind _kind);
+	void release(h256 const& _h, NodeKind _kind, unsigned _height, Released& o_released);
+	/// Appends the nodes referred to by node @a _n of a trie of @a _kind to @a o_children.
+	static void children(RLP const& _n, NodeKind _kind, Children& o_children);
+	static void childEntry(RLP const& _e, NodeKind _kind, Children& o_children);
+	static void leafChildren(bytesConstRef _v, NodeKind _kind, Children& o_children);
+
+	OverlayDB& m_db;
+	NodeKind m_kind;
+	std::unordered_map<h256, Ref> m_refs;	///< Counts loaded or changed by the current operation.
+};
+
+}
+}
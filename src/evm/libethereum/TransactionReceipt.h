@@ -35,6 +35,7 @@ namespace eth
 class TransactionReceipt
 {
 public:
+	TransactionReceipt() = default;
 	TransactionReceipt(bytesConstRef _rlp);
 	TransactionReceipt(h256 _root, u256 _gasUsed, LogEntries const& _log);
 
@@ -0,0 +1,237 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CodeAnalysis.cpp
+ */
+
+#include "CodeAnalysis.h"
+#include <list>
+#include <unordered_map>
+#include <libdevcore/Guards.h>
+#include <libevmcore/Instruction.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+struct Metric
+{
+	int tier;
+	int args;
+	int ret;
+	bool valid;
+};
+
+/// instructionInfo() is a map lookup that throws for invalid opcodes; tabulate it once.
+array<Metric, 256> const& metrics()
+{
+	static array<Metric, 256> const s_metrics = []()
+	{
+		array<Metric, 256> ret;
+		for (unsigned i = 0; i < 256; ++i)
+		{
+			Instruction inst = (Instruction)i;
+			bool valid = isValidInstruction(inst);
+			InstructionInfo info = valid ? instructionInfo(inst) : InstructionInfo{"", 0, 0, 0, false, InvalidTier};
+			ret[i] = Metric{info.gasPriceTier, info.args, info.ret, valid};
+		}
+		return ret;
+	}();
+	return s_metrics;
+}
+
+/// Instructions after which a new block starts: they transfer control, leave the
+/// interpreter loop, read the remaining gas or are not valid at all.
+bool endsBlock(Instruction _inst)
+{
+	switch (_inst)
+	{
+	case Instruction::STOP:
+	case Instruction::JUMP:
+	case Instruction::JUMPI:
+	case Instruction::RETURN:
+	case Instruction::SUICIDE:
+	case Instruction::CREATE:
+	case Instruction::CALL:
+	case Instruction::CALLCODE:
+	case Instruction::DELEGATECALL:
+	case Instruction::GAS:
+		return true;
+	default:
+		return !metrics()[(unsigned)_inst].valid;
+	}
+}
+
+}
+
+const uint32_t CodeAnalysis::c_none;
+
+CodeAnalysis::CodeAnalysis(bytesConstRef _code, EVMSchedule const& _schedule):
+	codeSize(_code.size()),
+	code(_code.begin(), _code.end()),
+	jumpDests(_code.size()),
+	pushIndex(_code.size(), c_none),
+	blockIndex(_code.size(), c_none),
+	tierStepGas(_schedule.tierStepGas)
+{
+	code.resize(codeSize + 33, 0);
+
+	Block block;
+	uint64_t start = 0;
+	int height = 0;
+	auto closeBlock = [&](uint64_t _end)
+	{
+		if (_end == start)
+			return;
+		block.end = _end;
+		blockIndex[start] = blocks.size();
+		blocks.push_back(block);
+		block = Block();
+		start = _end;
+		height = 0;
+	};
+
+	for (uint64_t pc = 0; pc < codeSize;)
+	{
+		Instruction inst = (Instruction)code[pc];
+		if (inst == Instruction::JUMPDEST)
+		{
+			closeBlock(pc);
+			jumpDests[pc] = true;
+		}
+
+		Metric const& m = metrics()[(unsigned)inst];
+		if (m.tier < (int)tierStepGas.size())
+			block.gas += tierStepGas[m.tier];
+		block.stackRequired = max(block.stackRequired, m.args - height);
+		height += m.ret - m.args;
+		block.stackMaxGrowth = max(block.stackMaxGrowth, height);
+		++block.instructions;
+
+		uint64_t next = pc + 1;
+		if (inst >= Instruction::PUSH1 && inst <= Instruction::PUSH32)
+		{
+			unsigned n = (unsigned)inst - (unsigned)Instruction::PUSH1 + 1;
+			byte data[32] = {};
+			memcpy(data + 32 - n, code.data() + pc + 1, n);
+			pushIndex[pc] = pushValues.size();
+			pushValues.push_back(Word256::fromBigEndian(data));
+			next += n;
+		}
+
+		if (inst == Instruction::COINBASE || inst == Instruction::TIMESTAMP || inst == Instruction::DIFFICULTY || inst == Instruction::NUMBER ||
+			inst == Instruction::BLOCKHASH || inst == Instruction::GASLIMIT || inst == Instruction::CREATE)
+			readsBlockInfo = true;
+
+		if (endsBlock(inst))
+			closeBlock(min<uint64_t>(next, codeSize));
+		pc = next;
+	}
+	closeBlock(codeSize);
+}
+
+size_t CodeAnalysis::memoryUsage() const
+{
+	return sizeof(CodeAnalysis) + code.size() + jumpDests.size() / 8 + (pushIndex.size() + blockIndex.size()) * sizeof(uint32_t) +
+		pushValues.size() * sizeof(Word256) + blocks.size() * sizeof(Block);
+}
+
+namespace
+{
+
+struct CacheEntry
+{
+	h256 codeHash;
+	shared_ptr<CodeAnalysis const> analysis;
+	size_t size;
+};
+
+Mutex x_cache;
+list<CacheEntry> g_lru;		// most recently used first
+unordered_map<h256, list<CacheEntry>::iterator> g_index;
+size_t g_bytes = 0;
+size_t g_maxBytes = c_defaultCodeAnalysisCacheSize;
+uint64_t g_hits = 0;
+uint64_t g_misses = 0;
+
+void evict()
+{
+	while (g_bytes > g_maxBytes && !g_lru.empty())
+	{
+		g_bytes -= g_lru.back().size;
+		g_index.erase(g_lru.back().codeHash);
+		g_lru.pop_back();
+	}
+}
+
+}
+
+shared_ptr<CodeAnalysis const> CodeAnalysisCache::get(h256 const& _codeHash, bytesConstRef _code, EVMSchedule const& _schedule)
+{
+	{
+		Guard l(x_cache);
+		auto it = g_index.find(_codeHash);
+		if (it != g_index.end() && it->second->analysis->tierStepGas == _schedule.tierStepGas)
+		{
+			++g_hits;
+			g_lru.splice(g_lru.begin(), g_lru, it->second);
+			return it->second->analysis;
+		}
+		++g_misses;
+	}
+
+	// Analyse outside the lock; a concurrent miss on the same code just does the work twice.
+	auto analysis = make_shared<CodeAnalysis const>(_code, _schedule);
+
+	Guard l(x_cache);
+	auto it = g_index.find(_codeHash);
+	if (it != g_index.end())
+	{
+		g_bytes -= it->second->size;
+		g_lru.erase(it->second);
+		g_index.erase(it);
+	}
+	size_t size = analysis->memoryUsage();
+	g_lru.push_front(CacheEntry{_codeHash, analysis, size});
+	g_index[_codeHash] = g_lru.begin();
+	g_bytes += size;
+	evict();
+	return analysis;
+}
+
+void CodeAnalysisCache::setMaxSize(size_t _bytes)
+{
+	Guard l(x_cache);
+	g_maxBytes = _bytes;
+	evict();
+}
+
+CodeAnalysisCacheStats CodeAnalysisCache::stats()
+{
+	Guard l(x_cache);
+	return CodeAnalysisCacheStats{g_index.size(), g_bytes, g_maxBytes, g_hits, g_misses};
+}
+
+void CodeAnalysisCache::clear()
+{
+	Guard l(x_cache);
+	g_lru.clear();
+	g_index.clear();
+	g_bytes = 0;
+}
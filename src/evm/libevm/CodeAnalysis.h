@@ -0,0 +1,105 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CodeAnalysis.h
+ *
+ * Per-contract bytecode analysis shared by all frames running the same code.
+ */
+
+#pragma once
+
+#include <memory>
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/Word256.h>
+#include <libevmcore/EVMSchedule.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Default upper bound on the memory held by the analysis cache.
+static const size_t c_defaultCodeAnalysisCacheSize = 32 * 1024 * 1024;
+
+/**
+ * The result of one linear pass over a contract's code: a jumpdest bitmap, the decoded value
+ * of every PUSH and a table of basic blocks. A block starts at pc 0, at every JUMPDEST and
+ * after every instruction that leaves the straight line or reads the remaining gas, so the
+ * interpreter may charge the tier gas of a whole block and check its stack bounds on entry.
+ */
+struct CodeAnalysis
+{
+	struct Block
+	{
+		uint64_t gas = 0;				///< Sum of the tier gas of the block's instructions.
+		int stackRequired = 0;			///< Items that must be on the stack on entry.
+		int stackMaxGrowth = 0;			///< Highest stack height reached above the entry height.
+		uint64_t instructions = 0;		///< Instructions in the block, counted against the step limit.
+		uint64_t end = 0;				///< pc just past the block's last instruction.
+	};
+
+	static const uint32_t c_none = uint32_t(-1);
+
+	CodeAnalysis(bytesConstRef _code, EVMSchedule const& _schedule);
+
+	/// @returns true if @a _pc is a JUMPDEST outside of PUSH data.
+	bool isJumpDest(uint64_t _pc) const { return _pc < codeSize && jumpDests[_pc]; }
+
+	/// Memory held by this analysis, used to bound the cache.
+	size_t memoryUsage() const;
+
+	size_t codeSize;
+	bytes code;							///< The code followed by 33 zero bytes so any pc reached by straight-line execution is readable.
+	std::vector<bool> jumpDests;
+	std::vector<uint32_t> pushIndex;	///< For each PUSH pc, its index into pushValues.
+	Word256s pushValues;
+	std::vector<uint32_t> blockIndex;	///< For each block start pc, its index into blocks; c_none elsewhere.
+	std::vector<Block> blocks;
+	std::array<unsigned, 8> tierStepGas;	///< The schedule the block gas was computed with.
+	/// The code reads the author, time, difficulty, number or gas limit of the block it runs in or
+	/// the hashes of the blocks before it, or creates contracts whose init code is not known here,
+	/// so its outcome may depend on more than the state.
+	bool readsBlockInfo = false;
+};
+
+struct CodeAnalysisCacheStats
+{
+	size_t entries;
+	size_t bytes;
+	size_t maxBytes;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+/// Process-wide LRU cache of CodeAnalysis keyed by code hash. Thread safe.
+class CodeAnalysisCache
+{
+public:
+	CodeAnalysisCache() = delete;
+
+	/// @returns the analysis of @a _code, computing and caching it on a miss.
+	static std::shared_ptr<CodeAnalysis const> get(h256 const& _codeHash, bytesConstRef _code, EVMSchedule const& _schedule);
+
+	/// Set the memory bound, evicting least recently used entries as needed.
+	static void setMaxSize(size_t _bytes);
+
+	static CodeAnalysisCacheStats stats();
+
+	static void clear();
+};
+
+}
+}
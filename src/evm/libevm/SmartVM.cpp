@@ -113,7 +113,7 @@ bytesConstRef SmartVM::execImpl(u256& io_gas, ExtVMFace& _ext, OnOpFunc const& _
 			if (hits == c_hitTreshold)
 			{
 				clog(JitInfo) << "Schedule:      " << codeIdentifier;
-				s_worker.push({_ext.code, codeIdentifier, schedule});
+				s_worker.push({_ext.code.toBytes(), codeIdentifier, schedule});
 			}
 			clog(JitInfo) << "Interpreter:   " << codeIdentifier;
 		}
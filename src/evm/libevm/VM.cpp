@@ -20,6 +20,7 @@
  */
 
 #include "VM.h"
+#include "VMConfig.h"
 
 using namespace std;
 using namespace dev;
@@ -27,14 +28,14 @@ using namespace dev::eth;
 
 // Convert from a 256-bit integer stack/memory entry into a 160-bit Address hash.
 // Currently we just pull out the right (low-order in BE) 160-bits.
-inline Address asAddress(u256 _item)
+inline Address asAddress(Word256 const& _item)
 {
-	return right160(h256(_item));
+	return right160(_item.toHash());
 }
 
-inline u256 fromAddress(Address _a)
+inline Word256 fromAddress(Address _a)
 {
-	return (u160)_a;
+	return Word256(h256(_a, h256::AlignRight));
 }
 
 // template<class T> static uint64_t toUint64(T v)
@@ -47,14 +48,14 @@ inline u256 fromAddress(Address _a)
 // }
 
 
-uint64_t VM::verifyJumpDest(u256 const& _dest)
+uint64_t VM::verifyJumpDest(Word256 const& _dest)
 {
 	// check for overflow
 	if (_dest > 0x7FFFFFFFFFFFFFFF)
 		throwBadJumpDestination(); // TODO temp BadJumpDestination
 		// throwVMException(BadJumpDestination());
 	uint64_t pc = uint64_t(_dest);
-	if (!m_jumpDests.count(pc))
+	if (!m_analysis->isJumpDest(pc))
 		throwBadJumpDestination(); // TODO temp BadJumpDestination
 		// throwVMException(BadJumpDestination());
 	return pc;
@@ -63,19 +64,12 @@ uint64_t VM::verifyJumpDest(u256 const& _dest)
 
 
 // static uint64_t memNeed(u256 _offset, u256 _size)
-uint64_t VM::memNeed(u256 _offset, u256 _size) // TODO temp OutOfGas
+uint64_t VM::memNeed(Word256 const& _offset, Word256 const& _size) // TODO temp OutOfGas
 {
-	return toUint64(_size ? u512(_offset) + _size : u512(0));
-}
-
-template <class S> S divWorkaround(S const& _a, S const& _b)
-{
-	return (S)(s512(_a) / s512(_b));
-}
-
-template <class S> S modWorkaround(S const& _a, S const& _b)
-{
-	return (S)(s512(_a) % s512(_b));
+	if (!_size)
+		return 0;
+	// both below 2^63, so the sum cannot wrap
+	return toUint64(toUint64(_offset) + toUint64(_size));
 }
 
 
@@ -92,6 +86,9 @@ void VM::onOperation()
 	else
 		++m_nSteps;
 
+	if (!(m_nSteps % c_deadlineSteps) && m_deadline != std::chrono::steady_clock::time_point())
+		checkDeadline();
+
 	if(m_nSteps >= m_nStepsLimit) {
 		throwBadInstruction(); // TODO temp BadInstruction
 		// throwVMException(BadInstruction());
@@ -142,7 +139,7 @@ void VM::updateMem()
 void VM::logGasMem(Instruction inst)
 {
 	unsigned n = (unsigned)inst - (unsigned)Instruction::LOG0;
-	m_runGas = toUint64(m_schedule->logGas + m_schedule->logTopicGas * n + u512(m_schedule->logDataGas) * *(m_SP - 1));
+	m_runGas = toUint64(m_schedule->logGas + m_schedule->logTopicGas * n + u512(m_schedule->logDataGas) * (m_SP - 1)->toU256());
 	m_newMemSize = memNeed(*m_SP, *(m_SP - 1));
 	updateMem();
 }
@@ -159,12 +156,19 @@ bytesConstRef VM::execImpl(u256& io_gas, ExtVMFace& _ext, OnOpFunc const& _onOp)
 	m_schedule = &m_ext->evmSchedule();
 	m_onOp = &_onOp;
 	m_onFail = &VM::onOperation;
+	m_deadline = threadDeadline();
 
 	initMetrics();
-	makeJumpDestTable(_ext);
+	analyseCode(_ext);
+
+#if EVM_PROFILING
+	VMProfiler::Frame profile(_ext.codeHash, &io_gas);
+	m_profile = &profile;
+#endif
 
 	// trampoline to minimize depth of call stack when calling out
-	m_bounce = &VM::interpretCases;
+	m_interpret = m_threaded ? &VM::interpretCases<true> : &VM::interpretCases<false>;
+	m_bounce = m_interpret;
 	do
 		(this->*m_bounce)();
 	while (m_bounce);
@@ -178,19 +182,19 @@ bytesConstRef VM::execImpl(u256& io_gas, ExtVMFace& _ext, OnOpFunc const& _onOp)
 
 void VM::caseCreate()
 {
-	m_bounce = &VM::interpretCases;
+	m_bounce = m_interpret;
 	m_newMemSize = memNeed(*(m_SP - 1), *(m_SP - 2));
 	m_runGas = toUint64(m_schedule->createGas);
 	updateMem();
 	onOperation();
 	updateIOGas();
 	
-	auto const& endowment = *m_SP--;
+	u256 endowment = (m_SP--)->toU256();
 	uint64_t initOff = (uint64_t)*m_SP--;
 	uint64_t initSize = (uint64_t)*m_SP--;
 	
 	if (m_ext->balance(m_ext->myAddress) >= endowment && m_ext->depth < 1024)
-		*++m_SP = (u160)m_ext->create(endowment, *m_io_gas, bytesConstRef(m_mem.data() + initOff, initSize), *m_onOp);
+		*++m_SP = fromAddress(m_ext->create(endowment, *m_io_gas, bytesConstRef(m_mem.data() + initOff, initSize), *m_onOp));
 	else
 		*++m_SP = 0;
 	++m_PC;
@@ -198,19 +202,18 @@ void VM::caseCreate()
 
 void VM::caseCall()
 {
-	m_bounce = &VM::interpretCases;
-	unique_ptr<CallParameters> callParams(new CallParameters());
-	if (caseCallSetup(&*callParams))
-		*++m_SP = m_ext->call(*callParams);
+	m_bounce = m_interpret;
+	if (caseCallSetup(&m_callParams))
+		*++m_SP = m_ext->call(m_callParams);
 	else
 		*++m_SP = 0;
-	*m_io_gas += callParams->gas;
+	*m_io_gas += m_callParams.gas;
 	++m_PC;
 }
 
 bool VM::caseCallSetup(CallParameters *callParams)
 {
-	m_runGas = toUint64(u512(*m_SP) + m_schedule->callGas);
+	m_runGas = toUint64(u512(m_SP->toU256()) + m_schedule->callGas);
 
 	if (m_inst == Instruction::CALL && !m_ext->exists(asAddress(*(m_SP - 1))))
 	{
@@ -229,7 +232,7 @@ bool VM::caseCallSetup(CallParameters *callParams)
 	onOperation();
 	updateIOGas();
 
-	callParams->gas = *m_SP;
+	callParams->gas = m_SP->toU256();
 	if (m_inst != Instruction::DELEGATECALL && *(m_SP - 2) > 0)
 		callParams->gas += m_schedule->callStipend;
 	--m_SP;
@@ -244,7 +247,7 @@ bool VM::caseCallSetup(CallParameters *callParams)
 	}
 	else
 	{
-		callParams->apparentValue = callParams->valueTransfer = *m_SP;
+		callParams->apparentValue = callParams->valueTransfer = m_SP->toU256();
 		--m_SP;
 	}
 
@@ -268,22 +271,67 @@ bool VM::caseCallSetup(CallParameters *callParams)
 }
 
 //
-// main interpreter loop and switch
+// Try to charge the tier gas of the basic block starting at m_PC and check its stack bounds
+// in one go. Declines, leaving every instruction to be checked on its own as before, when
+// a tracer is attached or when the block would fail part way through, so that failures keep
+// happening at the same instruction.
 //
-void VM::interpretCases()
+bool VM::enterBlock()
 {
-	for (;;)
+	if (m_PC >= m_analysis->codeSize || *m_onOp)
+		return false;
+	uint32_t index = m_analysis->blockIndex[m_PC];
+	if (index == CodeAnalysis::c_none)
+		return false;
+	CodeAnalysis::Block const& block = m_analysis->blocks[index];
+	int const size = 1 + m_SP - m_stack;
+	if (size < block.stackRequired || size + block.stackMaxGrowth > 1024 ||
+		*m_io_gas < block.gas || m_nSteps + block.instructions >= m_nStepsLimit)
+		return false;
+	*m_io_gas -= block.gas;
+	m_chargedTo = block.end;
+	return true;
+}
+
+//
+// fetch the instruction at m_PC and charge its tier gas
+//
+inline void VM::fetchInstruction()
+{
+	m_inst = (Instruction)m_code[m_PC];
+#if EVM_PROFILING
+	m_profile->step(m_inst);
+#endif
+
+	// FEES...
+	if (m_PC < m_chargedTo || enterBlock())
+		m_runGas = 0;
+	else
 	{
-		m_inst = (Instruction)m_ext->getCode(m_PC);
+		m_chargedTo = 0;
 		InstructionMetric metric = c_metrics[static_cast<size_t>(m_inst)];
-		
 		checkStack(metric.args, metric.ret);
-		
-		// FEES...
 		m_runGas = toUint64(m_schedule->tierStepGas[metric.gasPriceTier]);
-		m_newMemSize = m_mem.size();
-		m_copyMemSize = 0;
-		
+	}
+	m_newMemSize = m_mem.size();
+	m_copyMemSize = 0;
+}
+
+//
+// main interpreter loop and switch, see VMConfig.h for the dispatch macros
+//
+template <bool _threaded> void VM::interpretCases()
+{
+	EVM_JUMP_TABLE
+#if EVM_THREADED_DISPATCH
+	if (_threaded)
+		DISPATCH()
+#endif
+
+	for (;;)
+	{
+		fetchInstruction();
+
 		switch (m_inst)
 		{
 		
@@ -291,21 +339,21 @@ void VM::interpretCases()
 		// Call-related instructions
 		//
 		
-		case Instruction::CREATE:
+		CASE(CREATE)
 //			caseCreate();
 //			break;
 			m_bounce = &VM::caseCreate;
 			return;
 
-		case Instruction::DELEGATECALL:
+		CASE(DELEGATECALL)
 
 			// Pre-homestead
 			if (!m_schedule->haveDelegateCall)
 				throwBadInstruction(); // TODO temp BadInstruction
 				// throwVMException(BadInstruction());
 
-		case Instruction::CALL:
-		case Instruction::CALLCODE:
+		CASE(CALL)
+		CASE(CALLCODE)
 		{
 //			caseCall();
 //			break;
@@ -313,7 +361,7 @@ void VM::interpretCases()
 			return;
 		}
 
-		case Instruction::RETURN:
+		CASE(RETURN)
 		{
 			m_newMemSize = memNeed(*m_SP, *(m_SP - 1));
 			updateMem();
@@ -327,7 +375,7 @@ void VM::interpretCases()
 			return;
 		}
 
-		case Instruction::SUICIDE:
+		CASE(SUICIDE)
 		{
 			onOperation();
 			updateIOGas();
@@ -338,7 +386,7 @@ void VM::interpretCases()
 			return;
 		}
 
-		case Instruction::STOP:
+		CASE(STOP)
 			onOperation();
 			updateIOGas();
 
@@ -350,44 +398,44 @@ void VM::interpretCases()
 		// instructions potentially expanding memory
 		//
 		
-		case Instruction::MLOAD:
+		CASE(MLOAD)
 		{
 			m_newMemSize = toUint64(*m_SP) + 32;
 			updateMem();
 			onOperation();
 			updateIOGas();
 
-			*m_SP = (u256)*(h256 const*)(m_mem.data() + (unsigned)*m_SP);
-			break;
+			*m_SP = Word256::fromBigEndian(m_mem.data() + (uint64_t)*m_SP);
+			NEXT
 		}
 
-		case Instruction::MSTORE:
+		CASE(MSTORE)
 		{
 			m_newMemSize = toUint64(*m_SP) + 32;
 			updateMem();
 			onOperation();
 			updateIOGas();
 
-			*(h256*)&m_mem[(unsigned)*m_SP] = (h256)*(m_SP - 1);
+			(m_SP - 1)->toBigEndian(m_mem.data() + (uint64_t)*m_SP);
 			m_SP -= 2;
-			break;
+			NEXT
 		}
 
-		case Instruction::MSTORE8:
+		CASE(MSTORE8)
 		{
 			m_newMemSize = toUint64(*m_SP) + 1;
 			updateMem();
 			onOperation();
 			updateIOGas();
 
-			m_mem[(unsigned)*m_SP] = (byte)(*(m_SP - 1) & 0xff);
+			m_mem[(uint64_t)*m_SP] = (byte)((m_SP - 1)->limb(0) & 0xff);
 			m_SP -= 2;
-			break;
+			NEXT
 		}
 
-		case Instruction::SHA3:
+		CASE(SHA3)
 		{
-			m_runGas = toUint64(m_schedule->sha3Gas + (u512(*(m_SP - 1)) + 31) / 32 * m_schedule->sha3WordGas);
+			m_runGas = toUint64(m_schedule->sha3Gas + (u512((m_SP - 1)->toU256()) + 31) / 32 * m_schedule->sha3WordGas);
 			m_newMemSize = memNeed(*m_SP, *(m_SP - 1));
 			updateMem();
 			onOperation();
@@ -395,65 +443,65 @@ void VM::interpretCases()
 
 			uint64_t inOff = (uint64_t)*m_SP--;
 			uint64_t inSize = (uint64_t)*m_SP--;
-			*++m_SP = (u256)sha3(bytesConstRef(m_mem.data() + inOff, inSize));
-			break;
+			*++m_SP = Word256(sha3(bytesConstRef(m_mem.data() + inOff, inSize)));
+			NEXT
 		}
 
-		case Instruction::LOG0:
+		CASE(LOG0)
 			logGasMem(m_inst);
 			onOperation();
 			updateIOGas();
 
 			m_ext->log({}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
 			m_SP -= 2;
-			break;
+			NEXT
 
-		case Instruction::LOG1:
+		CASE(LOG1)
 			logGasMem(m_inst);
 			onOperation();
 			updateIOGas();
 
-			m_ext->log({*(m_SP - 2)}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
+			m_ext->log({(m_SP - 2)->toHash()}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
 			m_SP -= 3;
-			break;
+			NEXT
 
-		case Instruction::LOG2:
+		CASE(LOG2)
 			logGasMem(m_inst);
 			onOperation();
 			updateIOGas();
 
-			m_ext->log({*(m_SP - 2), *(m_SP-3)}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
+			m_ext->log({(m_SP - 2)->toHash(), (m_SP - 3)->toHash()}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
 			m_SP -= 4;
-			break;
+			NEXT
 
-		case Instruction::LOG3:
+		CASE(LOG3)
 			logGasMem(m_inst);
 			onOperation();
 			updateIOGas();
 
-			m_ext->log({*(m_SP - 2), *(m_SP-3), *(m_SP-4)}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
+			m_ext->log({(m_SP - 2)->toHash(), (m_SP - 3)->toHash(), (m_SP - 4)->toHash()}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
 			m_SP -= 5;
-			break;
-		case Instruction::LOG4:
+			NEXT
+		CASE(LOG4)
 			logGasMem(m_inst);
 			onOperation();
 			updateIOGas();
 
-			m_ext->log({*(m_SP - 2), *(m_SP-3), *(m_SP-4), *(m_SP-5)}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
+			m_ext->log({(m_SP - 2)->toHash(), (m_SP - 3)->toHash(), (m_SP - 4)->toHash(), (m_SP - 5)->toHash()}, bytesConstRef(m_mem.data() + (uint64_t)*m_SP, (uint64_t)*(m_SP - 1)));
 			m_SP -= 6;
-			break;	
+			NEXT
 
-		case Instruction::EXP:
+		CASE(EXP)
 		{
 			auto expon = *(m_SP - 1);
-			m_runGas = toUint64(m_schedule->expGas + m_schedule->expByteGas * (32 - (h256(expon).firstBitSet() / 8)));
+			m_runGas = toUint64(m_schedule->expGas + m_schedule->expByteGas * expon.byteLength());
 			updateMem();
 			onOperation();
 			updateIOGas();
 
 			auto base = *m_SP--;
-			*m_SP = (u256)boost::multiprecision::powm((bigint)base, (bigint)expon, bigint(1) << 256);
-			break;
+			*m_SP = Word256::exp(base, expon);
+			NEXT
 		}
 
 
@@ -461,262 +509,253 @@ void VM::interpretCases()
 		// ordinary instructions
 		//
 
-		case Instruction::ADD:
+		CASE(ADD)
 			onOperation();
 			updateIOGas();
 
 			//pops two items and pushes S[-1] + S[-2] mod 2^256.
 			*(m_SP - 1) += *m_SP;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::MUL:
+		CASE(MUL)
 			onOperation();
 			updateIOGas();
 
 			//pops two items and pushes S[-1] * S[-2] mod 2^256.
 			*(m_SP - 1) *= *m_SP;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::SUB:
+		CASE(SUB)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP - *(m_SP - 1);
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::DIV:
+		CASE(DIV)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = *(m_SP - 1) ? divWorkaround(*m_SP, *(m_SP - 1)) : 0;
+			*(m_SP - 1) = *m_SP / *(m_SP - 1);
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::SDIV:
+		CASE(SDIV)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = *(m_SP - 1) ? s2u(divWorkaround(u2s(*m_SP), u2s(*(m_SP - 1)))) : 0;
+			*(m_SP - 1) = Word256::sdiv(*m_SP, *(m_SP - 1));
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::MOD:
+		CASE(MOD)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = *(m_SP - 1) ? modWorkaround(*m_SP, *(m_SP - 1)) : 0;
+			*(m_SP - 1) = *m_SP % *(m_SP - 1);
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::SMOD:
+		CASE(SMOD)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = *(m_SP - 1) ? s2u(modWorkaround(u2s(*m_SP), u2s(*(m_SP - 1)))) : 0;
+			*(m_SP - 1) = Word256::smod(*m_SP, *(m_SP - 1));
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::NOT:
+		CASE(NOT)
 			onOperation();
 			updateIOGas();
 
 			*m_SP = ~*m_SP;
-			break;
+			NEXT
 
-		case Instruction::LT:
+		CASE(LT)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP < *(m_SP - 1) ? 1 : 0;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::GT:
+		CASE(GT)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP > *(m_SP - 1) ? 1 : 0;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::SLT:
+		CASE(SLT)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = u2s(*m_SP) < u2s(*(m_SP - 1)) ? 1 : 0;
+			*(m_SP - 1) = Word256::slt(*m_SP, *(m_SP - 1)) ? 1 : 0;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::SGT:
+		CASE(SGT)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = u2s(*m_SP) > u2s(*(m_SP - 1)) ? 1 : 0;
+			*(m_SP - 1) = Word256::slt(*(m_SP - 1), *m_SP) ? 1 : 0;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::EQ:
+		CASE(EQ)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP == *(m_SP - 1) ? 1 : 0;
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::ISZERO:
+		CASE(ISZERO)
 			onOperation();
 			updateIOGas();
 
 			*m_SP = *m_SP ? 0 : 1;
-			break;
+			NEXT
 
-		case Instruction::AND:
+		CASE(AND)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP & *(m_SP - 1);
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::OR:
+		CASE(OR)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP | *(m_SP - 1);
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::XOR:
+		CASE(XOR)
 			onOperation();
 			updateIOGas();
 
 			*(m_SP - 1) = *m_SP ^ *(m_SP - 1);
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::BYTE:
+		CASE(BYTE)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 1) = *m_SP < 32 ? (*(m_SP - 1) >> (unsigned)(8 * (31 - *m_SP))) & 0xff : 0;
+			*(m_SP - 1) = Word256::byteAt(*m_SP, *(m_SP - 1));
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::ADDMOD:
+		CASE(ADDMOD)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 2) = *(m_SP - 2) ? u256((u512(*m_SP) + u512(*(m_SP - 1))) % *(m_SP - 2)) : 0;
+			*(m_SP - 2) = Word256::addmod(*m_SP, *(m_SP - 1), *(m_SP - 2));
 			m_SP -= 2;
-			break;
+			NEXT
 
-		case Instruction::MULMOD:
+		CASE(MULMOD)
 			onOperation();
 			updateIOGas();
 
-			*(m_SP - 2) = *(m_SP - 2) ? u256((u512(*m_SP) * u512(*(m_SP - 1))) % *(m_SP - 2)) : 0;
+			*(m_SP - 2) = Word256::mulmod(*m_SP, *(m_SP - 1), *(m_SP - 2));
 			m_SP -= 2;
-			break;
+			NEXT
 
-		case Instruction::SIGNEXTEND:
+		CASE(SIGNEXTEND)
 			onOperation();
 			updateIOGas();
 
-			if (*m_SP < 31)
-			{
-				auto testBit = static_cast<unsigned>(*m_SP) * 8 + 7;
-				u256& number = *(m_SP - 1);
-				u256 mask = ((u256(1) << testBit) - 1);
-				if (boost::multiprecision::bit_test(number, testBit))
-					number |= ~mask;
-				else
-					number &= mask;
-			}
+			*(m_SP - 1) = Word256::signextend(*m_SP, *(m_SP - 1));
 			--m_SP;
-			break;
+			NEXT
 
-		case Instruction::ADDRESS:
+		CASE(ADDRESS)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = fromAddress(m_ext->myAddress);
-			break;
+			NEXT
 
-		case Instruction::ORIGIN:
+		CASE(ORIGIN)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = fromAddress(m_ext->origin);
-			break;
+			NEXT
 
-		case Instruction::BALANCE:
+		CASE(BALANCE)
 		{
 			onOperation();
 			updateIOGas();
 
 			*m_SP = m_ext->balance(asAddress(*m_SP));
-			break;
+			NEXT
 		}
 
-		case Instruction::CALLER:
+		CASE(CALLER)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = fromAddress(m_ext->caller);
-			break;
+			NEXT
 
-		case Instruction::CALLVALUE:
+		CASE(CALLVALUE)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->value;
-			break;
+			NEXT
 
 
-		case Instruction::CALLDATALOAD:
+		CASE(CALLDATALOAD)
 		{
 			onOperation();
 			updateIOGas();
 
-			if (u512(*m_SP) + 31 < m_ext->data.size())
-				*m_SP = (u256)*(h256 const*)(m_ext->data.data() + (size_t)*m_SP);
+			if (m_SP->fitsUint64() && (uint64_t)*m_SP < m_ext->data.size() && m_ext->data.size() - (uint64_t)*m_SP > 31)
+				*m_SP = Word256::fromBigEndian(m_ext->data.data() + (uint64_t)*m_SP);
 			else if (*m_SP >= m_ext->data.size())
-				*m_SP = u256(0);
+				*m_SP = Word256();
 			else
 			{
 				h256 r;
 				for (uint64_t i = (uint64_t)*m_SP, e = (uint64_t)*m_SP + (uint64_t)32, j = 0; i < e; ++i, ++j)
 					r[j] = i < m_ext->data.size() ? m_ext->data[i] : 0;
-				*m_SP = (u256)r;
+				*m_SP = Word256(r);
 			}
-			break;
+			NEXT
 		}
 
-		case Instruction::CALLDATASIZE:
+		CASE(CALLDATASIZE)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->data.size();
-			break;
+			NEXT
 
-		case Instruction::CODESIZE:
+		CASE(CODESIZE)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->code.size();
-			break;
+			NEXT
 
-		case Instruction::EXTCODESIZE:
+		CASE(EXTCODESIZE)
 			onOperation();
 			updateIOGas();
 
 			*m_SP = m_ext->codeAt(asAddress(*m_SP)).size();
-			break;
+			NEXT
 
-		case Instruction::CALLDATACOPY:
+		CASE(CALLDATACOPY)
 			m_copyMemSize = toUint64(*(m_SP - 2));
 			m_newMemSize = memNeed(*m_SP, *(m_SP - 2));
 			updateMem();
@@ -724,19 +763,19 @@ void VM::interpretCases()
 			updateIOGas();
 
 			copyDataToMemory(m_ext->data, m_SP);
-			break;
+			NEXT
 
-		case Instruction::CODECOPY:
+		CASE(CODECOPY)
 			m_copyMemSize = toUint64(*(m_SP - 2));
 			m_newMemSize = memNeed(*m_SP, *(m_SP - 2));
 			updateMem();
 			onOperation();
 			updateIOGas();
 
-			copyDataToMemory(&m_ext->code, m_SP);
-			break;
+			copyDataToMemory(m_ext->code, m_SP);
+			NEXT
 
-		case Instruction::EXTCODECOPY:
+		CASE(EXTCODECOPY)
 		{
 			m_copyMemSize = toUint64(*(m_SP - 3));
 			m_newMemSize = memNeed(*(m_SP - 1), *(m_SP - 3));
@@ -747,145 +786,145 @@ void VM::interpretCases()
 			auto a = asAddress(*m_SP);
 			--m_SP;
 			copyDataToMemory(&m_ext->codeAt(a), m_SP);
-			break;
+			NEXT
 		}
 
-		case Instruction::GASPRICE:
+		CASE(GASPRICE)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->gasPrice;
-			break;
+			NEXT
 
-		case Instruction::BLOCKHASH:
+		CASE(BLOCKHASH)
 			onOperation();
 			updateIOGas();
 
-			*m_SP = (u256)m_ext->blockHash(*m_SP);
-			break;
+			*m_SP = Word256(m_ext->blockHash(m_SP->toU256()));
+			NEXT
 
-		case Instruction::COINBASE:
+		CASE(COINBASE)
 			onOperation();
 			updateIOGas();
 
-			*++m_SP = (u160)m_ext->envInfo().author();
-			break;
+			*++m_SP = fromAddress(m_ext->envInfo().author());
+			NEXT
 
-		case Instruction::TIMESTAMP:
+		CASE(TIMESTAMP)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->envInfo().timestamp();
-			break;
+			NEXT
 
-		case Instruction::NUMBER:
+		CASE(NUMBER)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->envInfo().number();
-			break;
+			NEXT
 
-		case Instruction::DIFFICULTY:
+		CASE(DIFFICULTY)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->envInfo().difficulty();
-			break;
+			NEXT
 
-		case Instruction::GASLIMIT:
+		CASE(GASLIMIT)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_ext->envInfo().gasLimit();
-			break;
+			NEXT
 
-		case Instruction::POP:
+		CASE(POP)
 			onOperation();
 			updateIOGas();
 
 			--m_SP;
-			break;
-
-		case Instruction::PUSH1:
-		case Instruction::PUSH2:
-		case Instruction::PUSH3:
-		case Instruction::PUSH4:
-		case Instruction::PUSH5:
-		case Instruction::PUSH6:
-		case Instruction::PUSH7:
-		case Instruction::PUSH8:
-		case Instruction::PUSH9:
-		case Instruction::PUSH10:
-		case Instruction::PUSH11:
-		case Instruction::PUSH12:
-		case Instruction::PUSH13:
-		case Instruction::PUSH14:
-		case Instruction::PUSH15:
-		case Instruction::PUSH16:
-		case Instruction::PUSH17:
-		case Instruction::PUSH18:
-		case Instruction::PUSH19:
-		case Instruction::PUSH20:
-		case Instruction::PUSH21:
-		case Instruction::PUSH22:
-		case Instruction::PUSH23:
-		case Instruction::PUSH24:
-		case Instruction::PUSH25:
-		case Instruction::PUSH26:
-		case Instruction::PUSH27:
-		case Instruction::PUSH28:
-		case Instruction::PUSH29:
-		case Instruction::PUSH30:
-		case Instruction::PUSH31:
-		case Instruction::PUSH32:
+			NEXT
+
+		CASE(PUSH1)
+		CASE(PUSH2)
+		CASE(PUSH3)
+		CASE(PUSH4)
+		CASE(PUSH5)
+		CASE(PUSH6)
+		CASE(PUSH7)
+		CASE(PUSH8)
+		CASE(PUSH9)
+		CASE(PUSH10)
+		CASE(PUSH11)
+		CASE(PUSH12)
+		CASE(PUSH13)
+		CASE(PUSH14)
+		CASE(PUSH15)
+		CASE(PUSH16)
+		CASE(PUSH17)
+		CASE(PUSH18)
+		CASE(PUSH19)
+		CASE(PUSH20)
+		CASE(PUSH21)
+		CASE(PUSH22)
+		CASE(PUSH23)
+		CASE(PUSH24)
+		CASE(PUSH25)
+		CASE(PUSH26)
+		CASE(PUSH27)
+		CASE(PUSH28)
+		CASE(PUSH29)
+		CASE(PUSH30)
+		CASE(PUSH31)
+		CASE(PUSH32)
 		{
 			onOperation();
 			updateIOGas();
 
-			int i = (int)m_inst - (int)Instruction::PUSH1 + 1;
-			*++m_SP = 0;
-			for (++m_PC; i--; ++m_PC)
-				*m_SP = (*m_SP << 8) | m_ext->getCode(m_PC);
-			continue;
+			*++m_SP = m_analysis->pushValues[m_analysis->pushIndex[m_PC]];
+			m_PC += (unsigned)m_inst - (unsigned)Instruction::PUSH1 + 2;
+			CONTINUE
 		}
 
-		case Instruction::JUMP:
+		CASE(JUMP)
 			onOperation();
 			updateIOGas();
 
 			m_PC = verifyJumpDest(*m_SP);
+			m_chargedTo = 0;
 			--m_SP;
-			continue;
+			CONTINUE
 
-		case Instruction::JUMPI:
+		CASE(JUMPI)
 			onOperation();
 			updateIOGas();
 
 			if (*(m_SP - 1))
 			{
 				m_PC = verifyJumpDest(*m_SP);
+				m_chargedTo = 0;
 				m_SP -= 2;
-				continue;
+				CONTINUE
 			}
 			m_SP -= 2;
-			break;
-
-		case Instruction::DUP1:
-		case Instruction::DUP2:
-		case Instruction::DUP3:
-		case Instruction::DUP4:
-		case Instruction::DUP5:
-		case Instruction::DUP6:
-		case Instruction::DUP7:
-		case Instruction::DUP8:
-		case Instruction::DUP9:
-		case Instruction::DUP10:
-		case Instruction::DUP11:
-		case Instruction::DUP12:
-		case Instruction::DUP13:
-		case Instruction::DUP14:
-		case Instruction::DUP15:
-		case Instruction::DUP16:
+			NEXT
+
+		CASE(DUP1)
+		CASE(DUP2)
+		CASE(DUP3)
+		CASE(DUP4)
+		CASE(DUP5)
+		CASE(DUP6)
+		CASE(DUP7)
+		CASE(DUP8)
+		CASE(DUP9)
+		CASE(DUP10)
+		CASE(DUP11)
+		CASE(DUP12)
+		CASE(DUP13)
+		CASE(DUP14)
+		CASE(DUP15)
+		CASE(DUP16)
 		{
 			onOperation();
 			updateIOGas();
@@ -893,25 +932,25 @@ void VM::interpretCases()
 			unsigned n = 1 + (unsigned)m_inst - (unsigned)Instruction::DUP1;
 			*(m_SP+1) = m_stack[(1 + m_SP - m_stack) - n];
 			++m_SP;
-			break;
+			NEXT
 		}
 
-		case Instruction::SWAP1:
-		case Instruction::SWAP2:
-		case Instruction::SWAP3:
-		case Instruction::SWAP4:
-		case Instruction::SWAP5:
-		case Instruction::SWAP6:
-		case Instruction::SWAP7:
-		case Instruction::SWAP8:
-		case Instruction::SWAP9:
-		case Instruction::SWAP10:
-		case Instruction::SWAP11:
-		case Instruction::SWAP12:
-		case Instruction::SWAP13:
-		case Instruction::SWAP14:
-		case Instruction::SWAP15:
-		case Instruction::SWAP16:
+		CASE(SWAP1)
+		CASE(SWAP2)
+		CASE(SWAP3)
+		CASE(SWAP4)
+		CASE(SWAP5)
+		CASE(SWAP6)
+		CASE(SWAP7)
+		CASE(SWAP8)
+		CASE(SWAP9)
+		CASE(SWAP10)
+		CASE(SWAP11)
+		CASE(SWAP12)
+		CASE(SWAP13)
+		CASE(SWAP14)
+		CASE(SWAP15)
+		CASE(SWAP16)
 		{
 			onOperation();
 			updateIOGas();
@@ -920,21 +959,24 @@ void VM::interpretCases()
 			auto d = *m_SP;
 			*m_SP = m_stack[(1 + m_SP - m_stack) - n];
 			m_stack[(1 + m_SP - m_stack) - n] = d;
-			break;
+			NEXT
 		}
 
-		case Instruction::SLOAD:
+		CASE(SLOAD)
 			m_runGas = toUint64(m_schedule->sloadGas);
 			onOperation();
 			updateIOGas();
 
-			*m_SP = m_ext->store(*m_SP);
-			break;
+			*m_SP = m_ext->store(m_SP->toU256());
+			NEXT
 
-		case Instruction::SSTORE:
-			if (!m_ext->store(*m_SP) && *(m_SP - 1))
+		CASE(SSTORE)
+		{
+			u256 key = m_SP->toU256();
+			bool currentZero = !m_ext->store(key);
+			if (currentZero && *(m_SP - 1))
 				m_runGas = toUint64(m_schedule->sstoreSetGas);
-			else if (m_ext->store(*m_SP) && !*(m_SP - 1))
+			else if (!currentZero && !*(m_SP - 1))
 			{
 				m_runGas = toUint64(m_schedule->sstoreResetGas);
 				m_ext->sub.refunds += m_schedule->sstoreRefundGas;
@@ -944,43 +986,42 @@ void VM::interpretCases()
 			onOperation();
 			updateIOGas();
 	
-			m_ext->setStore(*m_SP, *(m_SP - 1));
+			m_ext->setStore(key, (m_SP - 1)->toU256());
 			m_SP -= 2;
-			break;
+			NEXT
+		}
 
-		case Instruction::PC:
+		CASE(PC)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_PC;
-			break;
+			NEXT
 
-		case Instruction::MSIZE:
+		CASE(MSIZE)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = m_mem.size();
-			break;
+			NEXT
 
-		case Instruction::GAS:
+		CASE(GAS)
 			onOperation();
 			updateIOGas();
 
 			*++m_SP = *m_io_gas;
-			break;
+			NEXT
 
-		case Instruction::JUMPDEST:
+		CASE(JUMPDEST)
 			m_runGas = 1;
 			onOperation();
 			updateIOGas();
-			break;
+			NEXT
 
-		default:
+		CASE_DEFAULT
 			// throwVMException(BadInstruction());
 			throwBadInstruction(); // TODO temp BadInstruction
 		}
-		
-		++m_PC;
 	}
-
 }
+
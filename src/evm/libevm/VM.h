@@ -21,11 +21,22 @@
 
 #pragma once
 
+#include <chrono>
 #include <unordered_map>
 #include <libdevcore/Exceptions.h>
 #include <libevmcore/Instruction.h>
 #include <libdevcore/SHA3.h>
+#include <libdevcore/Word256.h>
 #include "VMFace.h"
+#include "CodeAnalysis.h"
+#include "VMProfiler.h"
+
+// Threaded dispatch needs the labels-as-values extension.
+#if defined(__GNUC__)
+#define EVM_THREADED_DISPATCH 1
+#else
+#define EVM_THREADED_DISPATCH 0
+#endif
 
 namespace dev
 {
@@ -49,9 +60,14 @@ public:
 	virtual bytesConstRef execImpl(u256& io_gas, ExtVMFace& _ext, OnOpFunc const& _onOp) override final;
 
 	bytes const& memory() const { return m_mem; }
-	u256s stack() const { assert(m_stack <= m_SP + 1); return u256s(m_stack, m_SP + 1); };
+	u256s stack() const { assert(m_stack <= m_SP + 1); u256s ret; for (Word256 const* i = m_stack; i <= m_SP; ++i) ret.push_back(i->toU256()); return ret; };
+
+	/// @param _threaded dispatch through a computed-goto table rather than a switch; ignored when
+	/// the compiler lacks EVM_THREADED_DISPATCH.
+	explicit VM(bool _threaded = false): m_threaded(_threaded && EVM_THREADED_DISPATCH), m_mem(acquireMemory()), m_stack_vector(acquireStack()), m_stack(m_stack_vector.data() + 1) {};
 
-	VM(): m_stack_vector(1025), m_stack(m_stack_vector.data() + 1) {};
+	/// Hands the stack and memory over to the next VM created on this thread.
+	virtual ~VM();
 
 private:
 
@@ -62,21 +78,43 @@ private:
 	static std::array<InstructionMetric, 256> c_metrics;
 	static void initMetrics();
 
-	void makeJumpDestTable(ExtVMFace& _ext);
-	uint64_t verifyJumpDest(u256 const& _dest);
-	void copyDataToMemory(bytesConstRef _data, u256*& m_SP);
+	// stacks and memories of finished VMs, kept per thread so a call chain allocates them once per depth
+	static Word256s acquireStack();
+	static bytes acquireMemory();
+
+	// deadline of the thread, see VMDeadline; checked every c_deadlineSteps steps
+	static std::chrono::steady_clock::time_point threadDeadline();
+	static uint64_t const c_deadlineSteps = 1024;
+	void checkDeadline();
+	std::chrono::steady_clock::time_point m_deadline;
+
+	void analyseCode(ExtVMFace& _ext);
+	bool enterBlock();
+	uint64_t verifyJumpDest(Word256 const& _dest);
+	void copyDataToMemory(bytesConstRef _data, Word256*& m_SP);
 	// void throwVMStackException(unsigned _size, unsigned _n, unsigned _d);
 	void throwBadStack(unsigned _size, unsigned _n, unsigned _d);
 	void reportStackUse();
 
-	uint64_t memNeed(u256 _offset, u256 _size); // TODO temp OutOfGas
+	uint64_t memNeed(Word256 const& _offset, Word256 const& _size); // TODO temp OutOfGas
 	void throwOutOfGas(); // TODO temp OutOfGas
 	void throwBadInstruction(); // TODO temp BadInstruction
 	void throwBadJumpDestination(); // TODO temp BadJumpDestination
 
-	std::unordered_set<uint64_t> m_jumpDests;
+	// shared analysis of the running code, see CodeAnalysisCache
+	std::shared_ptr<CodeAnalysis const> m_analysis;
+	byte const* m_code = nullptr;
+	// end of the block whose tier gas and stack bounds were checked on entry; 0 if none
+	uint64_t m_chargedTo = 0;
+
+#if EVM_PROFILING
+	// statistics of the running frame, lives on execImpl's stack
+	VMProfiler::Frame* m_profile = nullptr;
+#endif
 
 	typedef void (VM::*MemFnPtr)();
+	bool m_threaded;
+	MemFnPtr m_interpret = 0;
 	MemFnPtr m_bounce = 0;
 	MemFnPtr m_onFail = 0;
 	uint64_t m_nSteps = 0;
@@ -86,16 +124,19 @@ private:
 	// return bytes
 	bytesConstRef m_bytes = bytesConstRef();
 
+	// parameters of the CALL being made, kept off the native stack that nested calls run on
+	CallParameters m_callParams;
+
 	// space for memory
 	bytes m_mem;
 
-	// space for stack
-	u256s m_stack_vector;
-	u256* m_stack;
+	// space for stack, kept in native 256-bit words; values become u256 only when passed to m_ext
+	Word256s m_stack_vector;
+	Word256* m_stack;
 
 	// interpreter state
 	uint64_t m_PC = 0;
-	u256* m_SP = m_stack - 1;
+	Word256* m_SP = m_stack - 1;
 	Instruction m_inst;
 
 	// metering and memory state
@@ -112,7 +153,8 @@ private:
 	void logGasMem(Instruction m_inst);
 
 	// interpreter loop & switch
-	void interpretCases();
+	void fetchInstruction();
+	template <bool _threaded> void interpretCases();
 
 	// interpreter cases that call out
 	void caseCreate();
@@ -130,6 +172,25 @@ private:
 	}
 };
 
+/**
+ * Makes the VMs run on this thread while it lives throw OutOfGas once the steady clock passes
+ * the deadline. Unlike a tracer doing the same, it keeps gas charged by basic block and
+ * instructions dispatched as the VM kind does.
+ */
+class VMDeadline
+{
+public:
+	explicit VMDeadline(std::chrono::steady_clock::time_point _deadline);
+	~VMDeadline();
+
+	/// Whether a VM was stopped by the deadline
+	bool passed() const;
+
+private:
+	std::chrono::steady_clock::time_point m_previous;
+	bool m_previousPassed;
+};
+
 // void throwVMException(VMException);
 
 }
@@ -0,0 +1,69 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMConfig.h
+ *
+ * Dispatch macros for VM::interpretCases. Only to be included by VM.cpp.
+ *
+ * The case bodies are written once. With _threaded false they run in the classic loop around
+ * a switch. With _threaded true every case ends by fetching and charging the next instruction
+ * and jumping straight to its label through c_jumpTable, so each opcode gets its own indirect
+ * branch and the branch predictor can learn opcode sequences.
+ */
+
+#pragma once
+
+#include "VM.h"
+
+#if EVM_THREADED_DISPATCH
+
+#define CASE(name) case Instruction::name: L_##name:
+#define CASE_DEFAULT default: L_INVALID:
+#define DISPATCH() { fetchInstruction(); goto *c_jumpTable[(byte)m_inst]; }
+#define NEXT { ++m_PC; if (_threaded) DISPATCH() break; }
+#define CONTINUE { if (_threaded) DISPATCH() continue; }
+
+// Label of the case for each opcode byte, in opcode order.
+#define EVM_JUMP_TABLE \
+	static void const* const c_jumpTable[256] = \
+	{ \
+		&&L_STOP, &&L_ADD, &&L_MUL, &&L_SUB, &&L_DIV, &&L_SDIV, &&L_MOD, &&L_SMOD, &&L_ADDMOD, &&L_MULMOD, &&L_EXP, &&L_SIGNEXTEND, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_LT, &&L_GT, &&L_SLT, &&L_SGT, &&L_EQ, &&L_ISZERO, &&L_AND, &&L_OR, &&L_XOR, &&L_NOT, &&L_BYTE, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_SHA3, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_ADDRESS, &&L_BALANCE, &&L_ORIGIN, &&L_CALLER, &&L_CALLVALUE, &&L_CALLDATALOAD, &&L_CALLDATASIZE, &&L_CALLDATACOPY, &&L_CODESIZE, &&L_CODECOPY, &&L_GASPRICE, &&L_EXTCODESIZE, &&L_EXTCODECOPY, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_BLOCKHASH, &&L_COINBASE, &&L_TIMESTAMP, &&L_NUMBER, &&L_DIFFICULTY, &&L_GASLIMIT, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_POP, &&L_MLOAD, &&L_MSTORE, &&L_MSTORE8, &&L_SLOAD, &&L_SSTORE, &&L_JUMP, &&L_JUMPI, &&L_PC, &&L_MSIZE, &&L_GAS, &&L_JUMPDEST, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_PUSH1, &&L_PUSH2, &&L_PUSH3, &&L_PUSH4, &&L_PUSH5, &&L_PUSH6, &&L_PUSH7, &&L_PUSH8, &&L_PUSH9, &&L_PUSH10, &&L_PUSH11, &&L_PUSH12, &&L_PUSH13, &&L_PUSH14, &&L_PUSH15, &&L_PUSH16, \
+		&&L_PUSH17, &&L_PUSH18, &&L_PUSH19, &&L_PUSH20, &&L_PUSH21, &&L_PUSH22, &&L_PUSH23, &&L_PUSH24, &&L_PUSH25, &&L_PUSH26, &&L_PUSH27, &&L_PUSH28, &&L_PUSH29, &&L_PUSH30, &&L_PUSH31, &&L_PUSH32, \
+		&&L_DUP1, &&L_DUP2, &&L_DUP3, &&L_DUP4, &&L_DUP5, &&L_DUP6, &&L_DUP7, &&L_DUP8, &&L_DUP9, &&L_DUP10, &&L_DUP11, &&L_DUP12, &&L_DUP13, &&L_DUP14, &&L_DUP15, &&L_DUP16, \
+		&&L_SWAP1, &&L_SWAP2, &&L_SWAP3, &&L_SWAP4, &&L_SWAP5, &&L_SWAP6, &&L_SWAP7, &&L_SWAP8, &&L_SWAP9, &&L_SWAP10, &&L_SWAP11, &&L_SWAP12, &&L_SWAP13, &&L_SWAP14, &&L_SWAP15, &&L_SWAP16, \
+		&&L_LOG0, &&L_LOG1, &&L_LOG2, &&L_LOG3, &&L_LOG4, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, \
+		&&L_CREATE, &&L_CALL, &&L_CALLCODE, &&L_RETURN, &&L_DELEGATECALL, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_INVALID, &&L_SUICIDE, \
+	};
+
+#else
+
+#define CASE(name) case Instruction::name:
+#define CASE_DEFAULT default:
+#define NEXT { ++m_PC; break; }
+#define CONTINUE continue;
+#define EVM_JUMP_TABLE
+
+#endif
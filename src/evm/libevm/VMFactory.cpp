@@ -38,6 +38,11 @@ void VMFactory::setKind(VMKind _kind)
 	g_kind = _kind;
 }
 
+VMKind VMFactory::kind()
+{
+	return g_kind;
+}
+
 std::unique_ptr<VMFace> VMFactory::create()
 {
 	return create(g_kind);
@@ -51,14 +56,16 @@ std::unique_ptr<VMFace> VMFactory::create(VMKind _kind)
 	default:
 	case VMKind::Interpreter:
 		return std::unique_ptr<VMFace>(new VM);
+	case VMKind::Threaded:
+		return std::unique_ptr<VMFace>(new VM(true));
 	case VMKind::JIT:
 		return std::unique_ptr<VMFace>(new JitVM);
 	case VMKind::Smart:
 		return std::unique_ptr<VMFace>(new SmartVM);
 	}
 #else
-	asserts(_kind == VMKind::Interpreter && "JIT disabled in build configuration");
-	return std::unique_ptr<VMFace>(new VM);
+	asserts((_kind == VMKind::Interpreter || _kind == VMKind::Threaded) && "JIT disabled in build configuration");
+	return std::unique_ptr<VMFace>(new VM(_kind == VMKind::Threaded));
 #endif
 }
 
@@ -26,6 +26,7 @@ namespace eth
 enum class VMKind
 {
 	Interpreter,
+	Threaded,		///< Interpreter dispatching through a computed-goto table where the compiler supports it.
 	JIT,
 	Smart
 };
@@ -43,6 +44,9 @@ public:
 
 	/// Set global VM kind
 	static void setKind(VMKind _kind);
+
+	/// Global VM kind
+	static VMKind kind();
 };
 
 }
@@ -16,11 +16,115 @@
 */
 
 
+#include <mutex>
+#include <boost/thread/tss.hpp>
 #include "VM.h"
 using namespace std;
 using namespace dev;
 using namespace dev::eth;
 
+namespace
+{
+
+/// Memories grown past this are freed rather than kept for the next VM.
+size_t const c_maxPooledMemory = 1024 * 1024;
+/// Most stacks, and most memories, kept per thread. Calls nest up to 1024 deep, but a thread
+/// rarely runs more than a few VMs at once again after the deepest call returned.
+size_t const c_maxPooled = 16;
+/// Most bytes of memory kept per thread; memories beyond it are freed.
+size_t const c_maxPooledMemoryTotal = 4 * 1024 * 1024;
+
+struct VMArena
+{
+	vector<Word256s> stacks;
+	vector<bytes> memories;
+	/// Capacity of the memories kept
+	size_t memoryTotal = 0;
+	/// Set by VMDeadline; zero if none
+	chrono::steady_clock::time_point deadline;
+	bool deadlinePassed = false;
+};
+
+boost::thread_specific_ptr<VMArena> t_arena;
+
+VMArena& arena()
+{
+	if (!t_arena.get())
+		t_arena.reset(new VMArena);
+	return *t_arena;
+}
+
+}
+
+Word256s VM::acquireStack()
+{
+	VMArena& a = arena();
+	if (a.stacks.empty())
+		return Word256s(1025);
+	Word256s ret = move(a.stacks.back());
+	a.stacks.pop_back();
+	return ret;
+}
+
+bytes VM::acquireMemory()
+{
+	VMArena& a = arena();
+	if (a.memories.empty())
+		return bytes();
+	bytes ret = move(a.memories.back());
+	a.memories.pop_back();
+	a.memoryTotal -= ret.capacity();
+	return ret;
+}
+
+chrono::steady_clock::time_point VM::threadDeadline()
+{
+	return arena().deadline;
+}
+
+void VM::checkDeadline()
+{
+	if (chrono::steady_clock::now() < m_deadline)
+		return;
+	arena().deadlinePassed = true;
+	throwOutOfGas();
+}
+
+VMDeadline::VMDeadline(chrono::steady_clock::time_point _deadline)
+{
+	VMArena& a = arena();
+	m_previous = a.deadline;
+	m_previousPassed = a.deadlinePassed;
+	a.deadline = _deadline;
+	a.deadlinePassed = false;
+}
+
+VMDeadline::~VMDeadline()
+{
+	VMArena& a = arena();
+	a.deadline = m_previous;
+	a.deadlinePassed = m_previousPassed;
+}
+
+bool VMDeadline::passed() const
+{
+	return arena().deadlinePassed;
+}
+
+VM::~VM()
+{
+	VMArena& a = arena();
+	if (a.stacks.size() < c_maxPooled)
+		a.stacks.push_back(move(m_stack_vector));
+	if (m_mem.capacity() && m_mem.capacity() <= c_maxPooledMemory && a.memories.size() < c_maxPooled && a.memoryTotal + m_mem.capacity() <= c_maxPooledMemoryTotal)
+	{
+		// memory expands with zeroes, so only the size needs resetting
+		m_mem.clear();
+		a.memoryTotal += m_mem.capacity();
+		a.memories.push_back(move(m_mem));
+	}
+}
+
 
 // Executive swallows exceptions in some circumstances
 //#undef BOOST_THROW_EXCEPTION
@@ -83,13 +187,18 @@ void VM::throwBadStack(unsigned _size, unsigned _n, unsigned _d)
 std::array<InstructionMetric, 256> VM::c_metrics;
 void VM::initMetrics()
 {
-	for (unsigned i = 0; i < 256; ++i)
+	// once per process: instructionInfo() throws for every invalid opcode
+	static std::once_flag s_once;
+	std::call_once(s_once, []()
 	{
-		InstructionInfo inst = instructionInfo((Instruction)i);
-		c_metrics[i].gasPriceTier = inst.gasPriceTier;
-		c_metrics[i].args = inst.args;
-		c_metrics[i].ret = inst.ret;
-	}
+		for (unsigned i = 0; i < 256; ++i)
+		{
+			InstructionInfo inst = instructionInfo((Instruction)i);
+			c_metrics[i].gasPriceTier = inst.gasPriceTier;
+			c_metrics[i].args = inst.args;
+			c_metrics[i].ret = inst.ret;
+		}
+	});
 }
 
 void VM::reportStackUse()
@@ -101,28 +210,22 @@ void VM::reportStackUse()
 	p = q;
 }
 
-void VM::makeJumpDestTable(ExtVMFace& _ext)
+void VM::analyseCode(ExtVMFace& _ext)
 {
-	// hash JUMPDESTs into table
-	for (size_t i = 0; i < _ext.code.size(); ++i)
-	{
-		byte inst = _ext.code[i];
-		if (inst == (byte)Instruction::JUMPDEST)
-			m_jumpDests.insert(i);
-		else if (inst >= (byte)Instruction::PUSH1 && inst <= (byte)Instruction::PUSH32)
-			i += inst - (byte)Instruction::PUSH1 + 1;
-	}
+	m_analysis = CodeAnalysisCache::get(_ext.codeHash, _ext.code, *m_schedule);
+	m_code = m_analysis->code.data();
 }
 
 
-void VM::copyDataToMemory(bytesConstRef _data, u256*& SP)
+void VM::copyDataToMemory(bytesConstRef _data, Word256*& SP)
 {
-	auto offset = static_cast<size_t>(*SP--);
-	s512 bigIndex = *SP--;
-	auto index = static_cast<size_t>(bigIndex);
-	auto size = static_cast<size_t>(*SP--);
+	auto offset = static_cast<size_t>((uint64_t)*SP--);
+	Word256 bigIndex = *SP--;
+	auto index = static_cast<size_t>((uint64_t)bigIndex);
+	auto size = static_cast<size_t>((uint64_t)*SP--);
 
-	size_t sizeToBeCopied = bigIndex + size > _data.size() ? _data.size() < bigIndex ? 0 : _data.size() - index : size;
+	// size was checked against memory, so only an out-of-range index can make the sum wrap
+	size_t sizeToBeCopied = !(bigIndex < _data.size()) ? 0 : index + size > _data.size() ? _data.size() - index : size;
 
 	if (sizeToBeCopied > 0)
 		std::memcpy(m_mem.data() + offset, _data.data() + index, sizeToBeCopied);
@@ -0,0 +1,146 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMProfiler.cpp
+ */
+
+#include "VMProfiler.h"
+#include <ctime>
+#include <limits>
+#include <boost/thread/tss.hpp>
+#include <libdevcore/Guards.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+std::mutex x_profile;
+VMProfile g_profile;
+
+void addContract(unordered_map<h256, ContractProfile>& _contracts, h256 const& _codeHash, ContractProfile const& _profile)
+{
+	auto it = _contracts.find(_codeHash);
+	if (it == _contracts.end())
+		it = _contracts.insert(make_pair(_contracts.size() < c_maxProfiledContracts ? _codeHash : h256(), ContractProfile())).first;
+	it->second.calls += _profile.calls;
+	it->second.gas += _profile.gas;
+	it->second.micros += _profile.micros;
+}
+
+}
+
+VMProfile VMProfiler::stats()
+{
+	Guard l(x_profile);
+	if (!g_profile.since)
+		g_profile.since = time(nullptr);
+	return g_profile;
+}
+
+void VMProfiler::reset()
+{
+	Guard l(x_profile);
+	g_profile = VMProfile();
+	g_profile.since = time(nullptr);
+}
+
+#if EVM_PROFILING
+
+struct VMProfiler::Thread
+{
+	array<OpcodeProfile, 256> opcodes;
+	unordered_map<h256, ContractProfile> contracts;
+	Frame::Current current{Instruction::STOP, 0};
+	Frame* top = nullptr;
+};
+
+namespace
+{
+
+boost::thread_specific_ptr<VMProfiler::Thread> t_profile;
+
+VMProfiler::Thread& profileThread()
+{
+	if (!t_profile.get())
+		t_profile.reset(new VMProfiler::Thread);
+	return *t_profile;
+}
+
+}
+
+void VMProfiler::noteTrieMiss()
+{
+	Thread* t = t_profile.get();
+	if (t && t->top)
+		++t->opcodes[(byte)t->current.inst].trieMisses;
+}
+
+VMProfiler::Frame::Frame(h256 const& _codeHash, u256 const* _gas):
+	m_thread(profileThread()),
+	m_opcodes(m_thread.opcodes),
+	m_current(&m_thread.current),
+	m_parent(m_thread.top),
+	m_callerInst(m_thread.current),
+	m_codeHash(_codeHash),
+	m_gas(_gas),
+	m_gasStart(*_gas),
+	m_start(chrono::steady_clock::now())
+{
+	m_thread.top = this;
+	if (!m_parent)
+		m_thread.current = Current{Instruction::STOP, ticks()};
+}
+
+VMProfiler::Frame::~Frame()
+{
+	uint64_t now = ticks();
+	m_opcodes[(byte)m_current->inst].ticks += now - m_current->tick;
+	m_thread.current = Current{m_callerInst.inst, now};
+
+	uint64_t gas = m_gasStart > *m_gas ? uint64_t(min<u256>(m_gasStart - *m_gas, numeric_limits<uint64_t>::max())) : 0;
+	uint64_t micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - m_start).count();
+	ContractProfile self;
+	self.calls = 1;
+	self.gas = gas - min(gas, m_childGas);
+	self.micros = micros - min(micros, m_childMicros);
+	addContract(m_thread.contracts, m_codeHash, self);
+
+	m_thread.top = m_parent;
+	if (m_parent)
+	{
+		m_parent->m_childGas += gas;
+		m_parent->m_childMicros += micros;
+		return;
+	}
+
+	// the outermost frame of the thread ended, hand its totals over
+	Guard l(x_profile);
+	for (size_t i = 0; i < m_thread.opcodes.size(); ++i)
+	{
+		g_profile.opcodes[i].count += m_thread.opcodes[i].count;
+		g_profile.opcodes[i].ticks += m_thread.opcodes[i].ticks;
+		g_profile.opcodes[i].trieMisses += m_thread.opcodes[i].trieMisses;
+	}
+	for (auto const& i: m_thread.contracts)
+		addContract(g_profile.contracts, i.first, i.second);
+	m_thread.opcodes.fill(OpcodeProfile());
+	m_thread.contracts.clear();
+}
+
+#endif
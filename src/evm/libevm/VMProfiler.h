@@ -0,0 +1,144 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMProfiler.h
+ *
+ * Execution statistics of the interpreter, compiled in with EVM_PROFILING (configure
+ * --enable-evm-profiling). Without it the VM has no hooks and the statistics stay empty.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <unordered_map>
+#include <libdevcore/FixedHash.h>
+#include <libevmcore/Instruction.h>
+
+#ifndef EVM_PROFILING
+#define EVM_PROFILING 0
+#endif
+
+#if EVM_PROFILING && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+namespace dev
+{
+namespace eth
+{
+
+/// Totals of one opcode over all frames.
+struct OpcodeProfile
+{
+	uint64_t count = 0;
+	uint64_t ticks = 0;				///< Time spent on the instruction, in cycles where the CPU counts them.
+	uint64_t trieMisses = 0;		///< Storage slots the instruction had to read from the state trie.
+};
+
+/// Totals of the frames running one code. Calls the frame makes are left out.
+struct ContractProfile
+{
+	uint64_t calls = 0;
+	uint64_t gas = 0;
+	uint64_t micros = 0;
+};
+
+struct VMProfile
+{
+	std::array<OpcodeProfile, 256> opcodes;
+	std::unordered_map<h256, ContractProfile> contracts;	///< By code hash; h256() gathers the codes past c_maxProfiledContracts.
+	int64_t since = 0;				///< Time of the last reset, in seconds since the epoch.
+};
+
+/// Most codes tracked on their own, so the statistics cannot grow without bound.
+static const size_t c_maxProfiledContracts = 10000;
+
+/// Process-wide execution statistics. Thread safe.
+class VMProfiler
+{
+public:
+	VMProfiler() = delete;
+
+	/// @returns true if the VM was compiled with EVM_PROFILING.
+	static bool enabled() { return EVM_PROFILING; }
+
+	static VMProfile stats();
+
+	static void reset();
+
+#if EVM_PROFILING
+	/// Counts a storage read that missed the account's storage cache against the running instruction.
+	static void noteTrieMiss();
+
+	static uint64_t ticks()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	struct Thread;
+
+	/**
+	 * Profiles the execution of one VM frame. Instructions are timed from one step() to the
+	 * next on the same thread, so a nested frame ends the instruction that called it and the
+	 * caller's instruction resumes when it returns. Totals are kept per thread and merged
+	 * when the outermost frame of the thread ends.
+	 */
+	class Frame
+	{
+	public:
+		Frame(h256 const& _codeHash, u256 const* _gas);
+		~Frame();
+
+		void step(Instruction _inst)
+		{
+			uint64_t now = ticks();
+			m_opcodes[(byte)m_current->inst].ticks += now - m_current->tick;
+			++m_opcodes[(byte)_inst].count;
+			m_current->inst = _inst;
+			m_current->tick = now;
+		}
+
+		struct Current
+		{
+			Instruction inst;
+			uint64_t tick;
+		};
+
+	private:
+		Thread& m_thread;
+		std::array<OpcodeProfile, 256>& m_opcodes;
+		Current* m_current;
+		Frame* m_parent;
+		Current m_callerInst;
+		h256 m_codeHash;
+		u256 const* m_gas;
+		u256 m_gasStart;
+		std::chrono::steady_clock::time_point m_start;
+		uint64_t m_childGas = 0;
+		uint64_t m_childMicros = 0;
+	};
+#else
+	static void noteTrieMiss() {}
+#endif
+};
+
+}
+}
@@ -38,12 +38,23 @@ namespace eth
 class QuantumExtVM: public ExtVMFace
 {
 public:
+	/// @a _code must outlive the object, as the init code of a CREATE does.
 	QuantumExtVM(State& _s, EnvInfo const& _envInfo, SealEngineFace* _sealEngine, Address _myAddress, Address _caller, Address _origin, u256 _value, u256 _gasPrice, bytesConstRef _data, bytesConstRef _code, h256 const& _codeHash, unsigned _depth = 0):
-		ExtVMFace(_envInfo, _myAddress, _caller, _origin, _value, _gasPrice, _data, _code.toBytes(), _codeHash, _depth), m_s(_s), m_origCache(_s.m_cache), m_sealEngine(_sealEngine)
+		ExtVMFace(_envInfo, _myAddress, _caller, _origin, _value, _gasPrice, _data, _code, _codeHash, _depth), m_sealEngine(_sealEngine), m_s(_s)
 	{
+		m_s.beginFrame();
 		m_s.ensureCached(_myAddress, true, true);
 	}
 
+	/// Runs the code of an account, shared with the state rather than copied.
+	QuantumExtVM(State& _s, EnvInfo const& _envInfo, SealEngineFace* _sealEngine, Address _myAddress, Address _caller, Address _origin, u256 _value, u256 _gasPrice, bytesConstRef _data, std::shared_ptr<bytes const> const& _code, h256 const& _codeHash, unsigned _depth = 0):
+		QuantumExtVM(_s, _envInfo, _sealEngine, _myAddress, _caller, _origin, _value, _gasPrice, _data, _code ? bytesConstRef(_code.get()) : bytesConstRef(), _codeHash, _depth)
+	{
+		m_code = _code;
+	}
+
+	~QuantumExtVM() { m_s.endFrame(); }
+
 	/// Read storage location.
 	// virtual u256 store(u256 _n) override final { return 0; }
 	virtual u256 store(u256 _n) override final { return m_s.storage(myAddress, _n); }
@@ -86,10 +97,10 @@ public:
 	// }
 	virtual void suicide(Address _a) override final
 	{
-		m_sealEngine->txData.push_back({myAddress, _a, m_s.balance(myAddress), 0}); // TODO temp dataToTx
+		m_s.txData.push_back({myAddress, _a, m_s.balance(myAddress), 0}); // TODO temp dataToTx
 
 		if(!m_s.addressInUse(_a)){
-			m_sealEngine->delAddresses.push_back(_a);
+			m_s.delAddresses.push_back(_a);
 		}
 		m_s.addBalance(_a, m_s.balance(myAddress));
 		m_s.subBalance(myAddress, m_s.balance(myAddress));
@@ -101,8 +112,8 @@ public:
 	/// @TODO check call site for the parent manifest being discarded.
 	virtual void revert() override final
 	{
-		m_s.m_cache = m_origCache;
-		m_sealEngine->txData.pop_back();
+		m_s.revertFrame();
+		m_s.txData.pop_back();
 		sub.clear();
 	}
 
@@ -115,7 +126,7 @@ public:
 private:
 	SealEngineFace* m_sealEngine;
 	State& m_s;											///< A reference to the base state.
-	std::unordered_map<Address, Account> m_origCache;	///< The cache of the address states (i.e. the externalities) as-was prior to the execution.
+	std::shared_ptr<bytes const> m_code;				///< Keeps the code of the account alive while it runs.
 };
 
 }
@@ -204,5 +204,9 @@ public:
  *      .Finalize()
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+/** Optimized SipHash-2-4 of a uint256 followed by the 4 little-endian bytes
+ *  of extra, as used to hash an outpoint.
+ */
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
 #endif // QUANTUM_HASH_H
@@ -11,11 +11,15 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockprefetch.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "contractlogdb.h"
+#include "crypto/sha256.h"
+#include "contractspeculator.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -36,6 +40,8 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
+#include <libevm/CodeAnalysis.h>
+#include <libevm/VMFactory.h>
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
 #endif
@@ -143,9 +149,9 @@ class CCoinsViewErrorCatcher : public CCoinsViewBacked
 {
 public:
     CCoinsViewErrorCatcher(CCoinsView* view) : CCoinsViewBacked(view) {}
-    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const {
         try {
-            return CCoinsViewBacked::GetCoins(txid, coins);
+            return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -224,14 +230,19 @@ void Shutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsPrefetch;
+        pcoinsPrefetch = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete pcontractlogdb;
+        pcontractlogdb = NULL;
         delete csGlobalState;
         csGlobalState = NULL;
+        globalSealEngine.reset();
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -326,21 +337,31 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
+    strUsage += HelpMessageOpt("-evmcodecache=<n>", strprintf(_("Keep the analysed bytecode of recently run contracts below <n> megabytes (default: %u)"), dev::eth::c_defaultCodeAnalysisCacheSize >> 20));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-evmvm=<kind>", strprintf(_("Select how the EVM dispatches instructions: interpreter or threaded (default: %s)"), DEFAULT_EVM_VM));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-logevents", strprintf(_("Maintain an index of contract event logs, used by the searchlogs rpc call (default: %u)"), DEFAULT_LOGEVENTS));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-mempoolspeculation", strprintf(_("Speculatively execute the contract outputs of mempool transactions on the chain tip for reuse in block templates (default: %u)"), DEFAULT_MEMPOOL_SPECULATION));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parallelcontracts", strprintf(_("Speculatively execute the contract outputs of a block on the script verification threads (default: %u)"), DEFAULT_PARALLEL_CONTRACTS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), QUANTUM_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading the inputs of blocks into the caches ahead of their validation (0 to %d, default: %d)"),
+        MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-statepruning=<n>", strprintf(_("Delete contract state that the roots of the last <n> blocks no longer refer to. "
+            "Enabling this on an existing state database requires -reindex-chainstate. "
+            "(default: 0 = keep all contract state, >=%u = blocks to keep for reorgs)"), MIN_BLOCKS_TO_KEEP));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifndef WIN32
@@ -482,6 +503,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), BaseParams(CBaseChainParams::MAIN).RPCPort(), BaseParams(CBaseChainParams::TESTNET).RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-callcontractgaslimit=<n>", strprintf(_("Maximum gas a callcontract RPC may use (default: %d)"), DEFAULT_CALLCONTRACT_GAS_LIMIT));
+    strUsage += HelpMessageOpt("-callcontracttimeout=<n>", strprintf(_("Abort a callcontract RPC after <n> milliseconds, 0 disables it (default: %d)"), DEFAULT_CALLCONTRACT_TIMEOUT));
+    strUsage += HelpMessageOpt("-callcontractthreads=<n>", strprintf(_("Set the number of threads running the calls of callcontractbatch requests, shared by all of them (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_CALLCONTRACT_THREADS, DEFAULT_CALLCONTRACT_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
@@ -936,6 +960,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    fParallelContracts = GetBoolArg("-parallelcontracts", DEFAULT_PARALLEL_CONTRACTS);
+    fMempoolSpeculation = GetBoolArg("-mempoolspeculation", DEFAULT_MEMPOOL_SPECULATION);
+    int nPrefetchThreads = std::max(0, std::min((int)GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+
+    int64_t nEVMCodeCache = GetArg("-evmcodecache", dev::eth::c_defaultCodeAnalysisCacheSize >> 20);
+    if (nEVMCodeCache < 0)
+        return InitError(_("-evmcodecache cannot be configured with a negative value."));
+    dev::eth::CodeAnalysisCache::setMaxSize((size_t)nEVMCodeCache << 20);
+
+    std::string strEVMKind = GetArg("-evmvm", DEFAULT_EVM_VM);
+    if (strEVMKind == "interpreter")
+        dev::eth::VMFactory::setKind(dev::eth::VMKind::Interpreter);
+    else if (strEVMKind == "threaded")
+        dev::eth::VMFactory::setKind(dev::eth::VMKind::Threaded);
+    else
+        return InitError(strprintf(_("Unknown -evmvm kind: '%s'"), strEVMKind));
 
     fServer = GetBoolArg("-server", false);
 
@@ -953,6 +993,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         fPruneMode = true;
     }
 
+    // contract state pruning; the number of blocks whose state roots stay intact for reorgs
+    nStatePruneDepth = GetArg("-statepruning", 0);
+    if (nStatePruneDepth < 0) {
+        return InitError(_("State pruning cannot be configured with a negative value."));
+    }
+    if (nStatePruneDepth) {
+        if (nStatePruneDepth < (int)MIN_BLOCKS_TO_KEEP) {
+            return InitError(strprintf(_("State pruning configured below the minimum of %d blocks.  Please use a higher number."), MIN_BLOCKS_TO_KEEP));
+        }
+        LogPrintf("State pruning configured to keep the contract state of the last %d blocks.\n", nStatePruneDepth);
+    }
+
     RegisterAllCoreRPCCommands(tableRPC);
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
@@ -1013,8 +1065,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
     // Initialize elliptic curve code
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
+    InitSignatureCache();
 
     // Sanity check
     if (!InitSanityCheck())
@@ -1058,7 +1113,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        if (fParallelContracts)
+            for (int i=0; i<nScriptCheckThreads-1; i++)
+                threadGroup.create_thread(&ThreadContractExec);
     }
+    if (fMempoolSpeculation)
+        threadGroup.create_thread(&ThreadMempoolSpeculation);
+    for (int i = 0; i < nPrefetchThreads; i++)
+        threadGroup.create_thread(&ThreadBlockPrefetch);
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1074,6 +1136,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         uiInterface.InitMessage.connect(SetRPCWarmupStatus);
         if (!AppInitServers(threadGroup))
             return InitError(_("Unable to start HTTP server. See debug log for details."));
+        // The RPC thread of a callcontractbatch request runs calls too, as the master of the queue
+        int nContractCallThreads = GetArg("-callcontractthreads", DEFAULT_CALLCONTRACT_THREADS);
+        if (nContractCallThreads <= 0)
+            nContractCallThreads += GetNumCores();
+        nContractCallThreads = std::min(nContractCallThreads, MAX_CALLCONTRACT_THREADS);
+        for (int i = 0; i < nContractCallThreads - 1; i++)
+            threadGroup.create_thread(&ThreadContractCall);
     }
 
     int64_t nStart;
@@ -1257,6 +1326,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nLogEventsDBCache = GetBoolArg("-logevents", DEFAULT_LOGEVENTS) ? std::min(nTotalCache / 8, nMaxLogEventsDBCache << 20) : 0;
+    nTotalCache -= nLogEventsDBCache;
+    int64_t nStateDBCache = std::min(nTotalCache / 4, nMaxStateDBCache << 20);
+    nTotalCache -= nStateDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1264,6 +1337,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for contract state databases\n", nStateDBCache * (1.0 / 1024 / 1024));
+    if (nLogEventsDBCache)
+        LogPrintf("* Using %.1fMiB for contract event log database\n", nLogEventsDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
@@ -1278,14 +1354,27 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsPrefetch;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete pcontractlogdb;
+                pcontractlogdb = NULL;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
+                if (GetBoolArg("-logevents", DEFAULT_LOGEVENTS))
+                    pcontractlogdb = new CContractLogDB(nLogEventsDBCache, false, fReindex || fReindexChainState);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+
+                // If necessary, upgrade from older database format.
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
+                pcoinsPrefetch = new CCoinsViewPrefetch(pcoinscatcher);
+                pcoinsTip = new CCoinsViewCache(pcoinsPrefetch);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1307,9 +1396,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 ////////////////////////////////////////////////////////////////////////////////// // TODO temp
 
                 boost::filesystem::path stateDir = GetDataDir() / "state";
+                // Node references are only counted from an empty database on, and rebuilding the chain state executes every contract again anyway
+                if (nStatePruneDepth && (fReindex || fReindexChainState) && csGlobalState == NULL)
+                    boost::filesystem::remove_all(stateDir);
                 bool fStateExt = boost::filesystem::exists(stateDir);
                 const dev::u256 accountStartNonce(0); 
                 const dev::h256 hashBlock(dev::sha3(dev::rlp("")));
+                dev::eth::State::setDBCacheSize(nStateDBCache / 2); // shared by the state and UTXO databases
 
                 csGlobalState = new dev::eth::QtumState(accountStartNonce,  // TODO temp dataToTx
                                 dev::eth::State::openDB(stateDir.string(), hashBlock, dev::WithExisting::Trust),
@@ -1331,7 +1424,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 }
                 csGlobalState->db().commit();
 
+                if (nStatePruneDepth) {
+                    if (fStateExt && !csGlobalState->pruner().enabled()) {
+                        strLoadError = _("You need to rebuild the database using -reindex-chainstate to enable -statepruning");
+                        break;
+                    }
+                    csGlobalState->pruner().setEnabled(true);
+                    csGlobalState->prunerUTXO().setEnabled(true);
+                } else {
+                    // Once blocks go uncounted the references can never be trusted again
+                    csGlobalState->pruner().setEnabled(false);
+                    csGlobalState->prunerUTXO().setEnabled(false);
+                }
                 dev::eth::Ethash::init();
+                globalSealEngine.reset(dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::HomesteadTest)).createSealEngine());
 //////////////////////////////////////////////////////////////////////////////////
 
                 // Initialize the block index (no-op if non-empty database was already loaded)
@@ -1346,6 +1452,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Check for changed -logevents state
+                if (fLogEvents != GetBoolArg("-logevents", DEFAULT_LOGEVENTS)) {
+                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -logevents");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1514,6 +1626,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    if (nStatePruneDepth)
+        scheduler.scheduleEvery(&PruneContractState, STATE_PRUNE_INTERVAL);
+
     StartNode(threadGroup, scheduler);
 
     //begin modif qtum
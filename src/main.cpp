@@ -8,12 +8,15 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockprefetch.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "contractlogdb.h"
+#include "contractspeculator.h"
 #include "hash.h"
 #include "init.h"
 #include "merkleblock.h"
@@ -68,6 +71,7 @@
 #include "libethereum/ChainParams.h"
 
 dev::eth::QtumState* csGlobalState; // TODO temp dataToTx
+std::unique_ptr<dev::eth::SealEngineFace> globalSealEngine;
 
 using namespace std;
 
@@ -95,9 +99,12 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+bool fParallelContracts = DEFAULT_PARALLEL_CONTRACTS;
+bool fMempoolSpeculation = DEFAULT_MEMPOOL_SPECULATION;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fLogEvents = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -106,6 +113,9 @@ bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
+int nStatePruneDepth = 0;
+/** Height of the best block of the coins database, which a restart after a crash resumes from. */
+static int nCoinsFlushedHeight = -1;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
 
@@ -716,6 +726,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CContractLogDB *pcontractlogdb = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -998,15 +1009,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -1243,9 +1254,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -1308,7 +1319,7 @@ bool CheckTxFee(CTxMemPool& pool, CValidationState& state, const CTransaction &t
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree,
                               bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
-                              std::vector<uint256>& vHashTxnToUncache)
+                              std::vector<COutPoint>& vCoinsToUncache)
 {
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
@@ -1428,21 +1439,18 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
         view.SetBackend(viewMemPool);
 
-        // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
-        }
-
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                vCoinsToUncache.push_back(txin.prevout);
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx?
+                for (size_t out = 0; out < tx.vout.size(); out++) {
+                    // Optimistically just do efficient check of cache for outputs
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out)))
+                        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+                }
+                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                 if (pfMissingInputs)
                     *pfMissingInputs = true;
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
@@ -1495,9 +1503,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // during reorgs to ensure COINBASE_MATURITY is still met.
         bool fSpendsCoinbase = false;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
+            const Coin &coin = view.AccessCoin(txin.prevout);
             //begin modif qtum
-            if ((coins->IsCoinBase() || coins->IsCoinStake())) {
+            if ((coin.IsCoinBase() || coin.IsCoinStake())) {
             //end modif qtum
                 fSpendsCoinbase = true;
                 break;
@@ -1527,7 +1535,13 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             //end modif qtum
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
+        // Resolve the contract sender while its prevout is in view, so that the miner and
+        // the RPCs read it from the entry rather than from disk
+        valtype vchSender;
+        if (tx.HasExec())
+            vchSender = GetSenderAddress(tx, view);
+
+        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp, vchSender);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1763,7 +1777,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
                 __func__, hash.ToString(), FormatStateMessage(state));
         }
 
-        if (tx.HasExec() && GetSenderAddress(tx) == valtype())
+        if (tx.HasExec() && vchSender.empty())
         {
         	return state.DoS(0, false,
 		    REJECT_INVALID, "malformed-exec", false,
@@ -1791,6 +1805,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             if (!pool.exists(hash))
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
+
+        if (fMempoolSpeculation && tx.HasExec())
+            mempoolSpeculator.Queue(hash);
         
         //begin modif qtum
         if (!tx.IsCoinStake())
@@ -1818,11 +1835,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> vCoinsToUncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, nAbsurdFee, vCoinsToUncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
-            pcoinsTip->Uncache(hashTx);
+        BOOST_FOREACH(const COutPoint& outpoint, vCoinsToUncache)
+            pcoinsTip->Uncache(outpoint);
     }
     return res;
 }
@@ -1879,15 +1896,8 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     }
 
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
-        int nHeight = -1;
-        {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
-        }
-        if (nHeight > 0)
-            pindexSlow = chainActive[nHeight];
+        const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+        if (!coin.IsSpent()) pindexSlow = chainActive[coin.nHeight];
     }
 
     if (pindexSlow) {
@@ -2280,27 +2290,14 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
             // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                //begin modif qtum
-                undo.fCoinStake = coins->fCoinStake;
-                //end modif qtum
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -2312,6 +2309,11 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = (nIn < ptxTo->wit.vtxinwit.size()) ? &ptxTo->wit.vtxinwit[nIn].scriptWitness : NULL;
+    if (fTxHashOnly && (scriptSig.HasOpTXHASH() || scriptPubKey.HasOpTXHASH())) {
+        BlockValidationContext txContext;
+        txContext.currentTxHash = ptxTo->GetHash();
+        return VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore), &error, &txContext);
+    }
     // if (!VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore), &error)) {
     if (!VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore), &error, context)) { // TODO temp checkHash
         return false;
@@ -2319,6 +2321,12 @@ bool CScriptCheck::operator()() {
     return true;
 }
 
+bool CScriptCheck::UsesExpectedTxHashes() const {
+    // Redeem and witness scripts are evaluated without the block context
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    return context && (scriptPubKey.HasOpExec() || scriptPubKey.HasOpAssign() || scriptSig.HasOpExec() || scriptSig.HasOpAssign());
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -2339,22 +2347,22 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
             //begin modif qtum
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
             //end modif qtum
-                if (nSpendHeight - coins->nHeight < COINBASE_MATURITY)
+                if (nSpendHeight - coin.nHeight < COINBASE_MATURITY)
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -2382,15 +2390,30 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 ////////////////////////////////////////////////////////////////////////////////////////////////// // TODO temp BCExecutor
 dev::eth::ResultExecute BCExecutor::execute(const dev::eth::QtumTransaction tx){ // TODO temp QtumTransaction
     using OnOpFunc = std::function<void(uint64_t /*steps*/, uint64_t /* PC */, dev::eth::Instruction /*instr*/, dev::bigint /*newMemSize*/, dev::bigint /*gasCost*/, dev::bigint /*gas*/, dev::eth::VM*, dev::eth::ExtVMFace const*)>;
-    std::unique_ptr<dev::eth::SealEngineFace> se(dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::HomesteadTest)).createSealEngine());
     dev::eth::ResultExecute execRes =
-            csGlobalState->execute(BuildEVMEnvironment(), se.get(), tx, dev::eth::Permanence::Committed, OnOpFunc());
+            csGlobalState->execute(BuildEVMEnvironment(), globalSealEngine.get(), tx, dev::eth::Permanence::Committed, OnOpFunc());
        
     csGlobalState->db().commit();
         
     return execRes;
 }
 
+bool CContractExecCheck::operator()() {
+    using OnOpFunc = std::function<void(uint64_t /*steps*/, uint64_t /* PC */, dev::eth::Instruction /*instr*/, dev::bigint /*newMemSize*/, dev::bigint /*gasCost*/, dev::bigint /*gas*/, dev::eth::VM*, dev::eth::ExtVMFace const*)>;
+    try {
+        dev::eth::QtumState state(*pbaseState);
+        state.setRecordAccess(true);
+        pspeculation->result = state.execute(*penv, globalSealEngine.get(), ethTx, dev::eth::Permanence::Uncommitted, OnOpFunc());
+        pspeculation->changes = state.takeChanges();
+        pspeculation->fDone = pspeculation->result.execRes.excepted == dev::eth::TransactionException::None;
+    } catch (...) {
+        // Anything unusual is left to the serial path in ConnectBlock.
+        pspeculation->fDone = false;
+    }
+    // A failed speculation never fails the block
+    return true;
+}
+
 dev::Address BCExecutor::EthAddrFromScript(const CScript& scriptIn){
     CTxDestination resDest;
     if(!ExtractDestination(scriptIn, resDest)){
@@ -2474,7 +2497,7 @@ void BitTxToEthTx::createEthTX(){
     else{
         txEth = dev::eth::QtumTransaction(txBit.vout[nOut].nValue, argEthTx.gasPrice, (argEthTx.gasLimit * argEthTx.gasPrice), argEthTx.to, argEthTx.code, dev::u256(0)); // TODO temp QtumTransaction
     }
-    txEth.forceSender(dev::Address(GetSenderAddress(txBit, coinsView ? coinsView : nullptr)));
+    txEth.forceSender(dev::Address(senderAddress));
     txEth.setHashWith(uintToh256(txBit.GetHash()));
     txEth.setVoutNumber(nOut);
     txEth.setVersion(argEthTx.version);
@@ -2512,13 +2535,14 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
                 // CScriptCheck check(*coins, tx, i, flags, cacheStore);
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, context); // TODO temp checkHash
-                if (pvChecks) {
+                CScriptCheck check(coin.out, tx, i, flags, cacheStore, context); // TODO temp checkHash
+                if (pvChecks && !check.UsesExpectedTxHashes()) {
+                    check.Detach();
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
                 } else if (!check()) {
@@ -2529,7 +2553,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
+                        CScriptCheck check2(coin.out, tx, i,
                                 flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, context); // TODO temp checkHash
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -2623,34 +2647,32 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 }
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint.
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+static bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
-    }
-    if (coins->IsAvailable(out.n))
+    if (view.HaveCoin(out))
         fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height, coinbase and coinstake). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("%s: undo data adding output to missing transaction", __func__);
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+        //begin modif qtum
+        undo.fCoinStake = alternate.fCoinStake;
+        //end modif qtum
+    }
+    view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean;
 }
@@ -2681,32 +2703,27 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                //begin modif qtum
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight ||
+                    tx.IsCoinBase() != coin.IsCoinBase() || tx.IsCoinStake() != coin.IsCoinStake())
+                //end modif qtum
+                    fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+            }
         }
 
         // restore inputs
         if (i > 0) { // not coinbases
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                     fClean = false;
             }
         }
@@ -2764,6 +2781,57 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CContractExecCheck> contractexecqueue(1);
+
+void ThreadContractExec() {
+    RenameThread("quantum-contract");
+    contractexecqueue.Thread();
+}
+
+//! Sums of the nSpeculated and nConflicts of every ConnectBlock, guarded by cs_main
+static uint64_t nTotalContractsSpeculated = 0;
+static uint64_t nTotalContractConflicts = 0;
+
+void GetContractSpeculationStats(uint64_t& nSpeculatedOut, uint64_t& nConflictsOut)
+{
+    LOCK(cs_main);
+    nSpeculatedOut = nTotalContractsSpeculated;
+    nConflictsOut = nTotalContractConflicts;
+}
+
+/**
+ * Execute every contract output of the block against the state the block starts from,
+ * in parallel and without touching csGlobalState. ConnectBlock commits a speculation only
+ * when nothing it accessed was written by an earlier output of the same block.
+ */
+static void SpeculateContractOutputs(const CBlock& block, const CCoinsViewCache& view, const dev::eth::EnvInfo& env, std::map<COutPoint, CContractSpeculation>& mapSpeculation)
+{
+    std::vector<CContractExecCheck> vChecks;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase() || !tx.HasExec() || tx.vin[0].scriptSig.HasOpTXHASH())
+            continue;
+        // The sender is taken from vin[0]; if it was created in this block it is not known yet
+        if (!view.HaveCoin(tx.vin[0].prevout))
+            continue;
+        valtype vchSender = GetSenderAddress(tx, view);
+        for (unsigned int q = 0; q < tx.vout.size(); q++) {
+            if (!tx.vout[q].scriptPubKey.HasOpExec() && !tx.vout[q].scriptPubKey.HasOpAssign())
+                continue;
+            dev::eth::QtumTransaction ethTx = BitTxToEthTx(tx, q, vchSender).getEthTx();
+            CContractSpeculation& speculation = mapSpeculation[COutPoint(tx.GetHash(), q)];
+            vChecks.push_back(CContractExecCheck(ethTx, env, *csGlobalState, speculation));
+        }
+    }
+    // Nothing to overlap
+    if (vChecks.size() < 2) {
+        mapSpeculation.clear();
+        return;
+    }
+    CCheckQueueControl<CContractExecCheck> control(&contractexecqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2879,24 +2947,11 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
 //////////////////////////////////////////////////////////////////// // TODO temp addressSender
-valtype GetSenderAddress(const CTransaction& tx, const CCoinsViewCache* coinsView){
-    CTransaction txPrevout;
-    uint256 hashBlock;
-    CScript script;
-    if (coinsView)
-    {
-        script = coinsView->AccessCoins(tx.vin[0].prevout.hash)->vout[tx.vin[0].prevout.n].scriptPubKey;    
-    } else 
-    {
-        if (GetTransaction(tx.vin[0].prevout.hash, txPrevout, Params().GetConsensus(), hashBlock, true)){
-            script = txPrevout.vout[tx.vin[0].prevout.n].scriptPubKey;
-        } else 
-        {
-            // TODO temp exeption   
-            return valtype();
-        }
-    }
-    
+valtype GetSenderAddress(const CTransaction& tx, const CCoinsViewCache& view){
+    const Coin& coin = view.AccessCoin(tx.vin[0].prevout);
+    if (coin.IsSpent())
+        return valtype();
+    const CScript& script = coin.out.scriptPubKey;
 
 
 	CTxDestination addressBit;
@@ -3022,10 +3077,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -3078,7 +3134,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
     std::vector<std::pair<valtype, CAmount>> refunds;
+    std::vector<CContractReceipt> vReceipts;
     BlockValidationContext context;
+
+    // Speculative parallel execution of the contract outputs; see SpeculateContractOutputs.
+    // Only possible when the global state has no pending changes to copy.
+    std::map<COutPoint, CContractSpeculation> mapSpeculation;
+    dev::AddressHash setContractWrites;
+    //! What the contract outputs wrote, without what the serial ones only read
+    dev::AddressHash setContractWritten;
+    unsigned int nSpeculated = 0, nConflicts = 0;
+    if (fParallelContracts && nScriptCheckThreads && csGlobalState->cachedAddresses().empty())
+        SpeculateContractOutputs(block, view, BCExecutor(block, block.vtx[0], 0, valtype()).BuildEVMEnvironment(), mapSpeculation);
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -3099,7 +3166,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             // Which orphan pool entries must we evict?
@@ -3143,34 +3210,71 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 //////////////////////////////////////////////////////////////////////////////////////////  // TODO temp checkHash
 			bool hasTxhash = tx.vin[0].scriptSig.HasOpTXHASH();
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, (hasTxhash || tx.HasExec()) ? NULL : (nScriptCheckThreads ? &vChecks : NULL), &context))
+            // Inputs spending contract outputs are still checked in place, see CScriptCheck::UsesExpectedTxHashes
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL, &context))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s", tx.GetHash().ToString(), FormatStateMessage(state));
 
 			control.Add(vChecks);
 
             if(tx.HasExec() && !hasTxhash){
 
-                dev::h256 oldHashQtumRoot(csGlobalState->rootHashUTXO());
-                dev::h256 oldHashStateRoot(csGlobalState->rootHash());
+                dev::eth::QtumState::Checkpoint checkpoint(csGlobalState->checkpoint());
+                std::vector<CContractReceipt> vTxReceipts;
+                // vin[0] is still unspent in view until UpdateCoins below
+                valtype vchSender = GetSenderAddress(tx, view);
 
                 for(unsigned int q = 0; q < tx.vout.size(); q++){
                     if (!tx.vout[q].scriptPubKey.HasOpExec() && !tx.vout[q].scriptPubKey.HasOpAssign())
                         continue;
-                    BCExecutor executor(block, tx, q, &view);
-                    dev::eth::ResultExecute res = executor.execute();
+                    dev::eth::ResultExecute res;
+                    auto itSpec = mapSpeculation.find(COutPoint(tx.GetHash(), q));
+                    bool fSpeculated = false;
+                    if (itSpec != mapSpeculation.end() && itSpec->second.fDone) {
+                        const dev::AddressHash& accessed = itSpec->second.changes.accessed;
+                        fSpeculated = std::none_of(accessed.begin(), accessed.end(), [&](const dev::Address& a){ return setContractWrites.count(a); });
+                        if (!fSpeculated)
+                            nConflicts++;
+                    }
+                    if (fSpeculated) {
+                        CContractSpeculation& speculation = itSpec->second;
+                        csGlobalState->applyChanges(speculation.changes);
+                        csGlobalState->db().commit();
+                        dev::AddressHash written = speculation.changes.written();
+                        setContractWrites.insert(written.begin(), written.end());
+                        setContractWritten.insert(written.begin(), written.end());
+                        res = speculation.result;
+                        nSpeculated++;
+                    } else {
+                        csGlobalState->setRecordAccess(true);
+                        BCExecutor executor(block, tx, q, vchSender);
+                        res = executor.execute();
+                        dev::AddressHash accessed = csGlobalState->accessed();
+                        // Both are dropped from the caches after the execution, so never written; the author is null in proof-of-stake blocks
+                        accessed.erase(dev::Address(vchSender));
+                        accessed.erase(executor.BuildEVMEnvironment().author());
+                        setContractWrites.insert(accessed.begin(), accessed.end());
+                        // Neither the sender nor the author is among them, both were dropped before the commit
+                        const dev::AddressHash& written = csGlobalState->written();
+                        setContractWritten.insert(written.begin(), written.end());
+                        csGlobalState->setRecordAccess(false);
+                    }
+                    dev::AddressHash cached = csGlobalState->cachedAddresses();
+                    setContractWrites.insert(cached.begin(), cached.end());
+                    setContractWritten.insert(cached.begin(), cached.end());
 
                     uint64_t sizeTx = 0;
+                    bool fRolledBack = false;
                     for(auto txRes : res.txs)
                     {
                         sizeTx += GetTransactionWeight(txRes);
                         if(sizeTx > GetMaxBlockSize() / 20){ // if(sizeTx > 10000){//8450){ // TEST
-                            csGlobalState->setRoot(oldHashStateRoot);
-                            csGlobalState->setRootUTXO(oldHashQtumRoot);
+                            csGlobalState->rollback(checkpoint);
                             while(!context.expectedTxHashes.empty())
                                 context.expectedTxHashes.pop();
                             refunds.clear();
                             res.execRes.gasRefunded = 0;
                             LogPrintfVM("The transaction: %s can not be executed (the result of more than a block size).\n", tx.GetHash().ToString());
+                            fRolledBack = true;
                             break;
                         }
 
@@ -3179,9 +3283,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             context.expectedTxHashes.push(txRes.GetHash());
                         }
                     }
+                    // Events of outputs the rollback undid never happened
+                    if (fRolledBack)
+                        vTxReceipts.clear();
+                    else if (fLogEvents)
+                        vTxReceipts.push_back(CContractReceipt(COutPoint(tx.GetHash(), q), res.txRec));
                     if(CAmount(res.execRes.gasRefunded) > 0)
-                        refunds.push_back(std::make_pair(GetSenderAddress(tx), CAmount(res.execRes.gasRefunded)));
+                        refunds.push_back(std::make_pair(vchSender, CAmount(res.execRes.gasRefunded)));
                 }
+                vReceipts.insert(vReceipts.end(), vTxReceipts.begin(), vTxReceipts.end());
             }
 //////////////////////////////////////////////////////////////////////////////////////////
         }
@@ -3199,6 +3309,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!context.expectedTxHashes.empty())
         return error("ConnectBlock() : evm generated %d more txs that are in block", context.expectedTxHashes.size());
 
+    if (!mapSpeculation.empty())
+        LogPrint("bench", "      - Contract outputs: %u speculated, %u committed, %u conflicts\n", (unsigned)mapSpeculation.size(), nSpeculated, nConflicts);
+    nTotalContractsSpeculated += nSpeculated;
+    nTotalContractConflicts += nConflicts;
+
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
     
@@ -3238,8 +3353,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
 
-    dev::h256 oldHashQtumRoot(csGlobalState->rootHashUTXO()); // TODO temp rootQtum
-    dev::h256 oldHashStateRoot(csGlobalState->rootHash());
+    // The contract outputs only committed pending changes, which are hashed here for the whole block
     if (csGlobalState->rootHashUTXO() != uintToh256(block.hashUTXORoot))
         return state.DoS(100, error("ConnectBlock(): rootHashUTXO diverged"),
                             REJECT_INVALID, "diverged-utxo-root");
@@ -3253,6 +3367,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         csGlobalState->setRootUTXO(uintToh256(pindex->pprev->hashUTXORoot));
         return true;
     }
+
+    csGlobalState->db().commit();
+    csGlobalState->dbUTXO().commit();
+
+    // Speculations on the previous tip that accessed what the block wrote are made again
+    if (fMempoolSpeculation)
+        mempoolSpeculator.BlockConnected(block, setContractWritten);
+
+    if (nStatePruneDepth > 0) {
+        // Count the nodes of the new roots; the ones only the previous roots used become prunable
+        dev::h256 hashBlock = uintToh256(pindex->GetBlockHash());
+        csGlobalState->pruner().journal(csGlobalState->rootHash(), pindex->nHeight, hashBlock);
+        csGlobalState->prunerUTXO().journal(csGlobalState->rootHashUTXO(), pindex->nHeight, hashBlock);
+    }
         
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
@@ -3277,6 +3405,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fLogEvents && !vReceipts.empty())
+        if (!pcontractlogdb->WriteBlockLogs(pindex->nHeight, pindex->GetBlockHash(), vReceipts))
+            return AbortNode(state, "Failed to write contract event logs");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3390,17 +3522,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
+        BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        if (it != mapBlockIndex.end())
+            nCoinsFlushedHeight = it->second->nHeight;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -3424,6 +3559,27 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+int GetStatePruneHeight() {
+    AssertLockHeld(cs_main);
+    if (nStatePruneDepth <= 0)
+        return -1;
+    // After a crash the node restarts from the best block of the coins database, which can be far
+    // behind the tip, and sets the state roots of that block
+    return std::min(chainActive.Height(), nCoinsFlushedHeight) - nStatePruneDepth;
+}
+
+void PruneContractState() {
+    LOCK(cs_main);
+    int nPruneHeight = GetStatePruneHeight();
+    if (nPruneHeight <= 0)
+        return;
+    int64_t nStart = GetTimeMicros();
+    size_t nPruned = csGlobalState->pruner().prune(nPruneHeight, MAX_STATE_PRUNE_BATCH);
+    nPruned += csGlobalState->prunerUTXO().prune(nPruneHeight, MAX_STATE_PRUNE_BATCH);
+    if (nPruned)
+        LogPrint("prune", "Pruned %u contract state nodes released at or below height %d: %.2fms\n", nPruned, nPruneHeight, 0.001 * (GetTimeMicros() - nStart));
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
@@ -3503,6 +3659,11 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    // Not in DisconnectBlock, which VerifyDB also runs on blocks that stay connected
+    if (fLogEvents && !pcontractlogdb->EraseBlockLogs(pindexDelete->nHeight))
+        return AbortNode(state, "Failed to erase contract event logs");
+    if (fMempoolSpeculation)
+        mempoolSpeculator.Clear();
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -3561,11 +3722,19 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         if (!ReadBlockFromDisk(block, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pblock = &block;
+        // Unless it was prefetched ahead, at least spread the reads of its inputs over the prefetch threads
+        blockPrefetcher.Queue(block);
     }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    uint64_t nPrefetchHits = 0, nPrefetchMisses = 0;
+    if (pcoinsPrefetch)
+        pcoinsPrefetch->GetStats(nPrefetchHits, nPrefetchMisses);
+    const dev::TrieNodeCache* pnodeCache = csGlobalState->db().nodeCache();
+    uint64_t nNodeHits = pnodeCache ? pnodeCache->hits() : 0;
+    uint64_t nNodeMisses = pnodeCache ? pnodeCache->misses() : 0;
     {
         CCoinsViewCache view(pcoinsTip);
 
@@ -3586,6 +3755,23 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         mapBlockSource.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        if (LogAcceptCategory("bench")) {
+            unsigned int nInputs = 0;
+            for (const CTransaction& tx : pblock->vtx)
+                if (!tx.IsCoinBase())
+                    nInputs += tx.vin.size();
+            uint64_t nPrefetchHitsNow = 0, nPrefetchMissesNow = 0;
+            if (pcoinsPrefetch)
+                pcoinsPrefetch->GetStats(nPrefetchHitsNow, nPrefetchMissesNow);
+            unsigned int nBelowCache = (nPrefetchHitsNow - nPrefetchHits) + (nPrefetchMissesNow - nPrefetchMisses);
+            unsigned int nPrefetched = nPrefetchHitsNow - nPrefetchHits;
+            // The node cache is shared with the prefetch threads and RPC, so its counts are only indicative
+            uint64_t nNodeHitsNow = pnodeCache ? pnodeCache->hits() - nNodeHits : 0;
+            uint64_t nNodeLookups = pnodeCache ? nNodeHitsNow + pnodeCache->misses() - nNodeMisses : 0;
+            LogPrint("bench", "    - Coins: %u inputs, %u lookups missed the cache, %u of those prefetched (%.1f%%); state trie nodes: %u of %u cached (%.1f%%)\n",
+                nInputs, nBelowCache, nPrefetched, nBelowCache ? 100.0 * nPrefetched / nBelowCache : 100.0,
+                nNodeHitsNow, nNodeLookups, nNodeLookups ? 100.0 * nNodeHitsNow / nNodeLookups : 100.0);
+        }
         assert(view.Flush());
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
@@ -3722,7 +3908,11 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
+        for (size_t i = vpindexToConnect.size(); i-- > 0;) {
+            CBlockIndex *pindexConnect = vpindexToConnect[i];
+            // Have the inputs of the next block read while this one is connected
+            if (i > 0)
+                blockPrefetcher.Queue(vpindexToConnect[i - 1]);
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
@@ -4740,6 +4930,10 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    // A block on top of the tip is connected next, read its inputs meanwhile
+    if (pindex->pprev == chainActive.Tip())
+        blockPrefetcher.Queue(block);
+
     // Write block to history file
     try {
         unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
@@ -5238,11 +5432,16 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have a contract event log index
+    pblocktree->ReadFlag("logevents", fLogEvents);
+    LogPrintf("%s: contract event log index %s\n", __func__, fLogEvents ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    nCoinsFlushedHeight = it->second->nHeight;
 
     PruneBlockIndexCandidates();
 
@@ -5488,6 +5687,7 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    nCoinsFlushedHeight = -1;
 }
 
 bool LoadBlockIndex()
@@ -5512,6 +5712,8 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fLogEvents = GetBoolArg("-logevents", DEFAULT_LOGEVENTS);
+    pblocktree->WriteFlag("logevents", fLogEvents);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5915,12 +6117,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 recentRejects->reset();
             }
 
-            // Use pcoinsTip->HaveCoinsInCache as a quick approximation to exclude
+            // Use pcoinsTip->HaveCoinInCache as a quick approximation to exclude
             // requesting or processing some txs which have already been included in a block
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoinsInCache(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
     case MSG_WITNESS_BLOCK:
@@ -38,10 +38,13 @@
 #include "libethereum/ChainParams.h"
 
 extern dev::eth::QtumState* csGlobalState; // TODO temp dataToTx
+/** Seal engine shared by every contract execution; built once in AppInit2 and never modified afterwards. */
+extern std::unique_ptr<dev::eth::SealEngineFace> globalSealEngine;
 
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CContractLogDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -96,6 +99,20 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -parallelcontracts, speculative parallel execution of a block's contract outputs */
+static const bool DEFAULT_PARALLEL_CONTRACTS = true;
+/** Default for -mempoolspeculation, speculative execution of mempool contract outputs for block templates */
+static const bool DEFAULT_MEMPOOL_SPECULATION = false;
+/** Default for -evmvm, the EVM instruction dispatch mode */
+static const char* const DEFAULT_EVM_VM = "interpreter";
+/** Default for -callcontractgaslimit, the most gas a callcontract RPC may use */
+static const int64_t DEFAULT_CALLCONTRACT_GAS_LIMIT = 1LL << 31;
+/** Default for -callcontracttimeout, in milliseconds (0 = no timeout) */
+static const int64_t DEFAULT_CALLCONTRACT_TIMEOUT = 5000;
+/** Default for -callcontractthreads, the threads running the calls of all callcontractbatch requests (0 = auto) */
+static const int DEFAULT_CALLCONTRACT_THREADS = 0;
+/** Maximum number of callcontractbatch threads allowed */
+static const int MAX_CALLCONTRACT_THREADS = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -145,6 +162,7 @@ static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 //begin modif qtum
 static const bool DEFAULT_TXINDEX = true;
+static const bool DEFAULT_LOGEVENTS = false;
 //end modif qtum
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
@@ -198,7 +216,10 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern bool fParallelContracts;
+extern bool fMempoolSpeculation;
 extern bool fTxIndex;
+extern bool fLogEvents;
 extern bool fAddrIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
@@ -232,6 +253,12 @@ extern bool fPruneMode;
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Depth of the contract state roots -statepruning keeps for reorgs; 0 keeps them all. */
+extern int nStatePruneDepth;
+/** Seconds between two runs of contract state pruning */
+static const int64_t STATE_PRUNE_INTERVAL = 10;
+/** Stop a run of contract state pruning after the block that takes it past this many trie nodes per database */
+static const size_t MAX_STATE_PRUNE_BATCH = 20000;
 
 static const signed int DEFAULT_CHECKBLOCKS = MIN_BLOCKS_TO_KEEP;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
@@ -294,6 +321,10 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the speculative contract execution thread */
+void ThreadContractExec();
+/** Contract outputs ConnectBlock committed from their speculation, and those whose speculation conflicted with an earlier output, since startup */
+void GetContractSpeculationStats(uint64_t& nSpeculatedOut, uint64_t& nConflictsOut);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -351,6 +382,10 @@ void Misbehaving(NodeId nodeid, int howmuch);
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
+/** Height at or below which blocks' released contract state nodes may be deleted, or -1. */
+int GetStatePruneHeight();
+/** Delete contract state trie nodes no root within nStatePruneDepth of the flushed tip refers to. */
+void PruneContractState();
 //begin modif qtum
 bool IsConfirmedInNPrevBlocks(const CDiskTxPos& txindex, const CBlockIndex* pindexFrom, int nMaxDepth, int& nActualDepth);
 //end modif qtum
@@ -385,7 +420,7 @@ class BitTxToEthTx{
 
 public:
 
-    BitTxToEthTx(const CTransaction& tx, const uint32_t nout, const CCoinsViewCache* coinsView = nullptr) : txBit(tx), nOut(nout), coinsView(coinsView){}
+    BitTxToEthTx(const CTransaction& tx, const uint32_t nout, const valtype& sender) : nOut(nout), txBit(tx), senderAddress(sender){}
 
     dev::eth::QtumTransaction getEthTx(); // TODO temp QtumTransaction
 
@@ -399,7 +434,7 @@ private:
 
     const uint32_t nOut;
     const CTransaction& txBit;
-    const CCoinsViewCache* coinsView;
+    const valtype senderAddress;
     dev::eth::QtumTransaction txEth; // TODO temp QtumTransaction
     std::vector<valtype> stack;
     VmArgumentsType argEthTx;
@@ -410,28 +445,67 @@ struct BCExecutor{
 
 public:
 
-    BCExecutor(const CBlock& block, const CTransaction& tx, const uint32_t nOut, const CCoinsViewCache* coinsView = nullptr):
-     block(block), tx(tx), nOut(nOut), coinsView(coinsView){};    
+    BCExecutor(const CBlock& block, const CTransaction& tx, const uint32_t nOut, const valtype& sender):
+     block(block), tx(tx), nOut(nOut), sender(sender){};    
 
     dev::eth::ResultExecute execute(){
-        BitTxToEthTx convert(tx, nOut, coinsView);
+        BitTxToEthTx convert(tx, nOut, sender);
         return execute(convert.getEthTx());
     }
 
+    dev::eth::EnvInfo BuildEVMEnvironment();
+
 private:
 
     dev::eth::ResultExecute execute(const dev::eth::QtumTransaction tx); // TODO temp QtumTransaction
 
     dev::Address EthAddrFromScript(const CScript& scriptIn);
 
-    dev::eth::EnvInfo BuildEVMEnvironment();
-
     const CBlock& block;
     const CTransaction& tx;
     const uint32_t nOut;
-    const CCoinsViewCache* coinsView;
+    const valtype sender;
     std::vector<dev::eth::ResultExecute> results;
 };
+
+/** Result of executing one contract output against the state its block started from. */
+struct CContractSpeculation
+{
+    //! Whether the execution finished without an exception, so result and changes can be committed
+    bool fDone;
+    dev::eth::ResultExecute result;
+    dev::eth::QtumStateChanges changes;
+
+    CContractSpeculation() : fDone(false) {}
+};
+
+/**
+ * Closure representing one speculative contract execution.
+ * It runs on a private copy of the base state and stores its outcome in the referenced
+ * CContractSpeculation; ConnectBlock then commits it or re-executes the output serially.
+ */
+class CContractExecCheck
+{
+private:
+    dev::eth::QtumTransaction ethTx;
+    const dev::eth::EnvInfo* penv;
+    const dev::eth::QtumState* pbaseState;
+    CContractSpeculation* pspeculation;
+
+public:
+    CContractExecCheck(): penv(NULL), pbaseState(NULL), pspeculation(NULL) {}
+    CContractExecCheck(const dev::eth::QtumTransaction& ethTxIn, const dev::eth::EnvInfo& envIn, const dev::eth::QtumState& baseStateIn, CContractSpeculation& speculationIn) :
+        ethTx(ethTxIn), penv(&envIn), pbaseState(&baseStateIn), pspeculation(&speculationIn) { }
+
+    bool operator()();
+
+    void swap(CContractExecCheck &check) {
+        std::swap(ethTx, check.ethTx);
+        std::swap(penv, check.penv);
+        std::swap(pbaseState, check.pbaseState);
+        std::swap(pspeculation, check.pspeculation);
+    }
+};
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 /** 
@@ -462,7 +536,8 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline, except for those consuming the expected transaction hashes
+ * of context.
  */
 // bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
                 //  unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL);
@@ -471,6 +546,8 @@ unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL,
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
+/** Same, recording the spent outputs in txundo */
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state);
@@ -535,19 +612,31 @@ private:
     ScriptError error;
 
     BlockValidationContext* context;
+    //! Set on block checks handed to the script check queue. They run out of block order, so
+    //! instead of the shared context OP_TXHASH in the scriptSig or scriptPubKey gets the hash
+    //! of the spending transaction, which is what the context holds while it is connected.
+    bool fTxHashOnly;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), context(NULL), fTxHashOnly(false) {}
     // CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
     //     scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
     //     ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, BlockValidationContext* context = NULL) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), context(context) { 
+    CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, BlockValidationContext* context = NULL) :
+        scriptPubKey(outIn.scriptPubKey), amount(outIn.nValue),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), context(context), fTxHashOnly(false) { 
         }
 
     bool operator()();
 
+    /**
+     * Whether the check pops the expected transaction hashes of the block context, which
+     * OP_EXEC and OP_EXEC_ASSIGN do in block order. Only such checks must run in place;
+     * the others can be deferred once Detach() has released the shared context.
+     */
+    bool UsesExpectedTxHashes() const;
+    void Detach() { fTxHashOnly = context != NULL; context = NULL; }
+
     void swap(CScriptCheck &check) {
         scriptPubKey.swap(check.scriptPubKey);
         std::swap(ptxTo, check.ptxTo);
@@ -556,6 +645,8 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(context, check.context);
+        std::swap(fTxHashOnly, check.fTxHashOnly);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -642,6 +733,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the contract event log database, if -logevents (protected by cs_main) */
+extern CContractLogDB *pcontractlogdb;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -660,7 +754,8 @@ bool ParseScriptPubKey(CDataForContract& data, txnouttype& transactionType, cons
 
 dev::eth::EnvInfo BuildEVMEnvironment(CBlockIndex* tip);
 
-valtype GetSenderAddress(const CTransaction& tx, const CCoinsViewCache* coinsView = nullptr); // TODO temp addressSender
+/** Hash160 of the key paying to the prevout of vin[0], which view must hold; empty if it is not a key hash output */
+valtype GetSenderAddress(const CTransaction& tx, const CCoinsViewCache& view); // TODO temp addressSender
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
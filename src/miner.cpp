@@ -12,6 +12,7 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "contractspeculator.h"
 #include "hash.h"
 #include "main.h"
 #include "net.h"
@@ -133,6 +134,10 @@ void BlockAssembler::resetBlock()
 
     lastFewTxs = 0;
     blockFinished = false;
+
+    fUseSpeculation = false;
+    setContractWrites.clear();
+    nSpeculated = 0;
 }
 
 CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fProofOfStake, int64_t* pFees)
@@ -231,8 +236,13 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bo
 
     dev::h256 oldHashQtumRoot(csGlobalState->rootHashUTXO()); // TODO temp rootQtum
     dev::h256 oldHashStateRoot(csGlobalState->rootHash());
+    // The speculations were made on the tip's state with a null author, as in proof-of-stake blocks
+    fUseSpeculation = fMempoolSpeculation && fProofOfStake && csGlobalState->cachedAddresses().empty() &&
+        oldHashStateRoot == uintToh256(pindexPrev->hashStateRoot) && oldHashQtumRoot == uintToh256(pindexPrev->hashUTXORoot);
     addPriorityTxs();
     addPackageTxs();
+    if (fUseSpeculation)
+        LogPrint("bench", "CreateNewBlock(): %u contract outputs taken from mempool speculation\n", nSpeculated);
     pblock->hashStateRoot = uint256(h256Touint(dev::h256(csGlobalState->rootHash())));
     pblock->hashUTXORoot = uint256(h256Touint(dev::h256(csGlobalState->rootHashUTXO()))); // TODO temp rootQtum
     csGlobalState->setRoot(oldHashStateRoot);
@@ -382,11 +392,36 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) // TODO temp
         if (!tx.vout[i].scriptPubKey.HasOpExec() && !tx.vout[i].scriptPubKey.HasOpAssign())
             continue;
 
-        dev::h256 oldHashQtumRoot(csGlobalState->rootHashUTXO());
-        dev::h256 oldHashStateRoot(csGlobalState->rootHash());
-
-        BCExecutor executor(*pblock, tx, i);
-        dev::eth::ResultExecute res = executor.execute();
+        dev::eth::QtumState::Checkpoint checkpoint(csGlobalState->checkpoint());
+
+        dev::eth::ResultExecute res;
+        std::shared_ptr<const CContractSpeculation> speculation;
+        if (fUseSpeculation)
+            speculation = mempoolSpeculator.Find(COutPoint(tx.GetHash(), i), pblock->hashPrevBlock, setContractWrites);
+        if (speculation) {
+            csGlobalState->applyChanges(speculation->changes);
+            csGlobalState->db().commit();
+            dev::AddressHash written = speculation->changes.written();
+            setContractWrites.insert(written.begin(), written.end());
+            res = speculation->result;
+            nSpeculated++;
+        } else {
+            csGlobalState->setRecordAccess(fUseSpeculation);
+            BCExecutor executor(*pblock, tx, i, iter->GetSender());
+            res = executor.execute();
+            if (fUseSpeculation) {
+                dev::AddressHash accessed = csGlobalState->accessed();
+                // Both are dropped from the caches after the execution, so never written; the author is null
+                accessed.erase(dev::Address(iter->GetSender()));
+                accessed.erase(dev::Address());
+                setContractWrites.insert(accessed.begin(), accessed.end());
+                csGlobalState->setRecordAccess(false);
+            }
+        }
+        if (fUseSpeculation) {
+            dev::AddressHash cached = csGlobalState->cachedAddresses();
+            setContractWrites.insert(cached.begin(), cached.end());
+        }
 
         uint64_t sizeTransactions = 0;
         uint64_t blockWeightTemp = nBlockWeight;
@@ -402,8 +437,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) // TODO temp
             ++nBlockTx;
 
             if(nBlockWeight - 4000 > nBlockMaxSize / 20 || sizeTransactions > nBlockMaxSize / 20){ // if(nBlockWeight > 10000 || sizeTransactions > 10000){//8450){ // TEST
-                csGlobalState->setRoot(oldHashStateRoot);
-                csGlobalState->setRootUTXO(oldHashQtumRoot);
+                csGlobalState->rollback(checkpoint);
                 nBlockTx -= transactions.size();
                 nBlockSize = blockSizeTemp;
                 transactions.clear();
@@ -422,7 +456,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) // TODO temp
         CAmount refund(res.execRes.gasRefunded);
         if (refund > 0){
             usedFee += refund;
-            CScript script(CScript() << OP_DUP << OP_HASH160 << GetSenderAddress(tx) << OP_EQUALVERIFY << OP_CHECKSIG);
+            CScript script(CScript() << OP_DUP << OP_HASH160 << iter->GetSender() << OP_EQUALVERIFY << OP_CHECKSIG);
             voutCoinBaseTX.push_back(CTxOut(CAmount(refund), script));
         }
     }
@@ -14,6 +14,8 @@
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
+#include <libdevcrypto/Common.h>
+
 class CBlockIndex;
 class CChainParams;
 class CReserveKey;
@@ -174,6 +176,12 @@ private:
     int lastFewTxs;
     bool blockFinished;
 
+    // Reuse of the mempool speculations (see CContractSpeculator)
+    bool fUseSpeculation;
+    // Addresses the contract outputs placed so far may have written
+    dev::AddressHash setContractWrites;
+    unsigned int nSpeculated;
+
 public:
     CAmount usedFee = 0;
     std::vector<CTxOut> voutCoinBaseTX;
@@ -7,8 +7,10 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "contractlogdb.h"
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
@@ -21,16 +23,27 @@
 #include "hash.h"
 //begin modif qtum
 #include "pos.h"
+#include <libevm/CodeAnalysis.h>
+#include <libevm/VM.h>
+#include <libevm/VMProfiler.h>
 //end modif qtum
 
 #include <stdint.h>
 
 #include <univalue.h>
 
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 using namespace std;
 
+//! Storage entries getstoragerange lists by default, and at most
+static const int DEFAULT_STORAGE_RANGE = 100;
+static const int MAX_STORAGE_RANGE = 1000;
+//! Calls callcontractbatch runs at most
+static const size_t MAX_CALLCONTRACT_BATCH = 1000;
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
@@ -301,6 +314,7 @@ std::string EntryDescriptionString()
            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including this one)\n"
+           "    \"sender\" : \"hex\",       (string, optional) hash160 of the sender of the contract outputs\n"
            "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
            "        \"transactionid\",    (string) parent transaction id\n"
            "       ... ]\n";
@@ -323,6 +337,8 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
     info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
     info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
+    if (!e.GetSender().empty())
+        info.push_back(Pair("sender", HexStr(e.GetSender())));
     const CTransaction& tx = e.GetTx();
     set<string> setDepends;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
@@ -724,6 +740,31 @@ static std::string minHex(dev::h256 const& _h)
 	return toHex(_h.ref().cropped(i));
 }
 
+/**
+ * Snapshot of the contract state of the main chain block at nHeight, or of
+ * the tip for -1, to be used outside cs_main. Requires cs_main.
+ */
+static std::unique_ptr<dev::eth::QtumState> SnapshotContractState(int nHeight, CBlockIndex** ppindex = NULL)
+{
+    AssertLockHeld(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    if (nHeight != -1) {
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        // Leave a block of margin, the state of the oldest kept block is pruned by the next one
+        if (nStatePruneDepth > 0 && nHeight <= chainActive.Height() - nStatePruneDepth)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Contract state of the block has been pruned");
+        pindex = chainActive[nHeight];
+    }
+    if (ppindex)
+        *ppindex = pindex;
+    try {
+        return std::unique_ptr<dev::eth::QtumState>(new dev::eth::QtumState(csGlobalState->snapshot(uintToh256(pindex->hashStateRoot), uintToh256(pindex->hashUTXORoot))));
+    } catch (dev::RootNotFound const&) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Contract state of the block is not available");
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////// // TODO temp getaccount // TODO temp callcontract
 UniValue getaccountinfo(const UniValue& params, bool fHelp)
 {
@@ -776,105 +817,562 @@ UniValue getaccountinfo(const UniValue& params, bool fHelp)
     return result;
 }
 
+ /** A contract call parsed from the arguments of callcontract or callcontractbatch */
+struct CContractCall
+{
+    dev::Address address;
+    std::vector<unsigned char> data;
+    dev::Address sender;
+    dev::u256 gasLimit;
+};
+
+static CContractCall ParseContractCall(const UniValue& address, const UniValue& data, const UniValue& sender, const UniValue& gasLimit)
+{
+    CContractCall call;
+    std::string strAddr = address.get_str();
+    if(strAddr.size() != 40 || !IsHex(strAddr))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address");
+    call.address = dev::Address(strAddr);
+    call.data = ParseHex(data.get_str());
+
+    int64_t nGasCap = GetArg("-callcontractgaslimit", DEFAULT_CALLCONTRACT_GAS_LIMIT);
+    call.gasLimit = dev::u256(nGasCap);
+    if (!gasLimit.isNull()) {
+        int64_t nGasLimit = gasLimit.get_int64();
+        if (nGasLimit <= 0 || nGasLimit > nGasCap)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid gasLimit, must be between 1 and %d", nGasCap));
+        call.gasLimit = dev::u256(nGasLimit);
+    }
+    call.sender = dev::Address("f1b0747fe29c1fe5d4ff1e63cefdbdeaae1329d6");
+    if(!sender.isNull() && !sender.get_str().empty()){
+        call.sender = dev::Address(sender.get_str());
+    }
+    return call;
+}
+
+/** Runs a call on the state without keeping its changes. Returns false if it ran out of -callcontracttimeout. */
+static bool RunContractCall(dev::eth::QtumState& state, dev::eth::EnvInfo env, const CContractCall& call, dev::eth::ResultExecute& resultExec)
+{
+    dev::u256 gasPrice = 1;
+    dev::eth::QtumTransaction callTransaction(0, gasPrice, call.gasLimit, call.address, call.data, dev::u256(0)); // TODO temp QtumTransaction
+    callTransaction.forceSender(call.sender);
+    callTransaction.setVersion(1);
+
+    env.setGasLimit(call.gasLimit);
+    int64_t nTimeout = GetArg("-callcontracttimeout", DEFAULT_CALLCONTRACT_TIMEOUT);
+    // Checked by the VM every so many steps, which unlike a tracer keeps its per-block gas checks
+    std::chrono::steady_clock::time_point timeDeadline;
+    if (nTimeout > 0)
+        timeDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(nTimeout);
+    dev::eth::VMDeadline deadline(timeDeadline);
+    resultExec = state.execute(env, globalSealEngine.get(), callTransaction, dev::eth::Permanence::Reverted);
+    return !deadline.passed();
+}
+
  UniValue callcontract(const UniValue& params, bool fHelp)
  {
-     if (fHelp || params.size() < 2)
+     if (fHelp || params.size() < 2 || params.size() > 5)
          throw runtime_error(
-             "callcontract \"address\" \"data\" ( address )\n"
+             "callcontract \"address\" \"data\" ( \"sender\" gasLimit height )\n"
+             "\nCall a contract without a transaction. Calls run in parallel with each other and with block validation.\n"
              "\nArgument:\n"
              "1. \"address\"          (string, required) The account address\n"
              "2. \"data\"             (string, required) The data hex string\n"
-             "3. address            (string, optional) The sender address hex string\n"
+             "3. \"sender\"           (string, optional) The sender address hex string\n"
+             "4. gasLimit           (numeric, optional) The gas the call may use, at most -callcontractgaslimit (default: that limit)\n"
+             "5. height             (numeric, optional) Call the contract in the state of the block at this height (default: the tip)\n"
          );
- 
-     LOCK(cs_main);
- 
+
+     CContractCall call = ParseContractCall(params[0], params[1], params.size() > 2 ? params[2] : NullUniValue, params.size() > 3 ? params[3] : NullUniValue);
+
+     // Only the state and environment of the block are taken under cs_main; the call runs on a
+     // snapshot of the committed state, which shares the databases with csGlobalState.
+     std::unique_ptr<dev::eth::QtumState> pstate;
+     dev::eth::EnvInfo env;
+     {
+         LOCK(cs_main);
+         CBlockIndex* pindex;
+         pstate = SnapshotContractState(params.size() > 4 ? params[4].get_int() : -1, &pindex);
+         env = BuildEVMEnvironment(pindex);
+     }
+
+     if(!pstate->addressInUse(call.address))
+         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
+
+     dev::eth::ResultExecute resultExec;
+     if (!RunContractCall(*pstate, env, call, resultExec))
+         throw JSONRPCError(RPC_MISC_ERROR, strprintf("Contract call timed out after %dms", GetArg("-callcontracttimeout", DEFAULT_CALLCONTRACT_TIMEOUT)));
+
+     UniValue result(UniValue::VOBJ);
+
+     result.push_back(Pair("address", params[0].get_str()));
+     result.push_back(Pair("gasUsed", CAmount(resultExec.execRes.gasUsed)));
+     result.push_back(Pair("output", HexStr(resultExec.execRes.output)));
+
+     return result;
+ }
+
+/**
+ * A call of a callcontractbatch request, run on its own copy of the snapshot of the batch, as
+ * executing changes the caches of the state. The copies share the databases, so the trie nodes
+ * one call reads are cached for all.
+ */
+class CContractCallCheck
+{
+private:
+    const dev::eth::QtumState* pstate;
+    const dev::eth::EnvInfo* penv;
+    const CContractCall* pcall;
+    UniValue* presult;
+
+public:
+    CContractCallCheck() : pstate(NULL), penv(NULL), pcall(NULL), presult(NULL) {}
+    CContractCallCheck(const dev::eth::QtumState& state, const dev::eth::EnvInfo& env, const CContractCall& call, UniValue& result) :
+        pstate(&state), penv(&env), pcall(&call), presult(&result) {}
+
+    //! Failed calls are reported in the result, so the check always succeeds
+    bool operator()();
+
+    void swap(CContractCallCheck& check) {
+        std::swap(pstate, check.pstate);
+        std::swap(penv, check.penv);
+        std::swap(pcall, check.pcall);
+        std::swap(presult, check.presult);
+    }
+};
+
+bool CContractCallCheck::operator()()
+{
+    UniValue& result = *presult;
+    result.push_back(Pair("address", pcall->address.hex()));
+    try {
+        dev::eth::QtumState state(*pstate);
+        if (!state.addressInUse(pcall->address)) {
+            result.push_back(Pair("error", "Address does not exist"));
+            return true;
+        }
+        dev::eth::ResultExecute resultExec;
+        if (!RunContractCall(state, *penv, *pcall, resultExec)) {
+            result.push_back(Pair("error", strprintf("Contract call timed out after %dms", GetArg("-callcontracttimeout", DEFAULT_CALLCONTRACT_TIMEOUT))));
+            return true;
+        }
+        std::ostringstream excepted;
+        excepted << resultExec.execRes.excepted;
+        result.push_back(Pair("gasUsed", CAmount(resultExec.execRes.gasUsed)));
+        result.push_back(Pair("output", HexStr(resultExec.execRes.output)));
+        result.push_back(Pair("excepted", excepted.str()));
+    } catch (const std::exception& e) {
+        result.push_back(Pair("error", e.what()));
+    }
+    return true;
+}
+
+//! Threads shared by all callcontractbatch requests, which take turns at the queue
+static CCheckQueue<CContractCallCheck> contractcallqueue(1);
+static boost::mutex cs_contractcallqueue;
+
+void ThreadContractCall() {
+    RenameThread("quantum-callcontract");
+    contractcallqueue.Thread();
+}
+
+UniValue callcontractbatch(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "callcontractbatch [{\"address\":\"address\",\"data\":\"data\",\"sender\":\"sender\",\"gasLimit\":n},...] ( height )\n"
+            "\nRun many contract calls without transactions, all in the state of the same block.\n"
+            "The calls run on the -callcontractthreads threads, which batches take in turn; each call has the limits of callcontract.\n"
+            "\nArguments:\n"
+            "1. \"calls\"            (string, required) A json array of at most " + std::to_string(MAX_CALLCONTRACT_BATCH) + " calls\n"
+            "     [\n"
+            "       {\n"
+            "         \"address\":\"address\",  (string, required) The account address\n"
+            "         \"data\":\"data\",        (string, required) The data hex string\n"
+            "         \"sender\":\"sender\",    (string, optional) The sender address hex string\n"
+            "         \"gasLimit\":n          (numeric, optional) The gas the call may use, at most -callcontractgaslimit\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+            "2. height             (numeric, optional) Call the contracts in the state of the block at this height (default: the tip)\n"
+            "\nResult:\n"
+            "[                     (array) One result for each call, in the same order\n"
+            "  {\n"
+            "    \"address\" : \"address\",   (string) The account address\n"
+            "    \"gasUsed\" : n,           (numeric) The gas the call used\n"
+            "    \"output\" : \"hex\",        (string) The output of the call\n"
+            "    \"excepted\" : \"reason\",   (string) How the call ended, None if it did not throw\n"
+            "    \"error\" : \"message\"      (string) Instead of the above, why the call could not run\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("callcontractbatch", "'[{\"address\":\"c4c1d7375918557df2ef8f1d1f0b2329cb248a15\",\"data\":\"70a08231\"}]'")
+            + HelpExampleRpc("callcontractbatch", "[{\"address\":\"c4c1d7375918557df2ef8f1d1f0b2329cb248a15\",\"data\":\"70a08231\"}]")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VNUM), true);
+    const UniValue& inputs = params[0].get_array();
+    if (inputs.size() > MAX_CALLCONTRACT_BATCH)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %d calls in a batch", MAX_CALLCONTRACT_BATCH));
+
+    std::vector<CContractCall> calls;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const UniValue& input = inputs[i];
+        if (!input.isObject())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected a call object");
+        RPCTypeCheckObj(input, {
+            {"address", UniValueType(UniValue::VSTR)},
+            {"data", UniValueType(UniValue::VSTR)},
+            {"sender", UniValueType(UniValue::VSTR)},
+            {"gasLimit", UniValueType(UniValue::VNUM)},
+        }, true, true);
+        if (find_value(input, "address").isNull() || find_value(input, "data").isNull())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, calls need an address and data");
+        calls.push_back(ParseContractCall(find_value(input, "address"), find_value(input, "data"), find_value(input, "sender"), find_value(input, "gasLimit")));
+    }
+
+    // One snapshot for the whole batch, so every call sees the same block
+    std::unique_ptr<dev::eth::QtumState> pstate;
+    dev::eth::EnvInfo env;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindex;
+        pstate = SnapshotContractState(params.size() > 1 ? params[1].get_int() : -1, &pindex);
+        env = BuildEVMEnvironment(pindex);
+    }
+
+    std::vector<UniValue> results(calls.size(), UniValue(UniValue::VOBJ));
+    std::vector<CContractCallCheck> vChecks;
+    vChecks.reserve(calls.size());
+    for (size_t i = 0; i < calls.size(); i++)
+        vChecks.push_back(CContractCallCheck(*pstate, env, calls[i], results[i]));
+    {
+        // Batches of concurrent requests run one after the other on the same threads
+        boost::unique_lock<boost::mutex> lock(cs_contractcallqueue);
+        CCheckQueueControl<CContractCallCheck> control(&contractcallqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const UniValue& entry : results)
+        result.push_back(entry);
+    return result;
+}
+ UniValue getstoragerange(const UniValue& params, bool fHelp)
+ {
+     if (fHelp || params.size() < 1 || params.size() > 4)
+         throw runtime_error(
+             "getstoragerange \"address\" ( \"cursor\" limit height )\n"
+             "\nList the storage of a contract, a page at a time, in an order that stays the same between calls.\n"
+             "\nArguments:\n"
+             "1. \"address\"          (string, required) The contract address\n"
+             "2. \"cursor\"           (string, optional) The \"next\" of the previous page, empty for the first page\n"
+             "3. limit              (numeric, optional, default=" + itostr(DEFAULT_STORAGE_RANGE) + ") Max entries to list, at most " + itostr(MAX_STORAGE_RANGE) + "\n"
+             "4. height             (numeric, optional) List the storage in the state of the block at this height (default: the tip)\n"
+             "\nResult:\n"
+             "{\n"
+             "  \"storage\" : {          (object) The entries of the page\n"
+             "    \"key\" : \"value\",     (string) A key and its value, in hex\n"
+             "    ...\n"
+             "  },\n"
+             "  \"next\" : \"cursor\"     (string) Where the next page starts, absent after the last page\n"
+             "}\n"
+             "\nExamples:\n"
+             + HelpExampleCli("getstoragerange", "\"c4c1d7375918557df2ef8f1d1f0b2329cb248a15\" \"\" 100")
+             + HelpExampleRpc("getstoragerange", "\"c4c1d7375918557df2ef8f1d1f0b2329cb248a15\", \"\", 100")
+         );
+
      std::string strAddr = params[0].get_str();
-     std::string data = params[1].get_str();
-     if(strAddr.size() != 40)
+     if (strAddr.size() != 40 || !IsHex(strAddr))
          throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address");
- 
      dev::Address addrAccount(strAddr);
-     if(!csGlobalState->addressInUse(addrAccount))
-         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
-     
-     dev::u256 gasPrice = 1;
-     dev::u256 gasLimit(MAX_MONEY);
-     dev::Address senderAddress("f1b0747fe29c1fe5d4ff1e63cefdbdeaae1329d6");
-     if(params.size() == 3){
-         senderAddress = dev::Address(params[2].get_str());
+
+     dev::h256 hashFrom;
+     if (params.size() > 1 && !params[1].get_str().empty()) {
+         std::string strCursor = params[1].get_str();
+         if (strCursor.size() != 64 || !IsHex(strCursor))
+             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+         hashFrom = dev::h256(strCursor);
+     }
+
+     int nLimit = DEFAULT_STORAGE_RANGE;
+     if (params.size() > 2) {
+         nLimit = params[2].get_int();
+         if (nLimit <= 0 || nLimit > MAX_STORAGE_RANGE)
+             throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid limit, must be between 1 and %d", MAX_STORAGE_RANGE));
+     }
+
+     // The storage trie is walked on a snapshot, outside cs_main
+     std::unique_ptr<dev::eth::QtumState> pstate;
+     {
+         LOCK(cs_main);
+         pstate = SnapshotContractState(params.size() > 3 ? params[3].get_int() : -1);
      }
- 
-     std::vector<unsigned char> opcode(ParseHex(data));
-    //  dev::eth::Transaction callTransaction(0, gasPrice, gasLimit, addrAccount, opcode, dev::u256(0));
-     dev::eth::QtumTransaction callTransaction(0, gasPrice, gasLimit, addrAccount, opcode, dev::u256(0)); // TODO temp QtumTransaction
-     callTransaction.forceSender(senderAddress);
-     callTransaction.setVersion(1);
- 
-     dev::eth::EnvInfo env(BuildEVMEnvironment(chainActive.Tip()));
-     env.setGasLimit(dev::u256(1 << 31));
-     using OnOpFunc = std::function<void(uint64_t /*steps*/, uint64_t /* PC */, dev::eth::Instruction /*instr*/, dev::bigint /*newMemSize*/, dev::bigint /*gasCost*/, dev::bigint /*gas*/, dev::eth::VM*, dev::eth::ExtVMFace const*)>;
-     unique_ptr<dev::eth::SealEngineFace> se(dev::eth::ChainParams(dev::eth::genesisInfo(dev::eth::Network::HomesteadTest)).createSealEngine());
-     dev::eth::ResultExecute resultExec = 
-         csGlobalState->execute(env, se.get(), callTransaction, dev::eth::Permanence::Reverted, OnOpFunc());
- 
+     if (!pstate->addressInUse(addrAccount))
+         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
+
+     UniValue storage(UniValue::VOBJ);
+     int nListed = 0;
+     dev::h256 hashNext = pstate->forEachStorage(addrAccount, hashFrom, [&](const dev::u256& key, const dev::u256& value) {
+         if (nListed == nLimit)
+             return false;
+         storage.push_back(Pair(minHex(key), minHex(value)));
+         nListed++;
+         return true;
+     });
+
      UniValue result(UniValue::VOBJ);
- 
-     result.push_back(Pair("address", strAddr));
-     result.push_back(Pair("gasUsed", CAmount(resultExec.execRes.gasUsed)));
-     result.push_back(Pair("output", HexStr(resultExec.execRes.output)));
- 
+     result.push_back(Pair("storage", storage));
+     if (hashNext)
+         result.push_back(Pair("next", hashNext.hex()));
      return result;
  }
  ////////////////////////////////////////////////////////////////////////////
  //////////////////////////////////////////////////////////////////////////// // TODO temp listaccounts
  UniValue listcontracts(const UniValue& params, bool fHelp)
  {
-     if (fHelp)
+     if (fHelp || params.size() > 3)
          throw runtime_error(
-             "listcontracts (start maxDisplay)\n"
-             "\nArgument:\n"
-             "1. start     (numeric or string, optional) The starting account index, default 1\n"
-        	 "2. maxDisplay       (numeric or string, optional) Max accounts to list, default 20\n"
+             "listcontracts ( \"cursor\" maxDisplay \"codehash\" )\n"
+             "\nList the contracts of the tip, a page at a time, in an order that stays the same between calls.\n"
+             "\nArguments:\n"
+             "1. \"cursor\"           (string, optional) The \"next\" of the previous page, or a 1-based index to start at (default: the first contract)\n"
+             "2. maxDisplay         (numeric, optional) Max contracts to list, default 20\n"
+             "3. \"codehash\"         (string, optional) Only list the contracts whose code has this hash\n"
+             "\nResult:\n"
+             "{\n"
+             "  \"contracts\" : {        (object) The contracts of the page\n"
+             "    \"address\" : balance, (numeric) The balance of the contract\n"
+             "    ...\n"
+             "  },\n"
+             "  \"next\" : \"cursor\"     (string) Where the next page starts, absent after the last page\n"
+             "}\n"
          );
 
-     LOCK(cs_main);
-
-     int start=1;
-	 if (params.size() > 0){
-		 start = params[0].get_int();
-		 if (start<= 0)
-			 throw JSONRPCError(RPC_TYPE_ERROR, "Invalid start, min=1");
-	 }
-
-     int maxDisplay=20;
-     if (params.size() > 1){
-    	 maxDisplay = params[1].get_int();
-		 if (maxDisplay <= 0)
-			 throw JSONRPCError(RPC_TYPE_ERROR, "Invalid maxDisplay");
+     dev::h256 hashFrom;
+     int nSkip = 0;
+     if (params.size() > 0 && !params[0].isNull()) {
+         std::string strCursor = params[0].isNum() ? params[0].getValStr() : params[0].get_str();
+         if (strCursor.size() == 64 && IsHex(strCursor)) {
+             hashFrom = dev::h256(strCursor);
+         } else {
+             // An index, as listcontracts took before it had cursors; the contracts before it are still walked
+             int start = atoi(strCursor);
+             if (start <= 0 || strCursor != itostr(start))
+                 throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+             nSkip = start - 1;
+         }
      }
 
-     UniValue result(UniValue::VOBJ);
+     int maxDisplay = 20;
+     if (params.size() > 1) {
+         maxDisplay = params[1].get_int();
+         if (maxDisplay <= 0)
+             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid maxDisplay");
+     }
 
-     auto map = csGlobalState->addresses();
-     int contractsCount=(int)map.size();
+     boost::optional<dev::h256> codeHash;
+     if (params.size() > 2) {
+         std::string strCodeHash = params[2].get_str();
+         if (strCodeHash.size() != 64 || !IsHex(strCodeHash))
+             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid codehash");
+         codeHash = dev::h256(strCodeHash);
+     }
 
-     if (start > contractsCount)
-     	throw JSONRPCError(RPC_TYPE_ERROR, "start greater than max index "+ itostr(contractsCount));
+     // The trie of the tip is walked on a snapshot, outside cs_main
+     std::unique_ptr<dev::eth::QtumState> pstate;
+     {
+         LOCK(cs_main);
+         pstate = SnapshotContractState(-1);
+     }
 
-     int itStartPos=std::min(start-1,contractsCount);
-     int i=0;
-	 for (auto it = std::next(map.begin(),itStartPos); it!=map.end(); it++)
-	 {
-		result.push_back(Pair(it->first.hex(),ValueFromAmount(CAmount(csGlobalState->balance(it->first)))));
-		i++;
-		if(i==maxDisplay)break;
-	 }
+     UniValue contracts(UniValue::VOBJ);
+     int nListed = 0;
+     dev::h256 hashNext = pstate->forEachAccount(hashFrom, [&](const dev::Address& address, const dev::RLP& account) {
+         if (codeHash && account[3].toHash<dev::h256>() != *codeHash)
+             return true;
+         if (nSkip > 0) {
+             nSkip--;
+             return true;
+         }
+         if (nListed == maxDisplay)
+             return false;
+         contracts.push_back(Pair(address.hex(), ValueFromAmount(CAmount(account[1].toInt<dev::u256>()))));
+         nListed++;
+         return true;
+     });
 
+     UniValue result(UniValue::VOBJ);
+     result.push_back(Pair("contracts", contracts));
+     if (hashNext)
+         result.push_back(Pair("next", hashNext.hex()));
      return result;
  }
 
  ////////////////////////////////////////////////////////////////////////////
+static UniValue ContractLogsToJSON(const std::vector<CContractLog>& logs, const CLogFilter* filter)
+{
+    UniValue result(UniValue::VARR);
+    for (const CContractLog& log : logs) {
+        if (filter && !filter->Matches(log))
+            continue;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", log.address.hex()));
+        UniValue topics(UniValue::VARR);
+        for (const uint256& topic : log.topics)
+            topics.push_back(HexStr(topic.begin(), topic.end()));
+        entry.push_back(Pair("topics", topics));
+        entry.push_back(Pair("data", HexStr(log.data)));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+UniValue searchlogs(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 4)
+        throw runtime_error(
+            "searchlogs fromBlock toBlock ( [\"address\",...] [\"topic\",...] )\n"
+            "\nSearch the event logs of contracts in a range of blocks. Requires -logevents.\n"
+            "\nArguments:\n"
+            "1. fromBlock          (numeric, required) The height of the first block to search\n"
+            "2. toBlock            (numeric, required) The height of the last block to search, -1 for the tip\n"
+            "3. addresses          (array, optional) Only logs of any of these contract addresses\n"
+            "4. topics             (array, optional) Only logs with these topics at the same positions, null matching any topic\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"blockhash\" : \"hash\",   (string) The block that executed the contract output\n"
+            "    \"blockheight\" : n,      (numeric) The height of the block\n"
+            "    \"txid\" : \"hash\",        (string) The transaction of the contract output\n"
+            "    \"vout\" : n,             (numeric) The index of the contract output\n"
+            "    \"gasUsed\" : n,          (numeric) The gas the execution used\n"
+            "    \"log\" : [               (array) The matching logs\n"
+            "      {\n"
+            "        \"address\" : \"hex\",  (string) The contract that emitted the log\n"
+            "        \"topics\" : [\"hex\",...],\n"
+            "        \"data\" : \"hex\"\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("searchlogs", "0 -1 '[\"c4c1d7375918557df2ef8f1d1f0b2329cb248a15\"]'")
+            + HelpExampleRpc("searchlogs", "0, -1, [\"c4c1d7375918557df2ef8f1d1f0b2329cb248a15\"]")
+        );
+
+    if (!fLogEvents)
+        throw JSONRPCError(RPC_MISC_ERROR, "Contract event logs are not indexed, restart with -logevents and -reindex-chainstate");
+
+    CLogFilter filter;
+    if (params.size() > 2) {
+        const UniValue& addresses = params[2].get_array();
+        for (unsigned int i = 0; i < addresses.size(); i++) {
+            const std::string& strAddr = addresses[i].get_str();
+            if (strAddr.size() != 40 || !IsHex(strAddr))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address " + strAddr);
+            filter.addresses.push_back(dev::Address(strAddr));
+        }
+    }
+    if (params.size() > 3) {
+        const UniValue& topics = params[3].get_array();
+        for (unsigned int i = 0; i < topics.size(); i++) {
+            if (topics[i].isNull()) {
+                filter.topics.push_back(boost::none);
+                continue;
+            }
+            const std::string& strTopic = topics[i].get_str();
+            if (strTopic.size() != 64 || !IsHex(strTopic))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect topic " + strTopic);
+            filter.topics.push_back(uint256(ParseHex(strTopic)));
+        }
+    }
+
+    int nFrom = params[0].get_int();
+    int nTo = params[1].get_int();
+    {
+        LOCK(cs_main);
+        if (nTo == -1)
+            nTo = chainActive.Height();
+        if (nFrom < 0 || nFrom > nTo || nTo > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block range out of range");
+    }
+
+    // The database is searched without cs_main; blocks reorganized away meanwhile are dropped below
+    std::vector<std::pair<int, CBlockLogs> > blocks;
+    pcontractlogdb->FindBlockLogs(filter, nFrom, nTo, blocks);
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<int, CBlockLogs>& block : blocks) {
+        {
+            LOCK(cs_main);
+            if (block.first > chainActive.Height() || chainActive[block.first]->GetBlockHash() != block.second.hashBlock)
+                continue;
+        }
+        for (const COutPoint& outpoint : block.second.vReceipts) {
+            CContractReceipt receipt;
+            if (!pcontractlogdb->ReadReceipt(outpoint, receipt))
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read receipt of " + outpoint.ToString());
+            UniValue logs = ContractLogsToJSON(receipt.logs, &filter);
+            if (logs.empty())
+                continue;
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("blockhash", block.second.hashBlock.GetHex()));
+            entry.push_back(Pair("blockheight", block.first));
+            entry.push_back(Pair("txid", receipt.outpoint.hash.GetHex()));
+            entry.push_back(Pair("vout", (uint64_t)receipt.outpoint.n));
+            entry.push_back(Pair("gasUsed", receipt.nGasUsed));
+            entry.push_back(Pair("log", logs));
+            result.push_back(entry);
+        }
+    }
+    return result;
+}
+
+UniValue gettransactionreceipt(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "gettransactionreceipt \"txid\"\n"
+            "\nGet the receipts of the contract outputs of a transaction in the main chain. Requires -logevents.\n"
+            "\nArgument:\n"
+            "1. \"txid\"             (string, required) The transaction id\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",        (string) The transaction id\n"
+            "    \"vout\" : n,             (numeric) The index of the contract output\n"
+            "    \"gasUsed\" : n,          (numeric) The gas the execution used\n"
+            "    \"log\" : [ ... ]         (array) The logs, as returned by searchlogs\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettransactionreceipt", "\"mytxid\"")
+            + HelpExampleRpc("gettransactionreceipt", "\"mytxid\"")
+        );
+
+    if (!fLogEvents)
+        throw JSONRPCError(RPC_MISC_ERROR, "Contract event logs are not indexed, restart with -logevents and -reindex-chainstate");
+
+    uint256 hash = ParseHashV(params[0], "parameter 1");
+    std::vector<CContractReceipt> receipts;
+    if (!pcontractlogdb->ReadReceipts(hash, receipts))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read receipts");
+
+    UniValue result(UniValue::VARR);
+    for (const CContractReceipt& receipt : receipts) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", receipt.outpoint.hash.GetHex()));
+        entry.push_back(Pair("vout", (uint64_t)receipt.outpoint.n));
+        entry.push_back(Pair("gasUsed", receipt.nGasUsed));
+        entry.push_back(Pair("log", ContractLogsToJSON(receipt.logs, NULL)));
+        result.push_back(entry);
+    }
+    return result;
+}
+
 struct CCoinsStats
 {
     int nHeight;
@@ -901,29 +1399,33 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
     }
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    // Outputs of one transaction are adjacent in the database, so the per-transaction
+    // layout of the serialized hash is kept by grouping them as they come.
+    uint256 prevkey;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                }
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (stats.nTransactions == 0 || key.hash != prevkey) {
+                if (stats.nTransactions != 0)
+                    ss << VARINT(0);
+                stats.nTransactions++;
+                ss << key.hash;
+                prevkey = key.hash;
             }
+            stats.nTransactionOutputs++;
+            ss << VARINT(key.n+1);
+            ss << coin.out;
+            nTotalAmount += coin.out.nValue;
             stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
+    if (stats.nTransactions != 0)
+        ss << VARINT(0);
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
     return true;
@@ -992,7 +1494,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -1016,33 +1517,30 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out))
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return NullUniValue;
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+        ret.push_back(Pair("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1)));
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("coinbase", (bool)coin.fCoinBase));
 
     return ret;
 }
@@ -1368,6 +1866,148 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue evmCacheInfoToJSON()
+{
+    dev::eth::CodeAnalysisCacheStats stats = dev::eth::CodeAnalysisCache::stats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("size", (int64_t) stats.entries));
+    ret.push_back(Pair("usage", (int64_t) stats.bytes));
+    ret.push_back(Pair("maxusage", (int64_t) stats.maxBytes));
+    ret.push_back(Pair("hits", (int64_t) stats.hits));
+    ret.push_back(Pair("misses", (int64_t) stats.misses));
+
+    return ret;
+}
+
+UniValue getevmcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getevmcacheinfo\n"
+            "\nReturns details on the cache of analysed contract bytecode.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": xxxxx,               (numeric) Number of contracts whose analysis is cached\n"
+            "  \"usage\": xxxxx,              (numeric) Total memory usage for the cache\n"
+            "  \"maxusage\": xxxxx,           (numeric) Maximum memory usage for the cache\n"
+            "  \"hits\": xxxxx,               (numeric) Contract executions that reused a cached analysis\n"
+            "  \"misses\": xxxxx              (numeric) Contract executions that had to analyse the code\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getevmcacheinfo", "")
+            + HelpExampleRpc("getevmcacheinfo", "")
+        );
+
+    return evmCacheInfoToJSON();
+}
+
+UniValue getevmstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getevmstats ( reset )\n"
+            "\nReturns execution statistics of the EVM. They are only collected by nodes built with\n"
+            "--enable-evm-profiling; time spent in the calls a contract makes is left out of its own.\n"
+            "\nArguments:\n"
+            "1. reset              (boolean, optional, default=false) Start the statistics over after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,        (boolean) If the node collects statistics\n"
+            "  \"since\": xxxxx,               (numeric) Time of the last reset in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"opcodes\": {                  (json object) Each opcode that ran\n"
+            "    \"opcode\": {\n"
+            "      \"count\": xxxxx,           (numeric) Times it ran\n"
+            "      \"cycles\": xxxxx,          (numeric) CPU cycles it took\n"
+            "      \"triemisses\": xxxxx       (numeric) Storage slots it read from the state trie rather than the cache\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"contracts\": [                (json array) Each contract code that ran, most time first\n"
+            "    {\n"
+            "      \"codehash\": \"hash\",       (string) The hash of the code, zero for the codes past the tracked limit\n"
+            "      \"calls\": xxxxx,           (numeric) Frames that ran the code\n"
+            "      \"gas\": xxxxx,             (numeric) Gas the code used\n"
+            "      \"time\": xxxxx             (numeric) Microseconds the code ran\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getevmstats", "")
+            + HelpExampleCli("getevmstats", "true")
+            + HelpExampleRpc("getevmstats", "true")
+        );
+
+    dev::eth::VMProfile profile = dev::eth::VMProfiler::stats();
+    if (params.size() > 0 && params[0].get_bool())
+        dev::eth::VMProfiler::reset();
+
+    UniValue opcodes(UniValue::VOBJ);
+    for (size_t i = 0; i < profile.opcodes.size(); i++) {
+        const dev::eth::OpcodeProfile& op = profile.opcodes[i];
+        if (!op.count)
+            continue;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("count", (int64_t) op.count));
+        entry.push_back(Pair("cycles", (int64_t) op.ticks));
+        entry.push_back(Pair("triemisses", (int64_t) op.trieMisses));
+        opcodes.push_back(Pair(dev::eth::instructionInfo((dev::eth::Instruction) i).name, entry));
+    }
+
+    std::vector<std::pair<dev::h256, dev::eth::ContractProfile> > vContracts(profile.contracts.begin(), profile.contracts.end());
+    std::sort(vContracts.begin(), vContracts.end(), [](const std::pair<dev::h256, dev::eth::ContractProfile>& a, const std::pair<dev::h256, dev::eth::ContractProfile>& b) {
+        return a.second.micros > b.second.micros;
+    });
+    UniValue contracts(UniValue::VARR);
+    for (const std::pair<dev::h256, dev::eth::ContractProfile>& contract : vContracts) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("codehash", contract.first.hex()));
+        entry.push_back(Pair("calls", (int64_t) contract.second.calls));
+        entry.push_back(Pair("gas", (int64_t) contract.second.gas));
+        entry.push_back(Pair("time", (int64_t) contract.second.micros));
+        contracts.push_back(entry);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", dev::eth::VMProfiler::enabled()));
+    ret.push_back(Pair("since", profile.since));
+    ret.push_back(Pair("opcodes", opcodes));
+    ret.push_back(Pair("contracts", contracts));
+    return ret;
+}
+
+UniValue getstatepruninginfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getstatepruninginfo\n"
+            "\nReturns details on the pruning of contract state (-statepruning).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,        (boolean) If contract state nodes are reference counted and pruned\n"
+            "  \"depth\": xxxxx,               (numeric) Number of blocks whose state roots are kept for reorgs\n"
+            "  \"pruneheight\": xxxxx,         (numeric) Nodes released at or below this height are being deleted\n"
+            "  \"pendingblocks\": xxxxx,       (numeric) Blocks whose released nodes are not deleted yet\n"
+            "  \"reclaimablenodes\": xxxxx,    (numeric) Released nodes that are still unreferenced\n"
+            "  \"reclaimablebytes\": xxxxx     (numeric) Their size before compression\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstatepruninginfo", "")
+            + HelpExampleRpc("getstatepruninginfo", "")
+        );
+
+    LOCK(cs_main);
+    dev::eth::StatePruner::Info info = csGlobalState->pruner().info();
+    dev::eth::StatePruner::Info infoUTXO = csGlobalState->prunerUTXO().info();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", nStatePruneDepth > 0));
+    ret.push_back(Pair("depth", nStatePruneDepth));
+    ret.push_back(Pair("pruneheight", std::max(0, GetStatePruneHeight())));
+    ret.push_back(Pair("pendingblocks", (int64_t) std::max(info.blocks, infoUTXO.blocks)));
+    ret.push_back(Pair("reclaimablenodes", (int64_t) (info.nodes + infoUTXO.nodes)));
+    ret.push_back(Pair("reclaimablebytes", (int64_t) (info.bytes + infoUTXO.bytes)));
+
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1452,6 +2092,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblock",               &getblock,               true  },
     { "blockchain",         "getaccountinfo",         &getaccountinfo,         true  }, // TODO temp getaccount
     { "blockchain",         "callcontract",           &callcontract,           true  }, // TODO temp callcontract
+    { "blockchain",         "callcontractbatch",      &callcontractbatch,      true  },
 	{ "blockchain",         "listcontracts",          &listcontracts,          true  }, // TODO temp listcontracts
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
@@ -1461,9 +2102,15 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
+    { "blockchain",         "getevmcacheinfo",        &getevmcacheinfo,        true  },
+    { "blockchain",         "getevmstats",            &getevmstats,            true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
+    { "blockchain",         "getstatepruninginfo",    &getstatepruninginfo,    true  },
+    { "blockchain",         "getstoragerange",        &getstoragerange,        true  },
+    { "blockchain",         "gettransactionreceipt",  &gettransactionreceipt,  true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "searchlogs",             &searchlogs,             true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
 
     /* Not shown in help */
@@ -72,7 +72,17 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listunspent", 2 },
     { "getblock", 1 },
     { "getaccountinfo", 1 }, // TODO temp getaccount
-    { "callcontract", 3 }, // TODO temp callcontract
+    { "callcontract", 3 },
+    { "callcontract", 4 },
+    { "callcontractbatch", 0 },
+    { "callcontractbatch", 1 },
+    { "getevmstats", 0 },
+    { "getstoragerange", 2 },
+    { "getstoragerange", 3 },
+    { "searchlogs", 0 },
+    { "searchlogs", 1 },
+    { "searchlogs", 2 },
+    { "searchlogs", 3 },
     { "getblockheader", 1 },
     { "gettransaction", 1 },
     { "getrawtransaction", 1 },
@@ -112,7 +122,6 @@ static const CRPCConvertParam vRPCConvertParams[] =
 	{ "sendtocontract", 2 },
 	{ "sendtocontract", 3 },
 	{ "sendtocontract", 4 },
-	{ "listcontracts", 0 },
 	{ "listcontracts", 1 },
 	{ "fundcontract", 1 },
 };
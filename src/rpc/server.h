@@ -195,6 +195,8 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 extern void EnsureWalletIsUnlocked();
 
 bool StartRPC();
+/** Run an instance of the thread executing the calls of callcontractbatch requests */
+void ThreadContractCall();
 void InterruptRPC();
 void StopRPC();
 std::string JSONRPCExecBatch(const UniValue& vReq);
@@ -1044,6 +1044,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                             popstack(stack);
                         if (opcode == OP_EXEC_ASSIGN)
                             popstack(stack);
+                        // Only scripts of a block have expected transaction hashes
+                        if (!blockContext)
+                            return set_error(serror, SCRIPT_ERR_OP_EXEC);
                         if (blockContext->expectedTxHashes.empty() || stack.empty())
                             stack.push_back(vchFalse);
                         if (blockContext->expectedTxHashes.front() == uint256(stacktop(-1))){
@@ -1059,6 +1062,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 //This should only be allowed to be used if an OP_EXEC bytecode execution indicates that it can be
                 case OP_TXHASH:
                 {
+                    // Redeem and witness scripts, and those checked outside a block, have no transaction hash to push
+                    if (!blockContext)
+                        return set_error(serror, SCRIPT_ERR_BAD_OPCODE);
                     valtype txHash(blockContext->currentTxHash.begin(), blockContext->currentTxHash.end());
                     stack.push_back(txHash);
                     // return set_error(serror, SCRIPT_ERR_BAD_OPCODE); //don't allow yet
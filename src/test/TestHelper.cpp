@@ -57,7 +57,7 @@ void printHelp()
 	cout << setw(30) << "--singletest <TestName>" << setw(25) << "Run on a single test" << std::endl;
 	cout << setw(30) << "--singletest <TestFile> <TestName>" << std::endl;
 	cout << setw(30) << "--verbosity <level>" << setw(25) << "Set logs verbosity. 0 - silent, 1 - only errors, 2 - informative, >2 - detailed" << std::endl;
-	cout << setw(30) << "--vm <interpreter|jit|smart>" << setw(25) << "Set VM type for VMTests suite" << std::endl;
+	cout << setw(30) << "--vm <interpreter|threaded|jit|smart>" << setw(25) << "Set VM type for VMTests suite" << std::endl;
 	cout << setw(30) << "--vmtrace" << setw(25) << "Enable VM trace for the test. (Require build with VMTRACE=1)" << std::endl;
 	cout << setw(30) << "--stats <OutFile>" << setw(25) << "Output debug stats to the file" << std::endl;
 	cout << setw(30) << "--filltest <FileData>" << setw(25) << "Try fill tests from the given json stream" << std::endl;
@@ -850,6 +850,8 @@ Options::Options(int argc, char** argv)
 			string vmKind = argv[++i];
 			if (vmKind == "interpreter")
 				VMFactory::setKind(VMKind::Interpreter);
+			else if (vmKind == "threaded")
+				VMFactory::setKind(VMKind::Threaded);
 			else if (vmKind == "jit")
 				VMFactory::setKind(VMKind::JIT);
 			else if (vmKind == "smart")
@@ -0,0 +1,106 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethereum/State.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+// Lists up to count accounts from the cursor into page and returns the cursor of the next page.
+h256 Page(State const& state, h256 const& cursor, size_t count, std::vector<Address>& page)
+{
+    return state.forEachAccount(cursor, [&](Address const& address, RLP const&) {
+        if (page.size() == count)
+            return false;
+        page.push_back(address);
+        return true;
+    });
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(accountcursor_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(accountcursor_pages)
+{
+    State state(0, OverlayDB(), BaseState::Empty);
+    std::set<Address> accounts;
+    for (unsigned i = 1; i <= 50; ++i) {
+        state.addBalance(Address(i), i);
+        accounts.insert(Address(i));
+    }
+    state.commit();
+    state.rootHash();
+
+    // Paging visits every account once, in the order of the hashed addresses
+    std::vector<Address> all;
+    h256 cursor;
+    unsigned pages = 0;
+    do {
+        std::vector<Address> page;
+        cursor = Page(state, cursor, 7, page);
+        BOOST_CHECK(page.size() == (cursor ? 7 : 50 % 7));
+        all.insert(all.end(), page.begin(), page.end());
+        pages++;
+    } while (cursor);
+    BOOST_CHECK_EQUAL(pages, 8);
+    BOOST_CHECK(std::set<Address>(all.begin(), all.end()) == accounts);
+    BOOST_CHECK_EQUAL(all.size(), 50);
+    for (size_t i = 1; i < all.size(); ++i)
+        BOOST_CHECK(sha3(all[i - 1]) < sha3(all[i]));
+
+    // A cursor between two accounts starts at the later one, and the accounts come with their balances
+    h256 between = sha3(all[9]);
+    between[31]++;
+    std::vector<Address> page;
+    BOOST_CHECK(!state.forEachAccount(between, [&](Address const& address, RLP const& account) {
+        BOOST_CHECK(account[1].toInt<u256>() == u256(u160(address)));
+        page.push_back(address);
+        return true;
+    }));
+    BOOST_CHECK(page == std::vector<Address>(all.begin() + 10, all.end()));
+
+    // Accounts not yet written to the trie are not seen
+    state.addBalance(Address(51), 1);
+    state.commit();
+    page.clear();
+    Page(state, h256(), 100, page);
+    BOOST_CHECK_EQUAL(page.size(), 50);
+}
+
+BOOST_AUTO_TEST_CASE(accountcursor_storage)
+{
+    State state(0, OverlayDB(), BaseState::Empty);
+    Address contract = state.newContract(0, bytes(1, 0));
+    for (unsigned i = 0; i < 30; ++i)
+        state.setStorage(contract, i, i + 100);
+    state.commit();
+    state.rootHash();
+
+    std::map<u256, u256> all;
+    h256 cursor;
+    do {
+        size_t listed = 0;
+        cursor = state.forEachStorage(contract, cursor, [&](u256 const& key, u256 const& value) {
+            if (listed == 8)
+                return false;
+            BOOST_CHECK(all.insert(std::make_pair(key, value)).second);
+            listed++;
+            return true;
+        });
+    } while (cursor);
+    BOOST_CHECK_EQUAL(all.size(), 30);
+    for (auto const& i : all)
+        BOOST_CHECK(i.second == i.first + 100);
+
+    BOOST_CHECK(!state.forEachStorage(Address(0x1234), h256(), [](u256 const&, u256 const&) { return false; }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprefetch.h"
+#include "coins.h"
+#include "random.h"
+#include "test/test_quantum.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockprefetch_tests, BasicTestingSetup)
+
+namespace {
+
+Coin MakeCoin(CAmount nValue)
+{
+    Coin coin;
+    coin.out.nValue = nValue;
+    coin.out.scriptPubKey = CScript() << OP_TRUE;
+    coin.nHeight = 1;
+    return coin;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_serves_coin_once)
+{
+    CCoinsView dummy;
+    CCoinsViewCache db(&dummy);
+    CCoinsViewPrefetch prefetch(&db);
+    CCoinsViewCache tip(&prefetch);
+
+    COutPoint present(GetRandHash(), 0), absent(GetRandHash(), 1);
+    db.AddCoin(present, MakeCoin(10), false);
+    prefetch.Prefetch(std::vector<COutPoint>{present, absent});
+
+    uint64_t nHits, nMisses;
+    BOOST_CHECK(prefetch.HaveCoin(present));
+    BOOST_CHECK(!prefetch.HaveCoin(absent));
+    BOOST_CHECK_EQUAL(tip.AccessCoin(present).out.nValue, 10);
+    BOOST_CHECK(tip.AccessCoin(absent).IsSpent());
+    prefetch.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 1U);
+
+    // Handed to the cache above, the next lookup goes to the database
+    Coin coin;
+    BOOST_CHECK(prefetch.GetCoin(present, coin));
+    prefetch.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_dropped_on_write)
+{
+    CCoinsView dummy;
+    CCoinsViewCache db(&dummy);
+    CCoinsViewPrefetch prefetch(&db);
+    CCoinsViewCache tip(&prefetch);
+
+    COutPoint spent(GetRandHash(), 0);
+    db.AddCoin(spent, MakeCoin(10), false);
+    // The tip already has the coin cached when it is prefetched for a later block
+    BOOST_CHECK(!tip.AccessCoin(spent).IsSpent());
+    prefetch.Prefetch(std::vector<COutPoint>(1, spent));
+    BOOST_CHECK(prefetch.HaveCoin(spent));
+
+    // Spending it in the tip and flushing must not leave the prefetched copy behind
+    BOOST_CHECK(tip.SpendCoin(spent));
+    BOOST_CHECK(tip.Flush());
+    Coin coin;
+    BOOST_CHECK(!prefetch.GetCoin(spent, coin) || coin.IsSpent());
+    BOOST_CHECK(!prefetch.HaveCoin(spent));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
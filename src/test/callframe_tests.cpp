@@ -0,0 +1,142 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethcore/SealEngine.h>
+#include <libethashseal/GenesisInfo.h>
+#include <libethereum/ChainParams.h>
+#include <libethereum/Executive.h>
+#include <libethereum/State.h>
+#include <libevmcore/Instruction.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+void Op(bytes& code, Instruction inst)
+{
+    code.push_back((byte)inst);
+}
+
+void Push(bytes& code, u256 value)
+{
+    bytes data = toCompactBigEndian(value, 1);
+    code.push_back((byte)Instruction::PUSH1 + data.size() - 1);
+    code.insert(code.end(), data.begin(), data.end());
+}
+
+// Stores value at slot 0.
+void Store(bytes& code, u256 value)
+{
+    Push(code, value);
+    Push(code, 0);
+    Op(code, Instruction::SSTORE);
+}
+
+// Calls to with value and discards the result.
+void Call(bytes& code, Address const& to, u256 value)
+{
+    for (int i = 0; i < 4; i++)
+        Push(code, 0);
+    Push(code, value);
+    Push(code, u256(u160(to)));
+    Push(code, 100000);
+    Op(code, Instruction::CALL);
+    Op(code, Instruction::POP);
+}
+
+// Jumps to pc 0, which is no JUMPDEST, so the frame fails.
+void Fail(bytes& code)
+{
+    Push(code, 0);
+    Op(code, Instruction::JUMP);
+}
+
+struct CallFrameSetup : public BasicTestingSetup
+{
+    State state;
+    std::unique_ptr<SealEngineFace> sealEngine;
+    EnvInfo env;
+    Address sender;
+
+    CallFrameSetup() : state(0, OverlayDB(), BaseState::Empty), sender(0x1001)
+    {
+        Ethash::init();
+        sealEngine.reset(ChainParams(genesisInfo(Network::HomesteadTest)).createSealEngine());
+        state.addBalance(sender, 1000);
+    }
+
+    // Runs a call from sender to the contract and returns whether it failed.
+    bool run(Address const& contract)
+    {
+        Executive e(state, env, sealEngine.get());
+        if (!e.call(contract, sender, 0, 1, bytesConstRef(), 1000000))
+            e.go();
+        return e.excepted();
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(callframe_tests, CallFrameSetup)
+
+BOOST_AUTO_TEST_CASE(callframe_revert_inner)
+{
+    bytes innerCode;
+    Store(innerCode, 2);
+    Fail(innerCode);
+    Address inner = state.newContract(0, innerCode);
+
+    bytes outerCode;
+    Store(outerCode, 1);
+    Call(outerCode, inner, 5);
+    Address outer = state.newContract(100, outerCode);
+
+    // Only the failed call is undone, value transfer included.
+    BOOST_CHECK(!run(outer));
+    BOOST_CHECK(state.storage(outer, 0) == 1);
+    BOOST_CHECK(state.storage(inner, 0) == 0);
+    BOOST_CHECK(state.balance(outer) == 100);
+    BOOST_CHECK(state.balance(inner) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(callframe_revert_nested)
+{
+    bytes innerCode;
+    Store(innerCode, 3);
+    Address inner = state.newContract(0, innerCode);
+
+    bytes middleCode;
+    Store(middleCode, 2);
+    Call(middleCode, inner, 5);
+    Fail(middleCode);
+    Address middle = state.newContract(50, middleCode);
+
+    bytes outerCode;
+    Store(outerCode, 1);
+    Call(outerCode, middle, 0);
+    Call(outerCode, inner, 7);
+    Address outer = state.newContract(100, outerCode);
+
+    // The inner call succeeded, but its changes go with the frame that made it; the call the outer
+    // frame makes afterwards is not affected.
+    BOOST_CHECK(!run(outer));
+    BOOST_CHECK(state.storage(outer, 0) == 1);
+    BOOST_CHECK(state.storage(middle, 0) == 0);
+    BOOST_CHECK(state.storage(inner, 0) == 3);
+    BOOST_CHECK(state.balance(middle) == 50);
+    BOOST_CHECK(state.balance(inner) == 7);
+    BOOST_CHECK(state.balance(outer) == 93);
+
+    // A failing top level frame leaves nothing behind.
+    BOOST_CHECK(run(middle));
+    BOOST_CHECK(state.storage(middle, 0) == 0);
+    BOOST_CHECK(state.balance(inner) == 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,119 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_quantum.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+namespace {
+
+std::atomic<unsigned int> nChecked;
+
+//! Counts how often it runs; fails if constructed to.
+struct CountingCheck
+{
+    bool fOk;
+
+    CountingCheck(bool fOkIn = true) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecked++;
+        return fOk;
+    }
+
+    void swap(CountingCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+    }
+};
+
+typedef CCheckQueue<CountingCheck> CountingQueue;
+
+void StartWorkers(CountingQueue& queue, boost::thread_group& threads, int nWorkers)
+{
+    for (int i = 0; i < nWorkers; i++)
+        threads.create_thread(boost::bind(&CountingQueue::Thread, boost::ref(queue)));
+}
+
+void StopWorkers(boost::thread_group& threads)
+{
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+//! Add nChecks checks in batches of varying size, the way ConnectBlock adds them per transaction.
+bool RunChecks(CountingQueue& queue, unsigned int nChecks, unsigned int nFailAt = (unsigned int)-1)
+{
+    CCheckQueueControl<CountingCheck> control(&queue);
+    unsigned int nAdded = 0;
+    for (unsigned int nBatch = 1; nAdded < nChecks; nBatch = nBatch % 37 + 1) {
+        std::vector<CountingCheck> vChecks;
+        for (unsigned int i = 0; i < nBatch && nAdded < nChecks; i++, nAdded++)
+            vChecks.push_back(CountingCheck(nAdded != nFailAt));
+        control.Add(vChecks);
+    }
+    return control.Wait();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    CountingQueue queue(128);
+    nChecked = 0;
+    BOOST_CHECK(RunChecks(queue, 1000));
+    BOOST_CHECK_EQUAL(nChecked, 1000U);
+    BOOST_CHECK(queue.IsIdle());
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checks_run_once)
+{
+    for (int nWorkers : {1, 3, 8}) {
+        CountingQueue queue(16);
+        boost::thread_group threads;
+        StartWorkers(queue, threads, nWorkers);
+        for (unsigned int nChecks : {0, 1, 2, 100, 10000}) {
+            nChecked = 0;
+            BOOST_CHECK(RunChecks(queue, nChecks));
+            BOOST_CHECK_EQUAL(nChecked, nChecks);
+            BOOST_CHECK(queue.IsIdle());
+        }
+        StopWorkers(threads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CountingQueue queue(16);
+    boost::thread_group threads;
+    StartWorkers(queue, threads, 4);
+    for (unsigned int nFailAt : {0, 1, 999, 4999}) {
+        BOOST_CHECK(!RunChecks(queue, 5000, nFailAt));
+        BOOST_CHECK(queue.IsIdle());
+        // The failure does not carry over to the next round
+        BOOST_CHECK(RunChecks(queue, 5000));
+    }
+    StopWorkers(threads);
+}
+
+// More workers than queues share them
+BOOST_AUTO_TEST_CASE(checkqueue_shared_slots)
+{
+    CountingQueue queue(1);
+    boost::thread_group threads;
+    StartWorkers(queue, threads, MAX_CHECKQUEUE_SLOTS + 3);
+    nChecked = 0;
+    BOOST_CHECK(RunChecks(queue, 2000));
+    BOOST_CHECK_EQUAL(nChecked, 2000U);
+    StopWorkers(threads);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,96 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <libdevcore/SHA3.h>
+#include <libevm/CodeAnalysis.h>
+#include <libevmcore/Instruction.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+BOOST_FIXTURE_TEST_SUITE(codeanalysis_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(codeanalysis_blocks)
+{
+    // PUSH1 0x5b PUSH1 0x06 JUMP JUMPDEST PUSH2 0x0102 POP STOP
+    bytes code = {0x60, 0x5b, 0x60, 0x06, 0x56, 0x5b, 0x61, 0x01, 0x02, 0x50, 0x00};
+    CodeAnalysis analysis(&code, HomesteadSchedule);
+
+    // The 0x5b inside the first PUSH's data is not a jump destination.
+    BOOST_CHECK(!analysis.isJumpDest(1));
+    BOOST_CHECK(analysis.isJumpDest(5));
+    BOOST_CHECK(!analysis.isJumpDest(code.size()));
+
+    BOOST_CHECK(analysis.pushValues.size() == 3);
+    BOOST_CHECK(analysis.pushValues[analysis.pushIndex[0]] == Word256(0x5b));
+    BOOST_CHECK(analysis.pushValues[analysis.pushIndex[6]] == Word256(0x0102));
+    BOOST_CHECK(analysis.pushIndex[1] == CodeAnalysis::c_none);
+
+    BOOST_CHECK(analysis.blocks.size() == 2);
+    CodeAnalysis::Block const& first = analysis.blocks[analysis.blockIndex[0]];
+    BOOST_CHECK(first.end == 5);
+    BOOST_CHECK(first.instructions == 3);
+    BOOST_CHECK(first.stackRequired == 0);
+    BOOST_CHECK(first.stackMaxGrowth == 2);
+    BOOST_CHECK(first.gas == 2 * HomesteadSchedule.tierStepGas[VeryLowTier] + HomesteadSchedule.tierStepGas[MidTier]);
+    CodeAnalysis::Block const& second = analysis.blocks[analysis.blockIndex[5]];
+    BOOST_CHECK(second.end == code.size());
+    BOOST_CHECK(second.instructions == 4);
+    BOOST_CHECK(analysis.blockIndex[6] == CodeAnalysis::c_none);
+
+    // A block reading more than it pushed requires the difference on entry.
+    bytes add = {0x01, 0x00};
+    BOOST_CHECK(CodeAnalysis(&add, HomesteadSchedule).blocks[0].stackRequired == 2);
+}
+
+BOOST_AUTO_TEST_CASE(codeanalysis_block_info)
+{
+    // NUMBER, BLOCKHASH and GASLIMIT change with every block too
+    bytes number = {0x43, 0x00};
+    BOOST_CHECK(CodeAnalysis(&number, HomesteadSchedule).readsBlockInfo);
+    bytes hash = {0x60, 0x00, 0x40, 0x00};
+    BOOST_CHECK(CodeAnalysis(&hash, HomesteadSchedule).readsBlockInfo);
+    bytes gasLimit = {0x45, 0x00};
+    BOOST_CHECK(CodeAnalysis(&gasLimit, HomesteadSchedule).readsBlockInfo);
+    bytes arithmetic = {0x60, 0x01, 0x60, 0x02, 0x01, 0x00};
+    BOOST_CHECK(!CodeAnalysis(&arithmetic, HomesteadSchedule).readsBlockInfo);
+    // TIMESTAMP
+    bytes time = {0x60, 0x01, 0x42, 0x00};
+    BOOST_CHECK(CodeAnalysis(&time, HomesteadSchedule).readsBlockInfo);
+    // PUSH1 0x41: COINBASE as PUSH data is not read
+    bytes data = {0x60, 0x41, 0x00};
+    BOOST_CHECK(!CodeAnalysis(&data, HomesteadSchedule).readsBlockInfo);
+    // CREATE runs init code the analysis does not see
+    bytes create = {0x60, 0x00, 0x80, 0x80, 0xf0, 0x00};
+    BOOST_CHECK(CodeAnalysis(&create, HomesteadSchedule).readsBlockInfo);
+}
+
+BOOST_AUTO_TEST_CASE(codeanalysis_cache)
+{
+    CodeAnalysisCache::clear();
+    bytes code = {0x60, 0x01, 0x60, 0x02, 0x01, 0x00};
+    h256 codeHash = sha3(code);
+
+    CodeAnalysisCacheStats before = CodeAnalysisCache::stats();
+    auto first = CodeAnalysisCache::get(codeHash, &code, HomesteadSchedule);
+    auto second = CodeAnalysisCache::get(codeHash, &code, HomesteadSchedule);
+    CodeAnalysisCacheStats after = CodeAnalysisCache::stats();
+    BOOST_CHECK(first == second);
+    BOOST_CHECK(after.misses == before.misses + 1);
+    BOOST_CHECK(after.hits == before.hits + 1);
+    BOOST_CHECK(after.entries == 1);
+    BOOST_CHECK(after.bytes == first->memoryUsage());
+
+    // Shrinking the bound below the entry's size evicts it.
+    CodeAnalysisCache::setMaxSize(0);
+    BOOST_CHECK(CodeAnalysisCache::stats().entries == 0);
+    BOOST_CHECK(first->isJumpDest(0) == false);
+    CodeAnalysisCache::setMaxSize(c_defaultCodeAnalysisCacheSize);
+    CodeAnalysisCache::clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
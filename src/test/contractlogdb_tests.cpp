@@ -0,0 +1,144 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "contractlogdb.h"
+#include "random.h"
+#include "test/test_quantum.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+
+CContractLog MakeLog(const dev::Address& address, const std::vector<uint256>& topics)
+{
+    CContractLog log;
+    log.address = address;
+    log.topics = topics;
+    log.data.push_back(0x2a);
+    return log;
+}
+
+CContractReceipt MakeReceipt(const COutPoint& outpoint, const std::vector<CContractLog>& logs)
+{
+    CContractReceipt receipt;
+    receipt.outpoint = outpoint;
+    receipt.nGasUsed = 21000;
+    receipt.logs = logs;
+    return receipt;
+}
+
+std::vector<int> Find(const CContractLogDB& db, const CLogFilter& filter, int nFrom, int nTo)
+{
+    std::vector<std::pair<int, CBlockLogs> > blocks;
+    db.FindBlockLogs(filter, nFrom, nTo, blocks);
+    std::vector<int> heights;
+    for (const std::pair<int, CBlockLogs>& block : blocks)
+        heights.push_back(block.first);
+    return heights;
+}
+
+struct ContractLogDBSetup : public BasicTestingSetup
+{
+    CContractLogDB db;
+    dev::Address addressA, addressB;
+    uint256 topic1, topic2;
+
+    ContractLogDBSetup() : db(1 << 20, true), addressA(0xa), addressB(0xb)
+    {
+        topic1 = GetRandHash();
+        topic2 = GetRandHash();
+        BOOST_CHECK(db.WriteBlockLogs(10, GetRandHash(), {MakeReceipt(COutPoint(GetRandHash(), 0), {MakeLog(addressA, {topic1})})}));
+        BOOST_CHECK(db.WriteBlockLogs(20, GetRandHash(), {MakeReceipt(COutPoint(GetRandHash(), 0), {})}));
+        BOOST_CHECK(db.WriteBlockLogs(1500, GetRandHash(), {MakeReceipt(COutPoint(GetRandHash(), 1), {MakeLog(addressB, {topic2})})}));
+        BOOST_CHECK(db.WriteBlockLogs(70000, GetRandHash(), {MakeReceipt(COutPoint(GetRandHash(), 0), {MakeLog(addressA, {topic1, topic2})})}));
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(contractlogdb_tests, ContractLogDBSetup)
+
+BOOST_AUTO_TEST_CASE(contractlogdb_search)
+{
+    // Blocks whose contract outputs emitted nothing are never found
+    CLogFilter all;
+    BOOST_CHECK(Find(db, all, 0, 100000) == std::vector<int>({10, 1500, 70000}));
+    BOOST_CHECK(Find(db, all, 11, 69999) == std::vector<int>({1500}));
+
+    CLogFilter byAddress;
+    byAddress.addresses.push_back(addressA);
+    BOOST_CHECK(Find(db, byAddress, 0, 100000) == std::vector<int>({10, 70000}));
+    byAddress.addresses.push_back(addressB);
+    BOOST_CHECK(Find(db, byAddress, 0, 100000) == std::vector<int>({10, 1500, 70000}));
+
+    CLogFilter byTopic;
+    byTopic.topics.push_back(topic1);
+    BOOST_CHECK(Find(db, byTopic, 0, 100000) == std::vector<int>({10, 70000}));
+
+    // The bloom of a block only tells that a topic is there, the position is checked on the logs
+    CLogFilter bySecondTopic;
+    bySecondTopic.topics.push_back(boost::none);
+    bySecondTopic.topics.push_back(topic2);
+    BOOST_CHECK(Find(db, bySecondTopic, 0, 100000) == std::vector<int>({1500, 70000}));
+    CBlockLogs blockLogs;
+    CContractReceipt receipt;
+    BOOST_CHECK(db.ReadBlockLogs(1500, blockLogs) && db.ReadReceipt(blockLogs.vReceipts[0], receipt));
+    BOOST_CHECK(!bySecondTopic.Matches(receipt.logs[0]));
+    BOOST_CHECK(db.ReadBlockLogs(70000, blockLogs) && db.ReadReceipt(blockLogs.vReceipts[0], receipt));
+    BOOST_CHECK(bySecondTopic.Matches(receipt.logs[0]));
+
+    // Ranges without a matching event are skipped as a whole
+    dev::LogBloom bloom;
+    BOOST_CHECK(db.ReadRangeBloom(0, 0, bloom) && byAddress.Matches(bloom));
+    byAddress.addresses.pop_back();
+    BOOST_CHECK(db.ReadRangeBloom(0, 1, bloom) && !byAddress.Matches(bloom));
+    BOOST_CHECK(!db.ReadRangeBloom(0, 2, bloom));
+    BOOST_CHECK(db.ReadRangeBloom(1, 1, bloom) && byAddress.Matches(bloom));
+}
+
+BOOST_AUTO_TEST_CASE(contractlogdb_receipts)
+{
+    uint256 txid = GetRandHash();
+    BOOST_CHECK(db.WriteBlockLogs(30, GetRandHash(), {MakeReceipt(COutPoint(txid, 1), {}), MakeReceipt(COutPoint(txid, 3), {MakeLog(addressB, {})})}));
+
+    std::vector<CContractReceipt> receipts;
+    BOOST_CHECK(db.ReadReceipts(txid, receipts));
+    BOOST_CHECK_EQUAL(receipts.size(), 2);
+    BOOST_CHECK_EQUAL(receipts[0].outpoint.n, 1);
+    BOOST_CHECK_EQUAL(receipts[1].outpoint.n, 3);
+    BOOST_CHECK_EQUAL(receipts[1].nGasUsed, 21000);
+    BOOST_CHECK(receipts[1].logs[0].address == addressB);
+    BOOST_CHECK(receipts[1].logs[0].data == std::vector<unsigned char>(1, 0x2a));
+}
+
+BOOST_AUTO_TEST_CASE(contractlogdb_disconnect)
+{
+    CBlockLogs blockLogs;
+    BOOST_CHECK(db.ReadBlockLogs(1500, blockLogs));
+    BOOST_CHECK(db.EraseBlockLogs(1500));
+    CContractReceipt receipt;
+    BOOST_CHECK(!db.ReadReceipt(blockLogs.vReceipts[0], receipt));
+
+    // The ranges that held the block no longer have its events
+    CLogFilter byAddress;
+    byAddress.addresses.push_back(addressB);
+    dev::LogBloom bloom;
+    BOOST_CHECK(!db.ReadRangeBloom(0, 1, bloom));
+    BOOST_CHECK(db.ReadRangeBloom(1, 0, bloom) && !byAddress.Matches(bloom));
+    BOOST_CHECK(Find(db, byAddress, 0, 100000).empty());
+
+    // Only a block without events is left in the first range
+    BOOST_CHECK(db.EraseBlockLogs(10));
+    BOOST_CHECK(!db.ReadRangeBloom(0, 0, bloom));
+    BOOST_CHECK(!db.ReadRangeBloom(1, 0, bloom));
+    BOOST_CHECK(db.ReadBlockLogs(20, blockLogs));
+
+    // Connecting the block again brings its events back
+    BOOST_CHECK(db.WriteBlockLogs(1500, GetRandHash(), {MakeReceipt(COutPoint(GetRandHash(), 1), {MakeLog(addressB, {})})}));
+    BOOST_CHECK(Find(db, byAddress, 0, 100000) == std::vector<int>({1500}));
+    BOOST_CHECK(db.EraseBlockLogs(12345));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
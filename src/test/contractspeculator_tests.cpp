@@ -0,0 +1,268 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "contractspeculator.h"
+#include "main.h"
+#include "random.h"
+#include "utilstrencodings.h"
+#include "test/test_quantum.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethereum/State.h>
+
+namespace {
+
+//! Adds one to storage slot 0 and returns the new count
+const char* const COUNTER_CODE = "6000546001018060005560005260206000f3";
+//! Returns 42
+const char* const ANSWER_CODE = "602a60005260206000f3";
+//! Returns the block number
+const char* const NUMBER_CODE = "4360005260206000f3";
+
+/** A fresh contract state made csGlobalState, as the contract state of the tip. */
+struct ContractSpeculatorSetup : public TestingSetup {
+    dev::eth::EnvInfo env;
+
+    ContractSpeculatorSetup()
+    {
+        boost::filesystem::path stateDir = GetDataDir() / "state";
+        const dev::h256 hashGenesis(dev::sha3(dev::rlp("")));
+        csGlobalState = new dev::eth::QtumState(dev::u256(0), dev::eth::State::openDB(stateDir.string(), hashGenesis, dev::WithExisting::Trust),
+                                                stateDir.string(), hashGenesis, dev::eth::BaseState::Empty);
+        env = BuildEVMEnvironment(chainActive.Tip());
+        env.setGasLimit(dev::u256(500000000));
+    }
+
+    ~ContractSpeculatorSetup()
+    {
+        delete csGlobalState;
+        csGlobalState = NULL;
+    }
+
+    dev::Address NewContract(const char* code)
+    {
+        dev::Address address = csGlobalState->newContract(0, ParseHex(code));
+        csGlobalState->dev::eth::State::commit();
+        csGlobalState->db().commit();
+        csGlobalState->dbUTXO().commit();
+        return address;
+    }
+
+    //! What BlockAssembler and ConnectBlock speculate on
+    dev::eth::QtumState Snapshot()
+    {
+        return csGlobalState->snapshot(csGlobalState->rootHash(), csGlobalState->rootHashUTXO());
+    }
+};
+
+/** A call of address by a contract output of a transaction hashed hashTx, as BitTxToEthTx makes it. */
+dev::eth::QtumTransaction ContractCall(const dev::Address& address, const uint256& hashTx)
+{
+    dev::eth::QtumTransaction ethTx(0, 1, 100000, address, dev::bytes(), dev::u256(0));
+    ethTx.forceSender(dev::Address("1111111111111111111111111111111111111111"));
+    ethTx.setHashWith(uintToh256(hashTx));
+    ethTx.setVoutNumber(0);
+    ethTx.setVersion(1);
+    return ethTx;
+}
+
+void CheckSameResult(const dev::eth::ResultExecute& a, const dev::eth::ResultExecute& b)
+{
+    BOOST_CHECK(a.execRes.excepted == b.execRes.excepted);
+    BOOST_CHECK(a.execRes.gasUsed == b.execRes.gasUsed);
+    BOOST_CHECK(a.execRes.output == b.execRes.output);
+    BOOST_CHECK(a.txRec.rlp() == b.txRec.rlp());
+    BOOST_CHECK_EQUAL(a.txs.size(), b.txs.size());
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(contractspeculator_tests, ContractSpeculatorSetup)
+
+BOOST_AUTO_TEST_CASE(speculation_matches_execution)
+{
+    dev::Address counter = NewContract(COUNTER_CODE);
+    dev::eth::QtumTransaction ethTx = ContractCall(counter, GetRandHash());
+
+    std::shared_ptr<const CContractSpeculation> speculation = CContractSpeculator::SpeculateOutput(Snapshot(), env, ethTx);
+    BOOST_REQUIRE(speculation);
+    BOOST_CHECK(speculation->fDone);
+    BOOST_CHECK(speculation->changes.accessed.count(counter));
+    BOOST_CHECK(speculation->changes.written().count(counter));
+
+    // Executed in the template as BCExecutor does
+    dev::eth::QtumState fresh(*csGlobalState);
+    dev::eth::ResultExecute res = fresh.execute(env, globalSealEngine.get(), ethTx, dev::eth::Permanence::Committed);
+    fresh.db().commit();
+
+    // Taken from the speculation instead
+    dev::eth::QtumState reused(*csGlobalState);
+    reused.applyChanges(speculation->changes);
+    reused.db().commit();
+
+    CheckSameResult(speculation->result, res);
+    BOOST_CHECK_EQUAL(dev::fromBigEndian<dev::u256>(res.execRes.output), 1);
+    BOOST_CHECK(reused.rootHash() == fresh.rootHash());
+    BOOST_CHECK(reused.rootHashUTXO() == fresh.rootHashUTXO());
+    BOOST_CHECK(reused.rootHash() != csGlobalState->rootHash());
+    BOOST_CHECK_EQUAL(reused.storage(counter, 0), 1);
+}
+
+BOOST_AUTO_TEST_CASE(speculation_not_reused)
+{
+    dev::Address counter = NewContract(COUNTER_CODE);
+    dev::Address bad = NewContract("fe");
+
+    // Neither an exception nor a contract creation is kept
+    BOOST_CHECK(!CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(bad, GetRandHash())));
+    dev::eth::QtumTransaction create(0, 1, 100000, ParseHex(COUNTER_CODE), dev::u256(0));
+    create.forceSender(dev::Address("1111111111111111111111111111111111111111"));
+    create.setHashWith(uintToh256(GetRandHash()));
+    BOOST_CHECK(!CContractSpeculator::SpeculateOutput(Snapshot(), env, create));
+
+    // Nor code reading the block info, which is not known before the block
+    dev::Address timestamp = NewContract("4260005260206000f3");
+    BOOST_CHECK(!CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(timestamp, GetRandHash())));
+    BOOST_CHECK(CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(counter, GetRandHash())));
+}
+
+BOOST_AUTO_TEST_CASE(speculation_conflict)
+{
+    dev::Address counter = NewContract(COUNTER_CODE);
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    COutPoint out1(GetRandHash(), 0), out2(GetRandHash(), 0);
+    dev::eth::QtumTransaction ethTx1 = ContractCall(counter, out1.hash);
+    dev::eth::QtumTransaction ethTx2 = ContractCall(counter, out2.hash);
+
+    // Both speculated on the tip
+    CContractSpeculator speculator;
+    std::vector<std::pair<COutPoint, std::shared_ptr<const CContractSpeculation> > > vSpeculation;
+    vSpeculation.push_back(std::make_pair(out1, CContractSpeculator::SpeculateOutput(Snapshot(), env, ethTx1)));
+    vSpeculation.push_back(std::make_pair(out2, CContractSpeculator::SpeculateOutput(Snapshot(), env, ethTx2)));
+    BOOST_REQUIRE(vSpeculation[0].second && vSpeculation[1].second);
+    BOOST_CHECK(speculator.Store(hashTip, vSpeculation));
+
+    // Serial execution of both
+    dev::eth::QtumState serial(*csGlobalState);
+    serial.execute(env, globalSealEngine.get(), ethTx1, dev::eth::Permanence::Committed);
+    dev::eth::ResultExecute res2 = serial.execute(env, globalSealEngine.get(), ethTx2, dev::eth::Permanence::Committed);
+    serial.db().commit();
+    BOOST_CHECK_EQUAL(dev::fromBigEndian<dev::u256>(res2.execRes.output), 2);
+
+    // The first is reused, which writes the counter the second read
+    dev::AddressHash setWritten;
+    dev::eth::QtumState reused(*csGlobalState);
+    std::shared_ptr<const CContractSpeculation> speculation = speculator.Find(out1, hashTip, setWritten);
+    BOOST_REQUIRE(speculation);
+    reused.applyChanges(speculation->changes);
+    reused.db().commit();
+    dev::AddressHash written = speculation->changes.written();
+    setWritten.insert(written.begin(), written.end());
+
+    // The second speculation saw the count before the first and must be executed again
+    BOOST_CHECK_EQUAL(dev::fromBigEndian<dev::u256>(vSpeculation[1].second->result.execRes.output), 1);
+    BOOST_CHECK(!speculator.Find(out2, hashTip, setWritten));
+    BOOST_CHECK(speculator.Find(out2, hashTip, dev::AddressHash()));
+    dev::eth::ResultExecute res = reused.execute(env, globalSealEngine.get(), ethTx2, dev::eth::Permanence::Committed);
+    reused.db().commit();
+
+    CheckSameResult(res, res2);
+    BOOST_CHECK(reused.rootHash() == serial.rootHash());
+    BOOST_CHECK(reused.rootHashUTXO() == serial.rootHashUTXO());
+}
+
+BOOST_AUTO_TEST_CASE(speculation_invalidation)
+{
+    dev::Address counter = NewContract(COUNTER_CODE);
+    dev::Address answer = NewContract(ANSWER_CODE);
+    dev::Address number = NewContract(NUMBER_CODE);
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+
+    CMutableTransaction txInBlock;
+    txInBlock.vout.resize(1);
+    COutPoint outCounter(GetRandHash(), 0), outAnswer(GetRandHash(), 0), outNumber(GetRandHash(), 0), outInBlock(txInBlock.GetHash(), 0);
+    std::vector<std::pair<COutPoint, std::shared_ptr<const CContractSpeculation> > > vSpeculation;
+    vSpeculation.push_back(std::make_pair(outCounter, CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(counter, outCounter.hash))));
+    vSpeculation.push_back(std::make_pair(outAnswer, CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(answer, outAnswer.hash))));
+    vSpeculation.push_back(std::make_pair(outInBlock, CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(answer, outInBlock.hash))));
+    for (const auto& i : vSpeculation)
+        BOOST_REQUIRE(i.second);
+    // The block number of a speculation would be stale on the next tip, so it is not kept
+    std::shared_ptr<const CContractSpeculation> speculationNumber = CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(number, outNumber.hash));
+    BOOST_CHECK(!speculationNumber);
+    if (speculationNumber)
+        vSpeculation.push_back(std::make_pair(outNumber, speculationNumber));
+
+    CContractSpeculator speculator;
+    BOOST_CHECK(speculator.Store(hashTip, vSpeculation));
+    BOOST_CHECK(speculator.Find(outCounter, hashTip, dev::AddressHash()));
+    // Only looked up on the block they were made on
+    BOOST_CHECK(!speculator.Find(outCounter, GetRandHash(), dev::AddressHash()));
+    BOOST_CHECK(!speculator.Store(GetRandHash(), vSpeculation));
+
+    // A block on the tip writing the counter and mining one of the transactions
+    CBlock block;
+    block.hashPrevBlock = hashTip;
+    block.nNonce = 1;
+    block.vtx.push_back(txInBlock);
+    dev::AddressHash setWritten;
+    setWritten.insert(counter);
+    speculator.BlockConnected(block, setWritten);
+    BOOST_CHECK(!speculator.Find(outAnswer, hashTip, dev::AddressHash()));
+    BOOST_CHECK(!speculator.Find(outCounter, block.GetHash(), dev::AddressHash()));
+    BOOST_CHECK(!speculator.Find(outInBlock, block.GetHash(), dev::AddressHash()));
+    BOOST_CHECK(speculator.Find(outAnswer, block.GetHash(), dev::AddressHash()));
+    BOOST_CHECK(!speculator.Find(outNumber, block.GetHash(), dev::AddressHash()));
+
+    // A block on another parent drops everything
+    CBlock other;
+    other.hashPrevBlock = GetRandHash();
+    speculator.BlockConnected(other, dev::AddressHash());
+    BOOST_CHECK(!speculator.Find(outAnswer, block.GetHash(), dev::AddressHash()));
+    BOOST_CHECK(!speculator.Find(outAnswer, other.GetHash(), dev::AddressHash()));
+
+    // So does a disconnected block
+    BOOST_CHECK(speculator.Store(other.GetHash(), vSpeculation));
+    BOOST_CHECK(speculator.Find(outAnswer, other.GetHash(), dev::AddressHash()));
+    speculator.Clear();
+    BOOST_CHECK(!speculator.Find(outAnswer, other.GetHash(), dev::AddressHash()));
+    // Until the next speculations are stored, on whatever the tip is then
+    BOOST_CHECK(speculator.Store(hashTip, vSpeculation));
+    BOOST_CHECK(speculator.Find(outAnswer, hashTip, dev::AddressHash()));
+}
+
+BOOST_AUTO_TEST_CASE(speculation_kept_after_reads)
+{
+    dev::Address counter = NewContract(COUNTER_CODE);
+    dev::Address answer = NewContract(ANSWER_CODE);
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    const dev::Address sender("1111111111111111111111111111111111111111");
+
+    COutPoint outAnswer(GetRandHash(), 0);
+    std::vector<std::pair<COutPoint, std::shared_ptr<const CContractSpeculation> > > vSpeculation;
+    vSpeculation.push_back(std::make_pair(outAnswer, CContractSpeculator::SpeculateOutput(Snapshot(), env, ContractCall(answer, outAnswer.hash))));
+    BOOST_REQUIRE(vSpeculation[0].second);
+    BOOST_CHECK(vSpeculation[0].second->changes.accessed.count(sender));
+    CContractSpeculator speculator;
+    BOOST_CHECK(speculator.Store(hashTip, vSpeculation));
+
+    // A block executing a call of the counter by the same sender, as ConnectBlock records it
+    dev::eth::QtumState serial(*csGlobalState);
+    serial.setRecordAccess(true);
+    serial.execute(env, globalSealEngine.get(), ContractCall(counter, GetRandHash()), dev::eth::Permanence::Committed);
+    BOOST_CHECK(serial.accessed().count(sender));
+    BOOST_CHECK(serial.written().count(counter));
+    // The sender and the author are dropped from the caches before the commit
+    BOOST_CHECK(!serial.written().count(sender));
+    BOOST_CHECK(!serial.written().count(env.author()));
+
+    // Only what the block wrote drops the speculations that read it
+    CBlock block;
+    block.hashPrevBlock = hashTip;
+    speculator.BlockConnected(block, serial.written());
+    BOOST_CHECK(speculator.Find(outAnswer, block.GetHash(), dev::AddressHash()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethereum/State.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+VinsInfo MakeVins(unsigned count)
+{
+    VinsInfo vins;
+    for (unsigned i = 0; i < count; ++i)
+        vins.push_back(std::make_pair(COutPoint(h256Touint(sha3(rlp(i))), i % 3), CAmount(1000 * (i + 1))));
+    return vins;
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(contractvins_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(contractvins_encoding)
+{
+    VinsInfo vins = MakeVins(5);
+    ContractVins contractVins;
+    contractVins.append(vins);
+
+    // Entries of the UTXO trie are hashed into the header, so the encoding has to stay the one of the
+    // vector of pairs it replaces.
+    std::vector<std::pair<std::pair<u256, bigint>, u256>> serial;
+    for (auto const& i : vins)
+        serial.push_back(std::make_pair(std::make_pair(u256(uintToh256(i.first.hash)), i.first.n), i.second));
+    RLPStream expected(1);
+    expected.append(serial);
+    RLPStream s(1);
+    contractVins.streamRLP(s);
+    BOOST_CHECK(s.out() == expected.out());
+
+    ContractVins decoded(RLP(s.out())[0]);
+    BOOST_CHECK(decoded == contractVins);
+    BOOST_CHECK(decoded.toVector() == vins);
+    BOOST_CHECK(ContractVins(RLP(s.out())[0]).size() == 5);
+}
+
+BOOST_AUTO_TEST_CASE(contractvins_spend)
+{
+    VinsInfo vins = MakeVins(6);
+    ContractVins contractVins;
+    contractVins.append(vins);
+
+    // The first output is never spent and the others go oldest first.
+    CAmount sum = 0;
+    VinsInfo selected = contractVins.select(4000, sum);
+    BOOST_CHECK(selected == VinsInfo(vins.begin() + 1, vins.begin() + 3));
+    BOOST_CHECK(sum == 5000);
+
+    contractVins.spend(selected.size());
+    contractVins.push_back(vins[1]);
+    VinsInfo remaining = contractVins.toVector();
+    BOOST_CHECK(remaining.size() == 5);
+    BOOST_CHECK(remaining.front() == vins[0]);
+    BOOST_CHECK(remaining[1] == vins[3]);
+    BOOST_CHECK(remaining.back() == vins[1]);
+
+    // Falling short selects everything spendable.
+    sum = 0;
+    BOOST_CHECK(contractVins.select(1000000, sum).size() == 4);
+    BOOST_CHECK(sum == 4000 + 5000 + 6000 + 2000);
+
+    sum = 0;
+    BOOST_CHECK(ContractVins().select(1000, sum).empty() && sum == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,240 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "test/test_quantum.h"
+
+#include <atomic>
+
+/** Tests for CuckooCache, as used by the signature cache.
+ *
+ *  All tests seed insecure_rand deterministically. The hit rates are a
+ *  regression test: a change to the eviction policy may legitimately move
+ *  them, but then the thresholds should be revisited rather than loosened.
+ */
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+namespace {
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher> SigCache;
+
+void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+std::vector<uint256> RandomHashes(size_t n)
+{
+    std::vector<uint256> hashes(n);
+    for (uint256& hash : hashes)
+        insecure_GetRandHash(hash);
+    return hashes;
+}
+
+/** Fill a cache of megabytes MiB with load times its capacity of entries and
+ * return the fraction of them still found.
+ */
+double HitRate(double load, size_t megabytes)
+{
+    SigCache set;
+    uint32_t n_insert = static_cast<uint32_t>(load * set.setup_bytes(megabytes << 20));
+    std::vector<uint256> hashes = RandomHashes(n_insert);
+    for (const uint256& hash : hashes)
+        set.insert(hash);
+    uint32_t count = 0;
+    for (const uint256& hash : hashes)
+        count += set.contains(hash, false);
+    return double(count) / double(n_insert);
+}
+
+/** An overfilled cache can hold at most 1/load of what went in; scale the
+ * hit rate back up so one threshold fits every load.
+ */
+double NormalizeHitRate(double hits, double load)
+{
+    return hits * std::max(load, 1.0);
+}
+
+}
+
+/* Test that no values not inserted into the cache are read out of it.
+ *
+ * There are no repeats in the first 200000 insecure_GetRandHash calls
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
+{
+    seed_insecure_rand(true);
+    SigCache cc;
+    cc.setup_bytes(32 << 20);
+    uint256 v;
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        cc.insert(v);
+    }
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        BOOST_CHECK(!cc.contains(v, false));
+    }
+}
+
+/** Check the hit rate at loads ranging from half full to heavily overfilled. */
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
+{
+    seed_insecure_rand(true);
+    double HitRateThresh = 0.98;
+    size_t megabytes = 4;
+    for (double load = 0.1; load < 2; load *= 2) {
+        double hits = HitRate(load, megabytes);
+        BOOST_CHECK(NormalizeHitRate(hits, load) > HitRateThresh);
+    }
+}
+
+/** Entries looked up with erase are the ones given up first once the cache is
+ * full, while the rest stay reachable.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
+{
+    seed_insecure_rand(true);
+    size_t megabytes = 4;
+    double load = 1;
+    SigCache set;
+    uint32_t n_insert = static_cast<uint32_t>(load * set.setup_bytes(megabytes << 20));
+    std::vector<uint256> hashes = RandomHashes(n_insert);
+
+    // Insert the first half
+    for (uint32_t i = 0; i < n_insert / 2; ++i)
+        set.insert(hashes[i]);
+    // Erase the first quarter
+    for (uint32_t i = 0; i < n_insert / 4; ++i)
+        BOOST_CHECK(set.contains(hashes[i], true));
+    // Insert the second half
+    for (uint32_t i = n_insert / 2; i < n_insert; ++i)
+        set.insert(hashes[i]);
+
+    // Erased but not yet overwritten entries may still be found
+    size_t count_erased_but_contained = 0;
+    for (uint32_t i = 0; i < n_insert / 4; ++i)
+        count_erased_but_contained += set.contains(hashes[i], false);
+    size_t count_stale = 0;
+    for (uint32_t i = n_insert / 4; i < n_insert / 2; ++i)
+        count_stale += set.contains(hashes[i], false);
+    size_t count_fresh = 0;
+    for (uint32_t i = n_insert / 2; i < n_insert; ++i)
+        count_fresh += set.contains(hashes[i], false);
+
+    double hit_rate_erased_but_contained = double(count_erased_but_contained) / (double(n_insert) / 4.0);
+    double hit_rate_stale = double(count_stale) / (double(n_insert) / 4.0);
+    double hit_rate_fresh = double(count_fresh) / (double(n_insert) / 2.0);
+
+    // Check that our hit_rate_fresh is perfect
+    BOOST_CHECK_EQUAL(hit_rate_fresh, 1.0);
+    // Check that we have a more than 2x better hit rate on stale elements than
+    // erased elements.
+    BOOST_CHECK(hit_rate_stale > 2 * hit_rate_erased_but_contained);
+}
+
+/** Erasing from several threads at once only flips atomic flags, so it must
+ * behave the same as erasing from one.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_erase_parallel_ok)
+{
+    seed_insecure_rand(true);
+    size_t megabytes = 4;
+    double load = 1;
+    SigCache set;
+    uint32_t n_insert = static_cast<uint32_t>(load * set.setup_bytes(megabytes << 20));
+    std::vector<uint256> hashes = RandomHashes(n_insert);
+    boost::shared_mutex mtx;
+
+    {
+        // Insert the first half
+        boost::unique_lock<boost::shared_mutex> l(mtx);
+        for (uint32_t i = 0; i < n_insert / 2; ++i)
+            set.insert(hashes[i]);
+    }
+
+    // Erase the first quarter from three threads, each taking a shared lock
+    // as CSignatureCache does.
+    std::atomic<uint32_t> found(0);
+    std::vector<boost::thread> threads;
+    for (uint32_t x = 0; x < 3; ++x)
+        threads.emplace_back([&, x] {
+            boost::shared_lock<boost::shared_mutex> l(mtx);
+            size_t ntodo = (n_insert / 4) / 3;
+            size_t start = ntodo * x;
+            size_t end = ntodo * (x + 1);
+            for (uint32_t i = start; i < end; ++i)
+                found += set.contains(hashes[i], true);
+        });
+    for (boost::thread& t : threads)
+        t.join();
+    BOOST_CHECK_EQUAL(found.load(), (n_insert / 4) / 3 * 3);
+
+    {
+        boost::unique_lock<boost::shared_mutex> l(mtx);
+        // Insert the second half
+        for (uint32_t i = n_insert / 2; i < n_insert; ++i)
+            set.insert(hashes[i]);
+    }
+
+    size_t count_erased_but_contained = 0;
+    for (uint32_t i = 0; i < (n_insert / 4) / 3 * 3; ++i)
+        count_erased_but_contained += set.contains(hashes[i], false);
+    size_t count_stale = 0;
+    for (uint32_t i = n_insert / 4; i < n_insert / 2; ++i)
+        count_stale += set.contains(hashes[i], false);
+    size_t count_fresh = 0;
+    for (uint32_t i = n_insert / 2; i < n_insert; ++i)
+        count_fresh += set.contains(hashes[i], false);
+
+    double hit_rate_erased_but_contained = double(count_erased_but_contained) / (double(n_insert) / 4.0);
+    double hit_rate_stale = double(count_stale) / (double(n_insert) / 4.0);
+    double hit_rate_fresh = double(count_fresh) / (double(n_insert) / 2.0);
+
+    BOOST_CHECK_EQUAL(hit_rate_fresh, 1.0);
+    BOOST_CHECK(hit_rate_stale > 2 * hit_rate_erased_but_contained);
+}
+
+/** Entries that keep getting looked up survive a stream of new inserts that
+ * is several times the size of the cache, while the ones left behind make
+ * room for it.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_generations)
+{
+    seed_insecure_rand(true);
+    SigCache set;
+    const uint32_t block = set.setup_bytes(1 << 20) / 20;
+
+    std::vector<std::vector<uint256>> blocks;
+    uint32_t in_window_checked = 0, in_window_hits = 0;
+    for (uint32_t round = 0; round < 100; ++round) {
+        blocks.push_back(RandomHashes(block));
+        for (const uint256& hash : blocks.back())
+            set.insert(hash);
+        // Keep touching the last four blocks as block validation would
+        for (uint32_t i = blocks.size() < 4 ? 0 : blocks.size() - 4; i < blocks.size(); ++i)
+            for (const uint256& hash : blocks[i]) {
+                in_window_checked++;
+                in_window_hits += set.contains(hash, false);
+                set.insert(hash);
+            }
+    }
+    BOOST_CHECK(in_window_hits > 0.99 * in_window_checked);
+
+    // Five times the capacity went through the cache since the first blocks.
+    uint32_t old_hits = 0;
+    for (uint32_t i = 0; i < 20; ++i)
+        for (const uint256& hash : blocks[i])
+            old_hits += set.contains(hash, false);
+    BOOST_CHECK(old_hits < 20 * block / 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
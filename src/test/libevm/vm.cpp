@@ -36,7 +36,7 @@ using namespace dev::eth;
 using namespace dev::test;
 
 FakeExtVM::FakeExtVM(EnvInfo const& _envInfo, unsigned _depth):			/// TODO: XXX: remove the default argument & fix.
-	ExtVMFace(_envInfo, Address(), Address(), Address(), 0, 1, bytesConstRef(), bytes(), EmptySHA3, _depth)
+	ExtVMFace(_envInfo, Address(), Address(), Address(), 0, 1, bytesConstRef(), bytesConstRef(), EmptySHA3, _depth)
 {}
 
 h160 FakeExtVM::create(u256 _endowment, u256& io_gas, bytesConstRef _init, OnOpFunc const&)
@@ -190,11 +190,11 @@ void FakeExtVM::importExec(mObject& _o)
 	execGas = gas;
 
 	thisTxCode.clear();
-	code = thisTxCode;
+	code.reset();
 
 	thisTxCode = importCode(_o);
 	if (_o["code"].type() != str_type && _o["code"].type() != array_type)
-		code.clear();
+		code.reset();
 
 	thisTxData.clear();
 	thisTxData = importData(_o);
@@ -326,7 +326,7 @@ void doVMTests(json_spirit::mValue& _v, bool _fillin)
 		if (fev.code.empty())
 		{
 			fev.thisTxCode = get<3>(fev.addresses.at(fev.myAddress));
-			fev.code = fev.thisTxCode;
+			fev.code = bytesConstRef(&fev.thisTxCode);
 		}
 		fev.codeHash = sha3(fev.code);
 
@@ -454,6 +454,52 @@ void doVMTests(json_spirit::mValue& _v, bool _fillin)
 
 } } // namespace close
 
+namespace
+{
+
+char const* const c_vmTestNames[] = {"vmtests", "vmArithmeticTest", "vmBitwiseLogicOperationTest", "vmSha3Test",
+	"vmEnvironmentalInfoTest", "vmBlockInfoTest", "vmIOandFlowOperationsTest", "vmPushDupSwapTest", "vmLogTest",
+	"vmSystemOperationsTest"};
+
+void doVMRandomTests()
+{
+	string testPath = getTestPath();
+	testPath += "/VMTests/RandomTests";
+
+	vector<boost::filesystem::path> testFiles;
+	boost::filesystem::directory_iterator iterator(testPath);
+	for(; iterator != boost::filesystem::directory_iterator(); ++iterator)
+		if (boost::filesystem::is_regular_file(iterator->path()) && iterator->path().extension() == ".json")
+			testFiles.push_back(iterator->path());
+
+	test::TestOutputHelper::initTest();
+	test::TestOutputHelper::setMaxTests(testFiles.size());
+
+	for (auto& path: testFiles)
+	{
+		try
+		{
+			cnote << "TEST " << path.filename();
+			json_spirit::mValue v;
+			string s = asString(dev::contents(path.string()));
+			BOOST_REQUIRE_MESSAGE(s.length() > 0, "Content of " + path.string() + " is empty. Have you cloned the 'tests' repo branch develop and set ETHEREUM_TEST_PATH to its path?");
+			json_spirit::read_string(s, v);
+			test::Listener::notifySuiteStarted(path.filename().string());			
+			doVMTests(v, false);
+		}
+		catch (Exception const& _e)
+		{
+			BOOST_ERROR("Failed test with Exception: " << diagnostic_information(_e));
+		}
+		catch (std::exception const& _e)
+		{
+			BOOST_ERROR("Failed test with Exception: " << _e.what());
+		}
+	}
+}
+
+}
+
 BOOST_AUTO_TEST_SUITE(VMTests)
 
 BOOST_AUTO_TEST_CASE(vmtests)
@@ -527,45 +573,39 @@ BOOST_AUTO_TEST_CASE(vmInputLimitsLightTest)
 BOOST_AUTO_TEST_CASE(vmRandom)
 {
 	test::Options::get(); // parse command line options, e.g. to enable JIT
+	doVMRandomTests();
+}
 
-	string testPath = getTestPath();
-	testPath += "/VMTests/RandomTests";
+BOOST_AUTO_TEST_CASE(userDefinedFile)
+{
+	dev::test::userDefinedTest(dev::test::doVMTests);
+}
 
-	vector<boost::filesystem::path> testFiles;
-	boost::filesystem::directory_iterator iterator(testPath);
-	for(; iterator != boost::filesystem::directory_iterator(); ++iterator)
-		if (boost::filesystem::is_regular_file(iterator->path()) && iterator->path().extension() == ".json")
-			testFiles.push_back(iterator->path());
+BOOST_AUTO_TEST_SUITE_END()
 
-	test::TestOutputHelper::initTest();
-	test::TestOutputHelper::setMaxTests(testFiles.size());
+/// The same tests with instructions dispatched through the threaded interpreter's jump table.
+/// Tests are only read here, filling them is left to VMTests.
+BOOST_AUTO_TEST_SUITE(VMTestsThreaded)
 
-	for (auto& path: testFiles)
-	{
-		try
-		{
-			cnote << "TEST " << path.filename();
-			json_spirit::mValue v;
-			string s = asString(dev::contents(path.string()));
-			BOOST_REQUIRE_MESSAGE(s.length() > 0, "Content of " + path.string() + " is empty. Have you cloned the 'tests' repo branch develop and set ETHEREUM_TEST_PATH to its path?");
-			json_spirit::read_string(s, v);
-			test::Listener::notifySuiteStarted(path.filename().string());			
-			doVMTests(v, false);
-		}
-		catch (Exception const& _e)
-		{
-			BOOST_ERROR("Failed test with Exception: " << diagnostic_information(_e));
-		}
-		catch (std::exception const& _e)
-		{
-			BOOST_ERROR("Failed test with Exception: " << _e.what());
-		}
-	}
+BOOST_AUTO_TEST_CASE(vmThreadedTests)
+{
+	if (test::Options::get().fillTests)
+		return;
+	VMKind kind = VMFactory::kind();
+	VMFactory::setKind(VMKind::Threaded);
+	for (char const* name: c_vmTestNames)
+		dev::test::executeTests(name, "/VMTests", dev::test::getFolder(__FILE__) + "/VMTestsFiller", dev::test::doVMTests);
+	VMFactory::setKind(kind);
 }
 
-BOOST_AUTO_TEST_CASE(userDefinedFile)
+BOOST_AUTO_TEST_CASE(vmThreadedRandom)
 {
-	dev::test::userDefinedTest(dev::test::doVMTests);
+	if (test::Options::get().fillTests)
+		return;
+	VMKind kind = VMFactory::kind();
+	VMFactory::setKind(VMKind::Threaded);
+	doVMRandomTests();
+	VMFactory::setKind(kind);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
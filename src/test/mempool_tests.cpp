@@ -2,7 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "key.h"
+#include "main.h"
 #include "policy/policy.h"
+#include "random.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -578,4 +582,49 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSenderTest)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+    std::vector<unsigned char> vchKeyID(keyID.begin(), keyID.end());
+
+    CMutableTransaction txPrev;
+    txPrev.vout.resize(2);
+    txPrev.vout[0].scriptPubKey = GetScriptForDestination(keyID);
+    txPrev.vout[0].nValue = 10 * COIN;
+    txPrev.vout[1].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    txPrev.vout[1].nValue = 10 * COIN;
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    AddCoins(view, txPrev, 1);
+
+    // The sender is the key hash paid by the prevout of vin[0]
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    BOOST_CHECK(GetSenderAddress(tx, view) == vchKeyID);
+    tx.vin[0].prevout.n = 1;
+    BOOST_CHECK(GetSenderAddress(tx, view).empty());
+    tx.vin[0].prevout.n = 2;
+    BOOST_CHECK(GetSenderAddress(tx, view).empty());
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    BOOST_CHECK(GetSenderAddress(tx, view).empty());
+
+    // The entry keeps the sender it was created with
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    CTxMemPoolEntry withSender = entry.Sender(vchKeyID).FromTx(tx);
+    CTxMemPoolEntry withoutSender = entry.Sender(std::vector<unsigned char>()).FromTx(tx);
+    BOOST_CHECK(withoutSender.GetSender().empty());
+    BOOST_CHECK(withSender.DynamicMemoryUsage() > withoutSender.DynamicMemoryUsage());
+    pool.addUnchecked(tx.GetHash(), withSender);
+    BOOST_CHECK(pool.mapTx.find(tx.GetHash())->GetSender() == vchKeyID);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
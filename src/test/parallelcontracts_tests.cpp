@@ -0,0 +1,216 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "contractlogdb.h"
+#include "hash.h"
+#include "key.h"
+#include "main.h"
+#include "miner.h"
+#include "pow.h"
+#include "script/sign.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+#include "test/test_quantum.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethereum/State.h>
+
+namespace {
+
+//! Init code deploying a contract that adds one to storage slot 0 and logs and returns the new count
+const char* const COUNTER_INIT = "601780600b6000396000f3" "6000546001018060005560005260206000a060206000f3";
+
+/** A chain of 25 blocks with csGlobalState at its tip, event logs on and contract execution threads running. */
+struct ParallelContractsSetup : public TestChain100Setup {
+    CScript scriptPubKey;
+
+    ParallelContractsSetup()
+    {
+        scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+        boost::filesystem::path stateDir = GetDataDir() / "state";
+        const dev::h256 hashGenesis(dev::sha3(dev::rlp("")));
+        csGlobalState = new dev::eth::QtumState(dev::u256(0), dev::eth::State::openDB(stateDir.string(), hashGenesis, dev::WithExisting::Trust),
+                                                stateDir.string(), hashGenesis, dev::eth::BaseState::Empty);
+        csGlobalState->setRoot(uintToh256(chainActive.Tip()->hashStateRoot));
+        csGlobalState->setRootUTXO(uintToh256(chainActive.Tip()->hashUTXORoot));
+        fLogEvents = true;
+        pcontractlogdb = new CContractLogDB(1 << 20, true);
+        fParallelContracts = true;
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadContractExec);
+    }
+
+    ~ParallelContractsSetup()
+    {
+        fParallelContracts = DEFAULT_PARALLEL_CONTRACTS;
+        fLogEvents = false;
+        delete pcontractlogdb;
+        pcontractlogdb = NULL;
+        delete csGlobalState;
+        csGlobalState = NULL;
+    }
+
+    //! Spend prevout, paying value to a contract output and the rest but the fee to the coinbase key
+    CMutableTransaction ContractTx(const CTransaction& txPrev, unsigned int n, const CScript& scriptContract, CAmount nValue, unsigned int nChange, CAmount nFee = CENT)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txPrev.GetHash(), n);
+        tx.vout.resize(1 + nChange);
+        tx.vout[0].nValue = nValue;
+        tx.vout[0].scriptPubKey = scriptContract;
+        for (unsigned int i = 1; i <= nChange; i++) {
+            tx.vout[i].nValue = (txPrev.vout[n].nValue - nValue - nFee) / nChange;
+            tx.vout[i].scriptPubKey = scriptPubKey;
+        }
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(txPrev.vout[n].scriptPubKey, tx, 0, SIGHASH_ALL, txPrev.vout[n].nValue, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig = CScript() << vchSig;
+        return tx;
+    }
+
+    bool ToMemPool(const CMutableTransaction& tx)
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        return AcceptToMemoryPool(mempool, state, tx, false, NULL, true, 0);
+    }
+
+    //! A block of the mempool transactions, executed by BlockAssembler into its state roots
+    CBlock MineBlock()
+    {
+        const CChainParams& chainparams = Params();
+        std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(scriptPubKey));
+        CBlock block = pblocktemplate->block;
+        unsigned int extraNonce = 0;
+        IncrementExtraNonce(&block, chainActive.Tip(), extraNonce);
+        while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+        return block;
+    }
+
+    //! The address of the contract created by the first output of tx
+    dev::Address CreatedContract(const CTransaction& tx)
+    {
+        std::vector<unsigned char> vchOut(tx.GetHash().begin(), tx.GetHash().end());
+        vchOut.push_back(0);
+        uint160 hashContract = Hash160(vchOut);
+        return dev::Address(valtype(hashContract.begin(), hashContract.end()));
+    }
+
+    //! What ConnectBlock wrote to the event log database for the contract outputs of tx
+    std::string Receipts(const CTransaction& tx)
+    {
+        std::vector<CContractReceipt> receipts;
+        pcontractlogdb->ReadReceipts(tx.GetHash(), receipts);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << receipts;
+        return ss.str();
+    }
+};
+
+CScript CreateScript(const valtype& code)
+{
+    return CScript() << valtype(1, 1) << CScriptNum(100000).getvch() << valtype(1, 1) << code << OP_EXEC;
+}
+
+CScript CallScript(const dev::Address& address)
+{
+    return CScript() << valtype(1, 1) << CScriptNum(100000).getvch() << valtype(1, 1) << valtype(1, 0) << address.asBytes() << OP_EXEC_ASSIGN;
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(parallelcontracts_tests, ParallelContractsSetup)
+
+BOOST_AUTO_TEST_CASE(parallel_matches_serial)
+{
+    const CChainParams& chainparams = Params();
+    CValidationState state;
+
+    CMutableTransaction txCreate = ContractTx(coinbaseTxns[0], 0, CreateScript(ParseHex(COUNTER_INIT)), 0, 2);
+    CMutableTransaction txCreateOther = ContractTx(coinbaseTxns[1], 0, CreateScript(ParseHex(COUNTER_INIT)), 0, 1);
+    BOOST_REQUIRE(ToMemPool(txCreate));
+    BOOST_REQUIRE(ToMemPool(txCreateOther));
+    CBlock block = MineBlock();
+    BOOST_REQUIRE(ProcessNewBlock(state, chainparams, NULL, &block, true, NULL));
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // The address of a contract is the hash of the output creating it
+    CTransaction txCreated(txCreate), txCreatedOther(txCreateOther);
+    dev::Address counter = CreatedContract(txCreated);
+    dev::Address other = CreatedContract(txCreatedOther);
+    BOOST_REQUIRE(csGlobalState->addressHasCode(counter));
+    BOOST_REQUIRE(csGlobalState->addressHasCode(other));
+
+    // Two calls writing the same storage slot and balance in one block. Both are speculated on the
+    // parent block, and the second must be executed again after the first. The third calls
+    // another contract after that. It shares only the sender and the block author with them,
+    // which every execution touches but none writes, so its speculation is still committed.
+    // The fees put the three in this order.
+    CMutableTransaction txCall1 = ContractTx(txCreated, 1, CallScript(counter), 0, 1, 3 * CENT);
+    CMutableTransaction txCall2 = ContractTx(txCreated, 2, CallScript(counter), 10 * CENT, 1, 2 * CENT);
+    CMutableTransaction txCall3 = ContractTx(txCreatedOther, 1, CallScript(other), 0, 1, CENT);
+    BOOST_REQUIRE(ToMemPool(txCall1));
+    BOOST_REQUIRE(ToMemPool(txCall2));
+    BOOST_REQUIRE(ToMemPool(txCall3));
+    block = MineBlock();
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 4U);
+    BOOST_REQUIRE(block.vtx[1].GetHash() == txCall1.GetHash());
+    BOOST_REQUIRE(block.vtx[2].GetHash() == txCall2.GetHash());
+    BOOST_REQUIRE(block.vtx[3].GetHash() == txCall3.GetHash());
+
+    // The roots in the header are those of BlockAssembler's serial execution
+    {
+        LOCK(cs_main);
+        fParallelContracts = false;
+        BOOST_CHECK(TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, true));
+        fParallelContracts = true;
+        BOOST_CHECK(TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, true));
+    }
+    uint64_t nSpeculated, nConflicts, nSpeculatedBefore, nConflictsBefore;
+    GetContractSpeculationStats(nSpeculatedBefore, nConflictsBefore);
+    BOOST_REQUIRE(ProcessNewBlock(state, chainparams, NULL, &block, true, NULL));
+    CBlockIndex* pindex = chainActive.Tip();
+    BOOST_REQUIRE(pindex->GetBlockHash() == block.GetHash());
+    // The first and the third were committed from their speculations, the second executed again
+    GetContractSpeculationStats(nSpeculated, nConflicts);
+    BOOST_CHECK_EQUAL(nSpeculated - nSpeculatedBefore, 2U);
+    BOOST_CHECK_EQUAL(nConflicts - nConflictsBefore, 1U);
+    BOOST_CHECK_EQUAL(csGlobalState->storage(counter, 0), 2);
+    BOOST_CHECK_EQUAL(csGlobalState->storage(other, 0), 1);
+    BOOST_CHECK_EQUAL(csGlobalState->balance(counter), 10 * CENT);
+    std::string strReceipts1 = Receipts(block.vtx[1]);
+    std::string strReceipts2 = Receipts(block.vtx[2]);
+    std::vector<CContractReceipt> receipts;
+    BOOST_CHECK(pcontractlogdb->ReadReceipts(block.vtx[1].GetHash(), receipts));
+    BOOST_CHECK(receipts.size() == 1 && receipts[0].logs.size() == 1);
+    // Each logged its own count
+    BOOST_CHECK(strReceipts1 != strReceipts2);
+
+    // Connected again with -parallelcontracts=0
+    fParallelContracts = false;
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(InvalidateBlock(state, chainparams, pindex));
+        BOOST_CHECK(chainActive.Tip() == pindex->pprev);
+        BOOST_CHECK_EQUAL(csGlobalState->storage(counter, 0), 0);
+        ResetBlockFailureFlags(pindex);
+    }
+    BOOST_REQUIRE(ActivateBestChain(state, chainparams));
+    BOOST_REQUIRE(chainActive.Tip() == pindex);
+    BOOST_CHECK(csGlobalState->rootHash() == uintToh256(pindex->hashStateRoot));
+    BOOST_CHECK(csGlobalState->rootHashUTXO() == uintToh256(pindex->hashUTXORoot));
+    BOOST_CHECK_EQUAL(csGlobalState->storage(counter, 0), 2);
+    BOOST_CHECK(Receipts(block.vtx[1]) == strReceipts1);
+    BOOST_CHECK(Receipts(block.vtx[2]) == strReceipts2);
+    BOOST_CHECK_EQUAL(csGlobalState->storage(other, 0), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
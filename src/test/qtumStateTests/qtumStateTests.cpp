@@ -244,10 +244,10 @@ void WriteAndReadDBTest(){
     std::vector<QtumTransaction> txs(ReadInfoForTest(GetPathTestFile(__func__)));
     std::vector<ResultExecute> res = ExecuteQtumTest(txs);
 
-    StateTest->db().commit();
-    StateTest->dbUTXO().commit();
     h256 rootHashState = StateTest->rootHash();
     h256 rootHashUTXO = StateTest->rootHashUTXO();
+    StateTest->db().commit();
+    StateTest->dbUTXO().commit();
 
     std::vector<std::pair<Address, VinsInfo>> accountsVinsBefore;
     std::unordered_map<Address, u256> accountsBefore = StateTest->addresses();
@@ -268,6 +268,71 @@ void WriteAndReadDBTest(){
     DelQtumState();
 }
 
+void SpeculativeExecutionTest(std::string nameTest){
+    InitQtumState(dev::eth::BaseState::Empty);
+    std::vector<QtumTransaction> txs(ReadInfoForTest(GetPathTestFile(nameTest)));
+
+    EnvInfo envInfo;
+    envInfo.setAuthor(Address("2ce42a7c257411ad96b77e271fa93c6d95b8ae22"));
+    envInfo.setGasLimit(1 << 31);
+    unique_ptr<dev::eth::SealEngineFace> se(ChainParams(genesisInfo(Network::HomesteadTest)).createSealEngine());
+    using OnOpFunc = std::function<void(uint64_t /*steps*/, uint64_t /* PC */, dev::eth::Instruction /*instr*/, dev::bigint /*newMemSize*/, dev::bigint /*gasCost*/, dev::bigint /*gas*/, dev::eth::VM*, dev::eth::ExtVMFace const*)>;
+
+    h256 rootHashBefore = StateTest->rootHash();
+    QtumState speculative(*StateTest);
+    speculative.setRecordAccess(true);
+    std::vector<ResultExecute> res;
+    for(size_t i = 0; i < txs.size(); i++){
+        res.push_back(speculative.execute(envInfo, se.get(), txs[i], Permanence::Uncommitted, OnOpFunc()));
+    }
+    QtumStateChanges changes = speculative.takeChanges();
+    BOOST_CHECK(StateTest->rootHash() == rootHashBefore);
+    BOOST_CHECK(!changes.accessed.empty());
+    for(Address const& a : changes.written()){
+        BOOST_CHECK(changes.accessed.count(a));
+    }
+
+    StateTest->applyChanges(changes);
+    StateTest->db().commit();
+
+    std::vector<uint256> hashes;
+    std::vector<ResultAccountInfo> accountInfo = ReadResultExecution(GetPathTestFile(nameTest, RESULT), hashes);
+    CheckResultExecution(accountInfo, hashes, res);
+    DelQtumState();
+}
+
+void CheckpointRollbackTest(std::string nameTest){
+    InitQtumState(dev::eth::BaseState::Empty);
+    std::vector<QtumTransaction> txs(ReadInfoForTest(GetPathTestFile(nameTest)));
+    ExecuteQtumTest(txs);
+    h256 rootHashState = StateTest->rootHash();
+    h256 rootHashUTXO = StateTest->rootHashUTXO();
+    DelQtumState();
+
+    // Executing the last transactions twice with a rollback in between gives the same state as executing them once
+    InitQtumState(dev::eth::BaseState::Empty);
+    size_t half = txs.size() / 2;
+    std::vector<ResultExecute> res;
+    for(size_t i = 0; i < half; i++){
+        res.push_back(Execute(txs[i]));
+    }
+    QtumState::Checkpoint checkpoint = StateTest->checkpoint();
+    for(size_t i = half; i < txs.size(); i++){
+        Execute(txs[i]);
+    }
+    StateTest->rollback(checkpoint);
+    for(size_t i = half; i < txs.size(); i++){
+        res.push_back(Execute(txs[i]));
+    }
+    BOOST_CHECK(StateTest->rootHash() == rootHashState);
+    BOOST_CHECK(StateTest->rootHashUTXO() == rootHashUTXO);
+
+    std::vector<uint256> hashes;
+    std::vector<ResultAccountInfo> accountInfo = ReadResultExecution(GetPathTestFile(nameTest, RESULT), hashes);
+    CheckResultExecution(accountInfo, hashes, res);
+    DelQtumState();
+}
+
 BOOST_AUTO_TEST_SUITE(QtumStateTest)
 
 BOOST_AUTO_TEST_CASE(qtumStateCreateAccountTest){
@@ -326,6 +391,14 @@ BOOST_AUTO_TEST_CASE(qtumStateWriteAndReadDBTest){
     WriteAndReadDBTest(); 
 }
 
+BOOST_AUTO_TEST_CASE(qtumStateSpeculativeExecutionTest){
+    SpeculativeExecutionTest(std::string("TransferAmountAccToAccAndUTXOTest"));
+}
+
+BOOST_AUTO_TEST_CASE(qtumStateCheckpointRollbackTest){
+    CheckpointRollbackTest(std::string("TransferAmountAccToAccManyVoutTest"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 // void WriteAccount(std::string file){
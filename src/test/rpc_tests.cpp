@@ -6,7 +6,10 @@
 #include "rpc/client.h"
 
 #include "base58.h"
+#include "main.h"
 #include "netbase.h"
+#include "util.h"
+#include "utilstrencodings.h"
 
 #include "test/test_quantum.h"
 
@@ -16,6 +19,8 @@
 
 #include <univalue.h>
 
+#include <libethereum/State.h>
+
 using namespace std;
 
 UniValue
@@ -332,4 +337,64 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+static std::string ContractCallJSON(const dev::Address& address)
+{
+    return "{\"address\":\"" + address.hex() + "\",\"data\":\"00\"}";
+}
+
+BOOST_AUTO_TEST_CASE(rpc_callcontractbatch)
+{
+    // Contracts created in a fresh contract state, made the state of the tip
+    boost::filesystem::path stateDir = GetDataDir() / "state";
+    const dev::h256 hashGenesis(dev::sha3(dev::rlp("")));
+    csGlobalState = new dev::eth::QtumState(dev::u256(0), dev::eth::State::openDB(stateDir.string(), hashGenesis, dev::WithExisting::Trust),
+                                            stateDir.string(), hashGenesis, dev::eth::BaseState::Empty);
+    dev::Address addr42 = csGlobalState->newContract(0, ParseHex("602a60005260206000f3")); // returns 42
+    dev::Address addr7 = csGlobalState->newContract(0, ParseHex("600760005260206000f3")); // returns 7
+    dev::Address addrBad = csGlobalState->newContract(0, ParseHex("fe"));
+    dev::Address addrLoop = csGlobalState->newContract(0, ParseHex("5b61ffff60002050600056")); // hashes 64 KB over and over
+    dev::Address addrNone("1234567890123456789012345678901234567890");
+    csGlobalState->dev::eth::State::commit();
+
+    CBlockIndex* tip = chainActive.Tip();
+    uint256 hashStateRoot = tip->hashStateRoot;
+    uint256 hashUTXORoot = tip->hashUTXORoot;
+    tip->hashStateRoot = h256Touint(csGlobalState->rootHash());
+    tip->hashUTXORoot = h256Touint(csGlobalState->rootHashUTXO());
+    csGlobalState->db().commit();
+    csGlobalState->dbUTXO().commit();
+
+    // One result per call in the order of the calls, failed calls included
+    UniValue r = CallRPC("callcontractbatch [" + ContractCallJSON(addr42) + "," + ContractCallJSON(addrNone) + "," +
+                         ContractCallJSON(addrBad) + "," + ContractCallJSON(addr7) + "]");
+    BOOST_CHECK_EQUAL(r.size(), 4U);
+    BOOST_CHECK_EQUAL(find_value(r[0], "address").get_str(), addr42.hex());
+    BOOST_CHECK_EQUAL(find_value(r[0], "output").get_str(), "000000000000000000000000000000000000000000000000000000000000002a");
+    BOOST_CHECK_EQUAL(find_value(r[0], "excepted").get_str(), "None");
+    BOOST_CHECK_EQUAL(find_value(r[1], "address").get_str(), addrNone.hex());
+    BOOST_CHECK_EQUAL(find_value(r[1], "error").get_str(), "Address does not exist");
+    BOOST_CHECK_EQUAL(find_value(r[2], "excepted").get_str(), "BadInstruction");
+    BOOST_CHECK_EQUAL(find_value(r[3], "address").get_str(), addr7.hex());
+    BOOST_CHECK_EQUAL(find_value(r[3], "output").get_str(), "0000000000000000000000000000000000000000000000000000000000000007");
+
+    // A call running out of time does not hold up the others
+    mapArgs["-callcontracttimeout"] = "1";
+    r = CallRPC("callcontractbatch [" + ContractCallJSON(addrLoop) + "," + ContractCallJSON(addr42) + "]");
+    mapArgs.erase("-callcontracttimeout");
+    BOOST_CHECK_EQUAL(find_value(r[0], "error").get_str(), "Contract call timed out after 1ms");
+    BOOST_CHECK_EQUAL(find_value(r[1], "output").get_str(), "000000000000000000000000000000000000000000000000000000000000002a");
+
+    // At most 1000 calls in a batch
+    std::string strCalls = ContractCallJSON(addr42);
+    for (int i = 1; i < 1000; i++)
+        strCalls += "," + ContractCallJSON(addr42);
+    BOOST_CHECK_EQUAL(CallRPC("callcontractbatch [" + strCalls + "]").size(), 1000U);
+    BOOST_CHECK_THROW(CallRPC("callcontractbatch [" + strCalls + "," + ContractCallJSON(addr42) + "]"), runtime_error);
+
+    tip->hashStateRoot = hashStateRoot;
+    tip->hashUTXORoot = hashUTXORoot;
+    delete csGlobalState;
+    csGlobalState = NULL;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,45 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+#include <libdevcore/CommonData.h>
+#include <libdevcore/SHA3.h>
+#include "random.h"
+#include "test/test_quantum.h"
+
+using namespace dev;
+
+BOOST_FIXTURE_TEST_SUITE(sha3_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sha3_vectors)
+{
+    BOOST_CHECK(sha3(bytesConstRef()) == h256("c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470"));
+    BOOST_CHECK(sha3(std::string("abc")) == h256("4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45"));
+}
+
+BOOST_AUTO_TEST_CASE(sha3_batch)
+{
+    // Lengths around the rate so that lanes of one group run out of blocks at different times.
+    std::vector<bytes> data;
+    for (unsigned i = 0; i < 67; ++i) {
+        bytes d(i % 5 == 0 ? 0 : i % 5 == 1 ? 32 : i % 5 == 2 ? 135 + i % 3 : insecure_rand() % 600);
+        for (auto& b : d)
+            b = insecure_rand();
+        data.push_back(d);
+    }
+
+    for (size_t count = 0; count <= data.size(); count += (count < 9 ? 1 : 29)) {
+        std::vector<bytesConstRef> inputs;
+        for (size_t i = 0; i < count; ++i)
+            inputs.push_back(bytesConstRef(&data[i]));
+        std::vector<h256> outputs(count);
+        sha3Batch(inputs.data(), outputs.data(), count);
+        for (size_t i = 0; i < count; ++i)
+            BOOST_CHECK(outputs[i] == sha3(data[i]));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,160 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+
+#include <libdevcore/OverlayDB.h>
+#include <libdevcore/TrieDB.h>
+#include <libethereum/StatePruner.h>
+#include <leveldb/env.h>
+#include <memenv.h>
+#include "main.h"
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+typedef SpecificTrieDB<HashedGenericTrieDB<OverlayDB>, h256> StorageTrie;
+
+struct StatePrunerDB
+{
+    std::unique_ptr<ldb::Env> env;
+    OverlayDB db;
+    StorageTrie trie;
+
+    StatePrunerDB() : env(ldb::NewMemEnv(ldb::Env::Default()))
+    {
+        ldb::Options options;
+        options.create_if_missing = true;
+        options.env = env.get();
+        ldb::DB* pdb = nullptr;
+        BOOST_REQUIRE(ldb::DB::Open(options, "state", &pdb).ok());
+        db = OverlayDB(std::shared_ptr<ldb::DB>(pdb), 1 << 20);
+        trie = StorageTrie(&db);
+        trie.init();
+    }
+
+    // Sets every key below _keys to _value plus the key, commits and returns the root.
+    h256 commitValues(unsigned _keys, unsigned _value)
+    {
+        for (unsigned i = 0; i < _keys; ++i)
+            trie.insert(h256(i), rlp(_value + i));
+        db.commit();
+        return trie.root();
+    }
+
+    bool readable(h256 const& _root, unsigned _keys, unsigned _value)
+    {
+        trie.setRoot(_root);
+        for (unsigned i = 0; i < _keys; ++i)
+            if (trie.at(h256(i)) != asString(rlp(_value + i)))
+                return false;
+        return true;
+    }
+};
+
+struct StatePrunerSetup : public BasicTestingSetup, public StatePrunerDB {};
+
+struct StatePrunerChainSetup : public TestChain100Setup, public StatePrunerDB {};
+
+BOOST_FIXTURE_TEST_SUITE(statepruner_tests, StatePrunerSetup)
+
+BOOST_AUTO_TEST_CASE(statepruner_prune)
+{
+    StatePruner pruner(db, StatePruner::PlainTrie);
+    BOOST_CHECK(!pruner.enabled());
+    pruner.setEnabled(true);
+    BOOST_CHECK(pruner.enabled());
+
+    h256 root1 = commitValues(64, 1000);
+    pruner.journal(root1, 1, h256(1));
+    h256 root2 = commitValues(64, 2000);
+    pruner.journal(root2, 2, h256(2));
+
+    // Everything root1 used is released by block 2, so nothing is released by block 1.
+    StatePruner::Info info = pruner.info();
+    BOOST_CHECK(info.blocks == 1 && info.nodes > 0 && info.bytes > 0);
+    BOOST_CHECK(pruner.prune(1, 100000) == 0);
+    BOOST_CHECK(readable(root1, 64, 1000));
+
+    BOOST_CHECK(pruner.prune(2, 100000) == info.nodes);
+    BOOST_CHECK(!db.exists(root1));
+    BOOST_CHECK(readable(root2, 64, 2000));
+    BOOST_CHECK(pruner.info().blocks == 0);
+}
+
+BOOST_AUTO_TEST_CASE(statepruner_reorg)
+{
+    StatePruner pruner(db, StatePruner::PlainTrie);
+    pruner.setEnabled(true);
+
+    h256 root1 = commitValues(64, 1000);
+    pruner.journal(root1, 1, h256(1));
+    h256 root2 = commitValues(32, 2000);
+    pruner.journal(root2, 2, h256(2));
+
+    // A competing block 2 goes back to the state of block 1: its nodes are referenced again
+    // and the ones only the abandoned block used are released instead.
+    pruner.journal(root1, 2, h256(3));
+    pruner.prune(2, 100000);
+    BOOST_CHECK(readable(root1, 64, 1000));
+    BOOST_CHECK(!db.exists(root2));
+
+    // Journalling the same root twice changes nothing.
+    pruner.journal(root1, 3, h256(4));
+    BOOST_CHECK(pruner.info().blocks == 0);
+}
+
+BOOST_AUTO_TEST_CASE(statepruner_disabled)
+{
+    StatePruner pruner(db, StatePruner::PlainTrie);
+    h256 root1 = commitValues(16, 1000);
+    pruner.journal(root1, 1, h256(1));
+    h256 root2 = commitValues(16, 2000);
+    pruner.journal(root2, 2, h256(2));
+
+    BOOST_CHECK(pruner.prune(2, 100000) == 0);
+    BOOST_CHECK(readable(root1, 16, 1000));
+}
+
+BOOST_FIXTURE_TEST_CASE(statepruner_unflushed_tip, StatePrunerChainSetup)
+{
+    // The coins database is left at block 100 while the tip moves on to 120
+    FlushStateToDisk();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 20; i++)
+        CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    StatePruner pruner(db, StatePruner::PlainTrie);
+    pruner.setEnabled(true);
+    std::vector<h256> roots(121);
+    for (unsigned h = 1; h <= 120; ++h)
+    {
+        roots[h] = commitValues(8, 1000 * h);
+        pruner.journal(roots[h], h, h256(h));
+    }
+
+    nStatePruneDepth = 10;
+    int nPruneHeight;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 120);
+        nPruneHeight = GetStatePruneHeight();
+    }
+    nStatePruneDepth = 0;
+    BOOST_CHECK_EQUAL(nPruneHeight, 90);
+    pruner.prune(nPruneHeight, 100000);
+
+    // A restart after a crash goes back to the roots of block 100, and a reorg from there to block 90
+    BOOST_CHECK(readable(roots[100], 8, 100000));
+    BOOST_CHECK(readable(roots[90], 8, 90000));
+    BOOST_CHECK(!db.exists(roots[89]));
+
+    // Pruning against the tip would have lost them
+    pruner.prune(120 - 10, 100000);
+    BOOST_CHECK(!db.exists(roots[100]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
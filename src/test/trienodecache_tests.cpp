@@ -0,0 +1,75 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+
+#include <libdevcore/OverlayDB.h>
+#include <libdevcore/SHA3.h>
+#include <libdevcore/TrieNodeCache.h>
+#include <leveldb/env.h>
+#include <memenv.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+
+BOOST_FIXTURE_TEST_SUITE(trienodecache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(trienodecache_lru)
+{
+    // Room for a handful of small nodes per shard.
+    TrieNodeCache cache(16 * 4 * 128);
+    std::vector<h256> hashes;
+    for (unsigned i = 0; i < 256; ++i) {
+        std::string value(16, (char)i);
+        hashes.push_back(sha3(value));
+        cache.insert(hashes.back(), value);
+    }
+    BOOST_CHECK(cache.size() <= cache.maxSize());
+
+    // The most recently inserted node of each shard is still there, the oldest are gone.
+    std::string value;
+    BOOST_CHECK(cache.lookup(hashes.back(), value));
+    BOOST_CHECK(value == std::string(16, (char)255));
+    BOOST_CHECK(!cache.lookup(hashes.front(), value));
+    BOOST_CHECK(cache.hits() == 1 && cache.misses() == 1);
+
+    cache.remove(hashes.back());
+    BOOST_CHECK(!cache.lookup(hashes.back(), value));
+
+    // Nodes larger than a shard are not cached at all.
+    std::string big(cache.maxSize(), 'x');
+    cache.insert(sha3(big), big);
+    BOOST_CHECK(!cache.lookup(sha3(big), value));
+}
+
+BOOST_AUTO_TEST_CASE(trienodecache_overlaydb)
+{
+    std::unique_ptr<ldb::Env> env(ldb::NewMemEnv(ldb::Env::Default()));
+    ldb::Options options;
+    options.create_if_missing = true;
+    options.env = env.get();
+    ldb::DB* db = nullptr;
+    BOOST_REQUIRE(ldb::DB::Open(options, "state", &db).ok());
+
+    OverlayDB overlay(std::shared_ptr<ldb::DB>(db), 1 << 20);
+    std::string node = "node";
+    h256 h = sha3(node);
+    overlay.insert(h, bytesConstRef(&node));
+    overlay.commit();
+
+    // Committed nodes are served from the cache without touching the DB.
+    BOOST_CHECK(overlay.nodeCache()->size() > 0);
+    BOOST_CHECK(overlay.lookup(h) == node);
+    BOOST_CHECK(overlay.nodeCache()->hits() == 1);
+
+    // A copy shares the cache; deleting the node from disk drops it from the cache too.
+    OverlayDB copy = overlay;
+    BOOST_CHECK(copy.nodeCache() == overlay.nodeCache());
+    BOOST_CHECK(copy.deepkill(h));
+    BOOST_CHECK(overlay.lookup(h).empty());
+    BOOST_CHECK(!overlay.exists(h));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
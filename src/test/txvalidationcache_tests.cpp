@@ -83,4 +83,93 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(scriptcheck_deferred_context, BasicTestingSetup)
+{
+    // A spend whose scriptSigs push its own hash, of an output checking that
+    // hash and of a contract output consuming an expected hash.
+    CMutableTransaction spend;
+    spend.vin.resize(2);
+    spend.vin[0].prevout.n = 0;
+    spend.vin[0].scriptSig = CScript() << OP_TXHASH;
+    spend.vin[1].prevout.n = 1;
+    spend.vin[1].scriptSig = CScript() << OP_TXHASH;
+    spend.vout.resize(1);
+    CTransaction txSpend(spend);
+
+    CMutableTransaction funding;
+    funding.vout.resize(2);
+    funding.vout[0].scriptPubKey = CScript() << ToByteVector(txSpend.GetHash()) << OP_EQUAL;
+    funding.vout[1].scriptPubKey = CScript() << valtype(1, 0) << valtype(1, 0) << valtype(1, 0) << valtype(1, 0) << valtype(20, 1) << OP_EXEC_ASSIGN;
+
+    BlockValidationContext context;
+    context.currentTxHash = txSpend.GetHash();
+
+    // Outside of a block neither check has a context to consume.
+    BOOST_CHECK(!CScriptCheck(funding.vout[0], txSpend, 0, 0, false).UsesExpectedTxHashes());
+    BOOST_CHECK(!CScriptCheck(funding.vout[1], txSpend, 1, 0, false).UsesExpectedTxHashes());
+
+    // The first can be queued and still sees its own hash after the block
+    // moved on to the next transaction.
+    std::vector<CScriptCheck> vChecks;
+    CScriptCheck check0(funding.vout[0], txSpend, 0, 0, false, &context);
+    BOOST_CHECK(!check0.UsesExpectedTxHashes());
+    check0.Detach();
+    vChecks.push_back(CScriptCheck());
+    check0.swap(vChecks.back());
+    context.currentTxHash = uint256();
+    BOOST_CHECK(vChecks.back()());
+
+    // The contract output pops the expected hash and so must run in place.
+    context.currentTxHash = txSpend.GetHash();
+    context.expectedTxHashes.push(txSpend.GetHash());
+    CScriptCheck check1(funding.vout[1], txSpend, 1, 0, false, &context);
+    BOOST_CHECK(check1.UsesExpectedTxHashes());
+    BOOST_CHECK(check1());
+    BOOST_CHECK(context.expectedTxHashes.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(scriptcheck_deferred_scriptpubkey_txhash, BasicTestingSetup)
+{
+    // Plain scriptSigs spending outputs that use OP_TXHASH themselves.
+    CMutableTransaction spend;
+    spend.vin.resize(2);
+    spend.vin[0].prevout.n = 0;
+    spend.vin[1].prevout.n = 1;
+    spend.vout.resize(1);
+    CTransaction txSpend(spend);
+
+    CMutableTransaction funding;
+    funding.vout.resize(2);
+    funding.vout[0].scriptPubKey = CScript() << OP_TXHASH << OP_DROP << OP_1;
+    funding.vout[1].scriptPubKey = CScript() << OP_TXHASH << ToByteVector(txSpend.GetHash()) << OP_EQUAL;
+
+    BlockValidationContext context;
+    context.currentTxHash = txSpend.GetHash();
+
+    // Queued checks get their own transaction hash, whatever the block context holds by then.
+    std::vector<CScriptCheck> vChecks;
+    for (unsigned int i = 0; i < 2; i++) {
+        CScriptCheck check(funding.vout[i], txSpend, i, 0, false, &context);
+        BOOST_CHECK(!check.UsesExpectedTxHashes());
+        check.Detach();
+        vChecks.push_back(CScriptCheck());
+        check.swap(vChecks.back());
+    }
+    context.currentTxHash = uint256();
+    for (CScriptCheck& check : vChecks)
+        BOOST_CHECK(check());
+
+    // Without any block context the scripts fail rather than read a missing context.
+    CScriptCheck checkNoContext(funding.vout[0], txSpend, 0, 0, false);
+    BOOST_CHECK(!checkNoContext());
+    BOOST_CHECK_EQUAL(checkNoContext.GetScriptError(), SCRIPT_ERR_BAD_OPCODE);
+
+    CMutableTransaction funding2;
+    funding2.vout.resize(1);
+    funding2.vout[0].scriptPubKey = CScript() << valtype(1, 0) << valtype(1, 0) << valtype(1, 0) << valtype(1, 0) << valtype(20, 1) << OP_EXEC_ASSIGN;
+    CScriptCheck checkExec(funding2.vout[0], txSpend, 0, 0, false);
+    BOOST_CHECK(!checkExec());
+    BOOST_CHECK_EQUAL(checkExec.GetScriptError(), SCRIPT_ERR_OP_EXEC);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,306 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethcore/SealEngine.h>
+#include <libethashseal/GenesisInfo.h>
+#include <libethereum/ChainParams.h>
+#include <libethereum/Executive.h>
+#include <libethereum/State.h>
+#include <libevm/VM.h>
+#include <libevm/VMFactory.h>
+#include <libevmcore/Instruction.h>
+#include "random.h"
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+void Op(bytes& code, Instruction inst)
+{
+    code.push_back((byte)inst);
+}
+
+void Push(bytes& code, u256 value)
+{
+    bytes data = toCompactBigEndian(value, 1);
+    code.push_back((byte)Instruction::PUSH1 + data.size() - 1);
+    code.insert(code.end(), data.begin(), data.end());
+}
+
+// Places a JUMPDEST and returns its position.
+u256 Label(bytes& code)
+{
+    Op(code, Instruction::JUMPDEST);
+    return code.size() - 1;
+}
+
+void Jump(bytes& code, u256 dest, Instruction jump = Instruction::JUMP)
+{
+    Push(code, dest);
+    Op(code, jump);
+}
+
+// Jump destinations, pushes of small numbers and of whole words among random bytes
+bytes RandomCode()
+{
+    bytes code;
+    size_t size = 1 + insecure_rand() % 100;
+    while (code.size() < size)
+    {
+        switch (insecure_rand() % 8)
+        {
+        case 0:
+            Label(code);
+            break;
+        case 1:
+        case 2:
+            Push(code, insecure_rand() % (size + 4));
+            break;
+        case 3:
+            Op(code, Instruction::PUSH32);
+            for (int i = 0; i < 32; i++)
+                code.push_back(insecure_rand() % 256);
+            break;
+        default:
+            code.push_back(insecure_rand() % 256);
+        }
+    }
+    return code;
+}
+
+struct Outcome
+{
+    TransactionException excepted;
+    u256 gas;
+    bytes output;
+    h256 root;
+
+    bool operator==(Outcome const& _o) const
+    {
+        return excepted == _o.excepted && gas == _o.gas && output == _o.output && root == _o.root;
+    }
+};
+
+struct VMGasSetup : public BasicTestingSetup
+{
+    State state;
+    std::unique_ptr<SealEngineFace> sealEngine;
+    EnvInfo env;
+    Address sender;
+
+    VMGasSetup() : state(0, OverlayDB(), BaseState::Empty), sender(0x1001)
+    {
+        Ethash::init();
+        sealEngine.reset(ChainParams(genesisInfo(Network::HomesteadTest)).createSealEngine());
+        state.addBalance(sender, 1000);
+    }
+
+    // Calls the contract with gas on a copy of the state. A tracer makes the VM charge every
+    // instruction on its own instead of whole basic blocks on entry.
+    Outcome run(Address const& contract, u256 gas, bool traced, bytes const& data = bytes())
+    {
+        State s(state);
+        ExecutionResult res;
+        Executive e(s, env, sealEngine.get());
+        e.setResultRecipient(res);
+        OnOpFunc onOp;
+        if (traced)
+            onOp = [](uint64_t, uint64_t, Instruction, bigint, bigint, bigint, VM*, ExtVMFace const*) {};
+        if (!e.call(contract, sender, 0, 1, &data, gas))
+            e.go(onOp);
+        u256 gasLeft = e.gas();
+        e.finalize();
+        s.commit();
+        return Outcome{res.excepted, gasLeft, res.output, s.rootHash()};
+    }
+
+    // Calls the contract untraced, with instructions dispatched as the kind of VM does
+    Outcome runDispatched(VMKind kind, Address const& contract, u256 gas, bytes const& data = bytes())
+    {
+        VMKind saved = VMFactory::kind();
+        VMFactory::setKind(kind);
+        Outcome outcome = run(contract, gas, false, data);
+        VMFactory::setKind(saved);
+        return outcome;
+    }
+
+    // Runs code at every gas limit up to what it needs and one more, with both ways of charging
+    // and both ways of dispatching. Code that fails anyway must fail the same way with
+    // c_failingGas. Returns the gas needed.
+    u256 sweep(bytes const& code, bytes const& data = bytes())
+    {
+        static u256 const c_plenty = 1000000;
+        static u256 const c_failingGas = 25000;
+        Address contract = state.newContract(0, code);
+        Outcome full = run(contract, c_plenty, true, data);
+        BOOST_CHECK(run(contract, c_plenty, false, data) == full);
+        u256 needed = c_plenty - full.gas;
+        if (full.excepted != TransactionException::None)
+        {
+            needed = c_failingGas;
+            BOOST_CHECK(run(contract, needed, true, data) == full);
+        }
+        for (u256 gas = 0; gas <= needed + 1; gas++)
+        {
+            Outcome traced = run(contract, gas, true, data);
+            BOOST_CHECK_MESSAGE(runDispatched(VMKind::Interpreter, contract, gas, data) == traced, "differs with gas " << gas);
+            BOOST_CHECK_MESSAGE(runDispatched(VMKind::Threaded, contract, gas, data) == traced, "threaded dispatch differs with gas " << gas);
+        }
+        return needed;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(vmgas_tests, VMGasSetup)
+
+BOOST_AUTO_TEST_CASE(vmgas_dynamic_costs)
+{
+    // for (i = 1; i <= 8; i++) mem[i * 64] = i, expanding memory every time
+    bytes code;
+    Push(code, 0);
+    u256 loop = Label(code);
+    Push(code, 1);
+    Op(code, Instruction::ADD);
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::DUP1);
+    Push(code, 64);
+    Op(code, Instruction::MUL);
+    Op(code, Instruction::MSTORE);
+    Op(code, Instruction::DUP1);
+    Push(code, 8);
+    Op(code, Instruction::GT);
+    Jump(code, loop, Instruction::JUMPI);
+    // Copy gas, SHA3 and EXP by word and byte, a log and a storage write
+    Op(code, Instruction::CALLDATASIZE);
+    Push(code, 0);
+    Push(code, 0x300);
+    Op(code, Instruction::CALLDATACOPY);
+    Push(code, 0x340);
+    Push(code, 0);
+    Op(code, Instruction::SHA3);
+    Push(code, 0xffff);
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::EXP);
+    Op(code, Instruction::ADD);
+    Push(code, 7);
+    Push(code, 0x40);
+    Push(code, 0);
+    Op(code, Instruction::LOG1);
+    Push(code, 0);
+    Op(code, Instruction::SSTORE);
+    Push(code, 0x40);
+    Push(code, 0x40);
+    Op(code, Instruction::RETURN);
+
+    BOOST_CHECK(sweep(code, bytes(40, 0xab)) > 20000);
+}
+
+BOOST_AUTO_TEST_CASE(vmgas_jumps)
+{
+    // Count down from 3 in a block that is entered by falling through and by jumps
+    bytes code;
+    Push(code, 3);
+    u256 loop = Label(code);
+    Push(code, 1);
+    Op(code, Instruction::SWAP1);
+    Op(code, Instruction::SUB);
+    Op(code, Instruction::DUP1);
+    Op(code, Instruction::ISZERO);
+    Push(code, 0);
+    size_t doneAt = code.size() - 1;
+    Op(code, Instruction::JUMPI);
+    Jump(code, loop);
+    code[doneAt] = (byte)Label(code);
+    Op(code, Instruction::POP);
+    Push(code, 1);
+    Push(code, 0);
+    Op(code, Instruction::SSTORE);
+    // Into the data of a PUSH, which is no jump destination
+    Push(code, 0x5b);
+    Jump(code, code.size() - 1);
+    sweep(code);
+
+    // And to a destination right behind the jump
+    code.resize(code.size() - 3);
+    Jump(code, code.size() + 3);
+    Label(code);
+    sweep(code);
+}
+
+BOOST_AUTO_TEST_CASE(vmgas_stack)
+{
+    // Underflow at the second ADD, after the gas of the first ran out or not
+    bytes code;
+    Push(code, 1);
+    Push(code, 2);
+    Op(code, Instruction::ADD);
+    Op(code, Instruction::ADD);
+    Op(code, Instruction::STOP);
+    sweep(code);
+
+    // Overflow, pushing forever
+    code.clear();
+    u256 loop = Label(code);
+    Push(code, 1);
+    Jump(code, loop);
+    sweep(code);
+}
+
+BOOST_AUTO_TEST_CASE(vmgas_step_limit)
+{
+    // A loop too long for the step limit fails on the same instruction with enough gas
+    bytes code;
+    Push(code, 50000);
+    u256 loop = Label(code);
+    Push(code, 1);
+    Op(code, Instruction::SWAP1);
+    Op(code, Instruction::SUB);
+    Op(code, Instruction::DUP1);
+    Jump(code, loop, Instruction::JUMPI);
+    Address contract = state.newContract(0, code);
+    Outcome blocks = run(contract, 10000000, false);
+    BOOST_CHECK(blocks.excepted == TransactionException::BadInstruction);
+    BOOST_CHECK(blocks == run(contract, 10000000, true));
+    BOOST_CHECK(blocks == runDispatched(VMKind::Threaded, contract, 10000000));
+}
+
+BOOST_AUTO_TEST_CASE(vmgas_deadline)
+{
+    // A loop that would run into the step limit stops at the deadline of its thread instead,
+    // without a tracer
+    bytes code;
+    u256 loop = Label(code);
+    Jump(code, loop);
+    Address contract = state.newContract(0, code);
+    {
+        VMDeadline deadline(std::chrono::steady_clock::now());
+        BOOST_CHECK(runDispatched(VMKind::Threaded, contract, 1000000).excepted == TransactionException::OutOfGas);
+        BOOST_CHECK(deadline.passed());
+    }
+    BOOST_CHECK(run(contract, 1000000, false).excepted == TransactionException::BadInstruction);
+}
+
+BOOST_AUTO_TEST_CASE(vmgas_dispatch_random)
+{
+    // The jump table of the threaded interpreter and the switch agree on random code, whether
+    // it runs out of gas early, late or not at all
+    for (int i = 0; i < 1000; i++)
+    {
+        bytes code = RandomCode();
+        bytes data(insecure_rand() % 64, insecure_rand() % 256);
+        Address contract = state.newContract(0, code);
+        u256 gasLimits[] = {insecure_rand() % 100, insecure_rand() % 10000, 1000000};
+        for (u256 gas : gasLimits)
+            BOOST_CHECK_MESSAGE(runDispatched(VMKind::Interpreter, contract, gas, data) == runDispatched(VMKind::Threaded, contract, gas, data),
+                "threaded dispatch differs on " << toHex(code) << " with gas " << gas);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
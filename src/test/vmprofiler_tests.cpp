@@ -0,0 +1,100 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <libethcore/SealEngine.h>
+#include <libethashseal/GenesisInfo.h>
+#include <libethereum/ChainParams.h>
+#include <libethereum/Executive.h>
+#include <libethereum/State.h>
+#include <libevm/VMProfiler.h>
+#include <libevmcore/Instruction.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+void Op(bytes& code, Instruction inst)
+{
+    code.push_back((byte)inst);
+}
+
+void Push(bytes& code, u256 value)
+{
+    bytes data = toCompactBigEndian(value, 1);
+    code.push_back((byte)Instruction::PUSH1 + data.size() - 1);
+    code.insert(code.end(), data.begin(), data.end());
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(vmprofiler_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(vmprofiler_counts)
+{
+    Ethash::init();
+    std::unique_ptr<SealEngineFace> sealEngine(ChainParams(genesisInfo(Network::HomesteadTest)).createSealEngine());
+    State state(0, OverlayDB(), BaseState::Empty);
+    Address sender(0x1001);
+    state.addBalance(sender, 1000);
+
+    // inner stores 2 at slot 0, outer stores 1 at slot 0 and calls inner
+    bytes innerCode;
+    Push(innerCode, 2);
+    Push(innerCode, 0);
+    Op(innerCode, Instruction::SSTORE);
+    Address inner = state.newContract(0, innerCode);
+    bytes outerCode;
+    Push(outerCode, 1);
+    Push(outerCode, 0);
+    Op(outerCode, Instruction::SSTORE);
+    for (int i = 0; i < 5; i++)
+        Push(outerCode, 0);
+    Push(outerCode, u256(u160(inner)));
+    Push(outerCode, 100000);
+    Op(outerCode, Instruction::CALL);
+    Address outer = state.newContract(0, outerCode);
+
+    VMProfiler::reset();
+    EnvInfo env;
+    Executive e(state, env, sealEngine.get());
+    if (!e.call(outer, sender, 0, 1, bytesConstRef(), 1000000))
+        e.go();
+    BOOST_CHECK(!e.excepted());
+
+    VMProfile profile = VMProfiler::stats();
+    BOOST_CHECK(profile.since > 0);
+    if (!VMProfiler::enabled()) {
+        BOOST_CHECK_EQUAL(profile.opcodes[(byte)Instruction::SSTORE].count, 0);
+        BOOST_CHECK(profile.contracts.empty());
+        return;
+    }
+
+    BOOST_CHECK_EQUAL(profile.opcodes[(byte)Instruction::SSTORE].count, 2);
+    BOOST_CHECK_EQUAL(profile.opcodes[(byte)Instruction::SSTORE].trieMisses, 2);
+    BOOST_CHECK_EQUAL(profile.opcodes[(byte)Instruction::CALL].count, 1);
+    BOOST_CHECK_EQUAL(profile.opcodes[(byte)Instruction::PUSH1].count, 9);
+    BOOST_CHECK(profile.opcodes[(byte)Instruction::SSTORE].ticks > 0);
+
+    // Each code is charged its own gas, the gas of the call it makes is left to the callee
+    BOOST_CHECK_EQUAL(profile.contracts.size(), 2);
+    ContractProfile innerProfile = profile.contracts[sha3(innerCode)];
+    ContractProfile outerProfile = profile.contracts[sha3(outerCode)];
+    BOOST_CHECK_EQUAL(innerProfile.calls, 1);
+    BOOST_CHECK_EQUAL(outerProfile.calls, 1);
+    BOOST_CHECK_EQUAL(innerProfile.gas, 3 + 3 + 20000);
+    BOOST_CHECK(outerProfile.gas > 20000 && outerProfile.gas < 2 * 20000);
+
+    // Reading the statistics leaves them, resetting drops them
+    BOOST_CHECK_EQUAL(VMProfiler::stats().opcodes[(byte)Instruction::CALL].count, 1);
+    VMProfiler::reset();
+    BOOST_CHECK_EQUAL(VMProfiler::stats().opcodes[(byte)Instruction::CALL].count, 0);
+    BOOST_CHECK(VMProfiler::stats().contracts.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
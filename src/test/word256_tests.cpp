@@ -0,0 +1,157 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <vector>
+
+#include <libdevcore/Word256.h>
+#include "test/test_quantum.h"
+
+using namespace dev;
+
+namespace
+{
+
+// The interpreter's former u256 implementations of each opcode, used as the reference.
+template <class S> S divWorkaround(S const& _a, S const& _b) { return (S)(s512(_a) / s512(_b)); }
+template <class S> S modWorkaround(S const& _a, S const& _b) { return (S)(s512(_a) % s512(_b)); }
+
+u256 refSignExtend(u256 const& _k, u256 _x)
+{
+    if (_k < 31)
+    {
+        auto testBit = static_cast<unsigned>(_k) * 8 + 7;
+        u256 mask = ((u256(1) << testBit) - 1);
+        if (boost::multiprecision::bit_test(_x, testBit))
+            _x |= ~mask;
+        else
+            _x &= mask;
+    }
+    return _x;
+}
+
+/// Limb-boundary values plus deterministic random words of varying width.
+std::vector<u256> TestValues()
+{
+    std::vector<u256> ret;
+    u256 const max = ~u256(0);
+    for (unsigned shift: {0, 1, 7, 8, 31, 32, 63, 64, 65, 127, 128, 129, 191, 192, 193, 254, 255})
+    {
+        u256 p = u256(1) << shift;
+        ret.push_back(p);
+        ret.push_back(p - 1);
+        ret.push_back(p + 1);
+        ret.push_back(max - p + 1);
+        ret.push_back(max - p);
+    }
+    ret.push_back(0);
+    ret.push_back(max);
+    ret.push_back(u256(0xff));
+    ret.push_back(u256(31));
+    ret.push_back(u256(32));
+
+    std::mt19937_64 rng(42);
+    for (unsigned i = 0; i < 64; ++i)
+    {
+        u256 v = 0;
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            uint64_t limb = rng();
+            switch (rng() % 4)
+            {
+                case 0: limb = 0; break;
+                case 1: limb = ~uint64_t(0); break;
+                default: break;
+            }
+            v = (v << 64) | limb;
+        }
+        ret.push_back(v);
+    }
+    return ret;
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(word256_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(word256_conversions)
+{
+    for (u256 const& a: TestValues())
+    {
+        Word256 w(a);
+        BOOST_CHECK(w.toU256() == a);
+        BOOST_CHECK(w.toHash() == h256(a));
+        BOOST_CHECK(Word256(h256(a)) == w);
+        BOOST_CHECK((uint64_t)w == (uint64_t)(a & u256(~uint64_t(0))));
+        BOOST_CHECK(bool(w) == (a != 0));
+        BOOST_CHECK(w.byteLength() == 32 - h256(a).firstBitSet() / 8);
+        BOOST_CHECK(w.fitsUint64() == (a <= u256(~uint64_t(0))));
+    }
+    constexpr Word256 c(1, 2, 3, 4);
+    static_assert(c.limb(0) == 4 && c.limb(3) == 1, "limbs are stored least significant first");
+}
+
+BOOST_AUTO_TEST_CASE(word256_unary)
+{
+    for (u256 const& a: TestValues())
+    {
+        Word256 w(a);
+        BOOST_CHECK((~w).toU256() == ~a);
+        BOOST_CHECK((-w).toU256() == u256(0) - a);
+        BOOST_CHECK(w.isNegative() == boost::multiprecision::bit_test(a, 255));
+        for (unsigned n: {0, 1, 8, 63, 64, 65, 100, 128, 200, 255, 256, 300})
+        {
+            BOOST_CHECK((w << n).toU256() == (n < 256 ? u256(a << n) : u256(0)));
+            BOOST_CHECK((w >> n).toU256() == (n < 256 ? u256(a >> n) : u256(0)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(word256_binary)
+{
+    std::vector<u256> values = TestValues();
+    for (u256 const& a: values)
+        for (u256 const& b: values)
+        {
+            Word256 wa(a), wb(b);
+            BOOST_CHECK((wa + wb).toU256() == u256(a + b));
+            BOOST_CHECK((wa - wb).toU256() == u256(a - b));
+            BOOST_CHECK((wa * wb).toU256() == u256(a * b));
+            BOOST_CHECK((wa & wb).toU256() == u256(a & b));
+            BOOST_CHECK((wa | wb).toU256() == u256(a | b));
+            BOOST_CHECK((wa ^ wb).toU256() == u256(a ^ b));
+            BOOST_CHECK((wa < wb) == (a < b));
+            BOOST_CHECK((wa > wb) == (a > b));
+            BOOST_CHECK((wa == wb) == (a == b));
+            BOOST_CHECK(Word256::slt(wa, wb) == (u2s(a) < u2s(b)));
+
+            BOOST_CHECK((wa / wb).toU256() == (b ? divWorkaround(a, b) : u256(0)));
+            BOOST_CHECK((wa % wb).toU256() == (b ? modWorkaround(a, b) : u256(0)));
+            BOOST_CHECK(Word256::sdiv(wa, wb).toU256() == (b ? s2u(divWorkaround(u2s(a), u2s(b))) : u256(0)));
+            BOOST_CHECK(Word256::smod(wa, wb).toU256() == (b ? s2u(modWorkaround(u2s(a), u2s(b))) : u256(0)));
+
+            BOOST_CHECK(Word256::exp(wa, wb).toU256() == u256(boost::multiprecision::powm(bigint(a), bigint(b), bigint(1) << 256)));
+            BOOST_CHECK(Word256::signextend(wa, wb).toU256() == refSignExtend(a, b));
+            BOOST_CHECK(Word256::byteAt(wa, wb).toU256() == (a < 32 ? u256((b >> (unsigned)(8 * (31 - a))) & 0xff) : u256(0)));
+        }
+}
+
+BOOST_AUTO_TEST_CASE(word256_modular)
+{
+    std::vector<u256> values = TestValues();
+    std::vector<u256> moduli = {0, 1, 2, 3, 0xff, u256(1) << 64, (u256(1) << 64) - 1, (u256(1) << 128) + 1, (u256(1) << 255) + 7, ~u256(0)};
+    for (unsigned i = 0; i < values.size(); i += 7)
+        moduli.push_back(values[i]);
+    for (u256 const& a: values)
+        for (u256 const& b: values)
+            for (u256 const& m: moduli)
+            {
+                Word256 wa(a), wb(b), wm(m);
+                BOOST_CHECK(Word256::addmod(wa, wb, wm).toU256() == (m ? u256((u512(a) + u512(b)) % m) : u256(0)));
+                BOOST_CHECK(Word256::mulmod(wa, wb, wm).toU256() == (m ? u256((u512(a) * u512(b)) % m) : u256(0)));
+            }
+}
+
+BOOST_AUTO_TEST_SUITE_END()